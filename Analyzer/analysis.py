@@ -131,6 +131,8 @@ def _get_global_max_timestamp(valid_data):
 def build_flame_graph(events: list[Event], stack_frame_map: dict[int, StackFrame], total=1000):
     """
     根据内存事件构建火焰图数据结构。
+    采样模式（--sample-bytes）下只有被采样的分配带有调用栈，
+    每个采样按其代表的估计分配次数（sample_weight / size）计数。
     Args:
         events (list[Event]): 包含 'callstack_path' 信息的事件对象列表。
         stack_frame_map (dict[int, StackFrame]): 栈帧ID到StackFrame对象的映射
@@ -161,9 +163,14 @@ def build_flame_graph(events: list[Event], stack_frame_map: dict[int, StackFrame
         if not stack:
             continue
 
+        # 采样事件按其代表的估计次数放大
+        weight = 1.0
+        if event.sample_weight and event.size > 0:
+            weight = event.sample_weight / event.size
+
         reversed_stack = list(reversed(stack)) # 火焰图通常从根开始显示最底层调用
         current_node = root
-        current_node["count"] += 1
+        current_node["count"] += weight
 
         for func_name in reversed_stack:
             if func_name not in current_node["_name_map"]:
@@ -179,7 +186,7 @@ def build_flame_graph(events: list[Event], stack_frame_map: dict[int, StackFrame
                 current_node["children"].append(next_node)
                 current_node["_name_map"][func_name] = next_node
             current_node = current_node["_name_map"][func_name]
-            current_node["count"] += 1
+            current_node["count"] += weight
 
     def calculate_value(node, parent_value):
         """递归计算火焰图中每个节点的值（比例）。"""
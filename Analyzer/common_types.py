@@ -44,6 +44,8 @@ class Event:
     """对于 free 事件，记录其对应分配事件的时间戳"""
     free_at: int | None = None
     """对于 alloc 事件，记录其对应释放事件的时间戳"""
+    sample_weight: int | None = None
+    """采样模式（--sample-bytes）下被采样的 alloc 事件代表的估计字节数"""
     
     # --- 分析阶段添加的字段 (可选) ---
     fragmentation_ratio: float | None = None
@@ -71,6 +73,8 @@ class Event:
             result["alloc_at"] = self.alloc_at
         if self.free_at is not None:
             result["free_at"] = self.free_at
+        if self.sample_weight is not None:
+            result["sample_weight"] = self.sample_weight
         if self.fragmentation_ratio is not None:
             result["fragmentation_ratio"] = self.fragmentation_ratio
         if self.free_ratio is not None:
@@ -93,6 +97,7 @@ class Event:
             callstack_path=data.get("callstack_path", []),
             alloc_at=data.get("alloc_at"),
             free_at=data.get("free_at"),
+            sample_weight=data.get("sample_weight"),
             fragmentation_ratio=data.get("fragmentation_ratio"),
             free_ratio=data.get("free_ratio"),
             impact_score=data.get("impact_score")
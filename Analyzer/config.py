@@ -49,6 +49,7 @@ class Config(Tap):
     # --- Advanced Settings ---
     log_interval: int = 2000  # 日志间隔
     skip_cpp: bool = False  # 是否跳过C++处理
+    no_native: bool = False  # 是否禁用 libmprofile_reader，使用纯 Python 解码事件与维护内存碎片
 
 
 # 全局配置实例
@@ -0,0 +1,93 @@
+"""
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+"""
+
+# fragment_diff.py
+# 用相同的随机更新序列驱动 native_reader.FragmentManager 与 MemoryFragmentManager, 逐步比较结果
+import pickle
+import random
+import sys
+from tap import Tap
+
+import native_reader
+from parser_core import MemoryFragmentManager
+
+class Config(Tap):
+    """片段管理器差分测试配置"""
+    seeds: int = 30        # 随机种子数
+    first_seed: int = 0    # 起始种子
+    steps: int = 3000      # 每个种子的更新次数
+    check_every: int = 97  # 每隔多少次更新比较一次
+    span: int = 1 << 16    # 地址空间大小
+    max_size: int = 2048   # 单次更新的最大长度
+
+def compare(seed: int, step: int, what: str, expected: object, actual: object) -> bool:
+    """比较一项结果, 不一致时输出位置"""
+    if expected == actual:
+        return True
+    print(f"MISMATCH seed={seed} step={step} {what}")
+    print(f"  python: {expected}")
+    print(f"  native: {actual}")
+    return False
+
+def run_seed(config: Config, seed: int) -> bool:
+    """对单个种子做差分比较"""
+    rnd = random.Random(seed)
+    base = 0x10000
+    end = base + config.span
+    expected, actual = MemoryFragmentManager(), native_reader.FragmentManager()
+    expected.update(base, config.span, "free")
+    actual.update(base, config.span, "free")
+
+    for step in range(config.steps):
+        addr = base + rnd.randrange(0, config.span, 16)
+        size = rnd.randrange(1, config.max_size)
+        status = rnd.choice(["alloc", "alloc", "free", "free", "remove"])
+        expected.update(addr, size, status)
+        actual.update(addr, size, status)
+        if step % config.check_every != 0 and step != config.steps - 1:
+            continue
+        # 检查区间任取一段, 覆盖部分重叠的片段
+        low = base + rnd.randrange(0, config.span)
+        high = low + rnd.randrange(1, config.span)
+        if not (compare(seed, step, "to_dict", expected.to_dict(), actual.to_dict())
+                and compare(seed, step, "get_fragmentation_ratios",
+                            expected.get_fragmentation_ratios(step, base),
+                            actual.get_fragmentation_ratios(step, base))
+                and compare(seed, step, "generate_fragment_data",
+                            expected.generate_fragment_data(low, high),
+                            actual.generate_fragment_data(low, high))
+                and compare(seed, step, "stats",
+                            (expected.largest_free, expected.free_blocks_count, expected.total_used, expected.total_free),
+                            (actual.largest_free, actual.free_blocks_count, actual.total_used, actual.total_free))):
+            return False
+
+    # 序列化与其他构造方式
+    state = expected.to_dict()
+    if not (compare(seed, config.steps, "pickle", state, pickle.loads(pickle.dumps(actual)).to_dict())
+            and compare(seed, config.steps, "from_dict", state,
+                        native_reader.FragmentManager.from_dict(state).to_dict())):
+        return False
+    allocs = [(base + rnd.randrange(0, config.span), rnd.randrange(1, config.max_size // 4)) for _ in range(200)]
+    return compare(seed, config.steps, "from_intervals",
+                   MemoryFragmentManager.from_intervals(base, end, allocs).to_dict(),
+                   native_reader.FragmentManager.from_intervals(base, end, allocs).to_dict())
+
+def main() -> int:
+    config = Config(underscores_to_dashes=True).parse_args()
+    if not native_reader.available():
+        print("libmprofile_reader not found, set MPROFILE_READER_LIB or build the Tracer")
+        return 2
+    seeds = range(config.first_seed, config.first_seed + config.seeds)
+    failed = [seed for seed in seeds if not run_seed(config, seed)]
+    if failed:
+        print(f"{len(failed)}/{len(seeds)} seeds failed: {failed}")
+        return 1
+    print(f"{len(seeds)} seeds x {config.steps} updates: native and python fragment maps match")
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
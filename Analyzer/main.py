@@ -116,6 +116,7 @@ class MainProcessor:
         # 内部状态
         self.stat_info = {}
         self.binary_data = None
+        self.profile_index: Parser.ProfileIndex | None = None
         self.final_snapshot = None
         self.peaks = []
         
@@ -166,6 +167,15 @@ class MainProcessor:
         if self.settings.compact_json:
             Output.set_pretty_print(False)  # 禁用美观输出
             
+    def _load_profile_index(self) -> Parser.ProfileIndex | None:
+        """读取 memory.profile 的块索引（旧格式没有索引）"""
+        if self.profile_index is None:
+            profile_path = os.path.join(self.input_dir, "memory.profile")
+            self.profile_index = Parser.ProfileIndex.load(profile_path)
+            if self.profile_index is not None:
+                logger.info(f"memory.profile 带有块索引，共 {len(self.profile_index.chunks)} 个数据块。")
+        return self.profile_index
+
     def _load_binary_data(self):
         """按需加载和解压二进制文件，确保只执行一次"""
         if self.binary_data is None:
@@ -215,7 +225,7 @@ class MainProcessor:
                             continue
                         # 特殊处理 memory_manager 的恢复
                         if key == "memory_manager" and isinstance(value, dict):
-                            parser_context.memory_manager = Parser.MemoryFragmentManager.from_dict(value)
+                            parser_context.memory_manager = Parser.fragment_manager_type().from_dict(value)
                         # 特殊处理 stack_frame_map 和 reverse_stack_frame_map 的恢复
                         elif key == "stack_frame_map" and isinstance(value, dict):
                             # 恢复 stack_frame_map: dict[int, StackFrame]
@@ -329,24 +339,73 @@ class MainProcessor:
             logger.error("最终快照不存在，无法检测峰值。")
             return False
 
+    def _load_binary_range(self, start_idx: int, ts_target: int) -> tuple[bytes, int]:
+        """
+        获取从 start_idx 解析到 ts_target 所需的数据，返回 (数据, 数据在完整文件中的偏移)。
+        数据已完整加载或没有块索引时返回全部数据。
+        """
+        index = self._load_profile_index() if self.binary_data is None else None
+        if index is None or not index.chunks:
+            self._load_binary_data()
+            return self.binary_data, 0
+        first = index.chunk_for_offset(start_idx)
+        last = index.chunk_for_timestamp(ts_target)
+        chunk = index.chunks[first]
+        logger.info(f"解压数据块 {first}-{last}（共 {len(index.chunks)} 个）...")
+        return index.read_chunks(first, max(first, last)), chunk.data_offset
+
     def get_snapshot_for(self, ts_target: int, initial_ctx: Parser.ParserContext | None = None, 
                         initial_start_idx: int = 0, initial_output: dict | None = None) -> Snapshot | None:
         """
         中心化的快照获取方法，封装了缓存逻辑。
         这是对原 get_snapshot_for 函数的类内版本。
         """
-        ts_str = str(ts_target)
-        cache_file = os.path.join(self.output_dir, f"cache_{ts_str}.pkl")
-
-        # 1. 检查此时间戳的快照是否已经存在精确缓存
-        if not self.settings.no_cache and os.path.exists(cache_file):
-            logger.info(f"发现已缓存的精确快照: {cache_file}")
-            try:
-                with open(cache_file, "rb") as f:
-                    snapshot_data = pickle.load(f)
-                return Snapshot.from_dict(snapshot_data)
-            except Exception as e:
-                logger.warning(f"加载缓存 {cache_file} 失败: {e}。将重新生成。")
+        return self.get_snapshots_for([ts_target], initial_ctx, initial_start_idx, initial_output).get(ts_target)
+
+    def get_snapshots_for(self, timestamps: list[int], initial_ctx: Parser.ParserContext | None = None,
+                          initial_start_idx: int = 0, initial_output: dict | None = None) -> dict[int, Snapshot]:
+        """
+        获取多个时间戳的快照：有精确缓存的直接加载，其余的按最近的检查点分组，
+        每组从组内最早的时间戳之前的缓存或检查点开始，在一次解析中全部生成。
+        返回 {时间戳: 快照}，失败的时间戳不包含在内。
+        """
+        snapshots: dict[int, Snapshot] = {}
+        pending: list[int] = []
+        for ts in sorted(set(timestamps)):
+            cache_file = os.path.join(self.output_dir, f"cache_{ts}.pkl")
+            # 1. 检查此时间戳的快照是否已经存在精确缓存
+            if not self.settings.no_cache and os.path.exists(cache_file):
+                logger.info(f"发现已缓存的精确快照: {cache_file}")
+                try:
+                    with open(cache_file, "rb") as f:
+                        snapshot_data = pickle.load(f)
+                    snapshots[ts] = Snapshot.from_dict(snapshot_data)
+                    continue
+                except Exception as e:
+                    logger.warning(f"加载缓存 {cache_file} 失败: {e}。将重新生成。")
+            pending.append(ts)
+
+        # 同一个检查点之后的时间戳一起解析；从检查点开始的快照只累积检查点之后的事件，
+        # 比从头开始的一次解析复制与缓存的数据少
+        index = self._load_profile_index() if initial_ctx is None else None
+        groups: list[list[int]] = []
+        group_checkpoint: int | None = None
+        for ts in pending:
+            checkpoint_idx = index.checkpoint_for_timestamp(ts) if index is not None and index.chunks else None
+            if groups and checkpoint_idx == group_checkpoint:
+                groups[-1].append(ts)
+            else:
+                groups.append([ts])
+                group_checkpoint = checkpoint_idx
+        for group in groups:
+            snapshots.update(self._generate_snapshots(group, initial_ctx, initial_start_idx, initial_output))
+        return snapshots
+
+    def _generate_snapshots(self, pending: list[int], initial_ctx: Parser.ParserContext | None,
+                            initial_start_idx: int, initial_output: dict | None) -> dict[int, Snapshot]:
+        """在一次解析中生成 pending（已排序）中各时间戳的快照并缓存。"""
+        snapshots: dict[int, Snapshot] = {}
+        ts_target, ts_last = pending[0], pending[-1]
 
         # 2. 如果不存在，则从最近的缓存开始解析（如果允许缓存）
         loaded_snapshot: Snapshot | None = None
@@ -369,7 +428,7 @@ class MainProcessor:
                         continue
                     # 特殊处理 memory_manager 的恢复
                     if key == "memory_manager" and isinstance(value, dict):
-                        current_ctx.memory_manager = Parser.MemoryFragmentManager.from_dict(value)
+                        current_ctx.memory_manager = Parser.fragment_manager_type().from_dict(value)
                     # 特殊处理 stack_frame_map 和 reverse_stack_frame_map 的恢复
                     elif key == "stack_frame_map" and isinstance(value, dict):
                         # 恢复 stack_frame_map: dict[int, StackFrame]
@@ -403,26 +462,44 @@ class MainProcessor:
             # 注意：这里我们只关心最终生成的快照，但解析器需要一个起点来累积数据
             # 确保只包含解析器会修改的键
             current_output = {"events": loaded_snapshot.events, "fragmentation_data": loaded_snapshot.fragmentation_data, "brk_events": loaded_snapshot.brk_events}
-        else:
-            logger.warning(f"未找到 {ts_target} 之前的有效缓存或禁用缓存，将从头开始解析...")
-
-        # 执行解析并获取快照
-        # 这个生成器循环只会执行一次，因为我们只请求了一个时间戳
-        snapshot_generated = False
 
-        parser_gen = Parser.extract_events(self.binary_data, snapshots=[ts_target],
-                                    ctx=current_ctx, start_idx=current_start_idx, output=current_output)
+        # 3. 最近的检查点比缓存更接近目标时，从检查点开始解析
+        index = self._load_profile_index() if initial_ctx is None else None
+        checkpoint_idx = index.checkpoint_for_timestamp(ts_target) if index is not None and index.chunks else None
+        if checkpoint_idx is not None and current_start_idx < index.chunks[checkpoint_idx].data_offset:
+            logger.info(f"从数据块 {checkpoint_idx} 的检查点开始，为 {ts_target} 进行解析...")
+            current_ctx = Parser.ParserContext()
+            current_ctx.restore_checkpoint = True
+            # 从检查点生成的快照只包含检查点之后的事件
+            current_output = {"events": [], "fragmentation_data": [], "brk_events": []}
+            binary_data, base_offset = index.read_from_checkpoint(checkpoint_idx, index.chunk_for_timestamp(ts_last))
+            current_start_idx = base_offset
+        else:
+            if not loaded_snapshot:
+                logger.warning(f"未找到 {ts_target} 之前的有效缓存或禁用缓存，将从头开始解析...")
+            binary_data, base_offset = self._load_binary_range(current_start_idx, ts_last)
+
+        # 执行解析，在一次解析中依次获取所有待生成的快照
+        if len(pending) > 1:
+            logger.info(f"在一次解析中生成 {len(pending)} 个时间戳的快照...")
+        parser_gen = Parser.extract_events(binary_data, snapshots=pending,
+                                    ctx=current_ctx, start_idx=current_start_idx, output=current_output,
+                                    base_offset=base_offset)
         
+        remaining = set(pending)
         for snapshot in parser_gen:
-            if snapshot.get("timestamp") == ts_target:
+            ts = snapshot.get("timestamp")
+            if ts in remaining:
                 # 缓存这个新生成的精确快照
-                SnapshotMngr.save_snapshot_cache(snapshot, ts_target, self.output_dir)
-                snapshot_generated = True
-                return Snapshot.from_dict(snapshot) # 我们只需要这一个快照
-
-        if not snapshot_generated:
-            logger.warning(f"未能为时间戳 {ts_target} 生成快照。可能该时间戳超出了数据范围或解析失败。")
-        return None
+                SnapshotMngr.save_snapshot_cache(snapshot, ts, self.output_dir)
+                snapshots[ts] = Snapshot.from_dict(snapshot)
+                remaining.discard(ts)
+                if not remaining:
+                    break # 所需的快照已全部生成
+
+        for ts in sorted(remaining):
+            logger.warning(f"未能为时间戳 {ts} 生成快照。可能该时间戳超出了数据范围或解析失败。")
+        return snapshots
         
     def _process_peak_details(self):
         """阶段2：为每个峰值生成详细报告"""
@@ -430,7 +507,9 @@ class MainProcessor:
             return
             
         logger.info("--- 阶段 2: 为峰值生成详细报告 ---")
-        self._load_binary_data() # 确保数据已加载
+        # 带有块索引时按需解压所需的数据块，否则一次性加载整个文件
+        if self._load_profile_index() is None:
+            self._load_binary_data() # 确保数据已加载
         
         all_events_with_frag = analysis.merge_fragmentation_into_events(
             self.final_snapshot.events, self.final_snapshot.fragmentation_data
@@ -439,17 +518,12 @@ class MainProcessor:
         # 从最终快照中获取所有的 brk 事件，只需执行一次
         all_brk_events = [e for e in all_events_with_frag if e.operation == 'brk']
         
-        # 按时间顺序处理，以便后续的峰值可以利用前面峰值生成的缓存
-        for i, t_peak in enumerate(sorted(self.peaks)):
-            logger.info(f">>>>> 正在处理峰值: {t_peak} ({i+1}/{len(self.peaks)}) <<<<<")
-            snapshot = self.get_snapshot_for(t_peak)
-            if not snapshot:
-                logger.warning(f"未能为时间戳 {t_peak} 获取快照，跳过。")
-                continue
-                
-            # 过滤内存布局
-            mem_data_to_write = snapshot.memory_fragments
+        # 第一遍：确定每个峰值的事件窗口、焦点区域与所需快照的时间戳（只依赖事件，不需要快照）
+        # 每项为 (峰值时间戳, 窗口内的事件, 焦点区域, 峰值后快照时间戳, 峰值前快照时间戳)
+        peak_plans: list[tuple[int, list, list[tuple[int, int]] | None, int | None, int | None]] = []
+        for t_peak in sorted(self.peaks):
             focus_regions: list[tuple[int, int]] | None = None # 初始化为 None
+            after_peak_ts: int | None = None
             
             # 从 all_events_with_frag 中筛选出在峰值窗口内的事件
             window_start_time = t_peak - self.settings.peak_window
@@ -470,18 +544,8 @@ class MainProcessor:
                 
                 # 如果有events_after_peak，需要获取峰值后最后一个事件的时间点作为快照时间
                 if events_after_peak:
-                    last_event_time = events_after_peak[-1].time
-                    logger.info(f"获取峰值后最后一个事件时间点: {last_event_time}，作为快照时间点")
-                    
-                    # 获取峰值后最后一个事件时间点的快照
-                    after_peak_snapshot = self.get_snapshot_for(last_event_time)
-                    
-                    if after_peak_snapshot is not None:
-                        # 使用这个新的快照数据
-                        snapshot = after_peak_snapshot
-                        mem_data_to_write = snapshot.memory_fragments
-                    else:
-                        logger.warning(f"未能为时间戳[{last_event_time}]获取精确快照，使用峰值时间点的快照")
+                    after_peak_ts = events_after_peak[-1].time
+                    logger.info(f"获取峰值后最后一个事件时间点: {after_peak_ts}，作为快照时间点")
                         
             if self.settings.enable_peak_focus:
                 logger.info(f"过滤内存布局：关注最近 {self.settings.peak_focus_events} 个事件，上下文扩展 {self.settings.peak_focus_context} 字节。")
@@ -492,13 +556,6 @@ class MainProcessor:
                     context_size=self.settings.peak_focus_context
                 )
                 
-                # 步骤 2: 使用计算出的区域过滤 'after' 内存布局
-                if focus_regions:
-                    mem_data_to_write = analysis.filter_memory_by_regions(
-                        snapshot.memory_fragments,
-                        focus_regions
-                    )
-                
                 # 根据内存区域过滤事件
                 if focus_regions:
                     logger.info(f"根据内存区域过滤事件...")
@@ -513,6 +570,40 @@ class MainProcessor:
                     
                     # 更新要导出的事件列表
                     evs_in_window = filtered_events
+
+            # 如果启用了峰值前内存布局生成，则需要第一个操作之前时间点的快照
+            before_peak_ts = evs_in_window[0].time - 1 if self.settings.generate_peak_before_layout and evs_in_window else None
+            peak_plans.append((t_peak, evs_in_window, focus_regions, after_peak_ts, before_peak_ts))
+
+        # 所有峰值所需的快照按时间顺序在一次解析中生成，而不是每个快照各解析一次
+        snapshot_timestamps = {ts for t_peak, _, _, after_ts, before_ts in peak_plans
+                               for ts in (t_peak, after_ts, before_ts) if ts is not None}
+        snapshots = self.get_snapshots_for(sorted(snapshot_timestamps))
+
+        for i, (t_peak, evs_in_window, focus_regions, after_peak_ts, before_peak_ts) in enumerate(peak_plans):
+            logger.info(f">>>>> 正在处理峰值: {t_peak} ({i+1}/{len(self.peaks)}) <<<<<")
+            snapshot = snapshots.get(t_peak)
+            if not snapshot:
+                logger.warning(f"未能为时间戳 {t_peak} 获取快照，跳过。")
+                continue
+                
+            # 过滤内存布局
+            mem_data_to_write = snapshot.memory_fragments
+            if after_peak_ts is not None:
+                after_peak_snapshot = snapshots.get(after_peak_ts)
+                if after_peak_snapshot is not None:
+                    # 使用这个新的快照数据
+                    snapshot = after_peak_snapshot
+                    mem_data_to_write = snapshot.memory_fragments
+                else:
+                    logger.warning(f"未能为时间戳[{after_peak_ts}]获取精确快照，使用峰值时间点的快照")
+
+            # 步骤 2: 使用计算出的区域过滤 'after' 内存布局
+            if focus_regions:
+                mem_data_to_write = analysis.filter_memory_by_regions(
+                    snapshot.memory_fragments,
+                    focus_regions
+                )
                 
             # 立即导出文件
             logger.info(f"为峰值[{t_peak}]导出详细文件...")
@@ -530,12 +621,9 @@ class MainProcessor:
             logger.info(f"已导出事件记录: {ev_file}")
             
             # 如果启用了峰值前内存布局生成，则生成第一个操作之前的内存布局
-            if self.settings.generate_peak_before_layout and evs_in_window:
-                # 获取第一个操作的时间
-                first_event_time = evs_in_window[0].time
-                
+            if before_peak_ts is not None:
                 # 获取第一个操作之前时间点的快照
-                before_snapshot = self.get_snapshot_for(first_event_time - 1)
+                before_snapshot = snapshots.get(before_peak_ts)
                 
                 if before_snapshot is not None:
                     before_mem_data_to_write = before_snapshot.memory_fragments
@@ -552,12 +640,12 @@ class MainProcessor:
                     Output.write_memory_fragments(
                         before_mem_data_to_write, 
                         before_mem_file, 
-                        first_event_time - 1,
+                        before_peak_ts,
                         focus_regions=focus_regions
                     )
                     logger.info(f"已导出 before 内存布局: {before_mem_file}")
                 else:
-                    logger.warning(f"未能为峰值[{t_peak}]生成第一个操作之前的内存布局，无法获取时间点 {first_event_time - 1} 的快照")
+                    logger.warning(f"未能为峰值[{t_peak}]生成第一个操作之前的内存布局，无法获取时间点 {before_peak_ts} 的快照")
             
             logger.info("----------------------------")
         
@@ -592,6 +680,24 @@ class MainProcessor:
             Output.write_fragmentation(self.final_snapshot.fragmentation_data, os.path.join(self.output_dir, "fragmentation.json"))
             logger.info("碎片率数据已生成: fragmentation.json")
 
+        # glibc arena 采样（追踪时使用了 --arena-interval）
+        arena_samples = getattr(self.final_snapshot.ctx, "arena_samples", None)
+        if arena_samples:
+            Output.write_arena_fragmentation(arena_samples, os.path.join(self.output_dir, "arena_fragmentation.json"))
+            logger.info(f"arena 碎片数据已生成: arena_fragmentation.json（{len(arena_samples)} 次采样）")
+
+        # 追踪器按溢出策略丢弃的追踪信息（追踪时使用了 --overflow drop）
+        lost_events = getattr(self.final_snapshot.ctx, "lost_events", None)
+        if lost_events:
+            Output.write_lost_events(lost_events, os.path.join(self.output_dir, "lost_events.json"))
+            lost_count = sum(item["count"] for item in lost_events)
+            lost_bytes = sum(item["alloc_bytes"] for item in lost_events)
+            logger.warning(f"追踪器丢弃了 {lost_count} 个追踪信息（{len(lost_events)} 段、"
+                           f"{lost_bytes} 字节的分配请求），分析结果不包含这些操作，详见 lost_events.json")
+        recorded = self.stat_info.get("overflow_lost_count")
+        if recorded and recorded.isdigit() and int(recorded) != sum(item["count"] for item in lost_events or []):
+            logger.warning(f"statinfo.txt 记录丢弃了 {recorded} 个追踪信息，与 memory.profile 中的记录不一致")
+
         # BRK 事件
         if self.settings.brk_events:
             logger.info("正在生成 BRK 事件数据...")
@@ -0,0 +1,435 @@
+"""
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+"""
+
+# native_reader.py
+# libmprofile_reader（Tracer 构建的 libmprofile_reader.so）的 ctypes 绑定。
+# 事件按批解码为列（tag/tid/time/args/stack_id...），每列是指向库内存的 memoryview，
+# 不复制数据，可直接交给 numpy.frombuffer；库不可用时 available() 返回 False，
+# parser_core 回退到纯 Python 的解码。
+# FragmentManager 是 MemoryFragmentManager 的原生实现（fragment_map.h）
+import ctypes
+import ctypes.util
+import os
+import logging
+from typing import Any, Iterator
+
+logger = logging.getLogger(__name__)
+
+# 查找顺序：环境变量、Tracer 的构建目录、系统库路径
+LIBRARY_ENV = "MPROFILE_READER_LIB"
+_ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+LIBRARY_PATHS = [
+    os.path.join(_ROOT, "Tracer", "build", "src", "libmprofile_reader.so"),
+    os.path.join(_ROOT, "Tracer", "build", "libmprofile_reader.so"),
+]
+# 每批解码的事件个数
+BATCH_SIZE = 65536
+
+# (列名, ctypes 类型, memoryview 格式)，与 profile_reader.h 中的 mpr_batch 一致
+COLUMNS = [
+    ("tag", ctypes.c_uint8, "B"),
+    ("is_call", ctypes.c_uint8, "B"),
+    ("tid", ctypes.c_uint32, "I"),
+    ("time", ctypes.c_int64, "q"),
+    ("arg1", ctypes.c_uint64, "Q"),
+    ("arg2", ctypes.c_uint64, "Q"),
+    ("ret", ctypes.c_uint64, "Q"),
+    ("stack_id", ctypes.c_uint32, "I"),
+    ("weight", ctypes.c_uint64, "Q"),
+    ("offset", ctypes.c_uint64, "Q"),
+    ("end", ctypes.c_uint64, "Q"),
+]
+
+
+class _Batch(ctypes.Structure):
+    _fields_ = [("count", ctypes.c_size_t)] + [(name, ctypes.POINTER(ctype)) for name, ctype, _ in COLUMNS]
+
+
+class _FragmentStats(ctypes.Structure):
+    _fields_ = [("total_used", ctypes.c_int64), ("total_free", ctypes.c_int64), ("largest_free", ctypes.c_uint64),
+                ("free_count", ctypes.c_int64), ("used_count", ctypes.c_int64)]
+
+
+class _FragmentList(ctypes.Structure):
+    _fields_ = [("count", ctypes.c_size_t), ("start", ctypes.POINTER(ctypes.c_uint64)),
+                ("end", ctypes.POINTER(ctypes.c_uint64)), ("status", ctypes.POINTER(ctypes.c_uint8))]
+
+
+class _FunctionInfo(ctypes.Structure):
+    """TraceWriter::FunctionInfo"""
+    _fields_ = [("file_index", ctypes.c_uint32), ("func_index", ctypes.c_uint32),
+                ("line_no", ctypes.c_int32), ("col_no", ctypes.c_int32)]
+
+
+_lib: ctypes.CDLL | None = None
+_load_failed = False
+
+
+def _load() -> ctypes.CDLL | None:
+    """加载并声明库函数，只尝试一次。"""
+    global _lib, _load_failed
+    if _lib is not None or _load_failed:
+        return _lib
+    candidates = [os.environ[LIBRARY_ENV]] if os.environ.get(LIBRARY_ENV) else []
+    candidates += [path for path in LIBRARY_PATHS if os.path.exists(path)]
+    system_path = ctypes.util.find_library("mprofile_reader")
+    if system_path:
+        candidates.append(system_path)
+    for path in candidates:
+        try:
+            lib = ctypes.CDLL(path)
+        except OSError as e:
+            logger.debug(f"无法加载 {path}: {e}")
+            continue
+        lib.mpr_decoder_new.restype = ctypes.c_void_p
+        lib.mpr_decoder_free.argtypes = [ctypes.c_void_p]
+        lib.mpr_decode.restype = ctypes.c_size_t
+        lib.mpr_decode.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t,
+                                   ctypes.c_uint16, ctypes.c_size_t, ctypes.POINTER(_Batch)]
+        lib.mpr_open.restype = ctypes.c_void_p
+        lib.mpr_open.argtypes = [ctypes.c_char_p]
+        lib.mpr_close.argtypes = [ctypes.c_void_p]
+        lib.mpr_next.restype = ctypes.c_size_t
+        lib.mpr_next.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(_Batch)]
+        lib.mpr_version.restype = ctypes.c_uint16
+        lib.mpr_version.argtypes = [ctypes.c_void_p]
+        lib.mpr_error.restype = ctypes.c_char_p
+        lib.mpr_error.argtypes = [ctypes.c_void_p]
+        lib.mpr_name_count.restype = ctypes.c_size_t
+        lib.mpr_name_count.argtypes = [ctypes.c_void_p, ctypes.c_int]
+        lib.mpr_name.restype = ctypes.c_char_p
+        lib.mpr_name.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_size_t]
+        lib.mpr_stack.restype = ctypes.c_size_t
+        lib.mpr_stack.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.POINTER(ctypes.c_void_p)]
+        lib.mpr_fragments_new.restype = ctypes.c_void_p
+        lib.mpr_fragments_free.argtypes = [ctypes.c_void_p]
+        lib.mpr_fragments_update.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_uint64, ctypes.c_int,
+                                             ctypes.POINTER(_FragmentStats)]
+        lib.mpr_fragments_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(_FragmentStats)]
+        lib.mpr_fragments_assign.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint64),
+                                             ctypes.POINTER(ctypes.c_uint64), ctypes.POINTER(ctypes.c_uint8),
+                                             ctypes.c_size_t]
+        lib.mpr_fragments_build.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_uint64,
+                                            ctypes.POINTER(ctypes.c_uint64), ctypes.POINTER(ctypes.c_uint64),
+                                            ctypes.c_size_t]
+        lib.mpr_fragments_collect.restype = ctypes.c_size_t
+        lib.mpr_fragments_collect.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_uint64,
+                                              ctypes.POINTER(_FragmentList)]
+        logger.info(f"已加载 libmprofile_reader: {path}")
+        _lib = lib
+        return _lib
+    _load_failed = True
+    return None
+
+
+def available() -> bool:
+    """libmprofile_reader 是否可用。"""
+    return _load() is not None
+
+
+def _columns(batch: _Batch) -> dict[str, memoryview]:
+    """将批次中的各列包装为 memoryview（零拷贝，在下一次解码之前有效）。"""
+    columns = {}
+    for name, ctype, fmt in COLUMNS:
+        pointer = getattr(batch, name)
+        if batch.count == 0 or not pointer:
+            columns[name] = memoryview(b"").cast(fmt)
+            continue
+        array = (ctype * batch.count).from_address(ctypes.addressof(pointer.contents))
+        # ctypes 数组的格式带字节序前缀（如 "<Q"），转换为原生格式以支持 tolist()
+        columns[name] = memoryview(array).cast("B").cast(fmt)
+    return columns
+
+
+def _buffer_address(binary) -> tuple[int, object]:
+    """返回数据的地址以及需要保持存活的对象，bytes 与可写缓冲区均不复制。"""
+    if isinstance(binary, bytes):
+        pointer = ctypes.c_char_p(binary)
+        return ctypes.cast(pointer, ctypes.c_void_p).value or 0, pointer
+    try:
+        buffer = (ctypes.c_char * len(binary)).from_buffer(binary)
+    except TypeError:
+        # 只读的 memoryview 等，复制一次
+        buffer = ctypes.create_string_buffer(bytes(binary), len(binary))
+    return ctypes.addressof(buffer), buffer
+
+
+class RecordDecoder:
+    """
+    在已解压的数据中按批解码事件记录（格式版本 1、2），供 parser_core 逐个取用。
+    批次在名称、调用栈、检查点等其它条目处结束，这些条目仍由 Python 处理；
+    格式版本 2 的 time 为时间差，由调用方按线程累加。
+    """
+
+    def __init__(self, binary, batch_size: int = BATCH_SIZE):
+        self._lib = _load()
+        if self._lib is None:
+            raise RuntimeError("libmprofile_reader 不可用")
+        self._size = len(binary)
+        self._address, self._keep = _buffer_address(binary)
+        self._handle = self._lib.mpr_decoder_new()
+        self._batch = _Batch()
+        self._batch_size = batch_size
+        self._records: list[tuple] = []
+        self._offsets: list[int] = []
+        self._pos = 0
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            self._lib.mpr_decoder_free(self._handle)
+            self._handle = None
+
+    def decode(self, offset: int, version: int, max_count: int | None = None) -> dict[str, memoryview]:
+        """从 offset 开始解码一批事件，返回各列（零拷贝）。"""
+        self._lib.mpr_decode(self._handle, self._address, self._size, offset, version,
+                             max_count or self._batch_size, ctypes.byref(self._batch))
+        return _columns(self._batch)
+
+    def record_at(self, offset: int, version: int) -> tuple | None:
+        """
+        返回从 offset 开始的事件
+        (标记, tid, 时间, 参数1, 参数2, 返回值, 调用栈编号, 是否为合并的调用, 结束位置)，
+        offset 处不是完整的事件记录时返回 None。
+        """
+        pos = self._pos
+        if pos < len(self._offsets) and self._offsets[pos] == offset:
+            self._pos = pos + 1
+            return self._records[pos]
+        # 生成快照后会重新处理同一个事件
+        if 0 < pos <= len(self._offsets) and self._offsets[pos - 1] == offset:
+            return self._records[pos - 1]
+        columns = self.decode(offset, version)
+        # 按批转换为 Python 对象，避免逐个元素访问 memoryview
+        self._offsets = columns["offset"].tolist()
+        self._records = list(zip(
+            columns["tag"].tolist(), columns["tid"].tolist(), columns["time"].tolist(),
+            columns["arg1"].tolist(), columns["arg2"].tolist(), columns["ret"].tolist(),
+            columns["stack_id"].tolist(), (bool(x) for x in columns["is_call"].tolist()),
+            columns["end"].tolist(),
+        ))
+        if not self._offsets or self._offsets[0] != offset:
+            self._pos = 0
+            self._offsets = []
+            self._records = []
+            return None
+        self._pos = 1
+        return self._records[0]
+
+
+class ProfileReader:
+    """
+    流式读取整个 memory.profile：库内部边解压边解码，按批返回事件的各列（零拷贝），
+    时间戳为绝对值，调用栈通过 stack() 按编号查询。
+    """
+
+    def __init__(self, path: str):
+        self._lib = _load()
+        if self._lib is None:
+            raise RuntimeError("libmprofile_reader 不可用")
+        self._handle = self._lib.mpr_open(path.encode())
+        if not self._handle:
+            raise OSError(f"无法打开 {path}")
+        self._batch = _Batch()
+
+    def close(self):
+        if self._handle:
+            self._lib.mpr_close(self._handle)
+            self._handle = None
+
+    def __enter__(self) -> 'ProfileReader':
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def batches(self, batch_size: int = BATCH_SIZE) -> Iterator[dict[str, memoryview]]:
+        """依次返回每批事件的各列，上一批的列在取下一批时失效。"""
+        while self._lib.mpr_next(self._handle, batch_size, ctypes.byref(self._batch)) > 0:
+            yield _columns(self._batch)
+        if self.error:
+            logger.warning(f"读取 memory.profile 时出错: {self.error}")
+
+    @property
+    def version(self) -> int:
+        return self._lib.mpr_version(self._handle)
+
+    @property
+    def error(self) -> str:
+        return (self._lib.mpr_error(self._handle) or b"").decode()
+
+    def names(self, kind: int) -> list[str]:
+        """已读取的文件名（kind=0）或函数名（kind=1）。"""
+        count = self._lib.mpr_name_count(self._handle, kind)
+        return [self._lib.mpr_name(self._handle, kind, i).decode("utf-8", errors="replace") for i in range(count)]
+
+    def stack(self, stack_id: int) -> list[tuple[int, int, int, int]]:
+        """调用栈的各帧 (文件名索引, 函数名索引, 行号, 列号)。"""
+        frames = ctypes.c_void_p()
+        depth = self._lib.mpr_stack(self._handle, stack_id, ctypes.byref(frames))
+        if depth == 0:
+            return []
+        array = (_FunctionInfo * depth).from_address(frames.value)
+        return [(f.file_index, f.func_index, f.line_no, f.col_no) for f in array]
+
+
+# 片段状态，与 fragment_map.h 中的 FragmentMap::Status 一致
+FRAGMENT_STATUS = {"free": 0, "alloc": 1, "remove": 2}
+FRAGMENT_STATUS_NAMES = ("free", "alloc")
+ADDRESS_LIMIT = (1 << 64) - 1
+
+
+class FragmentManager:
+    """
+    parser_core.MemoryFragmentManager 的原生实现（libmprofile_reader 的 FragmentMap），
+    接口与输出相同。片段保存在库中的有序表里，每次更新为 O(log n)，
+    最大空闲片段由有序的空闲大小集合维护，不需要重新扫描。
+    """
+
+    def __init__(self):
+        self._lib = _load()
+        if self._lib is None:
+            raise RuntimeError("libmprofile_reader 不可用")
+        self._handle = self._lib.mpr_fragments_new()
+        self._stats = _FragmentStats()
+        self._stats_ref = ctypes.byref(self._stats)
+        self._list = _FragmentList()
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            self._lib.mpr_fragments_free(self._handle)
+            self._handle = None
+
+    # 序列化时保存片段列表（缓存与 pickle）
+    def __getstate__(self) -> dict[str, Any]:
+        return self.to_dict()
+
+    def __setstate__(self, state: dict[str, Any]):
+        self.__init__()
+        self._assign(state.get("fragments", []))
+
+    @property
+    def total_used(self) -> int:
+        return self._stats.total_used
+
+    @property
+    def total_free(self) -> int:
+        return self._stats.total_free
+
+    @property
+    def largest_free(self) -> int:
+        return self._stats.largest_free
+
+    @property
+    def free_blocks_count(self) -> int:
+        return self._stats.free_count
+
+    @property
+    def used_blocks_count(self) -> int:
+        return self._stats.used_count
+
+    @property
+    def fragments(self) -> list[tuple[int, int, str]]:
+        """按起始地址排序的 (start_addr, end_addr, status)。"""
+        return [(start, end, FRAGMENT_STATUS_NAMES[status])
+                for start, end, status in self._collect(0, ADDRESS_LIMIT)]
+
+    def _collect(self, begin: int, end: int) -> Iterator[tuple[int, int, int]]:
+        count = self._lib.mpr_fragments_collect(self._handle, begin, end, ctypes.byref(self._list))
+        if count == 0:
+            return iter(())
+        starts = (ctypes.c_uint64 * count).from_address(ctypes.addressof(self._list.start.contents))
+        ends = (ctypes.c_uint64 * count).from_address(ctypes.addressof(self._list.end.contents))
+        statuses = (ctypes.c_uint8 * count).from_address(ctypes.addressof(self._list.status.contents))
+        return zip(starts[:], ends[:], statuses[:])
+
+    def _assign(self, fragments: list):
+        count = len(fragments)
+        starts = (ctypes.c_uint64 * count)(*(f[0] for f in fragments))
+        ends = (ctypes.c_uint64 * count)(*(f[1] for f in fragments))
+        statuses = (ctypes.c_uint8 * count)(*(FRAGMENT_STATUS[f[2]] for f in fragments))
+        self._lib.mpr_fragments_assign(self._handle, starts, ends, statuses, count)
+        self._lib.mpr_fragments_stats(self._handle, self._stats_ref)
+
+    def to_dict(self) -> dict[str, Any]:
+        """将管理器状态序列化为字典，与 MemoryFragmentManager.to_dict 相同。"""
+        return {
+            "fragments": self.fragments,
+            "total_used": self.total_used,
+            "total_free": self.total_free,
+            "largest_free": self.largest_free,
+            "free_blocks_count": self.free_blocks_count,
+            "used_blocks_count": self.used_blocks_count,
+        }
+
+    @classmethod
+    def from_dict(cls, data: dict[str, Any]) -> 'FragmentManager':
+        """从字典反序列化，统计数据由片段重新计算。"""
+        manager = cls()
+        manager._assign(data.get("fragments", []))
+        return manager
+
+    @classmethod
+    def from_intervals(cls, base: int, top: int, allocs: list[tuple[int, int]]) -> 'FragmentManager':
+        """由 brk 范围 [base, top) 与其中的存活分配 (地址, 大小) 构建管理器（用于检查点）。"""
+        manager = cls()
+        count = len(allocs)
+        addrs = (ctypes.c_uint64 * count)(*(addr for addr, _ in allocs))
+        sizes = (ctypes.c_uint64 * count)(*(size for _, size in allocs))
+        manager._lib.mpr_fragments_build(manager._handle, base, top, addrs, sizes, count)
+        manager._lib.mpr_fragments_stats(manager._handle, manager._stats_ref)
+        return manager
+
+    def update(self, addr: int, size: int, status: str):
+        """更新内存映射表，处理内存碎片合并并维护实时统计信息。"""
+        if size <= 0:
+            return
+        self._lib.mpr_fragments_update(self._handle, addr, size, FRAGMENT_STATUS[status], self._stats_ref)
+
+    def get_fragmentation_ratios(self, timestamp: int, brk_base: int | None = None):
+        """计算当前内存状态的碎片率和空闲率，仅针对 brk 管理范围内的内存。"""
+        stats = self._stats
+        total_used, total_free = stats.total_used, stats.total_free
+        brk_total_memory = total_used + total_free
+        if brk_base is None or brk_total_memory == 0:
+            return {
+                "timestamp": timestamp,
+                "fragmentation_ratio": 0.0,
+                "free_ratio": 0.0,
+            }
+        free_ratio = round(total_free / brk_total_memory, 4) if brk_total_memory > 0 else 0.0
+        frag_ratio = round(1.0 - (stats.largest_free / total_free), 4) if total_free > 0 else 0.0
+        return {
+            "timestamp": timestamp,
+            "fragmentation_ratio": frag_ratio,
+            "free_ratio": free_ratio,
+        }
+
+    def generate_fragment_data(self, brk_base: int | None = None, current_brk: int | None = None):
+        """生成紧凑格式的内存布局（用于可视化）及统计摘要，与 MemoryFragmentManager 相同。"""
+        if brk_base is None or current_brk is None:
+            return {"memory_fragments": [], "summary": {}}
+        compact_layout = []
+        brk_used_count = brk_free_count = 0
+        if current_brk > brk_base:
+            for _, end, status in self._collect(brk_base, current_brk):
+                if status == 1:
+                    brk_used_count += 1
+                else:
+                    brk_free_count += 1
+                compact_layout.append([end - brk_base, status])
+        summary = {
+            "total_memory": self.total_used + self.total_free,
+            "free_memory": self.total_free,
+            "used_memory": self.total_used,
+            "largest_free_fragment_size": self.largest_free,
+            "free_fragments_count": brk_free_count,
+            "used_fragments_count": brk_used_count,
+        }
+        return {"memory_fragments": compact_layout, "summary": summary}
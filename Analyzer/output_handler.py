@@ -78,6 +78,20 @@ def write_fragmentation(fragmentation_data: list[dict[str, Any]], output_path: s
             indent = 2 if PRETTY_PRINT else None
             json.dump(unique_data, f, indent=indent)
 
+def write_arena_fragmentation(arena_samples: list[dict[str, Any]], output_path: str):
+    """将 glibc arena 采样（--arena-interval）写入JSON文件。"""
+    if output_path:
+        with open(output_path, "w") as f:
+            indent = 2 if PRETTY_PRINT else None
+            json.dump(arena_samples, f, indent=indent)
+
+def write_lost_events(lost_events: list[dict[str, Any]], output_path: str):
+    """将追踪器丢弃的追踪信息（--overflow drop）写入JSON文件。"""
+    if output_path:
+        with open(output_path, "w") as f:
+            indent = 2 if PRETTY_PRINT else None
+            json.dump(lost_events, f, indent=indent)
+
 def write_brk_events(brk_events: list[Event], output_path: str):
     """将 brk 事件列表写入JSON文件。"""
     if output_path:
@@ -6,20 +6,61 @@ LICENSE file in the root directory of this source tree.
 """
 
 # parser_core.py
+import os
 import struct
 import zstandard as zstd
 import bisect
-from typing import Any, Callable
+from concurrent.futures import ThreadPoolExecutor
+from typing import Any, Callable, NamedTuple
 
 from common_types import Event, CallStack, StackFrame
 
 import config
 import logging
+import native_reader
 logger = logging.getLogger(__name__)
 
 # 用于解析内存分析数据的常量
 TRACE_HEADER_FORMAT = "<B I Q Q q H"
 FRAME_FORMAT = "<I I i i"
+# 格式版本 1：文件开头为版本条目，事件中以调用栈编号代替完整调用栈
+# 格式版本 2：事件为变长编码，时间戳为同一线程在当前数据块中的时间差，
+# 有返回值的调用与返回合并为一个调用条目（标记 | CALL_ENTRY_FLAG）
+FORMAT_ENTRY = 0xFF
+SUPPORTED_FORMAT_VERSIONS = (1, 2)
+CALL_ENTRY_FLAG = 0x80
+STACK_ENTRY = 0xFE
+# 采样权重条目（--sample-bytes），作用于紧随其后的事件
+SAMPLE_WEIGHT_ENTRY = 0xFC
+SAMPLE_WEIGHT_FORMAT = "<Q"
+TRACE_HEADER_FORMAT_V1 = "<B I Q Q q I"
+STACK_ENTRY_FORMAT = "<I H"
+# 检查点条目：位于数据块开头，记录存活分配、brk 范围与等待返回的调用
+CHECKPOINT_ENTRY = 0xFB
+CHECKPOINT_HEADER_FORMAT = "<q Q Q Q I I"
+CHECKPOINT_ALLOC_FORMAT = "<Q Q q I"
+CHECKPOINT_PENDING_FORMAT = "<B I Q Q q I Q"
+# glibc arena 采样条目（--arena-interval）：头部之后为每个 arena 的空闲内存统计
+ARENA_ENTRY = 0xFA
+ARENA_HEADER_FORMAT = "<q H"
+ARENA_FORMAT = "<Q Q Q Q Q Q Q Q Q I B"
+ARENA_FIELDS = (
+    "address", "system_mem", "top_size", "largest_free", "tcache_bytes",
+    "fastbin_bytes", "unsorted_bytes", "smallbin_bytes", "largebin_bytes",
+    "free_chunks", "flags",
+)
+ARENA_FLAG_MAIN = 0x01
+ARENA_FLAG_TRUNCATED = 0x02
+# 丢弃的追踪信息条目（--overflow drop）：同一线程连续丢弃的一段，头部之后为各标记被丢弃的个数
+LOST_ENTRY = 0xF9
+LOST_HEADER_FORMAT = "<I q q Q H"
+LOST_TAG_FORMAT = "<B I"
+# 块索引：文件末尾的 skippable 帧，由 ChunkInfo 数组和尾部组成
+INDEX_MAGIC = 0x5849504D  # "MPIX"
+INDEX_VERSION = 2
+# 版本 1 没有 checkpoint_size
+CHUNK_INFO_FORMATS = {1: "<Q I Q I q q I I I I", 2: "<Q I Q I q q I I I I I"}
+INDEX_TRAILER_FORMAT = "<Q I I H I"
 OPERATION_TYPE_LIST = [
     ("UNKNOWN", 2, 1),
     ("BRK", 1, 1),
@@ -27,7 +68,7 @@ OPERATION_TYPE_LIST = [
     ("MMAP", 2, 1),
     ("MUNMAP", 2, 1),
     ("CLONE", 1, 1),
-    ("CLONE3", 2, 1),
+    ("CLONE3", 1, 1),
     ("FORK", 0, 1),
     ("VFORK", 0, 1),
     ("EXECVE", 1, 1),
@@ -44,16 +85,212 @@ OPERATION_TYPE_LIST = [
     ("DELETE", 2, 0),
     ("DELETE[]", 1, 0),
 ]
-ALLOC_TYPES = {"MALLOC", "CALLOC", "VALLOC", "REALLOC", "NEW", "NEW[]"}
+ALLOC_TYPES = {"MALLOC", "CALLOC", "VALLOC", "REALLOC", "ALIGNED_ALLOC", "NEW", "NEW[]"}
 FREE_TYPES = {"FREE", "DELETE_LEGACY", "DELETE", "DELETE[]"}
 CPP_OP_TYPES = {"NEW", "NEW[]", "DELETE_LEGACY", "DELETE", "DELETE[]"}
 
+class ChunkInfo(NamedTuple):
+    """块索引中的一项，对应一个独立压缩的 zstd 帧。"""
+    offset: int        # 压缩帧在文件中的偏移
+    size: int          # 压缩帧大小
+    data_offset: int   # 解压后数据中的偏移
+    data_size: int     # 解压后大小
+    first_time: int    # 第一个事件的时间戳
+    last_time: int     # 最后一个事件的时间戳
+    event_count: int   # 事件个数
+    file_names: int    # 块开始时已定义的文件名个数
+    func_names: int    # 块开始时已定义的函数名个数
+    stacks: int        # 块开始时已定义的调用栈个数
+    checkpoint_size: int = 0  # 块开头的检查点条目大小，0 表示没有检查点
+
+
+class ProfileIndex:
+    """memory.profile 的块索引，用于按时间戳定位数据块并并行解压。"""
+
+    def __init__(self, path: str, chunks: list[ChunkInfo], tables_offset: int, tables_size: int):
+        self.path = path
+        self.chunks = chunks
+        self.tables_offset = tables_offset
+        self.tables_size = tables_size
+        # 时间戳的前缀最大值，保证二分查找的单调性
+        self._max_times: list[int] = []
+        for chunk in chunks:
+            self._max_times.append(max(chunk.last_time, self._max_times[-1] if self._max_times else chunk.last_time))
+        self._data_offsets = [chunk.data_offset for chunk in chunks]
+        self._tables: tuple[list[bytes], list[bytes], list[bytes]] | None = None
+
+    @classmethod
+    def load(cls, path: str) -> 'ProfileIndex | None':
+        """读取文件末尾的块索引，旧格式（没有索引）的文件返回 None。"""
+        trailer_size = struct.calcsize(INDEX_TRAILER_FORMAT)
+        with open(path, "rb") as f:
+            file_size = f.seek(0, os.SEEK_END)
+            if file_size < trailer_size:
+                return None
+            f.seek(file_size - trailer_size)
+            tables_offset, tables_size, count, version, magic = struct.unpack(INDEX_TRAILER_FORMAT, f.read(trailer_size))
+            if magic != INDEX_MAGIC or version not in CHUNK_INFO_FORMATS:
+                return None
+            chunk_format = CHUNK_INFO_FORMATS[version]
+            chunk_size = struct.calcsize(chunk_format)
+            index_size = count * chunk_size
+            if index_size + trailer_size > file_size:
+                return None
+            f.seek(file_size - trailer_size - index_size)
+            chunks = [ChunkInfo(*item) for item in struct.iter_unpack(chunk_format, f.read(index_size))]
+        return cls(path, chunks, tables_offset, tables_size)
+
+    def chunk_for_offset(self, data_offset: int) -> int:
+        """返回包含解压后偏移 data_offset 的数据块。"""
+        return max(bisect.bisect_right(self._data_offsets, data_offset) - 1, 0)
+
+    def chunk_for_timestamp(self, ts: int) -> int:
+        """返回包含第一个时间戳大于 ts 的事件的数据块（快照在该事件处生成）。"""
+        return min(bisect.bisect_right(self._max_times, ts), len(self.chunks) - 1)
+
+    def checkpoint_for_timestamp(self, ts: int) -> int | None:
+        """返回可以生成 ts 处快照的最近的检查点所在的数据块，没有时返回 None。"""
+        for idx in range(self.chunk_for_timestamp(ts), -1, -1):
+            if self.chunks[idx].checkpoint_size > 0:
+                return idx
+        return None
+
+    def read_chunks(self, first: int, last: int, workers: int | None = None) -> bytes:
+        """并行解压 [first, last] 范围内的数据块，返回拼接后的数据。"""
+        chunks = self.chunks[first:last + 1]
+        with open(self.path, "rb") as f:
+            frames = []
+            for chunk in chunks:
+                f.seek(chunk.offset)
+                frames.append(f.read(chunk.size))
+
+        def decompress(item: tuple[ChunkInfo, bytes]) -> bytes:
+            # ZstdDecompressor 不是线程安全的，每个块单独创建
+            chunk, frame = item
+            return zstd.ZstdDecompressor().decompress(frame, max_output_size=chunk.data_size)
+
+        with ThreadPoolExecutor(max_workers=workers or os.cpu_count()) as pool:
+            return b"".join(pool.map(decompress, zip(chunks, frames)))
+
+    def _load_tables(self) -> tuple[list[bytes], list[bytes], list[bytes]]:
+        """读取名称表与调用栈表，返回 (文件名条目, 函数名条目, 调用栈条目)。"""
+        if self._tables is not None:
+            return self._tables
+        with open(self.path, "rb") as f:
+            f.seek(self.tables_offset)
+            # 表为单个带有原始大小的 zstd 帧
+            data = zstd.ZstdDecompressor().decompress(f.read(self.tables_size))
+        file_entries, func_entries, stack_entries = [], [], []
+        stack_header_size = 1 + struct.calcsize(STACK_ENTRY_FORMAT)
+        frame_size = struct.calcsize(FRAME_FORMAT)
+        idx = 0
+        while idx < len(data):
+            if data[idx] in (0x00, 0x01):
+                end = idx + 3 + struct.unpack_from("<H", data, idx + 1)[0]
+                (file_entries if data[idx] == 0x00 else func_entries).append(data[idx:end])
+            else:
+                _, depth = struct.unpack_from(STACK_ENTRY_FORMAT, data, idx + 1)
+                end = idx + stack_header_size + depth * frame_size
+                stack_entries.append(data[idx:end])
+            idx = end
+        self._tables = (file_entries, func_entries, stack_entries)
+        return self._tables
+
+    def _preamble(self, idx: int) -> bytes:
+        """格式版本条目 + 数据块 idx 之前定义的名称与调用栈。"""
+        if idx == 0:
+            return b""
+        chunk = self.chunks[idx]
+        file_entries, func_entries, stack_entries = self._load_tables()
+        return b"".join([
+            # 格式版本条目，格式版本 2 的数据块中事件之前有各自的版本条目
+            struct.pack("<BH", FORMAT_ENTRY, 1),
+            *file_entries[:chunk.file_names],
+            *func_entries[:chunk.func_names],
+            *stack_entries[:chunk.stacks],
+        ])
+
+    def read_chunk_standalone(self, idx: int) -> bytes:
+        """
+        返回可以单独解析的数据块：格式版本条目 + 该块之前定义的名称与调用栈 + 块数据。
+        不同的块可以由多个进程并行解析。
+        """
+        return self._preamble(idx) + self.read_chunks(idx, idx, workers=1)
+
+    def read_from_checkpoint(self, first: int, last: int) -> tuple[bytes, int]:
+        """
+        返回从数据块 first（开头为检查点）到 last 的可单独解析的数据，以及数据在完整文件中的偏移。
+        前置的名称与调用栈条目位于偏移之前，之后的 next_idx 与完整数据一致。
+        """
+        preamble = self._preamble(first)
+        data = preamble + self.read_chunks(first, max(first, last))
+        return data, self.chunks[first].data_offset - len(preamble)
+
+
 def decompress_zst(path):
-    """解压一个 zstd 格式的压缩文件。"""
+    """解压一个 zstd 格式的压缩文件，带有块索引时并行解压各个数据块。"""
+    index = ProfileIndex.load(path)
+    if index is not None and index.chunks:
+        return index.read_chunks(0, len(index.chunks) - 1)
     dctx = zstd.ZstdDecompressor()
     with open(path, "rb") as f:
-        reader = dctx.stream_reader(f) # 返回的是一个流式读取器
-        return reader.read() # 但这里立刻调用了 .read()，将所有数据一次性读入内存
+        # 文件可能由多个帧组成
+        reader = dctx.stream_reader(f, read_across_frames=True)
+        return reader.read()
+
+
+def _compact_layout(tag: int) -> tuple[int, bool, int, bool]:
+    """格式版本 2 中标记为 tag 的事件的 (变长整数个数, 是否为合并的调用, 参数个数, 是否为调用)。"""
+    is_call = bool(tag & CALL_ENTRY_FLAG)
+    tag &= ~CALL_ENTRY_FLAG
+    op_code = tag >> 1
+    argc = OPERATION_TYPE_LIST[op_code][1] if op_code < len(OPERATION_TYPE_LIST) else 2
+    is_invoke = is_call or not tag & 1
+    # tid、时间差、调用耗时、参数、返回值、调用栈编号
+    count = 2 + is_call + (argc + 1 if is_invoke else 0) + (1 if is_call or tag & 1 else 0)
+    return count, is_call, argc, is_invoke
+
+
+# 按标记预先计算事件的布局，解码时不再逐个字段判断
+COMPACT_LAYOUTS = [_compact_layout(tag) for tag in range(256)]
+
+
+def _decode_compact(data: bytes, idx: int):
+    """
+    解码一个格式版本 2 的事件，返回
+    (标记, tid, 时间差, 参数1, 参数2, 返回值, 调用栈编号, 是否为合并的调用, 下一个位置)。
+    合并的调用返回的标记不含 CALL_ENTRY_FLAG，数据不足时抛出 IndexError。
+    """
+    tag = data[idx]
+    count, is_call, argc, is_invoke = COMPACT_LAYOUTS[tag]
+    idx += 1
+    # 依次读取 count 个 LEB128 变长整数
+    values = []
+    value = shift = 0
+    while count:
+        byte = data[idx]
+        idx += 1
+        if byte < 0x80:
+            values.append(value | byte << shift)
+            value = shift = 0
+            count -= 1
+        else:
+            value |= (byte & 0x7F) << shift
+            shift += 7
+    tid, delta = values[0], values[1]
+    delta = (delta >> 1) ^ -(delta & 1)
+    pos = 3 if is_call else 2  # 调用耗时只用于记录，解析时不需要
+    arg1 = arg2 = ret = stack_id = 0
+    if is_invoke:
+        if argc > 0:
+            arg1 = values[pos]
+        if argc > 1:
+            arg2 = values[pos + 1]
+        pos += argc
+        stack_id = values[-1]
+    if not is_invoke or is_call:
+        ret = values[pos]
+    return tag & ~CALL_ENTRY_FLAG, tid, delta, arg1, arg2, ret, stack_id, is_call, idx
 
 
 def get_op_info(code):
@@ -68,7 +305,8 @@ def create_event(
     callstack_path: list[int] | None,
     brk_base: int | None = None,
     alloc_at: int | None = None,
-    free_at: int | None = None
+    free_at: int | None = None,
+    sample_weight: int | None = None
     ) -> Event:
     """创建一个Event对象，使用相对地址。"""
     range_str = f"{hex(addr)}-{hex(addr + size)}" # 默认使用绝对地址
@@ -85,7 +323,8 @@ def create_event(
         size=size,
         callstack_path=callstack_path if callstack_path is not None else [],
         alloc_at=alloc_at,
-        free_at=free_at
+        free_at=free_at,
+        sample_weight=sample_weight
     )
 
 
@@ -126,6 +365,26 @@ class MemoryFragmentManager:
         manager.used_blocks_count = data.get("used_blocks_count", 0)
         return manager
 
+    @classmethod
+    def from_intervals(cls, base: int, top: int, allocs: list[tuple[int, int]]) -> 'MemoryFragmentManager':
+        """由 brk 范围 [base, top) 与其中的存活分配 (地址, 大小) 构建管理器（用于检查点）。"""
+        manager = cls()
+        pos = base
+        for addr, size in sorted(allocs):
+            start, end = max(addr, pos), addr + size
+            if start >= end:
+                continue
+            if start > pos:
+                manager.fragments.append((pos, start, "free"))
+            manager.fragments.append((start, end, "alloc"))
+            pos = end
+        if pos < top:
+            manager.fragments.append((pos, top, "free"))
+        for start, end, status in manager.fragments:
+            manager._update_stats(end - start, status, add=True)
+        manager._recalculate_largest_free()
+        return manager
+
     def _update_stats(self, size: int, status: str, add: bool):
         """辅助函数，用于增量更新统计数据。"""
         delta = size if add else -size
@@ -333,6 +592,16 @@ class MemoryFragmentManager:
         return {"memory_fragments": compact_layout, "summary": summary}
 
 
+def use_native() -> bool:
+    """是否使用 libmprofile_reader（未通过 --no-native 禁用且库可用）。"""
+    return not getattr(config.settings, "no_native", False) and native_reader.available()
+
+
+def fragment_manager_type() -> type:
+    """内存碎片管理器的实现：libmprofile_reader 可用时使用原生的 FragmentManager。"""
+    return native_reader.FragmentManager if use_native() else MemoryFragmentManager
+
+
 class ParserContext:
     """保存内存分析过程中的解析状态。"""
 
@@ -346,6 +615,19 @@ class ParserContext:
         # 临时存储文件名和函数名的映射，用于构建 StackFrame
         self._temp_filename_map: dict[int, str] = {}
         self._temp_function_map: dict[int, str] = {}
+
+        # 输出格式版本（0 表示旧格式，事件中携带完整调用栈）
+        self.format_version: int = 0
+        # 调用栈编号 -> 已解析的 callstack_path（格式版本 1）
+        self.stack_table: dict[int, list[int]] = {}
+        # 各线程上一个事件的时间戳（格式版本 2，每个数据块开头重置）
+        self.last_times: dict[int, int] = {}
+        # 下一个事件的采样权重（采样模式）
+        self.pending_weight: int | None = None
+        # glibc arena 采样，每次采样为 {"timestamp", "arenas": [...]}
+        self.arena_samples: list[dict[str, Any]] = []
+        # 追踪器丢弃的追踪信息，每段为 {"tid", "start", "end", "count", "alloc_bytes", "ops"}
+        self.lost_events: list[dict[str, Any]] = []
         
         # 其他状态
         self.tid_map: dict[tuple[int, int], tuple[Any, ...]] = {}
@@ -356,7 +638,9 @@ class ParserContext:
         self.current_brk: int | None = None # 当前BRK指针位置
         self.brk_no: int = 0 # BRK事件序号
         self.trace_idx: int = 0 # 已处理的事件总数
-        self.memory_manager: MemoryFragmentManager = MemoryFragmentManager() # 内存碎片管理器实例
+        # 是否从遇到的第一个检查点恢复状态（从检查点开始解析时设置）
+        self.restore_checkpoint: bool = False
+        self.memory_manager: MemoryFragmentManager = fragment_manager_type()() # 内存碎片管理器实例
 
 def _handle_alloc_event(
     ctx: 'ParserContext',
@@ -365,13 +649,14 @@ def _handle_alloc_event(
     addr: int,
     size: int,
     callstack_path: list[int] | None,
-    is_in_brk_heap: Callable[[int], bool]
+    is_in_brk_heap: Callable[[int], bool],
+    sample_weight: int | None = None
 ):
     """处理一个内存分配事件。"""
     if size <= 0:
         return
 
-    alloc_event = create_event("alloc", ts, addr, size, callstack_path, ctx.brk_base)
+    alloc_event = create_event("alloc", ts, addr, size, callstack_path, ctx.brk_base, sample_weight=sample_weight)
     output["events"].append(alloc_event)
     ctx.alloc_info_map[addr] = {"ts": ts, "event_idx": len(output["events"]) - 1}
     ctx.alloc_map[addr] = size
@@ -402,7 +687,8 @@ def _handle_free_event(
 
     if alloc_info:
         alloc_event_idx = alloc_info["event_idx"]
-        if alloc_event_idx < len(output["events"]):
+        # 从检查点恢复的分配没有对应的事件（event_idx 为 -1）
+        if 0 <= alloc_event_idx < len(output["events"]):
             output["events"][alloc_event_idx].free_at = ts
 
     # 只在地址位于brk堆区时更新
@@ -412,6 +698,78 @@ def _handle_free_event(
     
     ctx.alloc_map.pop(addr, None)
 
+def _make_arena_sample(ts: int, binary: bytes, idx: int, arena_count: int) -> dict[str, Any]:
+    """解析一次 arena 采样，计算各 arena 与全部 arena 的空闲字节数和碎片率。"""
+    arenas = []
+    for values in struct.iter_unpack(ARENA_FORMAT, binary[idx: idx + arena_count * struct.calcsize(ARENA_FORMAT)]):
+        arena = dict(zip(ARENA_FIELDS, values))
+        arena["main"] = bool(arena["flags"] & ARENA_FLAG_MAIN)
+        arena["truncated"] = bool(arena["flags"] & ARENA_FLAG_TRUNCATED)
+        del arena["flags"]
+        free_bytes = (arena["tcache_bytes"] + arena["fastbin_bytes"] + arena["unsorted_bytes"]
+                      + arena["smallbin_bytes"] + arena["largebin_bytes"])
+        arena["free_bytes"] = free_bytes
+        # 与 LiveHeap 相同：1 - 最大空闲块 / 空闲字节数（不含可归还系统的 top chunk）
+        arena["fragmentation"] = 1 - arena["largest_free"] / free_bytes if free_bytes else 0.0
+        arenas.append(arena)
+    system_mem = sum(arena["system_mem"] for arena in arenas)
+    free_bytes = sum(arena["free_bytes"] for arena in arenas)
+    largest_free = max((arena["largest_free"] for arena in arenas), default=0)
+    return {
+        "timestamp": ts,
+        "system_mem": system_mem,
+        "free_bytes": free_bytes,
+        "top_bytes": sum(arena["top_size"] for arena in arenas),
+        "largest_free": largest_free,
+        # 空闲块占从系统获取的内存的比例
+        "free_ratio": free_bytes / system_mem if system_mem else 0.0,
+        "fragmentation": 1 - largest_free / free_bytes if free_bytes else 0.0,
+        "arenas": arenas,
+    }
+
+def _make_lost_events(tid: int, start: int, end: int, alloc_bytes: int, binary: bytes, idx: int,
+                      tag_count: int) -> dict[str, Any]:
+    """解析一段丢弃的追踪信息，按操作统计被丢弃的调用与返回个数。"""
+    ops: dict[str, dict[str, int]] = {}
+    total = 0
+    for tag, count in struct.iter_unpack(LOST_TAG_FORMAT, binary[idx: idx + tag_count * struct.calcsize(LOST_TAG_FORMAT)]):
+        name, _ = get_op_info(tag >> 1)
+        item = ops.setdefault(name, {"invoke": 0, "result": 0})
+        item["result" if tag & 1 else "invoke"] += count
+        total += count
+    return {"tid": tid, "start": start, "end": end, "count": total, "alloc_bytes": alloc_bytes, "ops": ops}
+
+def _restore_checkpoint(ctx: 'ParserContext', binary: bytes, idx: int, alloc_count: int, pending_count: int,
+                        event_count: int, brk_base: int, brk_top: int):
+    """从检查点条目恢复解析状态，idx 为分配列表的起始位置。"""
+    ctx.trace_idx = event_count
+    ctx.brk_base = brk_base or None
+    ctx.current_brk = brk_top or None
+    ctx.alloc_map = {}
+    ctx.alloc_info_map = {}
+    ctx.tid_map = {}
+    brk_allocs = []
+    alloc_size = struct.calcsize(CHECKPOINT_ALLOC_FORMAT)
+    for addr, size, ts, _ in struct.iter_unpack(CHECKPOINT_ALLOC_FORMAT, binary[idx: idx + alloc_count * alloc_size]):
+        if size <= 0:
+            continue
+        ctx.alloc_map[addr] = size
+        ctx.alloc_info_map[addr] = {"ts": ts, "event_idx": -1}
+        if brk_base and brk_top and brk_base <= addr < brk_top:
+            brk_allocs.append((addr, size))
+    idx += alloc_count * alloc_size
+    pending_size = struct.calcsize(CHECKPOINT_PENDING_FORMAT)
+    for tag, tid, arg1, arg2, ts, stack_id, weight in struct.iter_unpack(
+            CHECKPOINT_PENDING_FORMAT, binary[idx: idx + pending_count * pending_size]):
+        callstack_path = list(ctx.stack_table.get(stack_id, [])) if stack_id else []
+        if config.settings.callstack_depth >= 0:
+            callstack_path = callstack_path[:config.settings.callstack_depth]
+        ctx.tid_map[(tid, tag >> 1)] = (arg1, arg2, ts, callstack_path, weight or None)
+    if ctx.brk_base is not None and ctx.current_brk is not None:
+        ctx.memory_manager = fragment_manager_type().from_intervals(ctx.brk_base, ctx.current_brk, brk_allocs)
+    else:
+        ctx.memory_manager = fragment_manager_type()()
+
 def _handle_brk_event(
     ctx: 'ParserContext',
     output: dict[str, list],
@@ -460,9 +818,12 @@ def extract_events(
     output: dict | None = None,
     total_events: int = 0,
     total_duration: int = 0,
+    base_offset: int = 0,
 ):
     """
     解析二进制数据以提取内存事件，支持增量解析和在指定时间戳生成快照。
+    binary 可以只是完整数据的一部分（从 base_offset 开始的若干数据块），
+    start_idx 与快照中的 next_idx 始终是完整数据中的偏移。
     """
     if ctx is None:
         ctx = ParserContext()
@@ -475,8 +836,39 @@ def extract_events(
     next_snapshot_target = snapshots_copy.pop(0) if snapshots_copy else None
 
     HEADER_SIZE = struct.calcsize(TRACE_HEADER_FORMAT)
+    HEADER_SIZE_V1 = struct.calcsize(TRACE_HEADER_FORMAT_V1)
+    STACK_ENTRY_SIZE = struct.calcsize(STACK_ENTRY_FORMAT)
+    SAMPLE_WEIGHT_SIZE = struct.calcsize(SAMPLE_WEIGHT_FORMAT)
     FRAME_SIZE = struct.calcsize(FRAME_FORMAT)
-    bin_idx = start_idx
+    CHECKPOINT_HEADER_SIZE = struct.calcsize(CHECKPOINT_HEADER_FORMAT)
+    CHECKPOINT_ALLOC_SIZE = struct.calcsize(CHECKPOINT_ALLOC_FORMAT)
+    CHECKPOINT_PENDING_SIZE = struct.calcsize(CHECKPOINT_PENDING_FORMAT)
+    ARENA_HEADER_SIZE = struct.calcsize(ARENA_HEADER_FORMAT)
+    ARENA_SIZE = struct.calcsize(ARENA_FORMAT)
+    LOST_HEADER_SIZE = struct.calcsize(LOST_HEADER_FORMAT)
+    LOST_TAG_SIZE = struct.calcsize(LOST_TAG_FORMAT)
+    bin_idx = start_idx - base_offset
+    # 事件记录优先由 libmprofile_reader 按批解码
+    decoder = native_reader.RecordDecoder(binary) if use_native() else None
+
+    def resolve_frame(file_idx: int, func_idx: int, line: int, col: int) -> int:
+        """将一帧解析为全局栈帧 ID。"""
+        # 从临时映射中获取文件名和函数名
+        filename = ctx._temp_filename_map.get(file_idx, f"<unknown_file_{file_idx}>")
+        funcname = ctx._temp_function_map.get(func_idx, f"<unknown_func_{func_idx}>")
+
+        # 创建 StackFrame 对象
+        frame = StackFrame(file=filename, func=funcname, line=line, col=col)
+
+        # 检查 frame 是否已存在于反向映射中
+        if frame in ctx.reverse_stack_frame_map:
+            return ctx.reverse_stack_frame_map[frame]
+        # 分配新的 ID 并添加到映射表
+        frame_id = ctx.next_stack_frame_id
+        ctx.stack_frame_map[frame_id] = frame
+        ctx.reverse_stack_frame_map[frame] = frame_id
+        ctx.next_stack_frame_id += 1
+        return frame_id
 
     while bin_idx < len(binary):
         event_start_idx = bin_idx  # 记录当前事件的起始位置，以便回溯
@@ -501,15 +893,132 @@ def extract_events(
             bin_idx += 3 + name_len
             continue
 
-        if bin_idx + HEADER_SIZE > len(binary):
-            # 数据不足以解析完整头部，结束解析
-            logger.warning(f"数据末尾不足以解析完整的事件头部，在索引 {bin_idx} 处停止。")
-            break
+        if entry_type == FORMAT_ENTRY:  # 处理格式版本条目
+            if bin_idx + 3 > len(binary):
+                logger.warning(f"数据末尾不足以解析格式版本，在索引 {bin_idx} 处停止。")
+                break
+            ctx.format_version = struct.unpack("<H", binary[bin_idx + 1: bin_idx + 3])[0]
+            if ctx.format_version not in SUPPORTED_FORMAT_VERSIONS:
+                logger.error(f"不支持的 memory.profile 格式版本: {ctx.format_version}")
+                break
+            # 格式版本 2 的每个数据块以版本条目开头，时间差重新开始计算
+            ctx.last_times = {}
+            bin_idx += 3
+            continue
 
-        tag, tid, arg1, arg2, ts, depth = struct.unpack(
-            TRACE_HEADER_FORMAT, binary[bin_idx: bin_idx + HEADER_SIZE]
-        )
-        ctx.trace_idx += 1
+        if entry_type == STACK_ENTRY and ctx.format_version >= 1:  # 处理调用栈条目
+            if bin_idx + 1 + STACK_ENTRY_SIZE > len(binary):
+                logger.warning(f"数据末尾不足以解析调用栈条目，在索引 {bin_idx} 处停止。")
+                break
+            stack_id, depth = struct.unpack(
+                STACK_ENTRY_FORMAT, binary[bin_idx + 1: bin_idx + 1 + STACK_ENTRY_SIZE]
+            )
+            frames_start = bin_idx + 1 + STACK_ENTRY_SIZE
+            if frames_start + depth * FRAME_SIZE > len(binary):
+                logger.warning(f"数据末尾不足以解析完整的调用栈 {stack_id}，在索引 {bin_idx} 处停止。")
+                break
+            # 每个调用栈只解析一次，之后的事件直接按编号引用
+            ctx.stack_table[stack_id] = [
+                resolve_frame(*frame)
+                for frame in struct.iter_unpack(
+                    FRAME_FORMAT, binary[frames_start: frames_start + depth * FRAME_SIZE]
+                )
+            ]
+            bin_idx = frames_start + depth * FRAME_SIZE
+            continue
+
+        if entry_type == SAMPLE_WEIGHT_ENTRY and ctx.format_version >= 1:  # 处理采样权重条目
+            if bin_idx + 1 + SAMPLE_WEIGHT_SIZE > len(binary):
+                logger.warning(f"数据末尾不足以解析采样权重，在索引 {bin_idx} 处停止。")
+                break
+            ctx.pending_weight = struct.unpack_from(SAMPLE_WEIGHT_FORMAT, binary, bin_idx + 1)[0]
+            bin_idx += 1 + SAMPLE_WEIGHT_SIZE
+            continue
+
+        if entry_type == ARENA_ENTRY and ctx.format_version >= 1:  # 处理 arena 采样条目
+            if bin_idx + 1 + ARENA_HEADER_SIZE > len(binary):
+                logger.warning(f"数据末尾不足以解析 arena 采样，在索引 {bin_idx} 处停止。")
+                break
+            ts, arena_count = struct.unpack_from(ARENA_HEADER_FORMAT, binary, bin_idx + 1)
+            body_start = bin_idx + 1 + ARENA_HEADER_SIZE
+            body_end = body_start + arena_count * ARENA_SIZE
+            if body_end > len(binary):
+                logger.warning(f"数据末尾不足以解析完整的 arena 采样，在索引 {bin_idx} 处停止。")
+                break
+            ctx.arena_samples.append(_make_arena_sample(ts, binary, body_start, arena_count))
+            bin_idx = body_end
+            continue
+
+        if entry_type == LOST_ENTRY and ctx.format_version >= 1:  # 处理丢弃的追踪信息条目
+            if bin_idx + 1 + LOST_HEADER_SIZE > len(binary):
+                logger.warning(f"数据末尾不足以解析丢弃的追踪信息，在索引 {bin_idx} 处停止。")
+                break
+            tid, start, end, alloc_bytes, tag_count = struct.unpack_from(LOST_HEADER_FORMAT, binary, bin_idx + 1)
+            body_start = bin_idx + 1 + LOST_HEADER_SIZE
+            body_end = body_start + tag_count * LOST_TAG_SIZE
+            if body_end > len(binary):
+                logger.warning(f"数据末尾不足以解析完整的丢弃的追踪信息，在索引 {bin_idx} 处停止。")
+                break
+            ctx.lost_events.append(_make_lost_events(tid, start, end, alloc_bytes, binary, body_start, tag_count))
+            bin_idx = body_end
+            continue
+
+        if entry_type == CHECKPOINT_ENTRY and ctx.format_version >= 1:  # 处理检查点条目
+            if bin_idx + 1 + CHECKPOINT_HEADER_SIZE > len(binary):
+                logger.warning(f"数据末尾不足以解析检查点，在索引 {bin_idx} 处停止。")
+                break
+            _, event_count, brk_base, brk_top, alloc_count, pending_count = struct.unpack_from(
+                CHECKPOINT_HEADER_FORMAT, binary, bin_idx + 1
+            )
+            body_start = bin_idx + 1 + CHECKPOINT_HEADER_SIZE
+            body_end = body_start + alloc_count * CHECKPOINT_ALLOC_SIZE + pending_count * CHECKPOINT_PENDING_SIZE
+            if body_end > len(binary):
+                logger.warning(f"数据末尾不足以解析完整的检查点，在索引 {bin_idx} 处停止。")
+                break
+            # 顺序解析时状态已经是最新的，只在从检查点开始解析时恢复
+            if ctx.restore_checkpoint:
+                _restore_checkpoint(ctx, binary, body_start, alloc_count, pending_count,
+                                    event_count, brk_base, brk_top)
+                ctx.restore_checkpoint = False
+            bin_idx = body_end
+            continue
+
+        is_call = False
+        ret = 0
+        depth = 0
+        # 定长的格式版本 1 由 struct.unpack 解码更快，只有变长的格式版本 2 交给 libmprofile_reader
+        record = decoder.record_at(bin_idx, ctx.format_version) if decoder is not None and ctx.format_version >= 2 else None
+        if record is not None:
+            tag, tid, ts, arg1, arg2, ret, stack_id, is_call, record_end = record
+            if ctx.format_version >= 2:
+                ts += ctx.last_times.get(tid, 0)
+            header_size = record_end - bin_idx
+        elif ctx.format_version >= 2:
+            try:
+                tag, tid, delta, arg1, arg2, ret, stack_id, is_call, record_end = _decode_compact(binary, bin_idx)
+            except IndexError:
+                logger.warning(f"数据末尾不足以解析完整的事件，在索引 {bin_idx} 处停止。")
+                break
+            ts = ctx.last_times.get(tid, 0) + delta
+            header_size = record_end - bin_idx
+        else:
+            header_size = HEADER_SIZE_V1 if ctx.format_version >= 1 else HEADER_SIZE
+            if bin_idx + header_size > len(binary):
+                # 数据不足以解析完整头部，结束解析
+                logger.warning(f"数据末尾不足以解析完整的事件头部，在索引 {bin_idx} 处停止。")
+                break
+
+            if ctx.format_version >= 1:
+                tag, tid, arg1, arg2, ts, stack_id = struct.unpack(
+                    TRACE_HEADER_FORMAT_V1, binary[bin_idx: bin_idx + header_size]
+                )
+            else:
+                tag, tid, arg1, arg2, ts, depth = struct.unpack(
+                    TRACE_HEADER_FORMAT, binary[bin_idx: bin_idx + header_size]
+                )
+                stack_id = 0
+        # 合并的调用对应调用与返回两个追踪信息
+        ctx.trace_idx += 2 if is_call else 1
 
         # 日志输出
         if ctx.trace_idx % config.settings.log_interval == 0:
@@ -547,7 +1056,7 @@ def extract_events(
                 "brk_events": output["brk_events"].copy(),
                 "memory_fragments": mem_fragments_data,
                 "ctx": ctx,  # 传递当前上下文，用于增量解析
-                "next_idx": bin_idx,  # 记录下一次开始解析的索引
+                "next_idx": bin_idx + base_offset,  # 记录下一次开始解析的索引
             }
             # 获取下一个快照时间戳
             next_snapshot_target = snapshots_copy.pop(0) if snapshots_copy else None
@@ -555,10 +1064,18 @@ def extract_events(
             yield snapshot_data
             continue  # 继续循环，从 bin_idx 处重新处理当前事件
 
-        bin_idx += HEADER_SIZE
+        bin_idx += header_size
+        if ctx.format_version >= 2:
+            ctx.last_times[tid] = ts
+        sample_weight, ctx.pending_weight = ctx.pending_weight, None
 
         # 解析调用栈信息，使用 StackFrame 对象
         callstack_path = []
+        if stack_id != 0:
+            if stack_id not in ctx.stack_table:
+                logger.warning(f"事件 {ctx.trace_idx} 引用了未定义的调用栈 {stack_id}。")
+            # 复制一份，避免截断时修改调用栈表
+            callstack_path = list(ctx.stack_table.get(stack_id, []))
         for _ in range(depth):
             if bin_idx + FRAME_SIZE > len(binary):
                 logger.warning(f"数据末尾不足以解析完整的栈帧，在索引 {bin_idx} 处停止。事件 {ctx.trace_idx} 的栈不完整。")
@@ -567,26 +1084,9 @@ def extract_events(
             file_idx, func_idx, line, col = struct.unpack(
                 FRAME_FORMAT, binary[bin_idx: bin_idx + FRAME_SIZE]
             )
-            
-            # 从临时映射中获取文件名和函数名
-            filename = ctx._temp_filename_map.get(file_idx, f"<unknown_file_{file_idx}>")
-            funcname = ctx._temp_function_map.get(func_idx, f"<unknown_func_{func_idx}>")
-            
-            # 创建 StackFrame 对象
-            frame = StackFrame(file=filename, func=funcname, line=line, col=col)
-            
-            # 检查 frame 是否已存在于反向映射中
-            if frame in ctx.reverse_stack_frame_map:
-                frame_id = ctx.reverse_stack_frame_map[frame]
-            else:
-                # 分配新的 ID 并添加到映射表
-                frame_id = ctx.next_stack_frame_id
-                ctx.stack_frame_map[frame_id] = frame
-                ctx.reverse_stack_frame_map[frame] = frame_id
-                ctx.next_stack_frame_id += 1
-            
+
             # 将单个 frame_id 添加到 callstack_path
-            callstack_path.append(frame_id)
+            callstack_path.append(resolve_frame(file_idx, func_idx, line, col))
             bin_idx += FRAME_SIZE
 
         # 根据配置参数截断调用栈
@@ -615,43 +1115,52 @@ def extract_events(
         if not is_ret and not need_ret:
             if name in ALLOC_TYPES:
                 addr, size = arg2, arg1
-                _handle_alloc_event(ctx, output, ts, addr, size, callstack_path, is_in_brk_heap)
+                _handle_alloc_event(ctx, output, ts, addr, size, callstack_path, is_in_brk_heap, sample_weight)
             elif name in FREE_TYPES:
                 addr = arg1
                 _handle_free_event(ctx, output, ts, addr, callstack_path, is_in_brk_heap)
             continue
 
         # 处理需要配对的操作（调用/返回匹配）
-        if not is_ret:  # 调用请求
-            ctx.tid_map[key] = (arg1, arg2, ts, callstack_path)  # 存储调用时的参数、时间戳和callstack_path
+        if is_call:  # 合并的调用，参数、返回值与调用栈都在同一个事件中
+            # 从检查点恢复的同一调用已经返回
+            ctx.tid_map.pop(key, None)
+            prev_a1, prev_a2, arg1 = arg1, arg2, ret
+        elif not is_ret:  # 调用请求
+            ctx.tid_map[key] = (arg1, arg2, ts, callstack_path, sample_weight)  # 存储调用时的参数、时间戳、callstack_path和采样权重
+            continue
         else:  # 返回响应
+            if ctx.format_version >= 2:
+                arg1 = ret
             if key not in ctx.tid_map:
                 logger.warning(f"发现未匹配的返回事件 (Tag: {tag}, TID: {tid}, OpCode: {op_code})，可能日志不完整或已跳过部分。")
                 continue  # 未找到对应的调用请求，跳过此返回事件
-            prev_a1, prev_a2, t_invoke, callstack_path = ctx.tid_map.pop(key)  # 获取调用时的信息和callstack_path
-            addr, size = 0, 0
-
-            if name in ALLOC_TYPES:
-                if name == "REALLOC":
-                    old_addr = prev_a1
-                    # realloc 的 free 部分
-                    _handle_free_event(ctx, output, ts, old_addr, callstack_path, is_in_brk_heap)
-                    # realloc 的 alloc 部分
-                    addr, size = arg1, prev_a2
-                elif name in {"MALLOC", "VALLOC", "NEW", "NEW[]"}:
-                    addr, size = arg1, prev_a1
-                elif name == "CALLOC":
-                    addr, size = arg1, prev_a1 * prev_a2
-                
-                _handle_alloc_event(ctx, output, ts, addr, size, callstack_path, is_in_brk_heap)
+            prev_a1, prev_a2, t_invoke, callstack_path, sample_weight = ctx.tid_map.pop(key)  # 获取调用时的信息和callstack_path
+        addr, size = 0, 0
+
+        if name in ALLOC_TYPES:
+            if name == "REALLOC":
+                old_addr = prev_a1
+                # realloc 的 free 部分
+                _handle_free_event(ctx, output, ts, old_addr, callstack_path, is_in_brk_heap)
+                # realloc 的 alloc 部分
+                addr, size = arg1, prev_a2
+            elif name in {"MALLOC", "VALLOC", "NEW", "NEW[]"}:
+                addr, size = arg1, prev_a1
+            elif name == "CALLOC":
+                addr, size = arg1, prev_a1 * prev_a2
+            elif name == "ALIGNED_ALLOC":
+                addr, size = arg1, prev_a2
+            
+            _handle_alloc_event(ctx, output, ts, addr, size, callstack_path, is_in_brk_heap, sample_weight)
 
-            elif name in FREE_TYPES:
-                addr = prev_a1
-                _handle_free_event(ctx, output, ts, addr, callstack_path, is_in_brk_heap)
+        elif name in FREE_TYPES:
+            addr = prev_a1
+            _handle_free_event(ctx, output, ts, addr, callstack_path, is_in_brk_heap)
 
-            elif name == "BRK":
-                new_brk = arg1
-                _handle_brk_event(ctx, output, ts, new_brk, callstack_path)
+        elif name == "BRK":
+            new_brk = arg1
+            _handle_brk_event(ctx, output, ts, new_brk, callstack_path)
 
     # 循环结束后，生成最终快照
     # 传递 current_brk 以便正确过滤输出
@@ -663,5 +1172,5 @@ def extract_events(
         "brk_events": output["brk_events"],
         "memory_fragments": mem_fragments_data,
         "ctx": ctx,  # 传递最终上下文
-        "next_idx": bin_idx,  # 传递最终读取位置
+        "next_idx": bin_idx + base_offset,  # 传递最终读取位置
     }
\ No newline at end of file
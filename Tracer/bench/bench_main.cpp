@@ -0,0 +1,692 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+// 追踪开销基准测试：每个负载先直接运行，再在各模式下由 mprofiler 追踪运行，
+// 输出减速倍数、每秒事件数、每个事件的字节数、追踪器 RSS 与队列最大深度
+//
+// 结果为 JSON（每行一个结果），可用 --baseline 与之前的结果比较，
+// 减速倍数或每个事件的字节数超过阈值时返回 2
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fcntl.h"
+#include "signal.h"
+#include "sys/resource.h"
+#include "sys/utsname.h"
+#include "sys/wait.h"
+#include "unistd.h"
+
+namespace {
+
+struct Workload {
+  std::string name;
+  std::vector<std::string> args;
+  uint64_t ops; // 每个线程的分配次数（乘以 --scale）
+};
+
+// 预设负载
+const std::vector<Workload> WORKLOADS = {
+    {"baseline", {"--threads", "1", "--size", "small", "--depth", "8"}, 20000},
+    {"threads", {"--threads", "8", "--size", "small", "--depth", "8"}, 5000},
+    {"sizes", {"--size", "mixed", "--api", "mixed", "--depth", "8"}, 20000},
+    {"deep", {"--depth", "64"}, 10000},
+    {"dlopen", {"--dlopen", "500", "--depth", "8"}, 20000},
+    {"syscalls", {"--syscalls", "mmap=50,brk=200", "--depth", "8"}, 20000},
+    {"rate", {"--rate", "20000", "--depth", "8"}, 20000},
+};
+
+struct Mode {
+  std::string name;
+  std::vector<std::string> args;
+};
+
+// 追踪模式，"agent" 会追加 --agent-lib
+const std::vector<Mode> MODES = {
+    {"ptrace", {}},
+    {"no-stack", {"--no-stack"}},
+    {"fp", {"--unwind", "fp"}},
+    {"dwarf", {"--unwind", "dwarf-cached"}},
+    {"loop", {"--engine", "loop"}},
+    {"displaced", {"--step-mode", "displaced"}},
+    {"seccomp", {"--seccomp"}},
+    {"sampled", {"--sample-bytes", "65536"}},
+    {"raw", {"--raw-stacks"}},
+    {"agent", {"--agent"}},
+    {"uprobe", {"--backend", "uprobe", "--seccomp"}},
+};
+const char *DEFAULT_MODES = "ptrace,no-stack,fp,loop,displaced,agent";
+
+struct Options {
+  std::string mprofiler = MPROFILER_PATH;
+  std::string workload = MPROFILER_BENCH_WORKLOAD;
+  std::string agent = MPROFILER_AGENT_PATH;
+  std::vector<std::string> workloads; // 为空时运行所有预设负载
+  std::vector<Workload> custom;
+  std::string modes = DEFAULT_MODES;
+  int repeat = 3;
+  double scale = 1;
+  int timeout = 600; // 每次运行的超时（秒）
+  std::string output;
+  std::string baseline;
+  double threshold = 10; // 允许的退化百分比
+  std::string work_dir;
+  bool keep = false;
+};
+
+// 一次运行的结果
+struct Run {
+  bool ok = false;
+  std::string error;
+  double wall_ms = 0;
+  double workload_ms = 0; // 负载自身测得的时间，不包括追踪器启动与退出
+  std::map<std::string, std::string> stat; // statinfo.txt 的内容
+};
+
+// 一个负载在一种模式下的汇总结果
+struct Result {
+  std::string workload;
+  std::string mode;
+  bool ok = false;
+  std::string error;
+  std::map<std::string, double> values;
+};
+
+double median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  auto n = values.size();
+  return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+std::vector<std::string> split(const std::string &value, char delimiter) {
+  std::vector<std::string> items;
+  std::stringstream stream(value);
+  std::string item;
+  while (std::getline(stream, item, delimiter)) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+std::map<std::string, std::string> parse_statinfo(const std::string &path) {
+  std::map<std::string, std::string> stat;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    auto pos = line.find(':');
+    if (pos == std::string::npos) {
+      continue;
+    }
+    auto trim = [](std::string value) {
+      value.erase(0, value.find_first_not_of(" \t"));
+      value.erase(value.find_last_not_of(" \t\r") + 1);
+      return value;
+    };
+    stat[trim(line.substr(0, pos))] = trim(line.substr(pos + 1));
+  }
+  return stat;
+}
+
+// statinfo.txt 中的数值，value 形如 "avg=1 p99=2 max=3" 时取 field 对应的值
+double stat_value(const std::map<std::string, std::string> &stat,
+                  const std::string &key, const std::string &field = "") {
+  auto item = stat.find(key);
+  if (item == stat.end()) {
+    return 0;
+  }
+  auto &value = item->second;
+  if (field.empty()) {
+    return strtod(value.c_str(), nullptr);
+  }
+  auto pos = value.find(field + "=");
+  return pos == std::string::npos
+             ? 0
+             : strtod(value.c_str() + pos + field.size() + 1, nullptr);
+}
+
+// 运行命令，输出重定向到 log，超时后结束整个进程组
+Run execute(const std::vector<std::string> &command, const std::string &log,
+            int timeout) {
+  Run run;
+  auto start = std::chrono::steady_clock::now();
+  auto pid = fork();
+  if (pid < 0) {
+    run.error = std::string("fork: ") + strerror(errno);
+    return run;
+  }
+  if (pid == 0) {
+    setpgid(0, 0);
+    int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+      close(fd);
+    }
+    std::vector<char *> argv;
+    for (auto &arg : command) {
+      argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    perror("execv");
+    _exit(127);
+  }
+
+  int status = 0;
+  auto deadline = start + std::chrono::seconds(timeout);
+  while (true) {
+    auto ret = waitpid(pid, &status, WNOHANG);
+    if (ret == pid) {
+      break;
+    }
+    if (ret < 0 && errno != EINTR) {
+      run.error = std::string("waitpid: ") + strerror(errno);
+      return run;
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+      kill(-pid, SIGKILL);
+      waitpid(pid, &status, 0);
+      run.error = "timeout";
+      return run;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  run.wall_ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    run.error = "exit status " + std::to_string(WIFEXITED(status)
+                                                    ? WEXITSTATUS(status)
+                                                    : 128 + WTERMSIG(status)) +
+                " (see " + log + ")";
+    return run;
+  }
+  run.ok = true;
+  return run;
+}
+
+class Bench {
+  Options options;
+  std::vector<Result> results;
+  int run_index = 0;
+
+  std::vector<std::string> workload_command(const Workload &workload,
+                                            const std::string &result) const {
+    std::vector<std::string> command = {options.workload};
+    command.insert(command.end(), workload.args.begin(), workload.args.end());
+    // 参数中已指定 --ops 时不再按 --scale 计算
+    if (std::find(workload.args.begin(), workload.args.end(), "--ops") ==
+        workload.args.end()) {
+      auto ops = std::max<uint64_t>(1, workload.ops * options.scale);
+      command.insert(command.end(), {"--ops", std::to_string(ops)});
+    }
+    command.insert(command.end(), {"--result", result});
+    return command;
+  }
+
+  // 运行一次，mode 为空时直接运行负载
+  Run run_once(const Workload &workload, const Mode *mode) {
+    auto dir = options.work_dir + "/run-" + std::to_string(run_index++);
+    std::filesystem::create_directories(dir);
+    auto result_path = dir + "/result.txt";
+    auto command = workload_command(workload, result_path);
+    if (mode != nullptr) {
+      std::vector<std::string> tracer = {
+          options.mprofiler, "--no-print-log", "--no-print-stack",
+          "--no-print-save", "--save-dir",     dir,
+          "--category",      "/name"};
+      tracer.insert(tracer.end(), mode->args.begin(), mode->args.end());
+      if (mode->name == "agent") {
+        tracer.insert(tracer.end(), {"--agent-lib", options.agent});
+      }
+      command.insert(command.begin(), tracer.begin(), tracer.end());
+    }
+
+    auto run = execute(command, dir + "/output.log", options.timeout);
+    if (run.ok) {
+      std::ifstream result(result_path);
+      long long elapsed = 0;
+      if (!(result >> elapsed)) {
+        run.ok = false;
+        run.error = "no workload result (see " + dir + "/output.log)";
+      }
+      run.workload_ms = elapsed / 1e6;
+    }
+    if (run.ok && mode != nullptr) {
+      for (auto &entry : std::filesystem::recursive_directory_iterator(dir)) {
+        if (entry.path().filename() == "statinfo.txt") {
+          run.stat = parse_statinfo(entry.path());
+        }
+      }
+      if (run.stat.empty()) {
+        run.ok = false;
+        run.error = "no statinfo.txt (see " + dir + "/output.log)";
+      }
+    }
+    if (run.ok && !options.keep) {
+      std::filesystem::remove_all(dir);
+    }
+    return run;
+  }
+
+  // 运行 repeat 次，取各项的中位数
+  Result measure(const Workload &workload, const Mode *mode,
+                 const Result *native) {
+    Result result{workload.name, mode != nullptr ? mode->name : "native",
+                  false, {}, {}};
+    std::vector<double> wall, elapsed, events, bytes_out, bytes_in, rss;
+    double queue_max = 0, dropped = 0;
+    // 直接运行的时间很短、波动较大，至少运行 5 次
+    int repeat = mode != nullptr ? options.repeat : std::max(options.repeat, 5);
+    for (int i = 0; i < repeat; i++) {
+      auto run = run_once(workload, mode);
+      if (!run.ok) {
+        result.error = run.error;
+        return result;
+      }
+      wall.push_back(run.wall_ms);
+      elapsed.push_back(run.workload_ms);
+      if (mode != nullptr) {
+        events.push_back(stat_value(run.stat, "total_traceinfo_count"));
+        bytes_out.push_back(stat_value(run.stat, "writer_bytes_out"));
+        bytes_in.push_back(stat_value(run.stat, "writer_bytes_in"));
+        rss.push_back(stat_value(run.stat, "tracer_max_rss_kb"));
+        queue_max = std::max(queue_max,
+                             stat_value(run.stat, "self_queue_bytes", "max"));
+        dropped = std::max(dropped,
+                           stat_value(run.stat, "agent_dropped_count") +
+                               stat_value(run.stat, "uprobe_lost_count"));
+      }
+    }
+
+    result.ok = true;
+    auto &values = result.values;
+    values["wall_ms"] = median(wall);
+    values["workload_ms"] = median(elapsed);
+    if (mode == nullptr) {
+      return result;
+    }
+    auto event_count = median(events);
+    if (native != nullptr && native->ok) {
+      auto base = native->values.at("workload_ms");
+      auto base_wall = native->values.at("wall_ms");
+      values["slowdown"] = base > 0 ? values["workload_ms"] / base : 0;
+      values["wall_slowdown"] = base_wall > 0 ? values["wall_ms"] / base_wall : 0;
+    }
+    values["events"] = event_count;
+    values["events_per_sec"] =
+        values["workload_ms"] > 0 ? event_count / (values["workload_ms"] / 1e3)
+                                  : 0;
+    values["bytes_per_event"] =
+        event_count > 0 ? median(bytes_out) / event_count : 0;
+    values["raw_bytes_per_event"] =
+        event_count > 0 ? median(bytes_in) / event_count : 0;
+    values["tracer_rss_kb"] = median(rss);
+    values["queue_high_water"] = queue_max;
+    values["dropped"] = dropped;
+    return result;
+  }
+
+  static std::string format_result(const Result &result) {
+    std::string line = "{\"workload\":\"" + result.workload + "\",\"mode\":\"" +
+                       result.mode + "\",\"ok\":" +
+                       (result.ok ? "true" : "false");
+    if (!result.ok) {
+      std::string error;
+      for (auto c : result.error) {
+        if (c == '"' || c == '\\') {
+          error += '\\';
+        }
+        error += c;
+      }
+      line += ",\"error\":\"" + error + "\"";
+    }
+    for (auto &[key, value] : result.values) {
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), ",\"%s\":%.6g", key.c_str(), value);
+      line += buffer;
+    }
+    return line + "}";
+  }
+
+  std::string format_results() const {
+    utsname uts{};
+    uname(&uts);
+    std::string text = "{\"tool\":\"mprofiler_bench\",\"version\":1,";
+    text += "\"host\":\"" + std::string(uts.nodename) + "\",";
+    text += "\"kernel\":\"" + std::string(uts.release) + "\",";
+    text += "\"cpus\":" + std::to_string(std::thread::hardware_concurrency());
+    text += ",\"repeat\":" + std::to_string(options.repeat);
+    char scale[32];
+    snprintf(scale, sizeof(scale), "%g", options.scale);
+    text += ",\"scale\":" + std::string(scale) + ",\"results\":[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+      text += format_result(results[i]);
+      text += i + 1 < results.size() ? ",\n" : "\n";
+    }
+    return text + "]}\n";
+  }
+
+  // 读取之前输出的结果，每行一个结果
+  static std::vector<Result> load_results(const std::string &path) {
+    std::vector<Result> loaded;
+    std::ifstream file(path);
+    std::regex field(R"re("(\w+)":("([^"]*)"|true|false|[-+0-9.eE]+))re");
+    std::string line;
+    while (std::getline(file, line)) {
+      if (line.find("\"workload\":") == std::string::npos) {
+        continue;
+      }
+      Result result;
+      for (std::sregex_iterator item(line.begin(), line.end(), field), end;
+           item != end; ++item) {
+        auto key = (*item)[1].str();
+        auto value = (*item)[2].str();
+        if (key == "workload") {
+          result.workload = (*item)[3];
+        } else if (key == "mode") {
+          result.mode = (*item)[3];
+        } else if (key == "ok") {
+          result.ok = value == "true";
+        } else if (value.front() != '"') {
+          result.values[key] = strtod(value.c_str(), nullptr);
+        }
+      }
+      loaded.push_back(result);
+    }
+    return loaded;
+  }
+
+  void print_summary() const {
+    fprintf(stderr, "\n%-10s %-10s %9s %9s %12s %9s %10s %10s\n", "workload",
+            "mode", "time_ms", "slowdown", "events/s", "B/event", "rss_kb",
+            "queue_max");
+    for (auto &result : results) {
+      if (!result.ok) {
+        fprintf(stderr, "%-10s %-10s failed: %s\n", result.workload.c_str(),
+                result.mode.c_str(), result.error.c_str());
+        continue;
+      }
+      auto value = [&result](const char *key) {
+        auto item = result.values.find(key);
+        return item == result.values.end() ? 0.0 : item->second;
+      };
+      fprintf(stderr, "%-10s %-10s %9.1f %9.2f %12.0f %9.2f %10.0f %10.0f\n",
+              result.workload.c_str(), result.mode.c_str(),
+              value("workload_ms"), value("slowdown"), value("events_per_sec"),
+              value("bytes_per_event"), value("tracer_rss_kb"),
+              value("queue_high_water"));
+    }
+  }
+
+  // 与基线比较，返回是否有退化
+  bool compare(const std::vector<Result> &baseline) const {
+    // 只对这两项做判断，其它项随环境波动较大，只输出变化
+    const char *gated[] = {"slowdown", "bytes_per_event"};
+    const char *reported[] = {"slowdown", "bytes_per_event", "events_per_sec",
+                              "tracer_rss_kb", "queue_high_water"};
+    bool regressed = false;
+    fprintf(stderr, "\ncompared with %s (threshold %.1f%%):\n",
+            options.baseline.c_str(), options.threshold);
+    for (auto &result : results) {
+      auto base = std::find_if(
+          baseline.begin(), baseline.end(), [&result](const Result &item) {
+            return item.workload == result.workload && item.mode == result.mode;
+          });
+      if (base == baseline.end() || !base->ok || !result.ok ||
+          result.mode == "native") {
+        continue;
+      }
+      std::string line;
+      bool bad = false;
+      for (auto key : reported) {
+        auto now = result.values.find(key);
+        auto old = base->values.find(key);
+        if (now == result.values.end() || old == base->values.end() ||
+            old->second <= 0) {
+          continue;
+        }
+        auto change = (now->second / old->second - 1) * 100;
+        char buffer[96];
+        snprintf(buffer, sizeof(buffer), " %s %.4g->%.4g(%+.1f%%)", key,
+                 old->second, now->second, change);
+        line += buffer;
+        if (std::find_if(std::begin(gated), std::end(gated),
+                         [key](const char *name) {
+                           return strcmp(name, key) == 0;
+                         }) != std::end(gated) &&
+            change > options.threshold) {
+          bad = true;
+        }
+      }
+      fprintf(stderr, "%s %-10s %-10s%s\n", bad ? "REGRESSION" : "ok        ",
+              result.workload.c_str(), result.mode.c_str(), line.c_str());
+      regressed |= bad;
+    }
+    return regressed;
+  }
+
+public:
+  explicit Bench(Options options) : options(std::move(options)) {}
+
+  int run() {
+    std::vector<const Mode *> modes;
+    auto names = options.modes == "all" ? std::vector<std::string>{}
+                                        : split(options.modes, ',');
+    for (auto &mode : MODES) {
+      if (names.empty() ||
+          std::find(names.begin(), names.end(), mode.name) != names.end()) {
+        modes.push_back(&mode);
+      }
+    }
+    for (auto &name : names) {
+      if (std::none_of(MODES.begin(), MODES.end(),
+                       [&name](const Mode &mode) { return mode.name == name; })) {
+        fprintf(stderr, "unknown mode: %s\n", name.c_str());
+        return 1;
+      }
+    }
+
+    std::vector<Workload> workloads;
+    for (auto &name : options.workloads) {
+      auto item = std::find_if(
+          WORKLOADS.begin(), WORKLOADS.end(),
+          [&name](const Workload &workload) { return workload.name == name; });
+      if (item == WORKLOADS.end()) {
+        fprintf(stderr, "unknown workload: %s\n", name.c_str());
+        return 1;
+      }
+      workloads.push_back(*item);
+    }
+    if (workloads.empty() && options.custom.empty()) {
+      workloads = WORKLOADS;
+    }
+    workloads.insert(workloads.end(), options.custom.begin(),
+                     options.custom.end());
+
+    if (options.work_dir.empty()) {
+      char dir[] = "/tmp/mprofiler-bench-XXXXXX";
+      if (mkdtemp(dir) == nullptr) {
+        perror("mkdtemp");
+        return 1;
+      }
+      options.work_dir = dir;
+    }
+
+    for (auto &workload : workloads) {
+      fprintf(stderr, "[%s] native\n", workload.name.c_str());
+      auto native = measure(workload, nullptr, nullptr);
+      results.push_back(native);
+      for (auto mode : modes) {
+        fprintf(stderr, "[%s] %s\n", workload.name.c_str(), mode->name.c_str());
+        results.push_back(measure(workload, mode, &native));
+      }
+    }
+    if (!options.keep) {
+      std::error_code error;
+      std::filesystem::remove(options.work_dir, error);
+    }
+
+    auto text = format_results();
+    if (options.output.empty()) {
+      fputs(text.c_str(), stdout);
+    } else {
+      std::ofstream file(options.output);
+      file << text;
+      if (!file) {
+        fprintf(stderr, "failed to write %s\n", options.output.c_str());
+        return 1;
+      }
+    }
+    print_summary();
+    if (!options.baseline.empty()) {
+      auto baseline = load_results(options.baseline);
+      if (baseline.empty()) {
+        fprintf(stderr, "no results in baseline %s\n", options.baseline.c_str());
+        return 1;
+      }
+      if (compare(baseline)) {
+        return 2;
+      }
+    }
+    return 0;
+  }
+};
+
+const char *USAGE = R"(Usage: mprofiler_bench [OPTION...] [WORKLOAD]...
+
+  Runs each workload natively and under mprofiler in each mode, then prints
+  JSON results (one result per line) and a summary table.
+
+  Examples:
+    mprofiler_bench --quick                       # All workloads, default modes
+    mprofiler_bench --output new.json --baseline old.json baseline threads
+    mprofiler_bench --custom "big=--threads 4 --size large --ops 2000"
+
+  Options:
+    -h, --help          Show help options
+    --list              List workloads and modes
+    --modes LIST        Comma separated tracing modes, "all" for all modes
+                            (default "ptrace,no-stack,fp,loop,displaced,agent")
+    --custom NAME=ARGS  Add a workload with mprofiler_bench_workload arguments
+    --repeat N          Runs of each workload and mode, medians are reported(default 3)
+    --scale F           Multiply the operation count of preset workloads(default 1)
+    --quick             Same as --repeat 1 --scale 0.1
+    --timeout SEC       Timeout of each run(default 600)
+    --output FILE       Write JSON results to FILE instead of stdout
+    --baseline FILE     Compare with earlier results, exit 2 when slowdown or
+                            bytes/event regress by more than --threshold
+    --threshold PCT     Allowed regression in percent(default 10)
+    --work-dir DIR      Directory of the runs(default: a new directory in /tmp)
+    --keep              Keep the output of successful runs
+    --mprofiler PATH    mprofiler to benchmark
+    --workload PATH     Workload generator(mprofiler_bench_workload)
+    --agent-lib PATH    Agent library used by the "agent" mode
+)";
+
+bool parse_args(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&]() -> const char * {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "missing value of %s\n", arg.c_str());
+        exit(1);
+      }
+      return argv[++i];
+    };
+    if (arg == "-h" || arg == "--help") {
+      printf("%s", USAGE);
+      exit(0);
+    } else if (arg == "--list") {
+      for (auto &workload : WORKLOADS) {
+        printf("workload %-10s", workload.name.c_str());
+        for (auto &item : workload.args) {
+          printf(" %s", item.c_str());
+        }
+        printf(" --ops %llu\n", static_cast<unsigned long long>(workload.ops));
+      }
+      for (auto &mode : MODES) {
+        printf("mode     %-10s", mode.name.c_str());
+        for (auto &item : mode.args) {
+          printf(" %s", item.c_str());
+        }
+        printf("\n");
+      }
+      exit(0);
+    } else if (arg == "--modes") {
+      options.modes = value();
+    } else if (arg == "--custom") {
+      std::string custom = value();
+      auto eq = custom.find('=');
+      if (eq == std::string::npos || eq == 0) {
+        fprintf(stderr, "invalid custom workload: %s\n", custom.c_str());
+        return false;
+      }
+      auto args = split(custom.substr(eq + 1), ' ');
+      options.custom.push_back({custom.substr(0, eq), args, 20000});
+    } else if (arg == "--repeat") {
+      options.repeat = std::max(1, atoi(value()));
+    } else if (arg == "--scale") {
+      options.scale = atof(value());
+    } else if (arg == "--quick") {
+      options.repeat = 1;
+      options.scale = 0.1;
+    } else if (arg == "--timeout") {
+      options.timeout = std::max(1, atoi(value()));
+    } else if (arg == "--output") {
+      options.output = value();
+    } else if (arg == "--baseline") {
+      options.baseline = value();
+    } else if (arg == "--threshold") {
+      options.threshold = atof(value());
+    } else if (arg == "--work-dir") {
+      options.work_dir = value();
+    } else if (arg == "--keep") {
+      options.keep = true;
+    } else if (arg == "--mprofiler") {
+      options.mprofiler = value();
+    } else if (arg == "--workload") {
+      options.workload = value();
+    } else if (arg == "--agent-lib") {
+      options.agent = value();
+    } else if (!arg.empty() && arg[0] == '-') {
+      fprintf(stderr, "unknown option: %s\n%s", arg.c_str(), USAGE);
+      return false;
+    } else {
+      options.workloads.push_back(arg);
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parse_args(argc, argv, options)) {
+    return 1;
+  }
+  return Bench(std::move(options)).run();
+}
@@ -0,0 +1,22 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+// 负载的 --dlopen 反复加载与卸载的动态库，加载时会触发追踪器刷新模块与断点
+
+#include <cstdlib>
+#include <cstring>
+
+extern "C" int mprofiler_bench_plugin(int count) {
+  int sum = 0;
+  for (int i = 0; i < count; i++) {
+    auto buffer = static_cast<char *>(malloc(64));
+    memset(buffer, i, 64);
+    sum += buffer[i % 64];
+    free(buffer);
+  }
+  return sum;
+}
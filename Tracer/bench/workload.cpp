@@ -0,0 +1,353 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+// 可配置的合成负载：按线程数、分配速率、大小分布、调用栈深度、dlopen 频率与
+// 系统调用比例产生内存操作，结束时把自身的运行时间写入 --result 文件
+//
+// 由 mprofiler_bench 驱动，也可单独运行：
+//   mprofiler_bench_workload --threads 4 --size mixed --depth 16 --ops 100000
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dlfcn.h"
+#include "sys/mman.h"
+#include "unistd.h"
+
+namespace {
+
+enum class SizeClass { SMALL, MEDIUM, LARGE, MIXED, RANGE };
+enum class Api { MALLOC, NEW, MIXED };
+
+struct Options {
+  int threads = 1;
+  uint64_t ops = 100000;  // 每个线程的分配次数
+  uint64_t rate = 0;      // 每个线程每秒的分配次数，0 表示不限制
+  SizeClass size = SizeClass::SMALL;
+  size_t min_size = 16, max_size = 256; // RANGE 的范围
+  int depth = 8;          // 分配时的调用栈深度
+  size_t live = 64;       // 每个线程保留的存活分配个数
+  uint64_t dlopen_every = 0; // 每 N 次分配 dlopen/dlclose 一次，0 表示不使用
+  uint64_t mmap_every = 0;   // 每 N 次分配 mmap/munmap 一次
+  uint64_t brk_every = 0;    // 每 N 次分配 sbrk 扩展并收缩一次
+  Api api = Api::MALLOC;
+  std::string plugin = MPROFILER_BENCH_PLUGIN;
+  std::string result;     // 结果文件
+};
+
+// splitmix64，每个线程使用独立的确定性序列
+struct Random {
+  uint64_t state;
+  uint64_t next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+  size_t between(size_t low, size_t high) {
+    return low + next() % (high - low + 1);
+  }
+};
+
+size_t pick_size(const Options &options, Random &random) {
+  switch (options.size) {
+  case SizeClass::SMALL:
+    return random.between(16, 256);
+  case SizeClass::MEDIUM:
+    return random.between(256, 4096);
+  case SizeClass::LARGE:
+    // 超过 mmap 阈值，由 malloc 直接映射
+    return random.between(128 << 10, 1 << 20);
+  case SizeClass::MIXED: {
+    auto roll = random.next() % 100;
+    return roll < 80   ? random.between(16, 256)
+           : roll < 95 ? random.between(256, 4096)
+                       : random.between(128 << 10, 1 << 20);
+  }
+  case SizeClass::RANGE:
+    return random.between(options.min_size, options.max_size);
+  }
+  return 16;
+}
+
+struct Block {
+  void *ptr = nullptr;
+  bool is_new = false;
+};
+
+void release(Block &block) {
+  if (block.ptr == nullptr) {
+    return;
+  }
+  if (block.is_new) {
+    delete[] static_cast<char *>(block.ptr);
+  } else {
+    free(block.ptr);
+  }
+  block.ptr = nullptr;
+}
+
+Block allocate(const Options &options, Random &random) {
+  auto size = pick_size(options, random);
+  auto api = options.api;
+  Block block;
+  if (api == Api::NEW || (api == Api::MIXED && random.next() % 4 == 0)) {
+    block.ptr = new char[size];
+    block.is_new = true;
+  } else if (api == Api::MIXED && random.next() % 3 == 0) {
+    block.ptr = random.next() % 2 ? calloc(1, size) : realloc(nullptr, size);
+  } else {
+    block.ptr = malloc(size);
+  }
+  // 写入内存，避免分配被编译器优化掉
+  static_cast<volatile char *>(block.ptr)[0] = char(size);
+  return block;
+}
+
+// 在 depth 层调用之后分配，得到指定深度的调用栈
+__attribute__((noinline)) Block descend(const Options &options, Random &random,
+                                        int depth) {
+  if (depth <= 1) {
+    return allocate(options, random);
+  }
+  auto block = descend(options, random, depth - 1);
+  // 阻止尾调用优化
+  asm volatile("" ::: "memory");
+  return block;
+}
+
+void churn_dlopen(const Options &options) {
+  auto handle = dlopen(options.plugin.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (handle == nullptr) {
+    fprintf(stderr, "dlopen %s: %s\n", options.plugin.c_str(), dlerror());
+    return;
+  }
+  using Function = int (*)(int);
+  if (auto function = reinterpret_cast<Function>(
+          dlsym(handle, "mprofiler_bench_plugin"));
+      function != nullptr) {
+    function(1);
+  }
+  dlclose(handle);
+}
+
+void churn_mmap() {
+  const size_t length = 64 << 10;
+  auto addr = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    perror("mmap");
+    return;
+  }
+  static_cast<volatile char *>(addr)[0] = 1;
+  munmap(addr, length);
+}
+
+void churn_brk() {
+  const intptr_t increment = 4096;
+  if (sbrk(increment) == reinterpret_cast<void *>(-1)) {
+    perror("sbrk");
+    return;
+  }
+  sbrk(-increment);
+}
+
+void run_thread(const Options &options, int index) {
+  Random random{uint64_t(index + 1) * 0x2545f4914f6cdd1dULL};
+  std::vector<Block> live(std::max<size_t>(options.live, 1));
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < options.ops; i++) {
+    // 存活分配保存在环形窗口中，新的分配替换最旧的分配
+    auto &slot = live[i % live.size()];
+    release(slot);
+    slot = descend(options, random, options.depth);
+
+    if (options.dlopen_every > 0 && (i + 1) % options.dlopen_every == 0) {
+      churn_dlopen(options);
+    }
+    if (options.mmap_every > 0 && (i + 1) % options.mmap_every == 0) {
+      churn_mmap();
+    }
+    // sbrk 会与其它线程的 malloc 竞争堆顶，只在第一个线程中执行
+    if (options.brk_every > 0 && index == 0 &&
+        (i + 1) % options.brk_every == 0) {
+      churn_brk();
+    }
+    // 按速率限制时，提前完成的分配等待到预定的时间
+    if (options.rate > 0) {
+      auto due = start + std::chrono::nanoseconds((i + 1) * 1000000000ULL /
+                                                  options.rate);
+      std::this_thread::sleep_until(due);
+    }
+  }
+  for (auto &block : live) {
+    release(block);
+  }
+}
+
+bool parse_size(const std::string &value, Options &options) {
+  if (value == "small") {
+    options.size = SizeClass::SMALL;
+  } else if (value == "medium") {
+    options.size = SizeClass::MEDIUM;
+  } else if (value == "large") {
+    options.size = SizeClass::LARGE;
+  } else if (value == "mixed") {
+    options.size = SizeClass::MIXED;
+  } else if (sscanf(value.c_str(), "%zu-%zu", &options.min_size,
+                    &options.max_size) == 2 &&
+             options.min_size > 0 && options.min_size <= options.max_size) {
+    options.size = SizeClass::RANGE;
+  } else if (sscanf(value.c_str(), "%zu", &options.min_size) == 1 &&
+             options.min_size > 0) {
+    options.size = SizeClass::RANGE;
+    options.max_size = options.min_size;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// 系统调用比例，如 "mmap=100,brk=1000"
+bool parse_syscalls(const std::string &value, Options &options) {
+  size_t pos = 0;
+  while (pos < value.size()) {
+    auto end = value.find(',', pos);
+    auto item = value.substr(pos, end == std::string::npos ? end : end - pos);
+    pos = end == std::string::npos ? value.size() : end + 1;
+    auto eq = item.find('=');
+    if (eq == std::string::npos) {
+      return false;
+    }
+    auto name = item.substr(0, eq);
+    auto every = strtoull(item.c_str() + eq + 1, nullptr, 10);
+    if (name == "mmap") {
+      options.mmap_every = every;
+    } else if (name == "brk") {
+      options.brk_every = every;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+const char *USAGE = R"(Usage: mprofiler_bench_workload [OPTION...]
+
+  Options:
+    --threads N     Number of worker threads(default 1)
+    --ops N         Allocations per thread(default 100000)
+    --rate N        Allocations per second per thread(default 0: unlimited)
+    --size DIST     Allocation size distribution(default small)
+                        "small" "medium" "large" "mixed" "N" "MIN-MAX"
+    --depth N       Call stack depth at each allocation(default 8)
+    --live N        Live allocations kept per thread(default 64)
+    --api API       Allocation functions: "malloc" "new" "mixed"(default malloc)
+    --dlopen N      dlopen/dlclose the plugin library every N allocations
+    --syscalls MIX  Extra syscalls every N allocations, e.g. "mmap=100,brk=1000"
+    --plugin PATH   Library used by --dlopen
+    --result FILE   Write elapsed time(ns) and operation count to FILE
+)";
+
+bool parse_args(int argc, char *argv[], Options &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      printf("%s", USAGE);
+      exit(0);
+    }
+    if (i + 1 >= argc) {
+      fprintf(stderr, "missing value of %s\n", arg.c_str());
+      return false;
+    }
+    std::string value = argv[++i];
+    auto number = [&value]() { return strtoull(value.c_str(), nullptr, 10); };
+    if (arg == "--threads") {
+      options.threads = std::max<int>(1, number());
+    } else if (arg == "--ops") {
+      options.ops = number();
+    } else if (arg == "--rate") {
+      options.rate = number();
+    } else if (arg == "--size") {
+      if (!parse_size(value, options)) {
+        fprintf(stderr, "invalid size distribution: %s\n", value.c_str());
+        return false;
+      }
+    } else if (arg == "--depth") {
+      options.depth = std::max<int>(1, number());
+    } else if (arg == "--live") {
+      options.live = number();
+    } else if (arg == "--api") {
+      if (value == "malloc") {
+        options.api = Api::MALLOC;
+      } else if (value == "new") {
+        options.api = Api::NEW;
+      } else if (value == "mixed") {
+        options.api = Api::MIXED;
+      } else {
+        fprintf(stderr, "invalid api: %s\n", value.c_str());
+        return false;
+      }
+    } else if (arg == "--dlopen") {
+      options.dlopen_every = number();
+    } else if (arg == "--syscalls") {
+      if (!parse_syscalls(value, options)) {
+        fprintf(stderr, "invalid syscall mix: %s\n", value.c_str());
+        return false;
+      }
+    } else if (arg == "--plugin") {
+      options.plugin = value;
+    } else if (arg == "--result") {
+      options.result = value;
+    } else {
+      fprintf(stderr, "unknown option: %s\n%s", arg.c_str(), USAGE);
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  if (!parse_args(argc, argv, options)) {
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int i = 1; i < options.threads; i++) {
+    workers.emplace_back(run_thread, std::cref(options), i);
+  }
+  run_thread(options, 0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  if (!options.result.empty()) {
+    auto file = fopen(options.result.c_str(), "w");
+    if (file == nullptr) {
+      perror("open result file");
+      return 1;
+    }
+    fprintf(file, "%lld %llu\n", static_cast<long long>(elapsed),
+            static_cast<unsigned long long>(options.ops * options.threads));
+    fclose(file);
+  }
+  return 0;
+}
@@ -0,0 +1,414 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+// 通过 LD_PRELOAD 注入目标进程的 agent，拦截分配函数并写入共享内存环形缓冲区
+// 只依赖 libc，不链接 libstdc++，也不使用需要动态初始化的全局对象
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "dlfcn.h"
+#include "execinfo.h"
+#include "link.h"
+#include "pthread.h"
+#include "sched.h"
+#include "sys/syscall.h"
+#include "time.h"
+#include "unistd.h"
+
+#include "agent_ring.h"
+#include "allocation_sampler.h"
+#include "config.h"
+#include "operation.h"
+
+using namespace Memory::Profile;
+
+namespace {
+
+// 被拦截的原始函数
+struct RealFunctions {
+  void *(*malloc)(size_t);
+  void (*free)(void *);
+  void *(*calloc)(size_t, size_t);
+  void *(*realloc)(void *, size_t);
+  void *(*valloc)(size_t);
+  int (*posix_memalign)(void **, size_t, size_t);
+  void *(*aligned_alloc)(size_t, size_t);
+  void *(*new_)(size_t);
+  void *(*new_array)(size_t);
+  void (*delete_legacy)(void *);
+  void (*delete_)(void *, size_t);
+  void (*delete_array)(void *);
+};
+
+enum : int { UNRESOLVED, RESOLVING, RESOLVED };
+
+RealFunctions real;
+std::atomic<int> resolve_state = UNRESOLVED;
+Agent::Ring ring;
+// agent 自身的地址范围，采集调用栈时跳过
+uintptr_t agent_begin = 0, agent_end = 0;
+
+// 解析 dlsym 期间 dlsym 自身可能分配内存，使用静态缓冲区
+constexpr size_t BOOTSTRAP_SIZE = 16384;
+alignas(64) char bootstrap[BOOTSTRAP_SIZE];
+std::atomic<size_t> bootstrap_used = 0;
+
+// 当前线程是否处于 agent 内部（防止重入）、是否正在解析、线程号缓存
+__thread bool in_hook __attribute__((tls_model("initial-exec"))) = false;
+__thread bool in_resolve __attribute__((tls_model("initial-exec"))) = false;
+__thread pid_t cached_tid __attribute__((tls_model("initial-exec"))) = 0;
+// 当前线程的分配采样（--sample-bytes）
+__thread AllocationSampler sampler __attribute__((tls_model("initial-exec")));
+
+// 缓冲区满时等待消费者的最长时间
+constexpr int64_t RING_WAIT_NS = 1000000000;
+
+void *bootstrap_alloc(size_t size, size_t alignment = 16) {
+  auto used = bootstrap_used.load();
+  while (true) {
+    auto begin = (used + alignment - 1) & ~(alignment - 1);
+    if (begin + size > BOOTSTRAP_SIZE) {
+      return nullptr;
+    }
+    if (bootstrap_used.compare_exchange_weak(used, begin + size)) {
+      return bootstrap + begin;
+    }
+  }
+}
+
+bool is_bootstrap(void *ptr) {
+  auto addr = static_cast<char *>(ptr);
+  return addr >= bootstrap && addr < bootstrap + BOOTSTRAP_SIZE;
+}
+
+template <typename F> void resolve_symbol(F &function, const char *name) {
+  function = reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+// 解析原始函数，当前线程正在解析时返回 false，由调用方使用静态缓冲区
+bool resolve() {
+  if (resolve_state.load(std::memory_order_acquire) == RESOLVED) {
+    return true;
+  }
+  if (in_resolve) {
+    return false;
+  }
+  int expected = UNRESOLVED;
+  if (resolve_state.compare_exchange_strong(expected, RESOLVING)) {
+    in_resolve = true;
+    resolve_symbol(real.malloc, "malloc");
+    resolve_symbol(real.free, "free");
+    resolve_symbol(real.calloc, "calloc");
+    resolve_symbol(real.realloc, "realloc");
+    resolve_symbol(real.valloc, "valloc");
+    resolve_symbol(real.posix_memalign, "posix_memalign");
+    resolve_symbol(real.aligned_alloc, "aligned_alloc");
+    resolve_symbol(real.new_, "_Znwm");
+    resolve_symbol(real.new_array, "_Znam");
+    resolve_symbol(real.delete_legacy, "_ZdlPv");
+    resolve_symbol(real.delete_, "_ZdlPvm");
+    resolve_symbol(real.delete_array, "_ZdaPv");
+    in_resolve = false;
+    resolve_state.store(RESOLVED, std::memory_order_release);
+    return true;
+  }
+  while (resolve_state.load(std::memory_order_acquire) != RESOLVED) {
+    sched_yield();
+  }
+  return true;
+}
+
+int64_t now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+pid_t current_tid() {
+  if (cached_tid == 0) {
+    cached_tid = static_cast<pid_t>(syscall(SYS_gettid));
+  }
+  return cached_tid;
+}
+
+void reset_tid() { cached_tid = 0; }
+
+// 写入一条记录；function 不为空时采集调用栈，第 0 帧为原始函数的入口
+void record(uint8_t tag, uintptr_t arg1, uintptr_t arg2, void *function) {
+  if (!ring.ready() || in_hook || !ring.traced(GetOperation(tag))) {
+    return;
+  }
+  in_hook = true;
+
+  uint64_t pos;
+  auto item = ring.reserve(pos);
+  for (int64_t deadline = 0; item == nullptr;) {
+    // 缓冲区已满，等待 tracer 消费，超时或 tracer 停止追踪后丢弃
+    auto current = now();
+    if (deadline == 0) {
+      deadline = current + RING_WAIT_NS;
+    } else if (current > deadline || !ring.traced(GetOperation(tag))) {
+      ring.drop();
+      in_hook = false;
+      return;
+    }
+    sched_yield();
+    item = ring.reserve(pos);
+  }
+
+  item->tag = tag;
+  item->tid = current_tid();
+  item->args[0] = arg1;
+  item->args[1] = arg2;
+  item->weight = 0;
+  item->stack_size = 0;
+
+  auto depth = ring.stack_depth(GetOperation(tag));
+  if (depth == 0) {
+    function = nullptr;
+  }
+  // 采样模式下只采集被采样的分配的调用栈，释放操作不采集调用栈
+  if (auto period = ring.sample_bytes(); function != nullptr && period > 0) {
+    auto op = GetOperation(tag);
+    auto size = AllocationSize(op, arg1, arg2);
+    if (size > 0) {
+      if (!sampler.ready()) {
+        sampler.seed(uint64_t(item->tid) * 0x9e3779b97f4a7c15ULL ^
+                     uint64_t(now()));
+      }
+      item->weight = sampler.sample(size, period);
+      if (item->weight == 0) {
+        function = nullptr;
+      }
+    } else if (IsDeallocation(op)) {
+      function = nullptr;
+    }
+  }
+
+  if (function != nullptr) {
+    // 与断点方式保持一致：第 0 帧为命中断点后的 rip，即函数入口 + 1
+    auto stack = item->stack();
+    stack[item->stack_size++] = reinterpret_cast<uintptr_t>(function) + 1;
+    void *frames[Agent::RING_STACK_MAX + 8];
+    int count = backtrace(frames, depth + 8);
+    for (int i = 0; i < count && item->stack_size < depth; i++) {
+      auto addr = reinterpret_cast<uintptr_t>(frames[i]);
+      if (addr >= agent_begin && addr < agent_end) {
+        continue;
+      }
+      stack[item->stack_size++] = addr;
+    }
+  }
+  item->timestamp = now();
+  ring.commit(item, pos);
+  in_hook = false;
+}
+
+inline void invoke(Operation op, uintptr_t arg1, uintptr_t arg2,
+                   void *function) {
+  record(op.invoke(), arg1, arg2, function);
+}
+
+inline void result(Operation op, uintptr_t ret) {
+  record(op.result(), ret, 0, nullptr);
+}
+
+template <typename F> inline void *address(F function) {
+  return reinterpret_cast<void *>(function);
+}
+
+int find_agent_range(dl_phdr_info *info, size_t, void *) {
+  auto self = reinterpret_cast<uintptr_t>(&find_agent_range);
+  uintptr_t begin = UINTPTR_MAX, end = 0;
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    auto &phdr = info->dlpi_phdr[i];
+    if (phdr.p_type != PT_LOAD) {
+      continue;
+    }
+    begin = std::min<uintptr_t>(begin, info->dlpi_addr + phdr.p_vaddr);
+    end = std::max<uintptr_t>(end, info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz);
+  }
+  if (self >= begin && self < end) {
+    agent_begin = begin;
+    agent_end = end;
+    return 1;
+  }
+  return 0;
+}
+
+__attribute__((constructor)) void agent_init() {
+  resolve();
+  in_hook = true;
+  dl_iterate_phdr(find_agent_range, nullptr);
+  // 预热 backtrace，首次调用会加载 libgcc_s 并分配内存
+  void *frames[4];
+  backtrace(frames, 4);
+  pthread_atfork(nullptr, nullptr, reset_tid);
+  if (auto name = getenv(Agent::RING_ENV); name != nullptr) {
+    ring.open(name);
+  }
+  in_hook = false;
+}
+
+} // namespace
+
+extern "C" {
+
+void *malloc(size_t size) {
+  if (!resolve()) {
+    return bootstrap_alloc(size);
+  }
+  invoke(op_type::MALLOC, size, 0, address(real.malloc));
+  void *ptr = real.malloc(size);
+  result(op_type::MALLOC, reinterpret_cast<uintptr_t>(ptr));
+  return ptr;
+}
+
+void free(void *ptr) {
+  if (ptr != nullptr && is_bootstrap(ptr)) {
+    return;
+  }
+  if (!resolve()) {
+    return;
+  }
+  invoke(op_type::FREE, reinterpret_cast<uintptr_t>(ptr), 0,
+         address(real.free));
+  real.free(ptr);
+}
+
+void *calloc(size_t count, size_t size) {
+  if (!resolve()) {
+    // 静态缓冲区本身为零初始化，且不会被复用
+    return bootstrap_alloc(count * size);
+  }
+  invoke(op_type::CALLOC, count, size, address(real.calloc));
+  void *ptr = real.calloc(count, size);
+  result(op_type::CALLOC, reinterpret_cast<uintptr_t>(ptr));
+  return ptr;
+}
+
+void *realloc(void *old, size_t size) {
+  if (!resolve()) {
+    // 正在解析时 old 只能来自静态缓冲区，新的内存位于其后，复制两者之间的部分
+    void *ptr = bootstrap_alloc(size);
+    if (ptr != nullptr && old != nullptr && is_bootstrap(old)) {
+      memcpy(ptr, old,
+             std::min<size_t>(size, static_cast<char *>(ptr) -
+                                        static_cast<char *>(old)));
+    }
+    return ptr;
+  }
+  if (old != nullptr && is_bootstrap(old)) {
+    // 静态缓冲区中的内存不知道原始大小，只能尽量复制
+    void *ptr = real.malloc(size);
+    if (ptr != nullptr) {
+      auto limit = bootstrap + BOOTSTRAP_SIZE - static_cast<char *>(old);
+      memcpy(ptr, old, std::min<size_t>(size, limit));
+    }
+    return ptr;
+  }
+  invoke(op_type::REALLOC, reinterpret_cast<uintptr_t>(old), size,
+         address(real.realloc));
+  void *ptr = real.realloc(old, size);
+  result(op_type::REALLOC, reinterpret_cast<uintptr_t>(ptr));
+  return ptr;
+}
+
+void *valloc(size_t size) {
+  if (!resolve()) {
+    return bootstrap_alloc(size, 4096);
+  }
+  invoke(op_type::VALLOC, size, 0, address(real.valloc));
+  void *ptr = real.valloc(size);
+  result(op_type::VALLOC, reinterpret_cast<uintptr_t>(ptr));
+  return ptr;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  if (!resolve()) {
+    *memptr = bootstrap_alloc(size, alignment);
+    return *memptr != nullptr ? 0 : ENOMEM;
+  }
+  // 与断点方式一致：参数为 size 与 alignment，返回值记录 &ptr
+  invoke(op_type::POSIX_MEMALIGN, size, alignment,
+         address(real.posix_memalign));
+  int ret = real.posix_memalign(memptr, alignment, size);
+  result(op_type::POSIX_MEMALIGN, reinterpret_cast<uintptr_t>(memptr));
+  return ret;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  if (!resolve()) {
+    return bootstrap_alloc(size, alignment);
+  }
+  invoke(op_type::ALIGNED_ALLOC, alignment, size, address(real.aligned_alloc));
+  void *ptr = real.aligned_alloc(alignment, size);
+  result(op_type::ALIGNED_ALLOC, reinterpret_cast<uintptr_t>(ptr));
+  return ptr;
+}
+
+} // extern "C"
+
+// 目标程序不使用 libstdc++ 时找不到原始的 new/delete，退回到 malloc/free
+void *operator new(size_t size) {
+  resolve();
+  if (real.new_ == nullptr) {
+    return malloc(size);
+  }
+  invoke(op_type::NEW, size, 0, address(real.new_));
+  void *ptr = real.new_(size);
+  result(op_type::NEW, reinterpret_cast<uintptr_t>(ptr));
+  return ptr;
+}
+
+void *operator new[](size_t size) {
+  resolve();
+  if (real.new_array == nullptr) {
+    return malloc(size);
+  }
+  invoke(op_type::NEW_ARRAY, size, 0, address(real.new_array));
+  void *ptr = real.new_array(size);
+  result(op_type::NEW_ARRAY, reinterpret_cast<uintptr_t>(ptr));
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  resolve();
+  if (real.delete_legacy == nullptr) {
+    return free(ptr);
+  }
+  invoke(op_type::DELETE_LEGACY, reinterpret_cast<uintptr_t>(ptr), 0,
+         address(real.delete_legacy));
+  real.delete_legacy(ptr);
+}
+
+void operator delete(void *ptr, size_t size) noexcept {
+  resolve();
+  if (real.delete_ == nullptr) {
+    return free(ptr);
+  }
+  invoke(op_type::DELETE, reinterpret_cast<uintptr_t>(ptr), size,
+         address(real.delete_));
+  real.delete_(ptr, size);
+}
+
+void operator delete[](void *ptr) noexcept {
+  resolve();
+  if (real.delete_array == nullptr) {
+    return free(ptr);
+  }
+  invoke(op_type::DELETE_ARRAY, reinterpret_cast<uintptr_t>(ptr), 0,
+         address(real.delete_array));
+  real.delete_array(ptr);
+}
+
+// libstdc++ 的 sized delete[] 调用 operator delete[](void *)，与断点方式一致记录为 delete_arr
+void operator delete[](void *ptr, size_t) noexcept { operator delete[](ptr); }
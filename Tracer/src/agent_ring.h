@@ -0,0 +1,233 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/types.h"
+#include "unistd.h"
+
+#include "operation.h"
+
+namespace Memory::Profile::Agent {
+
+// 传递共享内存名称的环境变量
+inline constexpr const char *RING_ENV = "MPROFILER_AGENT_SHM";
+// 共享内存头部的魔数与版本
+inline constexpr uint32_t RING_MAGIC = 0x4d505247; // "MPRG"
+inline constexpr uint32_t RING_VERSION = 5;
+// 记录中调用栈的最大深度，与 STACK_MAX（trace_writer.h）一致
+inline constexpr uint16_t RING_STACK_MAX = 100;
+
+// 环形缓冲区中的一条记录，调用栈紧跟在记录之后
+struct RingRecord {
+  std::atomic<uint64_t> sequence; // 槽位序号，用于生产者与消费者同步
+  uint8_t tag;                    // 操作类型 + 调用/返回
+  uint16_t stack_size;            // 调用栈元素个数
+  pid_t tid;                      // thread id
+  uint64_t args[2];               // 参数或返回值
+  int64_t timestamp;              // CLOCK_MONOTONIC 时间戳（纳秒）
+  uint64_t weight;                // 采样权重（估计的字节数），0 表示未采样
+
+  uint64_t *stack() { return reinterpret_cast<uint64_t *>(this + 1); }
+};
+
+// 共享内存头部，记录数组紧跟在头部之后
+struct alignas(64) RingHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t capacity;    // 记录个数，2 的幂
+  uint64_t record_size; // 单条记录（含调用栈）的字节数
+  uint64_t stack_depth; // 生产者采集调用栈的最大深度
+  uint64_t sample_bytes; // 按字节数采样调用栈的平均间隔，0 表示不采样
+  // 各操作采集调用栈的最大深度（--stack-policy），不超过 stack_depth
+  uint16_t op_stack_depth[Operation::op_type_count];
+  // 追踪的操作（--ops），按操作编号的位掩码，停止追踪后为 0
+  std::atomic<uint64_t> traced_ops;
+  alignas(64) std::atomic<uint64_t> head; // 生产者位置
+  alignas(64) std::atomic<uint64_t> tail; // 消费者位置
+  std::atomic<uint64_t> dropped;          // 缓冲区满而丢弃的记录数
+};
+static_assert(Operation::op_type_count <= 64);
+
+// 多生产者单消费者的有界环形缓冲区（基于槽位序号），位于共享内存中
+// 生产者为目标进程中的 agent，消费者为 TraceData 的处理线程
+class Ring {
+  RingHeader *header_ = nullptr;
+  size_t size_ = 0;
+
+  RingRecord *record(uint64_t pos) const {
+    auto base = reinterpret_cast<char *>(header_ + 1);
+    return reinterpret_cast<RingRecord *>(
+        base + (pos & (header_->capacity - 1)) * header_->record_size);
+  }
+
+public:
+  constexpr Ring() = default;
+
+  static uint64_t record_size(uint16_t stack_depth) {
+    return (sizeof(RingRecord) + stack_depth * sizeof(uint64_t) + 63) & ~63ULL;
+  }
+
+  // 创建并初始化共享内存（由 tracer 调用）
+  // op_stack_depth 为空时所有操作均使用 stack_depth
+  bool create(const char *name, uint64_t capacity, uint16_t stack_depth,
+              uint64_t sample_bytes = 0,
+              const uint16_t *op_stack_depth = nullptr,
+              uint64_t traced_ops = ~0ULL) {
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        stack_depth > RING_STACK_MAX) {
+      return false;
+    }
+    auto size = sizeof(RingHeader) + capacity * record_size(stack_depth);
+    // 清理同名的残留共享内存
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      return false;
+    }
+    if (ftruncate(fd, size) < 0) {
+      ::close(fd);
+      shm_unlink(name);
+      return false;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      shm_unlink(name);
+      return false;
+    }
+
+    header_ = static_cast<RingHeader *>(addr);
+    size_ = size;
+    header_->capacity = capacity;
+    header_->record_size = record_size(stack_depth);
+    header_->stack_depth = stack_depth;
+    header_->sample_bytes = sample_bytes;
+    header_->traced_ops.store(traced_ops, std::memory_order_relaxed);
+    for (size_t i = 0; i < Operation::op_type_count; i++) {
+      header_->op_stack_depth[i] =
+          op_stack_depth != nullptr
+              ? std::min(op_stack_depth[i], stack_depth)
+              : stack_depth;
+    }
+    header_->head.store(0, std::memory_order_relaxed);
+    header_->tail.store(0, std::memory_order_relaxed);
+    header_->dropped.store(0, std::memory_order_relaxed);
+    for (uint64_t i = 0; i < capacity; i++) {
+      record(i)->sequence.store(i, std::memory_order_relaxed);
+    }
+    header_->version = RING_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = RING_MAGIC;
+    return true;
+  }
+
+  // 映射已创建的共享内存（由 agent 调用）
+  bool open(const char *name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+      return false;
+    }
+    // 头部前 4 个字段：magic/version, capacity, record_size, stack_depth
+    uint64_t fields[4];
+    if (pread(fd, fields, sizeof(fields), 0) != sizeof(fields) ||
+        fields[0] != (RING_MAGIC | (uint64_t(RING_VERSION) << 32))) {
+      ::close(fd);
+      return false;
+    }
+    auto size = sizeof(RingHeader) + fields[1] * fields[2];
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      return false;
+    }
+    header_ = static_cast<RingHeader *>(addr);
+    size_ = size;
+    return true;
+  }
+
+  void close() {
+    if (header_ != nullptr) {
+      munmap(header_, size_);
+      header_ = nullptr;
+      size_ = 0;
+    }
+  }
+
+  bool ready() const { return header_ != nullptr; }
+  uint16_t stack_depth() const { return header_->stack_depth; }
+  uint16_t stack_depth(Operation op) const {
+    return header_->op_stack_depth[op.index()];
+  }
+  uint64_t sample_bytes() const { return header_->sample_bytes; }
+  bool traced(Operation op) const {
+    return (header_->traced_ops.load(std::memory_order_relaxed) >>
+            op.index()) &
+           1;
+  }
+  // 停止追踪，生产者不再写入（已写入的记录仍可读取）
+  void stop() { header_->traced_ops.store(0, std::memory_order_relaxed); }
+  uint64_t dropped() const { return header_->dropped.load(); }
+  // 等待消费者处理的记录数（包括尚未提交的槽位）
+  uint64_t pending() const {
+    return header_->head.load(std::memory_order_relaxed) -
+           header_->tail.load(std::memory_order_relaxed);
+  }
+  void drop() { header_->dropped.fetch_add(1, std::memory_order_relaxed); }
+
+  // 生产者申请一个槽位，缓冲区满时返回 nullptr
+  RingRecord *reserve(uint64_t &pos) {
+    pos = header_->head.load(std::memory_order_relaxed);
+    while (true) {
+      auto item = record(pos);
+      auto seq = item->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<int64_t>(seq - pos);
+      if (diff == 0) {
+        if (header_->head.compare_exchange_weak(pos, pos + 1,
+                                                std::memory_order_relaxed)) {
+          return item;
+        }
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = header_->head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // 生产者写完记录后发布
+  void commit(RingRecord *item, uint64_t pos) {
+    item->sequence.store(pos + 1, std::memory_order_release);
+  }
+
+  // 消费者获取下一条已发布的记录，没有时返回 nullptr
+  RingRecord *front() const {
+    auto pos = header_->tail.load(std::memory_order_relaxed);
+    auto item = record(pos);
+    if (item->sequence.load(std::memory_order_acquire) != pos + 1) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  // 消费者释放 front() 返回的记录
+  void pop() {
+    auto pos = header_->tail.load(std::memory_order_relaxed);
+    record(pos)->sequence.store(pos + header_->capacity,
+                                std::memory_order_release);
+    header_->tail.store(pos + 1, std::memory_order_relaxed);
+  }
+};
+
+} // namespace Memory::Profile::Agent
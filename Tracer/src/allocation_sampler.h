@@ -0,0 +1,84 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "operation.h"
+
+namespace Memory::Profile {
+
+// 分配操作申请的字节数（参数顺序与追踪信息一致），不是分配操作时返回 0
+inline uint64_t AllocationSize(Operation op, uintptr_t arg1, uintptr_t arg2) {
+  switch (op.type()) {
+  case op_type::MALLOC:
+  case op_type::VALLOC:
+  case op_type::POSIX_MEMALIGN:
+  case op_type::NEW:
+  case op_type::NEW_ARRAY:
+    return arg1;
+  case op_type::CALLOC:
+    return arg1 * arg2;
+  case op_type::REALLOC:
+  case op_type::ALIGNED_ALLOC:
+    return arg2;
+  default:
+    return 0;
+  }
+}
+
+// 是否为释放操作
+inline bool IsDeallocation(Operation op) {
+  return op == op_type::FREE || op == op_type::DELETE_LEGACY ||
+         op == op_type::DELETE || op == op_type::DELETE_ARRAY;
+}
+
+// 按字节数采样分配（与 tcmalloc 的堆采样相同）：
+// 采样间隔服从均值为 period 的指数分布，大小为 size 的分配被采样的概率为
+// 1 - exp(-size / period)，采样到的分配以 size / 概率 作为权重
+class AllocationSampler {
+  uint64_t state = 0;             // xorshift 随机数状态
+  int64_t bytes_until_sample = 0; // 距离下一次采样的字节数
+
+  // 下一个采样间隔
+  int64_t next_interval(uint64_t period) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    // 取 53 位作为 (0, 1] 之间的均匀分布
+    double u = double((state >> 11) + 1) / double(1ULL << 53);
+    return int64_t(-std::log(u) * double(period)) + 1;
+  }
+
+public:
+  constexpr AllocationSampler() = default;
+
+  bool ready() const { return state != 0; }
+  void seed(uint64_t value) {
+    state = value | 1;
+    bytes_until_sample = 0;
+  }
+
+  // 返回采样权重（估计的字节数），未采样时返回 0
+  uint64_t sample(uint64_t size, uint64_t period) {
+    if (bytes_until_sample <= 0) {
+      bytes_until_sample = next_interval(period);
+    }
+    bytes_until_sample -= int64_t(size);
+    if (bytes_until_sample > 0) {
+      return 0;
+    }
+    bytes_until_sample = next_interval(period);
+    double probability = -std::expm1(-double(size) / double(period));
+    return std::max<uint64_t>(uint64_t(double(size) / probability), size);
+  }
+};
+
+} // namespace Memory::Profile
@@ -0,0 +1,424 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "arena_sampler.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "elfutils/libdwfl.h"
+#include "sys/uio.h"
+
+namespace Memory::Profile {
+
+namespace {
+
+// glibc 2.27 及之后 64 位 malloc_state 的布局
+constexpr size_t STATE_SIZE = 2200;
+constexpr size_t FASTBINS_OFFSET = 16;
+constexpr size_t FASTBIN_COUNT = 10;
+constexpr size_t TOP_OFFSET = 96;
+constexpr size_t BINS_OFFSET = 112;
+constexpr size_t NEXT_OFFSET = 2160;
+constexpr size_t SYSTEM_MEM_OFFSET = 2184;
+constexpr size_t MAX_SYSTEM_MEM_OFFSET = 2192;
+// bin 1 为 unsorted，2~63 为 small bin，64~126 为 large bin
+constexpr size_t UNSORTED_BIN = 1;
+constexpr size_t LARGE_BIN_BEGIN = 64;
+constexpr size_t BIN_END = 127;
+// 块头：<Q prev_size><Q size><Q fd><Q bk>，size 的低 3 位为标志
+constexpr size_t CHUNK_HEADER_SIZE = 32;
+constexpr uint64_t SIZE_MASK = ~uint64_t(7);
+// tcache_perthread_struct 所在块的大小：counts 为 uint16_t[64]（2.30 起）或 char[64]
+constexpr size_t TCACHE_BINS = 64;
+constexpr uint64_t TCACHE_CHUNK_SIZE = 0x290;
+constexpr uint64_t TCACHE_CHUNK_SIZE_OLD = 0x250;
+// 找到 main_arena 所需的空 bin 个数（空 bin 的 fd == bk == bin 头）
+constexpr size_t SCAN_MIN_EMPTY_BINS = 16;
+// 搜索数据段时最多读取的字节数
+constexpr size_t SCAN_MAX_SIZE = 4 << 20;
+
+uint64_t load(const uint8_t *data, size_t offset) {
+  uint64_t value;
+  memcpy(&value, data + offset, sizeof(value));
+  return value;
+}
+
+// bin i 的头（bin_at）：把 bins[2(i-1)] 看作一个块的 fd 字段
+uintptr_t bin_head(uintptr_t arena, size_t bin) {
+  return arena + BINS_OFFSET + (bin - 1) * 16 - 16;
+}
+
+bool read_maps(pid_t pid, std::string &maps) {
+  std::ifstream file("/proc/" + std::to_string(pid) + "/maps");
+  if (!file.is_open()) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  maps = buffer.str();
+  return !maps.empty();
+}
+
+// /proc/pid/maps 中的一行
+struct MapLine {
+  uintptr_t start = 0;
+  uintptr_t end = 0;
+  std::string perms;
+  std::string path;
+};
+
+std::vector<MapLine> parse_maps(const std::string &maps) {
+  std::vector<MapLine> lines;
+  std::istringstream input(maps);
+  std::string line;
+  while (std::getline(input, line)) {
+    MapLine item;
+    char perms[8] = {0};
+    int path_pos = 0;
+    if (sscanf(line.c_str(), "%lx-%lx %7s %*s %*s %*s %n", &item.start,
+               &item.end, perms, &path_pos) < 3) {
+      continue;
+    }
+    item.perms = perms;
+    if (path_pos > 0 && size_t(path_pos) < line.size()) {
+      item.path = line.substr(path_pos);
+    }
+    lines.push_back(std::move(item));
+  }
+  return lines;
+}
+
+bool is_libc(const std::string &path) {
+  auto name = path.substr(path.rfind('/') + 1);
+  return name.starts_with("libc.so") || name.starts_with("libc-2.");
+}
+
+// glibc 2.32 起 fastbin 与 tcache 的 fd 经过 safe-linking 编码；
+// 2.34 之前 libc 文件名带版本号（libc-2.31.so），之后为 libc.so.6
+bool is_safe_linking(const std::string &path) {
+  auto name = path.substr(path.rfind('/') + 1);
+  int minor = 0;
+  if (sscanf(name.c_str(), "libc-2.%d", &minor) == 1) {
+    return minor >= 32;
+  }
+  return true;
+}
+
+} // namespace
+
+void ArenaSampler::reset(pid_t pid) {
+  target_pid = pid;
+  main_arena = 0;
+  main_tcache = 0;
+  symbol_searched = false;
+  failure_logged = false;
+  safe_linking = true;
+}
+
+bool ArenaSampler::read(uintptr_t addr, void *data, size_t size) const {
+  iovec local = {data, size};
+  iovec remote = {reinterpret_cast<void *>(addr), size};
+  return process_vm_readv(target_pid, &local, 1, &remote, 1, 0) ==
+         ssize_t(size);
+}
+
+bool ArenaSampler::locate() {
+  std::string maps;
+  if (!read_maps(target_pid, maps)) {
+    return false;
+  }
+  std::string libc_path;
+  for (auto &line : parse_maps(maps)) {
+    if (is_libc(line.path)) {
+      libc_path = line.path;
+      break;
+    }
+  }
+  if (libc_path.empty()) {
+    // 静态链接或使用其它分配器
+    return false;
+  }
+  safe_linking = is_safe_linking(libc_path);
+
+  uintptr_t address = 0;
+  if (!symbol_searched) {
+    symbol_searched = true;
+    address = find_symbol(libc_path);
+    if (address != 0 && !validate(address)) {
+      address = 0;
+    }
+  }
+  if (address == 0) {
+    address = scan_data(maps, libc_path);
+  }
+  if (address == 0) {
+    return false;
+  }
+  main_arena = address;
+  Log("[%d] glibc main_arena: %#lx (%s)", target_pid, main_arena,
+      libc_path.c_str());
+  return true;
+}
+
+uintptr_t ArenaSampler::find_symbol(const std::string &libc_path) const {
+  static const Dwfl_Callbacks callbacks = {.find_elf = dwfl_linux_proc_find_elf,
+                                           .find_debuginfo =
+                                               dwfl_standard_find_debuginfo};
+  Dwfl *dwfl = dwfl_begin(&callbacks);
+  if (dwfl == nullptr) {
+    return 0;
+  }
+  dwfl_report_begin(dwfl);
+  bool reported = dwfl_linux_proc_report(dwfl, target_pid) >= 0;
+  reported = dwfl_report_end(dwfl, nullptr, nullptr) >= 0 && reported;
+
+  struct Search {
+    const std::string *path;
+    uintptr_t address = 0;
+  } search = {&libc_path};
+  if (reported) {
+    dwfl_getmodules(
+        dwfl,
+        [](Dwfl_Module *module, void **, const char *name, Dwarf_Addr,
+           void *arg) -> int {
+          auto search = static_cast<Search *>(arg);
+          if (name == nullptr || *search->path != name) {
+            return DWARF_CB_OK;
+          }
+          // main_arena 是局部符号，只在 .symtab（调试符号）中
+          int count = dwfl_module_getsymtab(module);
+          for (int i = 0; i < count; i++) {
+            GElf_Sym sym;
+            GElf_Addr addr;
+            auto symbol = dwfl_module_getsym_info(module, i, &sym, &addr,
+                                                  nullptr, nullptr, nullptr);
+            if (symbol != nullptr && strcmp(symbol, "main_arena") == 0) {
+              search->address = addr;
+              break;
+            }
+          }
+          return DWARF_CB_ABORT;
+        },
+        &search, 0);
+  }
+  dwfl_end(dwfl);
+  return search.address;
+}
+
+uintptr_t ArenaSampler::scan_data(const std::string &maps,
+                                  const std::string &libc_path) const {
+  // main_arena 位于 libc 的可写数据段，或紧随其后的匿名映射（.bss）
+  std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+  uintptr_t libc_end = 0;
+  for (auto &line : parse_maps(maps)) {
+    if (line.path == libc_path) {
+      libc_end = line.end;
+      if (line.perms.starts_with("rw")) {
+        ranges.emplace_back(line.start, line.end);
+      }
+    } else if (line.start == libc_end && line.path.empty() &&
+               line.perms.starts_with("rw")) {
+      ranges.emplace_back(line.start, line.end);
+      libc_end = 0;
+    }
+  }
+
+  std::vector<uint8_t> data;
+  for (auto [start, end] : ranges) {
+    size_t size = std::min<size_t>(end - start, SCAN_MAX_SIZE);
+    data.resize(size);
+    if (size < STATE_SIZE || !read(start, data.data(), size)) {
+      continue;
+    }
+    for (size_t offset = 0; offset + STATE_SIZE <= size; offset += 8) {
+      auto state = data.data() + offset;
+      uintptr_t address = start + offset;
+      // malloc 初始化之后 top 不为空，system_mem 不超过峰值
+      auto top = load(state, TOP_OFFSET);
+      auto system_mem = load(state, SYSTEM_MEM_OFFSET);
+      if (top == 0 || top % 16 != 0 || load(state, NEXT_OFFSET) == 0 ||
+          system_mem == 0 ||
+          system_mem > load(state, MAX_SYSTEM_MEM_OFFSET)) {
+        continue;
+      }
+      size_t empty_bins = 0;
+      for (size_t bin = UNSORTED_BIN; bin < BIN_END; bin++) {
+        auto fd_offset = BINS_OFFSET + (bin - 1) * 16;
+        auto head = bin_head(address, bin);
+        empty_bins += load(state, fd_offset) == head &&
+                      load(state, fd_offset + 8) == head;
+      }
+      if (empty_bins >= SCAN_MIN_EMPTY_BINS && validate(address)) {
+        return address;
+      }
+    }
+  }
+  return 0;
+}
+
+bool ArenaSampler::validate(uintptr_t address) const {
+  // arena 链表（next）应在 MAX_ARENAS 个之内回到 main_arena
+  auto arena = address;
+  for (size_t i = 0; i < MAX_ARENAS; i++) {
+    uint64_t next = 0;
+    if (!read(arena + NEXT_OFFSET, &next, sizeof(next)) || next == 0) {
+      return false;
+    }
+    if (next == address) {
+      return true;
+    }
+    arena = next;
+  }
+  return false;
+}
+
+bool ArenaSampler::sample(std::vector<ArenaStats> &arenas) {
+  arenas.clear();
+  if (!ready() && !locate()) {
+    if (!failure_logged) {
+      Log("[%d] glibc main_arena not found yet, arena sampling deferred",
+          target_pid);
+      failure_logged = true;
+    }
+    return false;
+  }
+  std::vector<uint8_t> state(STATE_SIZE);
+  auto address = main_arena;
+  do {
+    if (!read(address, state.data(), state.size())) {
+      break;
+    }
+    auto &stats = arenas.emplace_back();
+    stats.address = address;
+    sample_arena(address, state.data(), stats);
+    address = load(state.data(), NEXT_OFFSET);
+  } while (address != main_arena && address != 0 &&
+           arenas.size() < MAX_ARENAS);
+  return !arenas.empty();
+}
+
+void ArenaSampler::sample_arena(uintptr_t address, const uint8_t *state,
+                                ArenaStats &stats) {
+  stats.system_mem = load(state, SYSTEM_MEM_OFFSET);
+  if (address == main_arena) {
+    stats.flags |= ArenaStats::MAIN_ARENA;
+  }
+  if (auto top = load(state, TOP_OFFSET); top != 0) {
+    uint64_t header[2];
+    if (read(top, header, sizeof(header))) {
+      stats.top_size = header[1] & SIZE_MASK;
+    }
+  }
+
+  // 目标线程同时在修改链表，读取到的状态可能不一致，按预算截断
+  size_t budget = MAX_CHUNKS;
+  bool complete = true;
+  for (size_t i = 0; i < FASTBIN_COUNT; i++) {
+    auto first = load(state, FASTBINS_OFFSET + i * 8);
+    complete &= walk_fastbin(first, stats.fastbin_bytes, stats, budget);
+  }
+  for (size_t bin = UNSORTED_BIN; bin < BIN_END; bin++) {
+    auto first = load(state, BINS_OFFSET + (bin - 1) * 16);
+    auto &bytes = bin == UNSORTED_BIN        ? stats.unsorted_bytes
+                  : bin < LARGE_BIN_BEGIN    ? stats.smallbin_bytes
+                                             : stats.largebin_bytes;
+    complete &= walk_bin(bin_head(address, bin), first, bytes, stats, budget);
+  }
+  if (!complete) {
+    stats.flags |= ArenaStats::TRUNCATED;
+  }
+
+  // tcache 是创建 arena 的线程分配的第一个块：main_arena 位于 brk 堆的开头，
+  // 线程 arena 紧随 malloc_state 之后
+  uintptr_t tcache = 0;
+  if (address == main_arena) {
+    if (main_tcache == 0) {
+      std::string maps;
+      if (read_maps(target_pid, maps)) {
+        for (auto &line : parse_maps(maps)) {
+          if (line.path == "[heap]") {
+            main_tcache = line.start;
+            break;
+          }
+        }
+      }
+    }
+    tcache = main_tcache;
+  } else {
+    tcache = (address + STATE_SIZE + 15) & ~uintptr_t(15);
+  }
+  if (tcache != 0) {
+    add_tcache(tcache, stats);
+  }
+}
+
+bool ArenaSampler::walk_bin(uintptr_t head, uintptr_t first, uint64_t &bytes,
+                            ArenaStats &stats, size_t &budget) const {
+  uint64_t chunk[CHUNK_HEADER_SIZE / 8];
+  for (uintptr_t addr = first; addr != head; addr = chunk[2]) {
+    if (budget == 0 || addr == 0 || addr % 16 != 0 ||
+        !read(addr, chunk, sizeof(chunk))) {
+      return false;
+    }
+    budget--;
+    auto size = chunk[1] & SIZE_MASK;
+    bytes += size;
+    stats.free_chunks++;
+    stats.largest_free = std::max(stats.largest_free, size);
+  }
+  return true;
+}
+
+bool ArenaSampler::walk_fastbin(uintptr_t first, uint64_t &bytes,
+                                ArenaStats &stats, size_t &budget) const {
+  uint64_t chunk[3];
+  for (uintptr_t addr = first; addr != 0;) {
+    if (budget == 0 || addr % 16 != 0 || !read(addr, chunk, sizeof(chunk))) {
+      return false;
+    }
+    budget--;
+    auto size = chunk[1] & SIZE_MASK;
+    bytes += size;
+    stats.free_chunks++;
+    stats.largest_free = std::max(stats.largest_free, size);
+    // safe-linking：fd 与其所在地址右移 12 位异或
+    addr = safe_linking ? chunk[2] ^ ((addr + 16) >> 12) : chunk[2];
+  }
+  return true;
+}
+
+void ArenaSampler::add_tcache(uintptr_t chunk, ArenaStats &stats) const {
+  uint8_t data[16 + TCACHE_BINS * sizeof(uint16_t)];
+  if (!read(chunk, data, sizeof(data))) {
+    return;
+  }
+  auto size = load(data, 8) & SIZE_MASK;
+  for (size_t i = 0; i < TCACHE_BINS; i++) {
+    uint64_t count = 0;
+    if (size == TCACHE_CHUNK_SIZE) {
+      uint16_t value;
+      memcpy(&value, data + 16 + i * sizeof(value), sizeof(value));
+      count = value;
+    } else if (size == TCACHE_CHUNK_SIZE_OLD) {
+      count = data[16 + i];
+    } else {
+      // 第一个块不是 tcache（如 tcache 被关闭）
+      return;
+    }
+    if (count > 0) {
+      uint64_t chunk_size = i * 16 + 32;
+      stats.tcache_bytes += count * chunk_size;
+      stats.largest_free = std::max(stats.largest_free, chunk_size);
+    }
+  }
+}
+
+} // namespace Memory::Profile
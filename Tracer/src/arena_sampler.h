@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sys/types.h"
+
+namespace Memory::Profile {
+
+// 单个 glibc arena 的空闲内存统计（字节），由 ArenaSampler 采样
+struct ArenaStats {
+  static constexpr uint8_t MAIN_ARENA = 0x01; // main_arena（brk 堆）
+  static constexpr uint8_t TRUNCATED = 0x02;  // 空闲链表过长或损坏，统计不完整
+
+  uint64_t address = 0;        // malloc_state 的地址
+  uint64_t system_mem = 0;     // 从系统获取的内存
+  uint64_t top_size = 0;       // top chunk 的大小
+  uint64_t largest_free = 0;   // 最大的空闲块（不含 top chunk）
+  uint64_t tcache_bytes = 0;   // 创建该 arena 的线程的 tcache 中的空闲字节数
+  uint64_t fastbin_bytes = 0;
+  uint64_t unsorted_bytes = 0;
+  uint64_t smallbin_bytes = 0;
+  uint64_t largebin_bytes = 0;
+  uint32_t free_chunks = 0;    // 各 bin 中的空闲块个数（不含 tcache）
+  uint8_t flags = 0;
+
+  uint64_t free_bytes() const {
+    return tcache_bytes + fastbin_bytes + unsorted_bytes + smallbin_bytes +
+           largebin_bytes;
+  }
+};
+
+// glibc 分配器状态的采样：用 process_vm_readv 读取目标进程的 main_arena 与线程
+// arena，遍历各 bin 的空闲链表与 top chunk，得到真实的空闲内存与碎片情况，
+// 不需要重放全部追踪信息
+//
+// main_arena 的地址优先从 libc 的符号表（dwfl，需要调试符号）中查找，
+// 找不到时在 libc 的数据段中按 malloc_state 的特征搜索。
+// 结构偏移对应 glibc 2.27 及之后的 64 位版本，tcache 只统计创建 arena 的线程
+// （位于 arena 的第一个内存块），其它线程的 tcache 无法定位
+class ArenaSampler {
+public:
+  // 最多遍历的 arena 个数与每个 arena 最多遍历的空闲块个数，限制采样的开销
+  static constexpr size_t MAX_ARENAS = 64;
+  static constexpr size_t MAX_CHUNKS = 4096;
+
+  void reset(pid_t pid);
+  // 是否已找到 main_arena
+  bool ready() const { return main_arena != 0; }
+  // 采样所有 arena，尚未找到 main_arena 时先查找（malloc 未初始化时失败）
+  bool sample(std::vector<ArenaStats> &arenas);
+
+private:
+  pid_t target_pid = 0;
+  uintptr_t main_arena = 0;
+  uintptr_t main_tcache = 0;    // brk 堆的开头
+  bool safe_linking = true;     // fastbin 的 fd 是否经过编码（glibc 2.32 起）
+  bool symbol_searched = false; // 只查找一次符号表
+  bool failure_logged = false;
+
+  bool locate();
+  // 在 libc 的符号表中查找 main_arena
+  uintptr_t find_symbol(const std::string &libc_path) const;
+  // 在 libc 的数据段中按 malloc_state 的特征查找 main_arena
+  uintptr_t scan_data(const std::string &maps,
+                      const std::string &libc_path) const;
+  // arena 链表是否回到 address
+  bool validate(uintptr_t address) const;
+
+  bool read(uintptr_t addr, void *data, size_t size) const;
+  void sample_arena(uintptr_t address, const uint8_t *state, ArenaStats &stats);
+  // 遍历一个 bin 的空闲链表，返回是否完整
+  bool walk_bin(uintptr_t head, uintptr_t first, uint64_t &bytes,
+                ArenaStats &stats, size_t &budget) const;
+  bool walk_fastbin(uintptr_t first, uint64_t &bytes, ArenaStats &stats,
+                    size_t &budget) const;
+  // 统计 chunk 处的 tcache_perthread_struct 中的空闲块
+  void add_tcache(uintptr_t chunk, ArenaStats &stats) const;
+};
+
+} // namespace Memory::Profile
@@ -6,14 +6,19 @@ LICENSE file in the root directory of this source tree.
 */
 
 #include "config.h"
+#include "metrics_server.h"
 #include "utils.h"
 
 #include "boost/format.hpp"
+#include "zstd.h"
 
+#include <algorithm>
+#include <cctype>
 #include <cstdlib> // for std::stoull
 #include <cstring>
 #include <filesystem>
 #include <stdexcept> // for exception handling
+#include <unistd.h>
 
 namespace Memory::Profile {
 
@@ -34,6 +39,66 @@ static constexpr std::string_view HELP_TEXT =
     --category             Specified save category. 
                            Preset: "/name/time" "/name-time" "time-name" "/name"
     --stack                Specified max stack trace depth, -1 means don't trace
+    --ops                  Specified traced operations and presets(default "all")
+                           Preset: "heap-only" "libc" "cpp" "syscalls"
+                           Example: "heap-only,mmap,munmap" "libc,cpp"
+    --stack-policy         Specified max stack trace depth of operations, 0 means don't trace
+                           Example: "free,delete,delete_arr,munmap=0" "brk,sbrk=8"
+    --stack-allow          Only get stack trace when the caller is in the modules
+                           Example: "malloc,new=libfoo.so,libbar.so" ("all" for all ops
+                           except syscalls)
+    --stack-deny           Don't get stack trace when the caller is in the modules
+                           Example: "malloc=libstdc++,libprotobuf"
+    --sample-bytes         Only get stack trace of sampled allocations, one sample
+                           per N allocated bytes on average(default 0: no sampling)
+    --unwind               Specified stack unwind mode: "libunwind" "dwarf-cached" "fp"
+                           fp: for targets built with -fno-omit-frame-pointer
+    --symbolize-threads    Specified number of symbolization threads(default 4)
+    --symcache             Specified directory of the persistent symbolization cache
+                           Entries are keyed by build-id and reused across runs
+    --raw-stacks           Save raw stack addresses(memory.raw) without symbolization
+                           Convert with: mprofiler-symbolize memory.raw
+    --format               Specified memory.profile format version(default 1)
+                           1: fixed-size records for older Analyzer versions
+    --compress-level       Specified zstd compression level(default 0: zstd default)
+    --compress-threads     Specified number of zstd compression threads(default 2)
+    --live-heap            Specified max number of tracked live allocations(default 1048576)
+                           Report live/growth/leak sites in liveheap.txt, 0 means disable
+    --live-heap-top        Specified number of sites listed in liveheap.txt(default 20)
+    --checkpoint-interval  Specified seconds between heap checkpoints in memory.profile
+                           (default 1, 0 means disable, requires --live-heap)
+    --checkpoint-events    Specified number of events between heap checkpoints(default 0)
+    --arena-interval       Specified seconds between glibc arena samples in memory.profile
+                           (default 0: disable), free bytes per bin class, top chunk
+                           and largest free chunk, read with process_vm_readv
+    --event-budget         Specified max bytes of buffered events waiting to be processed
+                           Example: "64M" "1G"(default 0: only per-thread buffers)
+    --overflow             Specified policy when the buffers are full: "block" "spill" "drop"
+                           block: delay the tracee(default), spill: write to memory.spill
+                           and catch up later, drop: record lost events in memory.profile
+    --metrics              Publish live metrics once per second on a unix socket
+                           (default /tmp/mprofiler-<pid>.sock)
+    --metrics-socket       Specified live metrics socket path(implies --metrics)
+    --watch                Print live metrics of a profiling session, then exit
+                           Example: "--watch 12345" "--watch /path/to/metrics.sock"
+    --duration             Specified seconds to trace, then restore breakpoints and detach
+                           (default 0: until exit; SIGINT/SIGTERM/SIGUSR1 also stop tracing)
+    --signal-window        Attach on SIGUSR1 and detach on the next SIGUSR1(requires --pid)
+    --step-mode            Specified breakpoint step mode: "pause" "displaced"
+                           displaced: step out of line without pausing threads
+    --return-capture       Specified return value capture: "breakpoint" "trampoline"
+                           trampoline: redirect returns to one trap page instead
+                           of a breakpoint at every call site
+    --engine               Specified tracer thread model: "threads" "loop"
+                           loop: one thread drives all tracees(waitpid(-1)), new
+                           threads are adopted without detaching(default
+                           --step-mode displaced)
+    --backend              Specified function tracing backend: "ptrace" "uprobe"
+                           uprobe: kernel uprobes via perf_event_open, threads
+                           don't stop at functions(use with --seccomp)
+    --seccomp              Only stop at traced syscalls(seccomp-bpf filter)
+    --agent                Inject in-process agent(LD_PRELOAD) for allocations
+    --agent-lib            Specified agent library path
     --no-print-log         Don't print logs
     --no-print-stack       Don't print stack trace
     --no-print-save        Don't print saved entries
@@ -41,6 +106,133 @@ static constexpr std::string_view HELP_TEXT =
     --extra key=value      Specified extra key-value pair(Saved in statinfo.txt)
   )";
 
+// 按逗号分割字符串
+static std::vector<std::string> split_list(const std::string &str) {
+  std::vector<std::string> items;
+  size_t pos = 0;
+  while (pos <= str.size()) {
+    auto end = std::min(str.find(',', pos), str.size());
+    if (end > pos) {
+      items.push_back(str.substr(pos, end - pos));
+    }
+    pos = end + 1;
+  }
+  return items;
+}
+
+// 解析字节数，可带 K/M/G 后缀（1024 进制）
+static uint64_t parse_size(const std::string &str) {
+  size_t pos = 0;
+  auto value = std::stoull(str, &pos);
+  if (pos + 1 == str.size()) {
+    switch (std::toupper(str[pos])) {
+    case 'G':
+      return value << 30;
+    case 'M':
+      return value << 20;
+    case 'K':
+      return value << 10;
+    }
+  }
+  if (pos != str.size()) {
+    throw std::invalid_argument(str);
+  }
+  return value;
+}
+
+// 系统调用在 syscall 指令处停止，栈顶不是返回地址，无法按调用者所在模块过滤
+static OperationSet syscall_operations() {
+  OperationSet ops;
+  for (auto op : {op_type::BRK, op_type::MMAP, op_type::MUNMAP, op_type::CLONE,
+                  op_type::CLONE3, op_type::FORK, op_type::VFORK,
+                  op_type::EXECVE}) {
+    ops.set(Operation(op).index());
+  }
+  return ops;
+}
+
+// 解析 "OP,OP...=VALUE" 形式的调用栈策略，对每个操作调用 apply，
+// "all" 不包括 unsupported 中的操作，显式指定这些操作时报错
+template <typename F>
+static bool parse_stack_policy(const std::string &arg, F &&apply,
+                               const OperationSet &unsupported = {}) {
+  auto pos = arg.find('=');
+  if (pos == std::string::npos || pos + 1 == arg.size()) {
+    Log("Invalid stack policy: %s", arg.c_str());
+    return false;
+  }
+  auto value = arg.substr(pos + 1);
+  for (auto &name : split_list(arg.substr(0, pos))) {
+    bool found = false;
+    for (size_t i = 0; i < Operation::op_type_count; i++) {
+      if (name == "all" && unsupported[i]) {
+        continue;
+      }
+      if (name == "all" || name == Operation::op_meta[i].name) {
+        if (unsupported[i]) {
+          Log("Unsupported operation in stack policy: %s", name.c_str());
+          return false;
+        }
+        if (!apply(i, value)) {
+          return false;
+        }
+        found = true;
+      }
+    }
+    if (!found) {
+      Log("Invalid operation in stack policy: %s", name.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+// --ops 的预设
+static const std::pair<std::string_view, std::string_view> OPERATION_PRESETS[] = {
+    {"heap-only", "malloc,free,calloc,realloc,brk,sbrk"},
+    {"libc", "malloc,free,calloc,realloc,valloc,posix_memalign,aligned_alloc"},
+    {"cpp", "new,new_arr,delete_legacy,delete,delete_arr"},
+    {"syscalls", "brk,mmap,munmap,clone,clone3,fork,vfork,execve"},
+};
+
+// 解析 "OP,PRESET..." 形式的操作列表，"all" 表示全部操作
+static bool parse_operations(const std::string &arg, OperationSet &ops) {
+  ops.reset();
+  for (auto &name : split_list(arg)) {
+    if (name == "all") {
+      ops.set();
+      continue;
+    }
+    auto preset = std::find_if(
+        std::begin(OPERATION_PRESETS), std::end(OPERATION_PRESETS),
+        [&name](auto &item) { return item.first == name; });
+    if (preset != std::end(OPERATION_PRESETS)) {
+      OperationSet expanded;
+      if (!parse_operations(std::string(preset->second), expanded)) {
+        return false;
+      }
+      ops |= expanded;
+      continue;
+    }
+    bool found = false;
+    for (size_t i = 1; i < Operation::op_type_count; i++) {
+      if (name == Operation::op_meta[i].name) {
+        ops.set(i);
+        found = true;
+      }
+    }
+    if (!found) {
+      Log("Invalid operation in ops: %s", name.c_str());
+      return false;
+    }
+  }
+  if (ops.none()) {
+    Log("No operation selected: %s", arg.c_str());
+    return false;
+  }
+  return true;
+}
+
 bool Config::parseArgs(int argc, char *argv[]) {
   //  如果未提供有效的命令或参数，显示帮助信息
   if (argc <= 1) {
@@ -53,6 +245,7 @@ bool Config::parseArgs(int argc, char *argv[]) {
   }
   argc_ = argc;
   argv_ = argv;
+  bool step_mode_set = false; // 是否指定了 --step-mode
 
   for (int i = 1; i < argc; ++i) {
     std::string arg = argv[i];
@@ -92,6 +285,286 @@ bool Config::parseArgs(int argc, char *argv[]) {
       maxStackTraceDepth = std::stoi(argv[++i]);
       isGetStackTrace = maxStackTraceDepth >= 0;
     }
+    // 设置追踪的操作的命令
+    else if ((arg == "--ops") && i + 1 < argc) {
+      if (!parse_operations(argv[++i], tracedOps)) {
+        return false;
+      }
+    }
+    // 设置各操作调用栈深度的命令
+    else if ((arg == "--stack-policy") && i + 1 < argc) {
+      bool ok = parse_stack_policy(
+          argv[++i], [this](size_t op, const std::string &value) -> bool {
+            try {
+              stackPolicy[op].maxDepth = std::stoi(value);
+            } catch (const std::exception &e) {
+              Log("Invalid stack depth: %s", value.c_str());
+              return false;
+            }
+            return true;
+          });
+      if (!ok) {
+        return false;
+      }
+    }
+    // 设置只在调用者位于指定模块时采集调用栈的命令
+    else if ((arg == "--stack-allow") && i + 1 < argc) {
+      if (!parse_stack_policy(argv[++i], [this](size_t op,
+                                                const std::string &value) {
+            auto modules = split_list(value);
+            auto &list = stackPolicy[op].allowModules;
+            list.insert(list.end(), modules.begin(), modules.end());
+            return true;
+          }, syscall_operations())) {
+        return false;
+      }
+    }
+    // 设置调用者位于指定模块时不采集调用栈的命令
+    else if ((arg == "--stack-deny") && i + 1 < argc) {
+      if (!parse_stack_policy(argv[++i], [this](size_t op,
+                                                const std::string &value) {
+            auto modules = split_list(value);
+            auto &list = stackPolicy[op].denyModules;
+            list.insert(list.end(), modules.begin(), modules.end());
+            return true;
+          }, syscall_operations())) {
+        return false;
+      }
+    }
+    // 设置按字节数采样调用栈的命令
+    else if ((arg == "--sample-bytes") && i + 1 < argc) {
+      try {
+        sampleBytes = std::stoull(argv[++i]);
+      } catch (const std::exception &e) {
+        Log("Invalid sample bytes: %s", argv[i]);
+        return false;
+      }
+    }
+    // 设置符号解析线程数的命令
+    else if ((arg == "--symbolize-threads") && i + 1 < argc) {
+      symbolizeThreads = std::stoi(argv[++i]);
+      if (symbolizeThreads < 1) {
+        Log("Invalid symbolize threads: %d", symbolizeThreads);
+        return false;
+      }
+    }
+    // 设置持久化符号解析缓存目录的命令
+    else if ((arg == "--symcache") && i + 1 < argc) {
+      symcache_dir = argv[++i];
+    }
+    // 保存原始地址，离线符号化的命令
+    else if (arg == "--raw-stacks") {
+      isRawStacks = true;
+    }
+    // 设置输出格式版本的命令
+    else if ((arg == "--format") && i + 1 < argc) {
+      formatVersion = std::stoi(argv[++i]);
+      if (formatVersion < 1 || formatVersion > 2) {
+        Log("Invalid format version: %d", formatVersion);
+        return false;
+      }
+    }
+    // 设置压缩等级的命令
+    else if ((arg == "--compress-level") && i + 1 < argc) {
+      compressLevel = std::stoi(argv[++i]);
+      if (compressLevel < ZSTD_minCLevel() || compressLevel > ZSTD_maxCLevel()) {
+        Log("Invalid compress level: %d", compressLevel);
+        return false;
+      }
+    }
+    // 设置压缩线程数的命令
+    else if ((arg == "--compress-threads") && i + 1 < argc) {
+      compressThreads = std::stoi(argv[++i]);
+      if (compressThreads < 0) {
+        Log("Invalid compress threads: %d", compressThreads);
+        return false;
+      }
+    }
+    // 设置存活分配表最多记录的分配个数的命令
+    else if ((arg == "--live-heap") && i + 1 < argc) {
+      try {
+        liveHeapEntries = std::stoull(argv[++i]);
+      } catch (const std::exception &e) {
+        Log("Invalid live heap entries: %s", argv[i]);
+        return false;
+      }
+    }
+    // 设置存活分配报告中列出的调用点个数的命令
+    else if ((arg == "--live-heap-top") && i + 1 < argc) {
+      liveHeapTop = std::stoi(argv[++i]);
+      if (liveHeapTop < 1) {
+        Log("Invalid live heap top: %d", liveHeapTop);
+        return false;
+      }
+    }
+    // 设置检查点时间间隔的命令
+    else if ((arg == "--checkpoint-interval") && i + 1 < argc) {
+      try {
+        checkpointInterval = std::stod(argv[++i]);
+      } catch (const std::exception &e) {
+        checkpointInterval = -1;
+      }
+      if (checkpointInterval < 0) {
+        Log("Invalid checkpoint interval: %s", argv[i]);
+        return false;
+      }
+    }
+    // 设置检查点追踪信息个数间隔的命令
+    else if ((arg == "--checkpoint-events") && i + 1 < argc) {
+      try {
+        checkpointEvents = std::stoull(argv[++i]);
+      } catch (const std::exception &e) {
+        Log("Invalid checkpoint events: %s", argv[i]);
+        return false;
+      }
+    }
+    // 设置 glibc arena 采样时间间隔的命令
+    else if ((arg == "--arena-interval") && i + 1 < argc) {
+      try {
+        arenaInterval = std::stod(argv[++i]);
+      } catch (const std::exception &e) {
+        arenaInterval = -1;
+      }
+      if (arenaInterval < 0) {
+        Log("Invalid arena interval: %s", argv[i]);
+        return false;
+      }
+    }
+    // 设置缓冲的追踪信息内存预算的命令
+    else if ((arg == "--event-budget") && i + 1 < argc) {
+      try {
+        eventBudget = parse_size(argv[++i]);
+      } catch (const std::exception &e) {
+        Log("Invalid event budget: %s", argv[i]);
+        return false;
+      }
+    }
+    // 设置超出预算时的处理方式的命令
+    else if ((arg == "--overflow") && i + 1 < argc) {
+      std::string mode = argv[++i];
+      if (mode == "block") {
+        overflowPolicy = OverflowPolicy::BLOCK;
+      } else if (mode == "spill") {
+        overflowPolicy = OverflowPolicy::SPILL;
+      } else if (mode == "drop") {
+        overflowPolicy = OverflowPolicy::DROP;
+      } else {
+        Log("Invalid overflow policy: %s", mode.c_str());
+        return false;
+      }
+    }
+    // 发布实时指标的命令
+    else if (arg == "--metrics") {
+      isMetrics = true;
+    }
+    // 设置实时指标套接字路径的命令
+    else if ((arg == "--metrics-socket") && i + 1 < argc) {
+      isMetrics = true;
+      metrics_socket_path = argv[++i];
+    }
+    // 读取实时指标的命令，不启动追踪
+    else if ((arg == "--watch") && i + 1 < argc) {
+      watch_target = argv[++i];
+      // 参数为数字时按 pid 得到默认的套接字路径
+      if (!watch_target.empty() &&
+          std::all_of(watch_target.begin(), watch_target.end(), ::isdigit)) {
+        try {
+          watch_target = MetricsServer::DefaultPath(std::stoi(watch_target));
+        } catch (const std::exception &e) {
+          Log("Invalid watch pid: %s", argv[i]);
+          return false;
+        }
+      }
+      return true;
+    }
+    // 设置追踪时长的命令
+    else if ((arg == "--duration") && i + 1 < argc) {
+      try {
+        traceDuration = std::stod(argv[++i]);
+      } catch (const std::exception &e) {
+        Log("Invalid duration: %s", argv[i]);
+        return false;
+      }
+    }
+    // 由信号开始和结束追踪的命令
+    else if (arg == "--signal-window") {
+      isSignalWindow = true;
+    }
+    // 设置调用栈展开方式的命令
+    else if ((arg == "--unwind") && i + 1 < argc) {
+      std::string mode = argv[++i];
+      if (mode == "libunwind") {
+        unwindMode = UnwindMode::LIBUNWIND;
+      } else if (mode == "dwarf-cached") {
+        unwindMode = UnwindMode::DWARF_CACHED;
+      } else if (mode == "fp") {
+        unwindMode = UnwindMode::FP;
+      } else {
+        Log("Invalid unwind mode: %s", mode.c_str());
+        return false;
+      }
+    }
+    // 设置断点单步方式的命令
+    else if ((arg == "--step-mode") && i + 1 < argc) {
+      std::string mode = argv[++i];
+      if (mode == "pause") {
+        stepMode = StepMode::PAUSE;
+      } else if (mode == "displaced") {
+        stepMode = StepMode::DISPLACED;
+      } else {
+        Log("Invalid step mode: %s", mode.c_str());
+        return false;
+      }
+      step_mode_set = true;
+    }
+    // 设置函数返回值采集方式的命令
+    else if ((arg == "--return-capture") && i + 1 < argc) {
+      std::string mode = argv[++i];
+      if (mode == "breakpoint") {
+        returnCapture = ReturnCapture::BREAKPOINT;
+      } else if (mode == "trampoline") {
+        returnCapture = ReturnCapture::TRAMPOLINE;
+      } else {
+        Log("Invalid return capture mode: %s", mode.c_str());
+        return false;
+      }
+    }
+    // 设置追踪线程模型的命令
+    else if ((arg == "--engine") && i + 1 < argc) {
+      std::string mode = argv[++i];
+      if (mode == "threads") {
+        engine = TraceEngine::THREADS;
+      } else if (mode == "loop") {
+        engine = TraceEngine::LOOP;
+      } else {
+        Log("Invalid engine: %s", mode.c_str());
+        return false;
+      }
+    }
+    // 设置函数调用采集方式的命令
+    else if ((arg == "--backend") && i + 1 < argc) {
+      std::string mode = argv[++i];
+      if (mode == "ptrace") {
+        backend = TraceBackend::PTRACE;
+      } else if (mode == "uprobe") {
+        backend = TraceBackend::UPROBE;
+      } else {
+        Log("Invalid backend: %s", mode.c_str());
+        return false;
+      }
+    }
+    // 设置使用 seccomp 过滤器的命令
+    else if (arg == "--seccomp") {
+      isSeccomp = true;
+    }
+    // 设置使用 agent 的命令
+    else if (arg == "--agent") {
+      isAgent = true;
+    }
+    // 设置 agent 动态库路径的命令
+    else if ((arg == "--agent-lib") && i + 1 < argc) {
+      agent_library_path = argv[++i];
+    }
     // 设置不跟踪信息的命令
     else if ((arg == "--no-trace")) {
       isGetTraceData = false;
@@ -191,6 +664,55 @@ bool Config::parseArgs(int argc, char *argv[]) {
     }
   }
 
+  if (isSeccomp && pid_ != 0) {
+    Log("ERROR: --seccomp can't be used with --pid");
+    return false;
+  }
+  // 分离后 seccomp 过滤器仍然有效，被过滤的系统调用会失败
+  if (isSeccomp && traceDuration > 0) {
+    Log("ERROR: --seccomp can't be used with --duration");
+    return false;
+  }
+  // agent 拦截的函数不设置断点，与 uprobe 同时使用时 sbrk 以外的函数都不采集
+  if (isAgent && backend == TraceBackend::UPROBE) {
+    Log("ERROR: --agent can't be used with --backend uprobe");
+    return false;
+  }
+  // loop 模式下原地单步需要逐个发送 SIGSTOP 暂停其它线程，默认离线单步
+  if (engine == TraceEngine::LOOP && backend == TraceBackend::PTRACE &&
+      stepMode == StepMode::PAUSE && !step_mode_set) {
+    stepMode = StepMode::DISPLACED;
+  }
+  if (isSignalWindow && pid_ == 0) {
+    Log("ERROR: --signal-window requires --pid");
+    return false;
+  }
+  if (pid_ != 0 && executable_name.empty()) {
+    // 附加时使用目标进程的可执行文件名
+    std::error_code ec;
+    executable_name =
+        std::filesystem::read_symlink("/proc/" + std::to_string(pid_) + "/exe",
+                                      ec)
+            .filename();
+  }
+  if (isAgent) {
+    if (pid_ != 0) {
+      Log("ERROR: --agent can't be used with --pid");
+      return false;
+    }
+    if (agent_library_path.empty()) {
+      agent_library_path =
+          std::filesystem::read_symlink("/proc/self/exe").parent_path() /
+          "libmprofiler_agent.so";
+    }
+    agent_library_path = std::filesystem::absolute(agent_library_path);
+    if (!std::filesystem::exists(agent_library_path)) {
+      Log("ERROR: agent library not found: %s", agent_library_path.c_str());
+      return false;
+    }
+    agent_ring_name = "/mprofiler-" + std::to_string(getpid());
+  }
+
   return true;
 }
 void Config::resolvePresetCategory() {
@@ -217,8 +739,11 @@ bool Config::init() {
   std::filesystem::path parent_directory = parentDir();
   std::filesystem::create_directories(parent_directory);
 
-  save_binary_path = parent_directory / save_binary_filename;
+  save_binary_path = parent_directory /
+                     (isRawStacks ? save_raw_filename : save_binary_filename);
   stat_info_path = parent_directory / stat_info_filename;
+  live_heap_path = parent_directory / live_heap_filename;
+  spill_path = parent_directory / spill_filename;
 
   printf("Executing command: ");
   for (int i = 0; i < command_.size(); i++) {
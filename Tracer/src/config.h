@@ -6,12 +6,70 @@ LICENSE file in the root directory of this source tree.
 */
 
 #pragma once
+#include <array>
+#include <bitset>
 #include <chrono>
 #include <cstdint>
 #include <string>
 #include <vector>
 
+#include "operation.h"
+
 namespace Memory::Profile {
+// 断点单步方式
+enum class StepMode {
+  PAUSE,     // 暂停其它线程，恢复原始指令后原地单步
+  DISPLACED, // 断点保持不变，在 scratch 页中离线执行原始指令
+};
+
+// 函数返回值的采集方式
+enum class ReturnCapture {
+  BREAKPOINT, // 在每个调用点的返回地址设置断点
+  TRAMPOLINE, // 入口处把返回地址改写为目标进程中的跳板页，断点数只与函数个数有关
+};
+
+// 追踪线程模型
+enum class TraceEngine {
+  THREADS, // 每个被跟踪的线程一个追踪线程，新线程分离后由新的追踪线程重新附加
+  LOOP,    // 单个线程通过 waitpid(-1) 跟踪所有线程，新线程直接接管
+};
+
+// 函数调用的采集方式
+enum class TraceBackend {
+  PTRACE, // 在函数入口和返回处设置断点，由追踪线程处理陷入
+  UPROBE, // 内核 uprobe/uretprobe 采样（perf_event_open），线程不会停止
+};
+
+// 缓冲的追踪信息超出预算（或线程缓冲区已满）时的处理方式
+enum class OverflowPolicy {
+  BLOCK, // 等待处理线程释放空间，被跟踪的线程暂不恢复执行
+  SPILL, // 写入临时文件，处理线程赶上后按原顺序读回
+  DROP,  // 丢弃，并在 memory.profile 中写入丢弃的统计
+};
+
+// 调用栈展开方式
+enum class UnwindMode {
+  LIBUNWIND,    // libunwind 远程展开，逐字读取目标内存
+  DWARF_CACHED, // 复制栈内存后基于缓存的 .eh_frame 信息本地展开
+  FP,           // 复制栈内存后沿帧指针链展开
+};
+
+// 单个操作的调用栈采集策略
+struct StackPolicy {
+  // 最大深度，0 表示不采集，-1 表示使用 --stack 的深度
+  int maxDepth = -1;
+  // 调用者（栈顶的返回地址）所在模块的路径包含其中之一时才采集，为空时不限制
+  std::vector<std::string> allowModules;
+  // 调用者所在模块的路径包含其中之一时不采集
+  std::vector<std::string> denyModules;
+
+  bool hasModuleFilter() const {
+    return !allowModules.empty() || !denyModules.empty();
+  }
+};
+using StackPolicyTable = std::array<StackPolicy, Operation::op_type_count>;
+using OperationSet = std::bitset<Operation::op_type_count>;
+
 using TimePoint = std::chrono::steady_clock::time_point; // 时间点
 class Config {
   uint64_t pid_ = 0;
@@ -27,25 +85,85 @@ public:
   bool parseArgs(int argc, char *argv[]);
   bool init();
 
-// 是否检测特定调用
-#define TRACE_BRK
-#define TRACE_SBRK
-#define TRACE_MMAP
-#define TRACE_MUNMAP
-#define TRACE_FORK
-#define TRACE_EXECVE
-#define TRACE_FREE
-#define TRACE_MALLOC
-#define TRACE_CALLOC
-#define TRACE_REALLOC
-#define TRACE_VALLOC
-#define TRACE_MALLOCCALLED
-#define TRACE_CPP
+  // 追踪的操作（--ops），未选择的函数不设置断点，系统调用不分发
+  OperationSet tracedOps = OperationSet().set();
 
   // 是否提取调用栈信息
   bool isGetStackTrace = true;
   // 遍历调用栈时最大查找深度
   int maxStackTraceDepth = 100;
+  // 按分配字节数采样调用栈的平均间隔，0 表示采集所有调用栈
+  uint64_t sampleBytes = 0;
+  // 各操作的调用栈采集策略
+  StackPolicyTable stackPolicy;
+
+  // 符号解析线程数
+  int symbolizeThreads = 4;
+  // 持久化符号解析缓存的目录，为空时不使用
+  std::string symcache_dir = "";
+
+  // 是否保存原始地址及模块映射快照，由 mprofiler-symbolize 离线符号化
+  bool isRawStacks = false;
+  // memory.profile 的格式版本，1 为定长记录，2 为变长记录（文件更小）
+  int formatVersion = 1;
+
+  // zstd 压缩等级，0 表示默认等级
+  int compressLevel = 0;
+  // zstd 压缩线程数，0 表示只在写入线程中压缩
+  int compressThreads = 2;
+
+  // 存活分配表最多记录的分配个数，0 表示不维护存活分配表
+  uint64_t liveHeapEntries = 1 << 20;
+  // 存活分配报告中列出的调用点个数
+  int liveHeapTop = 20;
+  // 在 memory.profile 中写入检查点的时间间隔（秒），0 表示不按时间写入
+  double checkpointInterval = 1;
+  // 写入检查点的追踪信息个数间隔，0 表示不按个数写入
+  uint64_t checkpointEvents = 0;
+  // 在 memory.profile 中写入 glibc arena 采样的时间间隔（秒），0 表示不采样
+  double arenaInterval = 0;
+
+  // 是否在 Unix 域套接字上发布实时指标
+  bool isMetrics = false;
+  // 实时指标套接字路径，为空时使用 /tmp/mprofiler-<目标 pid>.sock
+  std::string metrics_socket_path = "";
+  // --watch 的套接字路径（参数为 pid 时已换成默认路径），非空时只作为客户端读取实时指标
+  std::string watch_target = "";
+
+  // 缓冲的追踪信息的内存预算（字节），0 表示只受各线程缓冲区容量限制
+  uint64_t eventBudget = 0;
+  // 超出预算时的处理方式
+  OverflowPolicy overflowPolicy = OverflowPolicy::BLOCK;
+
+  // 调用栈展开方式
+  UnwindMode unwindMode = UnwindMode::LIBUNWIND;
+
+  // 断点单步方式
+  StepMode stepMode = StepMode::PAUSE;
+
+  // 函数返回值的采集方式
+  ReturnCapture returnCapture = ReturnCapture::BREAKPOINT;
+
+  // 追踪线程模型
+  TraceEngine engine = TraceEngine::THREADS;
+
+  // 函数调用的采集方式
+  TraceBackend backend = TraceBackend::PTRACE;
+
+  // 追踪时长（秒），到达后恢复断点并分离目标进程，0 表示不限制
+  double traceDuration = 0;
+  // 收到 SIGUSR1 后才附加目标进程，再次收到时分离（仅 --pid）
+  bool isSignalWindow = false;
+
+  // 是否使用 seccomp 过滤器，只在被跟踪的系统调用处停止（仅启动目标程序时可用）
+  bool isSeccomp = false;
+
+  // 是否通过 LD_PRELOAD 注入 agent 采集分配函数（仅启动目标程序时可用）
+  bool isAgent = false;
+  // agent 动态库路径，默认与 mprofiler 位于同一目录
+  std::string agent_library_path = "";
+  // agent 共享内存名称
+  std::string agent_ring_name = "";
 
   // 是否打印invoke或result的Log记录
   bool isPrintInvokeResultLog = true;
@@ -60,13 +178,18 @@ public:
   bool isGetTraceData = true;  // TODO
   bool isSaveTraceData = true; // TODO
   const std::string save_binary_filename = "memory.profile";
+  const std::string save_raw_filename = "memory.raw";
   const std::string stat_info_filename = "statinfo.txt";
+  const std::string live_heap_filename = "liveheap.txt";
+  const std::string spill_filename = "memory.spill";
 
   std::string save_directory = "tracedata";
   std::string save_category = "";
 
   std::string save_binary_path = save_directory + save_binary_filename;
   std::string stat_info_path = save_directory + stat_info_filename;
+  std::string live_heap_path = save_directory + live_heap_filename;
+  std::string spill_path = save_directory + spill_filename;
 
   // 额外记录的键值对
   std::vector<std::pair<std::string, std::string>> extrakeys;
@@ -74,6 +197,8 @@ public:
   int argc() const { return argc_; }
   char **argv() const { return argv_; }
   uint64_t pid() const { return pid_; }
+  // 是否由超时或信号结束追踪并分离目标进程（--pid 时总是可以由信号结束）
+  bool hasTraceWindow() const { return pid_ != 0 || traceDuration > 0; }
   const std::vector<char *> &command() const { return command_; }
   const TimePoint &startTime() const { return startTime_; }
   const std::string parentDir() const;
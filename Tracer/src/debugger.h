@@ -10,6 +10,10 @@ LICENSE file in the root directory of this source tree.
 #include <cstdio>   // 包含 C 标准输入输出函数，如 snprintf
 #include <cstdlib>  // 包含 atoi 函数
 #include <cstring>  // 包含字符串操作函数，如 strlen, strcmp
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
 #include <dirent.h> // 包含目录操作函数
 #include <fcntl.h>
 #include <filesystem>
@@ -17,65 +21,243 @@ LICENSE file in the root directory of this source tree.
 #include <mutex>
 #include <shared_mutex>
 #include <thread>
+#include <utility>
 #include <vector>
 
+#include "sys/mman.h"    // 提供 mmap 相关的定义
 #include "sys/ptrace.h"  // 提供 ptrace 系统调用的定义
 #include "sys/syscall.h" // 提供系统调用的相关定义
+#include "sys/uio.h"     // 提供 process_vm_readv 的定义
 #include "sys/user.h" // 定义了 struct user_regs_struct，用于保存寄存器的值
 #include "sys/wait.h" // 提供 wait 和相关宏的定义
+#include "unistd.h"
 
+#include "config.h"
+#include "instruction_decoder.h"
+#include "lookup_table.h"
+#include "self_stats.h"
 #include "target_loader.h"
+#include "uprobe_tracer.h"
 #include "utils.h"
 
 namespace Memory::Profile {
 
 template <class T, class S> class Debugger {
+public:
+  // 调试器配置
+  struct DebugConfig {
+    StepMode stepMode = StepMode::PAUSE;
+    ReturnCapture returnCapture = ReturnCapture::BREAKPOINT;
+    // 目标程序已安装 seccomp 过滤器，只在被跟踪的系统调用处停止
+    bool isSeccomp = false;
+    // 附加到已运行的进程，需要附加所有已有线程并立即设置断点
+    bool isAttach = false;
+    TraceEngine engine = TraceEngine::THREADS;
+    // uprobe 模式下函数调用由内核采样，ptrace 只处理系统调用和线程
+    TraceBackend backend = TraceBackend::PTRACE;
+    // uprobe 采样的栈内存大小，0 表示不采样（不采集调用栈）
+    size_t uprobeStackSize = 0;
+    // 调用栈深度大于 0、需要 uprobe 入口采样栈内存的操作
+    OperationSet uprobeStackOps;
+  } debug_config;
+
+private:
   static constexpr size_t INVALID_INDEX = UINT64_MAX;
+  // 批量读取断点原始数据时一次 process_vm_readv 的地址个数（UIO_MAXIOV）
+  static constexpr size_t BREAKPOINT_BATCH = 1024;
+
+  // 离线单步使用的 scratch 区域，每个线程占用一页，每页分为若干指令槽
+  static constexpr size_t SCRATCH_PAGE_SIZE = 4096;
+  static constexpr size_t SCRATCH_PAGES = 1024;
+  static constexpr size_t SCRATCH_SLOT_SIZE = 16;
+  static constexpr size_t SCRATCH_SLOTS = SCRATCH_PAGE_SIZE / SCRATCH_SLOT_SIZE;
 
   bool has_loading_libraries = false;
   std::atomic_flag doing_setup = false;
   std::mutex libraries_mutex;
   std::set<std::string> loading_libraries;
   std::set<std::string> loaded_libraries;
+  // 首次设置断点时完整解析 /proc/pid/maps，之后只处理 mmap 映射的库
+  bool maps_scanned = false;
+  std::vector<std::pair<std::string, uintptr_t>> mapped_libraries;
 
-  mutable std::shared_mutex functions_mutex;
+  // 断点与函数表由写入方在锁内修改，每次陷入时的查找使用无锁发布的副本：
+  // 函数表在加载库后重建为有序数组，断点地址集合只增不减
+  std::mutex functions_mutex;
   mutable std::shared_mutex breakpoints_mutex;
   std::map<uintptr_t, size_t> functions;
   std::map<uintptr_t, uint64_t> breakpoints;
+  FlatTable<size_t> function_table;
+  AddressSet breakpoint_set;
   uintptr_t breakpoint_min = 0;
   uintptr_t breakpoint_max = 0;
 
+  // uprobe 采样只在处理线程中按时间顺序处理，每个目标线程一个 arena，
+  // 并记录尚未返回的带返回探针的调用，用于恢复被 uretprobe 改写的返回地址
+  struct UprobeThread {
+    S arena;
+    std::vector<uintptr_t> return_sps; // 调用入口处的 rsp
+    std::vector<uintptr_t> returns;    // 原始返回地址
+  };
+  UprobeTracer uprobes;
+  std::map<pid_t, UprobeThread> uprobe_threads;
+  bool uprobe_trampoline_mapped = false;
+  // 已退出的线程及其退出时间（CLOCK_MONOTONIC），之前的采样处理完成后删除其状态
+  std::mutex uprobe_exited_mutex;
+  std::vector<std::pair<pid_t, uint64_t>> uprobe_exited;
+
+  // 离线执行的原始指令
+  struct DisplacedInstruction {
+    Instruction insn;
+    uint8_t code[SCRATCH_SLOT_SIZE];
+    // rip 相对寻址改写后使用的基址寄存器
+    decltype(&user_regs_struct::rbx) base = nullptr;
+    // 指令编号，用于判断线程的指令槽是否需要重新写入
+    size_t id = 0;
+  };
+
+  std::atomic_flag scratch_requested = false;
+  std::atomic<uintptr_t> scratch_base = 0;
+  std::atomic<size_t> scratch_pages = 0;
+  // 返回跳板：紧跟 scratch 区域的一页 int3，函数入口处把栈顶的返回地址改写为该页，
+  // 返回时陷入并跳回原始返回地址，不再为每个调用点设置返回断点
+  std::atomic<uintptr_t> trampoline = 0;
+  // 可能抛出 C++ 异常的函数（operator new 等）仍使用返回断点，
+  // 否则异常展开会在跳板页处找不到展开信息
+  std::vector<bool> trampoline_functions;
+  mutable std::shared_mutex displaced_mutex;
+  std::map<uintptr_t, DisplacedInstruction> displaced_instructions;
+  size_t displaced_count = 0;
+
+  // 系统调用号到回调索引的映射表
+  std::vector<std::vector<size_t>> syscall_table;
+
+  // 恢复线程执行，seccomp 模式下不再停在每个系统调用的入口和出口
+  long resume_thread(pid_t tid, int signal = 0) const {
+    return ptrace(debug_config.isSeccomp ? PTRACE_CONT : PTRACE_SYSCALL, tid,
+                  0, signal);
+  }
+
+  static inline bool is_seccomp_stop(int status) {
+    return status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8));
+  }
+
+  // 线程的信号停止不需要传递给目标：组停止（没有 siginfo），或追踪器自己发送的
+  // SIGSTOP（暂停其它线程、分离新线程时残留）；其它来源的 SIGSTOP（如作业控制）仍需传递
+  static bool is_tracer_stop(pid_t tid) {
+    siginfo_t info;
+    if (ptrace(PTRACE_GETSIGINFO, tid, 0, &info) < 0) {
+      return errno == EINVAL;
+    }
+    if (info.si_signo != SIGSTOP || info.si_code > 0) {
+      return false;
+    }
+    if (info.si_pid == getpid()) {
+      return true;
+    }
+    char path[48];
+    snprintf(path, sizeof(path), "/proc/self/task/%d", info.si_pid);
+    return access(path, F_OK) == 0;
+  }
+
   static inline bool is_breakpoint(uintptr_t rip, uintptr_t addr) {
     return rip - 1 == addr;
   }
 
   std::pair<uintptr_t, size_t> get_function(uintptr_t rip) const {
-    std::shared_lock<std::shared_mutex> lock(functions_mutex);
-    auto item = functions.find(rip - 1);
-    if (item == functions.end()) {
+    size_t index;
+    if (!function_table.find(rip - 1, index)) {
       return {0, 0};
     }
-    return {item->first, item->second};
+    return {rip - 1, index};
   }
 
   uintptr_t get_breakpoint(uintptr_t rip) const {
-    std::shared_lock<std::shared_mutex> lock(breakpoints_mutex);
-    return breakpoints.find(rip - 1) != breakpoints.end() ? (rip - 1) : 0;
+    return breakpoint_set.contains(rip - 1) ? (rip - 1) : 0;
   }
 
-  // 在目标线程的内存地址addr处插入断点，并保存原始数据
-  bool add_breakpoint(pid_t tid, uintptr_t addr) {
-    // 使用PTRACE_PEEKTEXT从目标进程的内存中读取地址addr处的原始数据，并保存到orig中
-    breakpoints[addr] = ptrace(PTRACE_PEEKTEXT, tid, addr, 0);
-    if (breakpoint_min == 0 && breakpoint_min > addr) {
+  // 记录断点的原始数据，调用方需持有 breakpoints_mutex 的独占锁
+  void save_breakpoint(uintptr_t addr, uint64_t orig) {
+    breakpoints[addr] = orig;
+    // 先于写入断点指令发布，其它线程陷入时一定能查到
+    breakpoint_set.insert(addr);
+    {
+      // 原始数据可能已变化（如库被重新加载），需要重新解码
+      std::unique_lock<std::shared_mutex> lock(displaced_mutex);
+      displaced_instructions.erase(addr);
+    }
+    extend_breakpoint_range(addr);
+  }
+
+  // 映射覆盖 [breakpoint_min, breakpoint_max] 时重新检查断点并通知库已加载
+  void extend_breakpoint_range(uintptr_t addr) {
+    if (breakpoint_min == 0 || breakpoint_min > addr) {
       breakpoint_min = addr;
     }
-    if (breakpoint_max == 0 && breakpoint_max < addr) {
+    if (breakpoint_max == 0 || breakpoint_max < addr) {
       breakpoint_max = addr;
     }
+  }
+
+  // 在目标线程的内存地址addr处插入断点，并保存原始数据
+  // 调用方需持有 breakpoints_mutex 的独占锁
+  bool add_breakpoint(pid_t tid, uintptr_t addr) {
+    // 使用PTRACE_PEEKTEXT从目标进程的内存中读取地址addr处的原始数据，并保存到orig中
+    save_breakpoint(addr, ptrace(PTRACE_PEEKTEXT, tid, addr, 0));
     return enable_breakpoint(tid, addr);
   }
 
+  // 批量插入断点：process_vm_readv 一次读取多个地址的原始数据，
+  // 断点指令通过 /proc/tid/mem 写入，都不用逐个 ptrace，失败的地址回退到 ptrace
+  // 调用方需持有 breakpoints_mutex 的独占锁
+  bool add_breakpoints(pid_t tid, const std::vector<uintptr_t> &addrs) {
+    std::vector<uint64_t> origs(addrs.size());
+    // 成功读取的地址个数，process_vm_readv 在第一个失败的地址处停止
+    size_t count = 0;
+    iovec local[BREAKPOINT_BATCH];
+    iovec remote[BREAKPOINT_BATCH];
+    while (count < addrs.size()) {
+      auto n = std::min(BREAKPOINT_BATCH, addrs.size() - count);
+      for (size_t i = 0; i < n; i++) {
+        local[i] = {&origs[count + i], sizeof(uint64_t)};
+        remote[i] = {reinterpret_cast<void *>(addrs[count + i]),
+                     sizeof(uint64_t)};
+      }
+      auto size = process_vm_readv(tid, local, n, remote, n, 0);
+      if (size <= 0) {
+        break;
+      }
+      count += size / sizeof(uint64_t);
+      if (static_cast<size_t>(size) != n * sizeof(uint64_t)) {
+        break;
+      }
+    }
+
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/mem", tid);
+    int fd = count > 0 ? open(path, O_RDWR) : -1;
+    bool result = true;
+    for (size_t i = 0; i < addrs.size(); i++) {
+      auto addr = addrs[i];
+      if (i >= count || fd < 0) {
+        if (!add_breakpoint(tid, addr)) {
+          result = false;
+        }
+        continue;
+      }
+      save_breakpoint(addr, origs[i]);
+      constexpr uint8_t code = 0xCC;
+      if (pwrite(fd, &code, sizeof(code), addr) != sizeof(code) &&
+          !enable_breakpoint(tid, addr)) {
+        result = false;
+      }
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    return result;
+  }
+
   // 通过设置断点处的字节来启用断点
   bool enable_breakpoint(pid_t tid, uintptr_t addr) const {
     // 使用PTRACE_POKETEXT将地址addr处的内容替换为断点指令0xCC(int
@@ -106,7 +288,9 @@ template <class T, class S> class Debugger {
   }
 
   // 恢复进程在断点处的执行，并恢复断点
-  bool resume_breakpoint(pid_t tid, uintptr_t addr, user_regs_struct &regs) {
+  // 单步期间到达的信号存入 signal 与 siginfo，由调用方在恢复执行时传递
+  bool resume_breakpoint(pid_t tid, uintptr_t addr, user_regs_struct &regs,
+                         int &signal, siginfo_t &siginfo) {
     // 将RIP寄存器的值设置回断点的地址，这是因为在断点处，RIP寄存器会指向断点指令的下一个地址
     regs.rip = addr;
     // 使用PTRACE_SETREGS将寄存器的值（特别是RIP）设置回断点的地址
@@ -133,33 +317,32 @@ template <class T, class S> class Debugger {
       if (WIFEXITED(status)) {
         return true;
       }
+      // 被信号打断时指令未执行，暂存信号后重新单步；追踪器发送的 SIGSTOP 直接忽略
+      if (WIFSTOPPED(status) && WSTOPSIG(status) != SIGTRAP) {
+        if (!is_tracer_stop(tid)) {
+          if (signal != 0) {
+            Log("[%d] signal %d during single step dropped", tid, signal);
+          }
+          signal = WSTOPSIG(status);
+          ptrace(PTRACE_GETSIGINFO, tid, 0, &siginfo);
+        }
+        i--;
+      }
     }
 
     // 重新启用断点，恢复断点指令
     return enable_breakpoint(tid, addr);
   }
 
-  // 多线程场景下，恢复指定线程在断点处的执行
-  bool resume_thread_breakpoint(pid_t tid, uintptr_t addr,
-                                user_regs_struct &regs) {
-    std::unique_lock<std::shared_mutex> lock(breakpoints_mutex);
-    if (!pause_others(tid)) {
-      return false;
-    }
-    if (!resume_breakpoint(tid, addr, regs)) {
-      return false;
-    }
-    return continue_others(tid);
-  }
-
 protected:
   using ThreadSafeArena = S;
 
 private:
-  // 断点信息
+  // 断点信息，sp 不为 0 时返回地址已改写为跳板，sp 为入口处的 rsp
   struct ResultBreakpoint {
     uintptr_t breakpoint;
     size_t function_index;
+    uintptr_t sp = 0;
   };
 
   // 线程数据
@@ -169,17 +352,48 @@ private:
     std::thread tracer;
     std::vector<bool> syscalls;
     std::vector<ResultBreakpoint> stack;
+    // 线程在 scratch 区域中的页，以及每个指令槽当前写入的指令编号
+    uintptr_t scratch = 0;
+    std::vector<size_t> scratch_slots;
+    // seccomp 停止位于系统调用入口，需要用 PTRACE_SYSCALL 等待对应的出口
+    bool in_syscall = false;
+    // loop 模式下通过 PTRACE_O_TRACECLONE 接管、尚未处理第一次停止的线程
+    bool adopting = false;
+    // 分离时已暂停并等待恢复断点（受 detach_mutex 保护）及分离时传递的信号
+    bool detach_ready = false;
+    int detach_signal = 0;
+    // 离线单步被信号打断时暂存的信号，下次恢复执行时传递
+    int pending_signal = 0;
+    siginfo_t pending_siginfo;
+    // loop 模式下暂停其它线程时先到达、尚未处理的事件
+    bool deferred = false;
   };
 
   std::shared_mutex threads_mutex;
   std::atomic<size_t> active_threads;
   std::map<pid_t, ThreadData> threads;
 
+  // 分离：所有线程暂停后由最后一个线程恢复断点处的原始字节，然后各自分离
+  std::atomic<bool> detaching = false;
+  std::mutex detach_mutex;
+  std::condition_variable detach_cv;
+  size_t tracing_threads = 0; // 正在 trace_thread 中的线程数
+  size_t ready_threads = 0;   // 已暂停并等待分离的线程数
+  bool breakpoints_restored = false;
+  // 正在附加的已有线程数（--pid）
+  std::atomic<size_t> attaching_threads = 0;
+  // loop 模式：暂停其它线程时先到达的事件（线程与 waitpid 状态），由 trace_loop 处理
+  std::deque<std::pair<pid_t, int>> deferred_events;
+
+  // 线程未被跟踪时返回 false 和一个空的 ThreadData，调用方不应使用
   std::pair<bool, ThreadData &> get_thread(pid_t tid) {
     static ThreadData empty;
     std::shared_lock<std::shared_mutex> lock(threads_mutex);
     auto item = threads.find(tid);
-    return {item != threads.end(), item->second};
+    if (item == threads.end()) {
+      return {false, empty};
+    }
+    return {true, item->second};
   }
 
   ThreadData &add_thread(pid_t tid) {
@@ -192,9 +406,23 @@ private:
 
     auto &thread = threads[tid];
     thread.syscalls.resize(get_syscall_callbacks().size(), false);
+    uprobes.add_thread(tid);
     return thread;
   }
 
+  // 线程尚未被跟踪时添加，否则返回 nullptr
+  ThreadData *try_add_thread(pid_t tid) {
+    std::unique_lock<std::shared_mutex> lock(threads_mutex);
+    if (threads.contains(tid)) {
+      return nullptr;
+    }
+    auto &thread = threads[tid];
+    thread.syscalls.resize(get_syscall_callbacks().size(), false);
+    // 新线程开始运行前打开 uprobe 事件
+    uprobes.add_thread(tid);
+    return &thread;
+  }
+
   void join_threads() {
     std::shared_lock<std::shared_mutex> lock(threads_mutex);
     for (auto &[tid, thread] : threads) {
@@ -205,6 +433,7 @@ private:
   }
 
   bool pause_others(pid_t tid) {
+    SelfStats::Scope scope(SelfStats::PAUSE_OTHERS);
     int status;
     siginfo_t siginfo;
     std::shared_lock<std::shared_mutex> lock(threads_mutex);
@@ -215,8 +444,8 @@ private:
         continue;
       }
 
-      // 发送 SIGSTOP 信号暂停线程
-      if (kill(oid, SIGSTOP) < 0) {
+      // 发送 SIGSTOP 信号暂停线程（kill 发送给整个进程，可能由其它线程接收）
+      if (syscall(SYS_tgkill, target_pid, oid, SIGSTOP) < 0) {
         perror("pause others");
         return false;
       }
@@ -244,7 +473,7 @@ private:
       }
 
       // 继续线程执行
-      if (ptrace(PTRACE_SYSCALL, oid, 0, 0) < 0) {
+      if (resume_thread(oid) < 0) {
         perror("continue others");
         return false;
       }
@@ -253,48 +482,426 @@ private:
     return true;
   }
 
-  void reset_breakpoint(pid_t tid, uintptr_t range_min, uintptr_t range_max) {
+  // loop 模式：其它线程的停止都由当前线程等待，用 tgkill 发送 SIGSTOP 暂停；
+  // 已停止的线程不需要暂停，等待期间先到达的其它事件留给 trace_loop 处理
+  // （此时 SIGSTOP 仍未处理，之后由 trace_loop 忽略）
+  bool pause_others_loop(pid_t tid) {
+    SelfStats::Scope scope(SelfStats::PAUSE_OTHERS);
+    int status;
+    siginfo_t siginfo;
+    std::shared_lock<std::shared_mutex> lock(threads_mutex);
+    for (auto &[oid, t] : threads) {
+      t.paused = false;
+      // 新线程在执行任何指令前停止，分离中的线程已暂停
+      if (oid == tid || t.adopting || t.deferred || t.detach_ready ||
+          ptrace(PTRACE_GETSIGINFO, oid, 0, &siginfo) == 0) {
+        continue;
+      }
+      // 已退出的线程，或属于其它进程（fork 的子进程）的线程
+      if (syscall(SYS_tgkill, target_pid, oid, SIGSTOP) < 0) {
+        continue;
+      }
+      if (waitpid(oid, &status, __WALL) < 0) {
+        perror("waitpid pause others");
+        return false;
+      }
+      if (WIFSTOPPED(status) && WSTOPSIG(status) != SIGTRAP &&
+          is_tracer_stop(oid)) {
+        t.paused = true;
+      } else {
+        t.deferred = true;
+        deferred_events.emplace_back(oid, status);
+      }
+    }
+    return true;
+  }
+
+  bool continue_others_loop() {
+    std::shared_lock<std::shared_mutex> lock(threads_mutex);
+    for (auto &[oid, t] : threads) {
+      if (t.paused) {
+        resume_event(oid, t);
+        t.paused = false;
+      }
+    }
+    return true;
+  }
+
+  // 多线程场景下，恢复指定线程在断点处的执行
+  bool resume_thread_breakpoint(pid_t tid, uintptr_t addr,
+                                user_regs_struct &regs, ThreadData &thread) {
+    SelfStats::Scope scope(SelfStats::RESUME);
+    if (debug_config.stepMode == StepMode::DISPLACED) {
+      bool stepped = false;
+      if (!step_displaced(tid, addr, regs, thread, stepped)) {
+        return false;
+      }
+      if (stepped) {
+        return true;
+      }
+      // 无法离线执行的指令回退到暂停其它线程的方式
+    }
+
     std::unique_lock<std::shared_mutex> lock(breakpoints_mutex);
-    for (auto [addr, orig] : breakpoints) {
-      if (addr < range_min || addr > range_max) {
+    if (debug_config.engine == TraceEngine::LOOP) {
+      if (!pause_others_loop(tid)) {
+        return false;
+      }
+      if (!resume_breakpoint(tid, addr, regs, thread.pending_signal,
+                             thread.pending_siginfo)) {
+        return false;
+      }
+      return continue_others_loop();
+    }
+    if (!pause_others(tid)) {
+      return false;
+    }
+    if (!resume_breakpoint(tid, addr, regs, thread.pending_signal,
+                           thread.pending_siginfo)) {
+      return false;
+    }
+    return continue_others(tid);
+  }
+
+  // 读取断点处的原始指令并解码，结果按断点地址缓存
+  // 调用方需持有 breakpoints_mutex 的共享锁
+  bool get_displaced(pid_t tid, uintptr_t addr,
+                     DisplacedInstruction &displaced) {
+    {
+      std::shared_lock<std::shared_mutex> lock(displaced_mutex);
+      auto item = displaced_instructions.find(addr);
+      if (item != displaced_instructions.end()) {
+        displaced = item->second;
+        return true;
+      }
+    }
+
+    auto item = breakpoints.find(addr);
+    if (item == breakpoints.end()) {
+      return false;
+    }
+    // 断点处的前 8 个字节取自保存的原始数据，其余从目标进程中读取
+    uint8_t code[SCRATCH_SLOT_SIZE];
+    uint64_t words[2] = {item->second, 0};
+    errno = 0;
+    words[1] = ptrace(PTRACE_PEEKTEXT, tid, addr + sizeof(uint64_t), 0);
+    if (errno != 0) {
+      return false;
+    }
+    memcpy(code, words, sizeof(code));
+    // 指令范围内的其它断点需要还原为原始字节
+    for (auto next = std::next(item);
+         next != breakpoints.end() && next->first < addr + sizeof(code);
+         ++next) {
+      code[next->first - addr] = next->second & 0xFF;
+    }
+
+    DisplacedInstruction result;
+    if (!decode_instruction(code, MAX_INSTRUCTION_LENGTH, result.insn)) {
+      result.insn.kind = Instruction::Kind::UNSUPPORTED;
+    }
+    memcpy(result.code, code, sizeof(code));
+    if (result.insn.rip_relative &&
+        (result.insn.kind == Instruction::Kind::NORMAL ||
+         result.insn.kind == Instruction::Kind::CALL_INDIRECT)) {
+      switch (relocate_rip_relative(result.insn, result.code)) {
+      case 3:
+        result.base = &user_regs_struct::rbx;
+        break;
+      case 6:
+        result.base = &user_regs_struct::rsi;
+        break;
+      default:
+        result.base = &user_regs_struct::rdi;
+        break;
+      }
+    }
+    if (result.insn.kind == Instruction::Kind::UNSUPPORTED) {
+      Log("[%d][displaced] unsupported instruction at %p, fallback to pause",
+          tid, addr);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(displaced_mutex);
+    result.id = ++displaced_count;
+    displaced = displaced_instructions.try_emplace(addr, result).first->second;
+    return true;
+  }
+
+  // 获取线程的指令槽，必要时把指令写入目标进程，失败时返回 0
+  uintptr_t get_scratch_slot(pid_t tid, ThreadData &thread,
+                             const DisplacedInstruction &displaced) {
+    if (thread.scratch == 0) {
+      auto base = scratch_base.load();
+      if (base == 0 || scratch_pages.load() >= SCRATCH_PAGES) {
+        return 0;
+      }
+      auto page = scratch_pages++;
+      if (page >= SCRATCH_PAGES) {
+        return 0;
+      }
+      thread.scratch = base + page * SCRATCH_PAGE_SIZE;
+      thread.scratch_slots.assign(SCRATCH_SLOTS, 0);
+    }
+
+    auto index = displaced.id % SCRATCH_SLOTS;
+    auto slot = thread.scratch + index * SCRATCH_SLOT_SIZE;
+    if (thread.scratch_slots[index] != displaced.id) {
+      for (size_t i = 0; i < SCRATCH_SLOT_SIZE; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, displaced.code + i, sizeof(word));
+        if (ptrace(PTRACE_POKETEXT, tid, slot + i, word) < 0) {
+          perror("write scratch slot");
+          thread.scratch_slots[index] = 0;
+          return 0;
+        }
+      }
+      thread.scratch_slots[index] = displaced.id;
+    }
+    return slot;
+  }
+
+  // 断点保持启用，在线程自己的 scratch 页中执行原始指令，其它线程无需暂停
+  // 相对跳转直接模拟，无法离线执行时 stepped 为 false，由调用方回退
+  bool step_displaced(pid_t tid, uintptr_t addr, user_regs_struct &regs,
+                      ThreadData &thread, bool &stepped) {
+    stepped = false;
+    // 与暂停方式互斥，避免单步过程中被其它线程的 SIGSTOP 打断
+    std::shared_lock<std::shared_mutex> lock(breakpoints_mutex);
+    DisplacedInstruction displaced;
+    if (!get_displaced(tid, addr, displaced)) {
+      return true;
+    }
+
+    const auto &insn = displaced.insn;
+    uintptr_t next = addr + insn.length;
+    switch (insn.kind) {
+    case Instruction::Kind::CALL_REL:
+      regs.rsp -= sizeof(uint64_t);
+      if (ptrace(PTRACE_POKEDATA, tid, regs.rsp, next) < 0) {
+        perror("displaced call");
+        return false;
+      }
+      regs.rip = next + insn.relative;
+      break;
+    case Instruction::Kind::JMP_REL:
+      regs.rip = next + insn.relative;
+      break;
+    case Instruction::Kind::JCC_REL:
+      regs.rip = check_condition(insn.condition, regs.eflags)
+                     ? next + insn.relative
+                     : next;
+      break;
+    case Instruction::Kind::NORMAL:
+    case Instruction::Kind::CALL_INDIRECT: {
+      auto slot = get_scratch_slot(tid, thread, displaced);
+      if (slot == 0) {
+        return true;
+      }
+
+      user_regs_struct step = regs;
+      step.rip = slot;
+      if (displaced.base != nullptr) {
+        step.*displaced.base = next;
+      }
+      if (ptrace(PTRACE_SETREGS, tid, 0, &step) < 0) {
+        perror("displaced set regs");
+        return false;
+      }
+      int status = 0;
+      while (true) {
+        if (ptrace(PTRACE_SINGLESTEP, tid, 0, 0) < 0) {
+          perror("displaced step");
+          return false;
+        }
+        if (waitpid(tid, &status, __WALL) < 0) {
+          perror("wait displaced step");
+          return false;
+        }
+        // 追踪器发送的 SIGSTOP 在指令执行前到达，忽略后重新单步
+        if (!WIFSTOPPED(status) || WSTOPSIG(status) == SIGTRAP ||
+            !is_tracer_stop(tid)) {
+          break;
+        }
+      }
+      if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        stepped = true;
+        return true;
+      }
+      if (!WIFSTOPPED(status) || WSTOPSIG(status) != SIGTRAP) {
+        // 指令未执行完成（被信号打断），恢复现场后回退，信号在恢复执行时传递
+        Log("[%d][displaced] step at %p stopped by signal %d", tid, addr,
+            WIFSTOPPED(status) ? WSTOPSIG(status) : 0);
+        if (WIFSTOPPED(status)) {
+          thread.pending_signal = WSTOPSIG(status);
+          ptrace(PTRACE_GETSIGINFO, tid, 0, &thread.pending_siginfo);
+        }
+        ptrace(PTRACE_SETREGS, tid, 0, &regs);
+        return true;
+      }
+
+      ptrace(PTRACE_GETREGS, tid, 0, &step);
+      if (displaced.base != nullptr) {
+        step.*displaced.base = regs.*displaced.base;
+      }
+      // 顺序执行的指令回到原始位置的下一条指令，跳转则保留目标地址
+      if (step.rip == slot + insn.length) {
+        step.rip = next;
+      }
+      // 间接调用压栈的是 scratch 中的返回地址，需要修正
+      if (insn.kind == Instruction::Kind::CALL_INDIRECT &&
+          ptrace(PTRACE_PEEKDATA, tid, step.rsp, nullptr) ==
+              static_cast<long>(slot + insn.length) &&
+          ptrace(PTRACE_POKEDATA, tid, step.rsp, next) < 0) {
+        perror("displaced indirect call");
+        return false;
+      }
+      regs = step;
+      break;
+    }
+    default:
+      return true;
+    }
+
+    if (ptrace(PTRACE_SETREGS, tid, 0, &regs) < 0) {
+      perror("displaced set regs");
+      return false;
+    }
+    stepped = true;
+    return true;
+  }
+
+  // 借用第一个停在系统调用入口的线程执行 mmap，分配 scratch 区域和返回跳板页
+  // （附加时主线程可能一直阻塞在 join、epoll_wait 等系统调用中）
+  // 只在系统调用入口处注入，返回 true 表示本次 syscall-stop 已被消耗
+  bool inject_scratch(pid_t tid) {
+    user_regs_struct regs;
+    ptrace(PTRACE_GETREGS, tid, 0, &regs);
+    // 系统调用入口处 rax 为 -ENOSYS
+    if (regs.rax != static_cast<uint64_t>(-ENOSYS) ||
+        scratch_requested.test_and_set()) {
+      return false;
+    }
+
+    auto scratch_size = debug_config.stepMode == StepMode::DISPLACED
+                            ? SCRATCH_PAGES * SCRATCH_PAGE_SIZE
+                            : 0;
+    auto trampoline_size =
+        debug_config.returnCapture == ReturnCapture::TRAMPOLINE
+            ? SCRATCH_PAGE_SIZE
+            : 0;
+    user_regs_struct call = regs;
+    call.orig_rax = SYS_mmap;
+    call.rdi = 0;
+    call.rsi = scratch_size + trampoline_size;
+    call.rdx = PROT_READ | PROT_EXEC;
+    call.r10 = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    call.r8 = static_cast<uint64_t>(-1);
+    call.r9 = 0;
+    if (ptrace(PTRACE_SETREGS, tid, 0, &call) < 0) {
+      perror("inject scratch");
+      return false;
+    }
+
+    int status = 0;
+    if (ptrace(PTRACE_SYSCALL, tid, 0, 0) < 0 ||
+        waitpid(tid, &status, __WALL) < 0) {
+      perror("wait inject scratch");
+      return true;
+    }
+    if (!WIFSTOPPED(status) || WSTOPSIG(status) != (SIGTRAP | 0x80)) {
+      Log("[%d] inject scratch: unexpected status 0x%x", tid, status);
+      return true;
+    }
+
+    ptrace(PTRACE_GETREGS, tid, 0, &call);
+    if (call.rax > static_cast<uint64_t>(-4096)) {
+      Log("[%d] inject scratch: mmap failed(%lld), fallback to pause and "
+          "return breakpoints",
+          tid, static_cast<long long>(call.rax));
+    } else {
+      if (scratch_size > 0) {
+        scratch_base = call.rax;
+        Log("[%d] scratch pages: [%p], count: [%llu]", tid, call.rax,
+            SCRATCH_PAGES);
+      }
+      if (trampoline_size > 0) {
+        setup_trampoline(tid, call.rax + scratch_size);
+      }
+    }
+
+    // 回退 rip 重新执行被借用的系统调用
+    regs.rip -= 2;
+    regs.rax = regs.orig_rax;
+    if (ptrace(PTRACE_SETREGS, tid, 0, &regs) < 0) {
+      perror("restore inject scratch");
+    }
+    return true;
+  }
+
+  // 在跳板页开头写入 int3，映射为只读，ptrace 写入不受页权限限制
+  void setup_trampoline(pid_t tid, uintptr_t addr) {
+    if (ptrace(PTRACE_POKETEXT, tid, addr, 0xCCCCCCCCCCCCCCCCULL) < 0) {
+      perror("write return trampoline");
+      return;
+    }
+    auto &callbacks = get_function_callbacks();
+    trampoline_functions.resize(callbacks.size());
+    for (size_t i = 0; i < callbacks.size(); i++) {
+      trampoline_functions[i] = !callbacks[i].name.starts_with("_Z");
+    }
+    trampoline = addr;
+    Log("[%d] return trampoline: [%p]", tid, addr);
+  }
+
+  // 恢复被跳板改写且尚未返回的返回地址，分离前由线程自己的追踪线程调用
+  void restore_returns(pid_t tid, ThreadData &thread) {
+    auto addr = trampoline.load();
+    if (addr == 0) {
+      return;
+    }
+    size_t count = 0;
+    for (auto &item : thread.stack) {
+      if (item.sp == 0) {
         continue;
       }
+      errno = 0;
+      auto data = ptrace(PTRACE_PEEKDATA, tid, item.sp, 0);
+      if (errno != 0 || static_cast<uintptr_t>(data) != addr) {
+        continue;
+      }
+      ptrace(PTRACE_POKEDATA, tid, item.sp, item.breakpoint);
+      count++;
+    }
+    thread.stack.clear();
+    if (count > 0) {
+      Log("[%d] restored %llu return addresses", tid, count);
+    }
+  }
+
+  void reset_breakpoint(pid_t tid, uintptr_t range_min, uintptr_t range_max) {
+    std::unique_lock<std::shared_mutex> lock(breakpoints_mutex);
+    std::vector<uintptr_t> addrs;
+    for (auto item = breakpoints.lower_bound(range_min);
+         item != breakpoints.end() && item->first <= range_max; ++item) {
+      auto addr = item->first;
       auto curr = ptrace(PTRACE_PEEKTEXT, tid, addr, 0);
       if ((curr & 0xFF) != 0xCC) {
-        add_breakpoint(tid, addr);
+        addrs.push_back(addr);
       }
     }
+    if (!addrs.empty()) {
+      add_breakpoints(tid, addrs);
+    }
   }
 
   bool setup_breakpoint(pid_t tid) {
     bool result = true;
-    if (!doing_setup.test_and_set()) {
+    // 其它线程正在设置断点
+    if (doing_setup.test_and_set()) {
       return result;
     }
     auto process_maps_entry = [this, tid, &result](const char *path,
                                                    uintptr_t base) -> bool {
-      auto load_libary = [this, tid, &result, path,
-                          base](const char *name, uintptr_t offset) -> bool {
-        if (offset == 0) {
-          return false;
-        }
-        for (size_t function_index = 0; auto &c : get_function_callbacks()) {
-          auto breakpoint = base + offset;
-          if (c.name == name &&
-              breakpoints.find(breakpoint) == breakpoints.end()) {
-            functions[breakpoint] = function_index;
-            Log("[function] name: [%s], index: [%llu], file: [%s], base: [%p], "
-                "offset: "
-                "[%p], invoke: [%p], result: [%p]",
-                name, function_index, path, base, offset, c.invoke, c.result);
-            if (!add_breakpoint(tid, breakpoint)) {
-              result = false;
-            }
-          }
-          function_index++;
-        }
-        return false;
-      };
       {
         std::lock_guard<std::mutex> lock(libraries_mutex);
         loaded_libraries.insert(path);
@@ -326,15 +933,84 @@ private:
       }
       close(fd);
       Log("[File] Load library: [%s], base: [%p]", path, base);
-      std::unique_lock<std::shared_mutex> functions_lock(functions_mutex);
-      std::unique_lock<std::shared_mutex> breakpoints_lock(breakpoints_mutex);
-      if (!get_function_offset(path, load_libary)) {
+      auto index = get_symbol_index(path);
+      if (index == nullptr) {
         result = false;
+        return false;
+      }
+      std::lock_guard<std::mutex> functions_lock(functions_mutex);
+      std::unique_lock<std::shared_mutex> breakpoints_lock(breakpoints_mutex);
+      // 按回调的函数名查找符号，同一个库的断点一起写入
+      std::vector<uintptr_t> addrs;
+      bool uprobe = debug_config.backend == TraceBackend::UPROBE;
+      for (size_t function_index = 0; auto &c : get_function_callbacks()) {
+        if (static_cast<SubClass *>(this)->should_trace_function(c.name)) {
+          index->find(c.name, [&](uintptr_t offset) -> void {
+            auto breakpoint = base + offset;
+            if (breakpoints.find(breakpoint) == breakpoints.end() &&
+                functions.try_emplace(breakpoint, function_index).second) {
+              Log("[function] name: [%s], index: [%llu], file: [%s], "
+                  "base: [%p], offset: [%p], invoke: [%p], result: [%p]",
+                  c.name.c_str(), function_index, path, base, offset,
+                  c.invoke, c.result);
+              if (!uprobe) {
+                addrs.push_back(breakpoint);
+                return;
+              }
+              // 不设置断点，在函数入口（及返回处）注册 uprobe；
+              // 内核在新的映射上自动安装，只需记录范围以便映射变化时刷新展开信息
+              extend_breakpoint_range(breakpoint);
+              auto file_offset = index->file_offset(offset);
+              // 不采集调用栈时入口只采样返回地址，用于还原被返回探针改写的返回地址
+              size_t stack_size = 0;
+              if (debug_config.uprobeStackSize > 0) {
+                stack_size = debug_config.uprobeStackOps[c.op.index()]
+                                 ? debug_config.uprobeStackSize
+                             : c.result != nullptr ? sizeof(uintptr_t)
+                                                   : 0;
+              }
+              if (file_offset == 0 ||
+                  !uprobes.add(path, file_offset, function_index,
+                               c.result != nullptr, stack_size)) {
+                Log("[error] failed to add uprobe for [%s] in [%s]",
+                    c.name.c_str(), path);
+                result = false;
+              }
+            }
+          });
+        }
+        function_index++;
+      }
+      if (!addrs.empty()) {
+        if (!add_breakpoints(tid, addrs)) {
+          result = false;
+        }
+        function_table.publish(functions);
       }
       return false;
     };
-    if (!get_maps_addr(target_pid, loaded_libraries, process_maps_entry)) {
-      result = false;
+    if (!maps_scanned) {
+      if (!get_maps_addr(target_pid, loaded_libraries, process_maps_entry)) {
+        result = false;
+      }
+      maps_scanned = true;
+    } else {
+      // 只处理 mmap 返回时记录的新映射
+      std::vector<std::pair<std::string, uintptr_t>> mapped;
+      {
+        std::lock_guard<std::mutex> lock(libraries_mutex);
+        mapped.swap(mapped_libraries);
+      }
+      for (auto &[path, base] : mapped) {
+        bool loaded;
+        {
+          std::lock_guard<std::mutex> lock(libraries_mutex);
+          loaded = loaded_libraries.find(path) != loaded_libraries.end();
+        }
+        if (!loaded) {
+          process_maps_entry(path.c_str(), base);
+        }
+      }
     }
     doing_setup.clear();
     return result;
@@ -351,25 +1027,85 @@ private:
     // 读取进程的寄存器值到一个结构体regs中
     ptrace(PTRACE_GETREGS, tid, 0, &regs);
 
-    for (size_t i = 0; auto &c : get_syscall_callbacks()) {
-      if (c.syscall == regs.orig_rax) {
-        if (thread.syscalls[i]) {
-          if (c.result != nullptr) {
-            c.result(static_cast<SubClass *>(this), tid, regs, thread.arena);
-          }
-          thread.syscalls[i] = false;
-        } else {
-          if (c.invoke != nullptr) {
-            c.invoke(static_cast<SubClass *>(this), tid, regs, thread.arena);
-          }
-          thread.syscalls[i] = true;
+    if (regs.orig_rax >= syscall_table.size()) {
+      return true;
+    }
+    auto &callbacks = get_syscall_callbacks();
+    for (auto i : syscall_table[regs.orig_rax]) {
+      auto &c = callbacks[i];
+      if (thread.syscalls[i]) {
+        if (c.result != nullptr) {
+          c.result(static_cast<SubClass *>(this), tid, regs, thread.arena);
+        }
+        thread.syscalls[i] = false;
+      } else {
+        if (c.invoke != nullptr) {
+          c.invoke(static_cast<SubClass *>(this), tid, regs, thread.arena);
         }
+        thread.syscalls[i] = true;
       }
-      i++;
     }
     return true;
   }
 
+  void build_syscall_table() {
+    syscall_table.clear();
+    for (size_t i = 0; auto &c : get_syscall_callbacks()) {
+      if (c.syscall >= syscall_table.size()) {
+        syscall_table.resize(c.syscall + 1);
+      }
+      syscall_table[c.syscall].push_back(i);
+      i++;
+    }
+  }
+
+  // 嵌套调用（如 malloc 中的 sbrk）的回调期间线程处于暂停状态，临时写回外层调用
+  // 被跳板改写的返回地址，各种展开方式都能越过外层的栈帧；回调后重新改写
+  void call_nested(auto callback, pid_t tid, const user_regs_struct &regs,
+                   ThreadData &thread) {
+    auto page = trampoline.load();
+    std::vector<uintptr_t> sps;
+    for (auto &item : thread.stack) {
+      // 因 longjmp 等未返回的调用，其栈槽可能已被复用
+      if (page != 0 && item.sp != 0 &&
+          static_cast<uintptr_t>(ptrace(PTRACE_PEEKDATA, tid, item.sp, 0)) ==
+              page) {
+        ptrace(PTRACE_POKEDATA, tid, item.sp, item.breakpoint);
+        sps.push_back(item.sp);
+      }
+    }
+    callback(static_cast<SubClass *>(this), tid, regs, thread.arena);
+    for (auto sp : sps) {
+      ptrace(PTRACE_POKEDATA, tid, sp, page);
+    }
+  }
+
+  // 函数经跳板返回：返回后 rsp 比入口处大 8，按 rsp 找到对应的调用，
+  // 之后的调用因 longjmp 等没有经过跳板返回，一并丢弃；跳回原始返回地址，不需要单步
+  bool trace_trampoline(pid_t tid, user_regs_struct &regs, ThreadData &thread) {
+    auto item = thread.stack.end();
+    while (item != thread.stack.begin()) {
+      --item;
+      if (item->sp != 0 && item->sp + sizeof(uintptr_t) == regs.rsp) {
+        auto current = *item;
+        thread.stack.erase(item, thread.stack.end());
+        regs.rip = current.breakpoint;
+        auto &callback = get_function_callbacks()[current.function_index];
+        if (callback.result != nullptr) {
+          call_nested(callback.result, tid, regs, thread);
+        }
+        if (ptrace(PTRACE_SETREGS, tid, 0, &regs) < 0) {
+          perror("return from trampoline");
+          return false;
+        }
+        return true;
+      }
+    }
+    Log("[%d][error] return trampoline without a matching call, rsp: [%p]",
+        tid, regs.rsp);
+    return false;
+  }
+
   bool trace_breakpoint(pid_t tid) {
     auto [ok, thread] = get_thread(tid);
     if (!ok) {
@@ -387,21 +1123,30 @@ private:
                                                Callback callback,
                                                size_t index) -> bool {
       if (callback != nullptr) {
-        callback(static_cast<SubClass *>(this), tid, regs, thread.arena);
+        call_nested(callback, tid, regs, thread);
       }
 
       if (index != INVALID_INDEX) {
         uintptr_t result_addr = ptrace(PTRACE_PEEKDATA, tid, regs.rsp, nullptr);
+        // 改写栈顶的返回地址，返回时陷入跳板页，不需要调用点的断点
+        auto page = trampoline.load();
+        if (page != 0 && trampoline_functions[index] &&
+            ptrace(PTRACE_POKEDATA, tid, regs.rsp, page) == 0) {
+          thread.stack.emplace_back(result_addr, index, regs.rsp);
+          return resume_thread_breakpoint(tid, addr, regs, thread);
+        }
         thread.stack.emplace_back(result_addr, index);
-        std::unique_lock<std::shared_mutex> lock(breakpoints_mutex);
-        if (breakpoints.find(result_addr) == breakpoints.end()) {
-          if (!add_breakpoint(tid, result_addr)) {
+        // 只有新的返回地址需要加锁插入断点
+        if (!breakpoint_set.contains(result_addr)) {
+          std::unique_lock<std::shared_mutex> lock(breakpoints_mutex);
+          if (breakpoints.find(result_addr) == breakpoints.end() &&
+              !add_breakpoint(tid, result_addr)) {
             return false;
           }
         }
       }
 
-      return resume_thread_breakpoint(tid, addr, regs);
+      return resume_thread_breakpoint(tid, addr, regs, thread);
     };
 
     if (auto [addr, index] = get_function(regs.rip); addr != 0) {
@@ -410,6 +1155,11 @@ private:
                      c.result != nullptr ? index : INVALID_INDEX);
     }
 
+    if (auto page = trampoline.load();
+        page != 0 && is_breakpoint(regs.rip, page)) {
+      return trace_trampoline(tid, regs, thread);
+    }
+
     // result
     if (!thread.stack.empty()) {
       ResultBreakpoint &currentBreakpoint = thread.stack.back();
@@ -437,14 +1187,23 @@ private:
       uint64_t _;
     };
     ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &new_child);
-    if (new_child >= 0) {
+    if (new_child >= 0 && debug_config.engine == TraceEngine::LOOP) {
+      // 新线程已被自动附加，继承跟踪选项，第一次停止时开始运行
+      Log("[%d] new thread %d", tid, new_child);
+      static_cast<SubClass *>(this)->add_new_tid(tid, new_child);
+      adopt_thread(new_child);
+    } else if (new_child >= 0) {
       Log("[%d] new thread %d", tid, new_child);
       static_cast<SubClass *>(this)->add_new_tid(tid, new_child);
       waitpid(new_child, &status, __WALL);
       ptrace(PTRACE_DETACH, new_child, nullptr, SIGSTOP);
-      auto &thread = add_thread(new_child);
+      // 附加已有线程时可能已被扫描到，由对应的线程负责
+      auto thread = try_add_thread(new_child);
+      if (thread == nullptr) {
+        return true;
+      }
       active_threads++;
-      thread.tracer = std::thread([this, new_child]() -> void {
+      thread->tracer = std::thread([this, new_child]() -> void {
         int status;
         ptrace(PTRACE_ATTACH, new_child);
         waitpid(new_child, &status, 0);
@@ -456,51 +1215,343 @@ private:
   }
 
   bool trace_thread(pid_t tid) {
-    Log("[%d] start trace thread", tid);
+    {
+      std::lock_guard<std::mutex> lock(detach_mutex);
+      tracing_threads++;
+    }
+    auto result = trace_events(tid);
+    {
+      std::lock_guard<std::mutex> lock(detach_mutex);
+      tracing_threads--;
+    }
+    // 线程退出后可能所有剩余线程都已暂停
+    detach_cv.notify_all();
+    return result;
+  }
 
+  // 恢复所有断点处的原始字节，调用方需持有 detach_mutex
+  void restore_breakpoints(pid_t tid) {
+    std::unique_lock<std::shared_mutex> lock(breakpoints_mutex);
+    size_t count = 0;
+    for (auto [addr, orig] : breakpoints) {
+      errno = 0;
+      auto data = ptrace(PTRACE_PEEKTEXT, tid, addr, 0);
+      // 所在的库已被卸载
+      if (errno != 0 || (data & 0xFF) != 0xCC) {
+        continue;
+      }
+      ptrace(PTRACE_POKETEXT, tid, addr, (data & ~0xFF) | (orig & 0xFF));
+      count++;
+    }
+    Log("[%d] restored %llu breakpoints", tid, count);
+  }
+
+  // 线程已暂停，等待其它线程暂停并恢复断点后分离，signal 为分离时传递的信号
+  bool detach_thread(pid_t tid, int signal) {
+    std::unique_lock<std::mutex> lock(detach_mutex);
+    if (auto [ok, thread] = get_thread(tid); ok) {
+      thread.detach_ready = true;
+    }
+    ready_threads++;
+    detach_cv.notify_all();
+    detach_cv.wait(lock, [this]() {
+      return breakpoints_restored || ready_threads >= tracing_threads;
+    });
+    if (!breakpoints_restored) {
+      restore_breakpoints(tid);
+      breakpoints_restored = true;
+      detach_cv.notify_all();
+    }
+    lock.unlock();
+    if (auto [ok, thread] = get_thread(tid); ok) {
+      restore_returns(tid, thread);
+    }
+    if (ptrace(PTRACE_DETACH, tid, nullptr, signal) < 0) {
+      perror("detach");
+      return false;
+    }
+    Log("[%d] detached", tid);
+    return true;
+  }
+
+  // 恢复线程执行，没有指定信号时传递离线单步期间暂存的信号
+  void resume_event(pid_t tid, ThreadData &thread, int signal = 0) {
+    if (signal == 0 && thread.pending_signal != 0) {
+      signal = std::exchange(thread.pending_signal, 0);
+      // 保留原始的 siginfo，否则内核按追踪器发送的信号构造
+      ptrace(PTRACE_SETSIGINFO, tid, 0, &thread.pending_siginfo);
+    }
+    if (thread.in_syscall) {
+      ptrace(PTRACE_SYSCALL, tid, 0, signal);
+    } else {
+      resume_thread(tid, signal);
+    }
+  }
+
+  void set_options(pid_t tid) {
     ptrace(PTRACE_SETOPTIONS, tid, nullptr,
            PTRACE_O_TRACESYSGOOD |   // get syscall info
                PTRACE_O_TRACECLONE | // trace cloned processes
                PTRACE_O_TRACEFORK |  // trace forked processes
                PTRACE_O_TRACEVFORK | // trace vforked processes
                PTRACE_O_TRACEEXEC |  // disable legacy sigtrap on execve
-               PTRACE_O_EXITKILL);   // send SIGKILL to target if tracer exits
+               PTRACE_O_EXITKILL |   // send SIGKILL to target if tracer exits
+               (debug_config.isSeccomp ? PTRACE_O_TRACESECCOMP : 0));
+  }
+
+  enum class EventResult {
+    RESUMED,   // 已处理并恢复执行
+    EXITED,    // 线程已退出
+    DETACHING, // 正在分离，线程保持暂停
+    FAILED,
+  };
 
-    ptrace(PTRACE_SYSCALL, tid, 0, 0);
+  // 处理线程的一次状态变化（waitpid 的结果）
+  EventResult handle_event(pid_t tid, ThreadData &thread, int status) {
+    SelfStats::Scope scope(SelfStats::TRAP);
+    if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_CLONE << 8)) ||
+        status >> 8 == (SIGTRAP | (PTRACE_EVENT_FORK << 8)) ||
+        status >> 8 == (SIGTRAP | (PTRACE_EVENT_VFORK << 8))) {
+      if (!trace_new_thread(tid)) {
+        return EventResult::FAILED;
+      }
+    }
+
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+      uprobes.remove_thread(tid);
+      if (debug_config.backend == TraceBackend::UPROBE) {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        std::lock_guard<std::mutex> lock(uprobe_exited_mutex);
+        uprobe_exited.emplace_back(tid, now.tv_sec * 1'000'000'000ULL +
+                                            now.tv_nsec);
+      }
+      static_cast<SubClass *>(this)->on_thread_exit(tid, thread.arena);
+      return EventResult::EXITED;
+    } else if (!WIFSTOPPED(status)) {
+    } else if (is_seccomp_stop(status) ||
+               WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+      thread.in_syscall = is_seccomp_stop(status);
+      if ((debug_config.stepMode == StepMode::DISPLACED ||
+           (debug_config.returnCapture == ReturnCapture::TRAMPOLINE &&
+            debug_config.backend == TraceBackend::PTRACE)) &&
+          !scratch_requested.test() && inject_scratch(tid)) {
+        // 被借用的系统调用会重新进入，本次不做处理
+        thread.in_syscall = false;
+      } else if (has_loading_libraries && !setup_breakpoint(tid)) {
+        return EventResult::FAILED;
+      } else if (!trace_syscall(tid)) {
+        return EventResult::FAILED;
+      }
+    } else if (WSTOPSIG(status) == SIGTRAP) {
+      if (!trace_breakpoint(tid)) {
+        return EventResult::FAILED;
+      }
+    } else if (detaching) {
+      // 分离时发送的 SIGSTOP 不再传递，其它信号在分离时传递
+      thread.detach_signal = WSTOPSIG(status) == SIGSTOP ? 0 : WSTOPSIG(status);
+      return EventResult::DETACHING;
+    } else if (is_tracer_stop(tid)) {
+      // 暂停其它线程时残留的 SIGSTOP 以及组停止，不传递给线程
+    } else {
+      // signal delivery stop
+      resume_event(tid, thread, WSTOPSIG(status));
+      return EventResult::RESUMED;
+    }
+    if (detaching && WIFSTOPPED(status)) {
+      thread.detach_signal = std::exchange(thread.pending_signal, 0);
+      return EventResult::DETACHING;
+    }
+    resume_event(tid, thread);
+    return EventResult::RESUMED;
+  }
+
+  // threads 模式：在当前线程中跟踪 tid 直到其退出或分离
+  bool trace_events(pid_t tid) {
+    Log("[%d] start trace thread", tid);
+    SelfStats::SetThread("tracer");
+    auto [ok, thread] = get_thread(tid);
+    if (!ok) {
+      Log("[%d] trace events thread not exists", tid);
+      return false;
+    }
+
+    set_options(tid);
+    // 分离开始后才被附加的线程
+    if (detaching) {
+      return detach_thread(tid, 0);
+    }
+    resume_event(tid, thread);
 
     while (true) {
       int status;
       waitpid(tid, &status, __WALL);
+      switch (handle_event(tid, thread, status)) {
+      case EventResult::RESUMED:
+        continue;
+      case EventResult::EXITED:
+        return true;
+      case EventResult::DETACHING:
+        return detach_thread(tid, thread.detach_signal);
+      case EventResult::FAILED:
+        return false;
+      }
+    }
+  }
 
-      if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_CLONE << 8)) ||
-          status >> 8 == (SIGTRAP | (PTRACE_EVENT_FORK << 8)) ||
-          status >> 8 == (SIGTRAP | (PTRACE_EVENT_VFORK << 8))) {
-        if (!trace_new_thread(tid)) {
-          return false;
+  // loop 模式：记录自动附加的新线程，第一次停止前的线程也计入跟踪线程数
+  ThreadData *adopt_thread(pid_t tid) {
+    auto thread = try_add_thread(tid);
+    if (thread != nullptr) {
+      thread->adopting = true;
+      std::lock_guard<std::mutex> lock(detach_mutex);
+      tracing_threads++;
+    }
+    return thread;
+  }
+
+  // loop 模式：线程已暂停，所有线程都暂停后恢复断点并全部分离
+  void ready_to_detach(ThreadData &thread) {
+    std::lock_guard<std::mutex> lock(detach_mutex);
+    thread.detach_ready = true;
+    ready_threads++;
+    if (breakpoints_restored || ready_threads < tracing_threads) {
+      return;
+    }
+    std::shared_lock<std::shared_mutex> threads_lock(threads_mutex);
+    for (auto &[tid, item] : threads) {
+      if (!item.detach_ready) {
+        continue;
+      }
+      if (!breakpoints_restored) {
+        restore_breakpoints(tid);
+        breakpoints_restored = true;
+      }
+      restore_returns(tid, item);
+      if (ptrace(PTRACE_DETACH, tid, nullptr, item.detach_signal) < 0) {
+        perror("detach");
+      } else {
+        Log("[%d] detached", tid);
+      }
+      item.detach_ready = false;
+      tracing_threads--;
+    }
+    detach_cv.notify_all();
+  }
+
+  // loop 模式：由当前线程通过 waitpid(-1) 跟踪所有线程，
+  // 新线程通过 PTRACE_O_TRACECLONE 直接接管，不需要分离后重新附加
+  bool trace_loop() {
+    SelfStats::SetThread("tracer");
+    {
+      std::lock_guard<std::mutex> lock(detach_mutex);
+      std::shared_lock<std::shared_mutex> threads_lock(threads_mutex);
+      tracing_threads = threads.size();
+      // 主线程与附加的线程都处于暂停状态
+      for (auto &[tid, thread] : threads) {
+        Log("[%d] start trace thread", tid);
+        set_options(tid);
+        resume_event(tid, thread);
+      }
+    }
+
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(detach_mutex);
+        if (tracing_threads == 0) {
+          return true;
         }
       }
+      int status;
+      pid_t tid;
+      if (!deferred_events.empty()) {
+        tid = deferred_events.front().first;
+        status = deferred_events.front().second;
+        deferred_events.pop_front();
+      } else {
+        tid = waitpid(-1, &status, __WALL);
+      }
+      if (tid < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        // 没有剩余的被跟踪线程
+        if (errno == ECHILD) {
+          return true;
+        }
+        perror("waitpid loop");
+        return false;
+      }
 
-      if (WIFEXITED(status)) {
-        break;
-      } else if (!WIFSTOPPED(status)) {
-      } else if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
-        if (has_loading_libraries && !setup_breakpoint(tid)) {
-          return false;
-        } else if (!trace_syscall(tid)) {
-          return false;
+      auto [ok, thread] = get_thread(tid);
+      ThreadData *current = ok ? &thread : nullptr;
+      if (current == nullptr) {
+        // 新线程的第一次停止先于父线程的 clone 事件到达
+        current = adopt_thread(tid);
+        if (current == nullptr) {
+          continue;
         }
-      } else if (WSTOPSIG(status) == SIGTRAP) {
-        if (!trace_breakpoint(tid)) {
-          return false;
+      }
+      if (current->adopting && WIFSTOPPED(status) &&
+          WSTOPSIG(status) == SIGSTOP) {
+        // 自动附加时的 SIGSTOP 不传递给线程
+        current->adopting = false;
+        if (detaching) {
+          current->detach_signal = 0;
+          ready_to_detach(*current);
+        } else {
+          resume_event(tid, *current);
         }
-      } else {
-        // signal delivery stop
-        ptrace(PTRACE_SYSCALL, tid, 0, WSTOPSIG(status));
         continue;
       }
-      ptrace(PTRACE_SYSCALL, tid, 0, 0);
+      current->adopting = false;
+      current->deferred = false;
+
+      switch (handle_event(tid, *current, status)) {
+      case EventResult::RESUMED:
+        break;
+      case EventResult::EXITED: {
+        std::lock_guard<std::mutex> lock(detach_mutex);
+        tracing_threads--;
+        detach_cv.notify_all();
+        break;
+      }
+      case EventResult::DETACHING:
+        ready_to_detach(*current);
+        break;
+      case EventResult::FAILED:
+        return false;
+      }
+    }
+  }
+
+  // seccomp 模式下子进程在安装过滤器和 execve 之前暂停
+  // 需要先设置 PTRACE_O_TRACESECCOMP，否则被过滤的 execve 会返回 ENOSYS
+  bool wait_target_exec() {
+    ptrace(PTRACE_SETOPTIONS, target_pid, nullptr,
+           PTRACE_O_TRACESECCOMP | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL);
+    int status, signal = 0;
+    while (true) {
+      if (ptrace(PTRACE_CONT, target_pid, 0, signal) < 0) {
+        perror("wait target exec");
+        return false;
+      }
+      if (waitpid(target_pid, &status, 0) < 0) {
+        perror("waitpid target exec");
+        return false;
+      }
+      if (!WIFSTOPPED(status)) {
+        Log("target exited before exec");
+        return false;
+      }
+      if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXEC << 8))) {
+        return true;
+      }
+      // 忽略 execve 自身的 seccomp 停止和之前的 SIGSTOP
+      signal = (WSTOPSIG(status) == SIGTRAP || WSTOPSIG(status) == SIGSTOP)
+                   ? 0
+                   : WSTOPSIG(status);
     }
-    return true;
   }
   static inline void on_mmap_invoke(T *self, pid_t tid,
                                     const user_regs_struct &regs,
@@ -522,6 +1573,23 @@ private:
   static inline void on_mmap_result(T *self, pid_t tid,
                                     const user_regs_struct &regs,
                                     ThreadSafeArena &) {
+    // 映射库文件的开头时记录基址，设置断点时不必重新解析 /proc/pid/maps
+    // 系统调用返回时参数寄存器不变，r8 为 fd，r9 为文件偏移
+    if (self->has_loading_libraries && regs.r9 == 0 &&
+        static_cast<int>(regs.r8) >= 0) {
+      auto file_path = get_file_path(self->target_pid, regs.r8);
+      std::lock_guard<std::mutex> lock(self->libraries_mutex);
+      if (self->loading_libraries.find(file_path) !=
+          self->loading_libraries.end()) {
+        if (regs.rax > static_cast<uint64_t>(-4096)) {
+          // 映射失败
+          self->loading_libraries.erase(file_path);
+          self->has_loading_libraries = !self->loading_libraries.empty();
+        } else {
+          self->mapped_libraries.emplace_back(file_path, regs.rax);
+        }
+      }
+    }
     if (regs.rax < self->breakpoint_max &&
         regs.rax + regs.rsi > self->breakpoint_min) {
       self->Debugger::reset_breakpoint(tid, regs.rax, regs.rax + regs.rsi);
@@ -532,52 +1600,175 @@ private:
 protected:
   pid_t target_pid;
   std::string target_path;
+  // 附加 pid 的所有其它线程，每个线程由独立的追踪线程附加和跟踪。
+  // 重复扫描直到没有新线程，返回时所有线程都已被附加，可以安全地设置断点
   bool attach_all_threads(pid_t pid) {
-    DIR *dir;
-    struct dirent *entry;
     char task_path[256];
     snprintf(task_path, sizeof(task_path), "/proc/%d/task", pid);
 
-    dir = opendir(task_path);
-    if (dir == nullptr) {
-      perror("opendir");
-      return false;
-    }
-
-    while ((entry = readdir(dir)) != nullptr) {
-      if (entry->d_name[0] == '.') {
-        continue; // 跳过 "." 和 ".."
+    while (true) {
+      DIR *dir = opendir(task_path);
+      if (dir == nullptr) {
+        perror("opendir");
+        return false;
       }
-
-      int tid = atoi(entry->d_name);
-      if (tid == 0) {
-        continue;
+      size_t found = 0;
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != nullptr) {
+        int tid = atoi(entry->d_name);
+        // 跳过 "." 和 ".."，主线程已经附加过
+        if (tid == 0 || tid == pid) {
+          continue;
+        }
+        auto thread = try_add_thread(tid);
+        if (thread == nullptr) {
+          continue;
+        }
+        found++;
+        if (debug_config.engine == TraceEngine::LOOP) {
+          // 由调用线程附加，保持暂停，在 trace_loop 中开始运行
+          int status = 0;
+          if (ptrace(PTRACE_ATTACH, tid, nullptr, nullptr) == 0 &&
+              waitpid(tid, &status, __WALL) == tid && WIFSTOPPED(status)) {
+            Log("[%d] attached thread", tid);
+          } else {
+            Log("[%d] attach thread failed: %s", tid, strerror(errno));
+            std::unique_lock<std::shared_mutex> lock(threads_mutex);
+            threads.erase(tid);
+          }
+          continue;
+        }
+        active_threads++;
+        attaching_threads++;
+        thread->tracer = std::thread([this, tid]() -> void {
+          // 新线程交接期间仍被创建它的追踪线程跟踪，稍后重试
+          long result = -1;
+          for (int retry = 0; retry < 1000; retry++) {
+            result = ptrace(PTRACE_ATTACH, tid, nullptr, nullptr);
+            if (result == 0 || errno != EPERM) {
+              break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          }
+          int status = 0;
+          if (result == 0) {
+            waitpid(tid, &status, __WALL);
+          } else {
+            Log("[%d] attach thread failed: %s", tid, strerror(errno));
+          }
+          attaching_threads--;
+          if (result == 0 && WIFSTOPPED(status)) {
+            Log("[%d] attached thread", tid);
+            trace_thread(tid);
+          }
+          active_threads--;
+        });
       }
+      closedir(dir);
 
-      // 如果 tid 等于 pid，则说明这是主线程，已经附加过，跳过
-      if (tid == pid) {
-        continue;
+      while (attaching_threads != 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
       }
-      int status;
-      // printf("Attaching to thread: %d\n", tid);
-      waitpid(tid, &status, __WALL);
-      ptrace(PTRACE_DETACH, tid, nullptr, SIGSTOP);
-      ptrace(PTRACE_ATTACH, tid);
-      waitpid(tid, &status, 0);
-      if (!trace_thread(tid)) {
-        return false;
+      if (found == 0) {
+        return true;
       }
     }
+  }
 
-    closedir(dir);
-    return true;
+  // 结束追踪：暂停所有线程，恢复断点后分离，之后目标进程以原速运行。
+  // 可在任意线程调用，线程暂停前重复发送 SIGSTOP（单步期间收到的会被丢弃）
+  void detach() {
+    Log("debugger detach from pid(%d)", target_pid);
+    // 先关闭 uprobe 事件，分离后目标不再进入内核采样
+    uprobes.stop();
+    detaching = true;
+    std::unique_lock<std::mutex> lock(detach_mutex);
+    while (!breakpoints_restored && tracing_threads > 0) {
+      {
+        std::shared_lock<std::shared_mutex> threads_lock(threads_mutex);
+        for (auto &[tid, thread] : threads) {
+          if (!thread.detach_ready) {
+            syscall(SYS_tgkill, target_pid, tid, SIGSTOP);
+          }
+        }
+      }
+      detach_cv.wait_for(lock, std::chrono::milliseconds(100));
+    }
+  }
+
+  // 内核 uprobe 缓冲区满时丢弃的采样数
+  uint64_t uprobe_lost_count() const { return uprobes.lost_count; }
+  // 打开失败的 uprobe 事件数（之后加入的线程或加载的库）
+  uint64_t uprobe_open_failed_count() const {
+    return uprobes.open_failed_count;
+  }
+
+  // 在 uprobe 读取线程中按时间顺序调用，与断点处的回调相同，寄存器来自采样
+  void handle_uprobe_sample(const UprobeTracer::Sample &sample) {
+    auto &callbacks = get_function_callbacks();
+    if (sample.probe >= callbacks.size()) {
+      return;
+    }
+    auto &c = callbacks[sample.probe];
+    // 采样按时间顺序处理，退出时间之前的采样都已处理
+    {
+      std::lock_guard<std::mutex> lock(uprobe_exited_mutex);
+      std::erase_if(uprobe_exited,
+                    [this, &sample](const std::pair<pid_t, uint64_t> &item) {
+                      if (item.second >= sample.time) {
+                        return false;
+                      }
+                      uprobe_threads.erase(item.first);
+                      return true;
+                    });
+    }
+    auto &thread = uprobe_threads[sample.tid];
+    auto sp = sample.regs.rsp;
+    // 返回后 rsp 比入口处大 8，一并弹出因 longjmp、异常等未经返回探针的调用；
+    // 入口处 rsp 不大于当前 rsp 的调用都已经结束
+    while (!thread.return_sps.empty() &&
+           (sample.is_return ? thread.return_sps.back() < sp
+                             : thread.return_sps.back() <= sp)) {
+      thread.return_sps.pop_back();
+      thread.returns.pop_back();
+    }
+
+    auto callback = sample.is_return ? c.result : c.invoke;
+    if (callback != nullptr) {
+      auto current = sample;
+      current.returns = thread.returns.data();
+      current.return_count = thread.returns.size();
+      static_cast<SubClass *>(this)->on_uprobe_sample(thread.arena, &current);
+      callback(static_cast<SubClass *>(this), sample.tid, sample.regs,
+               thread.arena);
+      static_cast<SubClass *>(this)->on_uprobe_sample(thread.arena, nullptr);
+    }
+
+    // 入口采样先于内核改写返回地址，栈顶仍是原始返回地址
+    if (!sample.is_return && c.result != nullptr &&
+        sample.stack_size >= sizeof(uintptr_t)) {
+      uintptr_t ra;
+      memcpy(&ra, sample.stack, sizeof(ra));
+      thread.return_sps.push_back(sp);
+      thread.returns.push_back(ra);
+      // 跳板页在首次命中返回探针时创建，通知重新读取映射
+      if (!uprobe_trampoline_mapped) {
+        uprobe_trampoline_mapped = true;
+        static_cast<SubClass *>(this)->on_library_loaded(sample.tid);
+      }
+    }
   }
+
   bool run() {
     Log("debugger for pid(%d) start", target_pid);
 
     int status;
     /* 等待子进程停止执行第一个指令 */
     waitpid(target_pid, &status, 0);
+    if (debug_config.isSeccomp && !wait_target_exec()) {
+      return false;
+    }
+    build_syscall_table();
 
     target_path = get_target_path(target_pid);
     if (target_path.empty()) {
@@ -585,20 +1776,53 @@ protected:
     }
     Log("path: %s", target_path.c_str());
 
-    // TODO: 需要检查已经开启的所有线程，全都attach
+    if (debug_config.backend == TraceBackend::UPROBE &&
+        !uprobes.start(debug_config.uprobeStackSize,
+                       [this](const UprobeTracer::Sample &sample) {
+                         handle_uprobe_sample(sample);
+                       })) {
+      return false;
+    }
     add_thread(target_pid);
-    if (!trace_thread(target_pid)) {
+    if (debug_config.isAttach) {
+      // 先附加所有线程再设置断点，否则未被跟踪的线程执行到断点时会被 SIGTRAP 终止
+      if (!attach_all_threads(target_pid) || !setup_breakpoint(target_pid)) {
+        return false;
+      }
+    }
+    // 已有线程的 uprobe 事件打开失败时不开始跟踪，否则这些线程的调用全部丢失；
+    // 附加时其它追踪线程可能正在设置断点，等待其完成
+    while (doing_setup.test()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (uprobes.open_failed_count > 0) {
+      Log("[error] failed to open uprobe events, check the open file limit");
       return false;
     }
+    if (debug_config.engine == TraceEngine::LOOP) {
+      if (!trace_loop()) {
+        return false;
+      }
+    } else {
+      if (!trace_thread(target_pid)) {
+        return false;
+      }
 
-    // wait for remaining threads
-    constexpr auto interval = std::chrono::milliseconds(200);
-    while (active_threads != 0) {
-      std::this_thread::sleep_for(interval);
-    }
+      // wait for remaining threads
+      constexpr auto interval = std::chrono::milliseconds(200);
+      while (active_threads != 0) {
+        std::this_thread::sleep_for(interval);
+      }
 
-    join_threads();
+      join_threads();
+    }
 
+    if (detaching) {
+      // 清除分离后仍未处理的 SIGSTOP，恢复被暂停的线程
+      kill(target_pid, SIGCONT);
+    }
+    // 处理剩余的采样
+    uprobes.stop();
     Log("debugger end");
     return true;
   }
@@ -607,12 +1831,15 @@ protected:
   using Callback = void (*)(SubClass *, pid_t, const user_regs_struct &,
                             ThreadSafeArena &);
 
+  // op 为回调记录的操作，UNKNOWN 表示调试器自身使用的回调，不受 --ops 影响
   struct SyscallCallback {
     uint64_t syscall;
+    Operation op;
     Callback invoke;
     Callback result;
-    SyscallCallback(uint64_t syscall_, Callback invoke_, Callback result_)
-        : syscall(syscall_), invoke(invoke_), result(result_) {}
+    SyscallCallback(uint64_t syscall_, Operation op_, Callback invoke_,
+                    Callback result_)
+        : syscall(syscall_), op(op_), invoke(invoke_), result(result_) {}
   };
 
   static inline std::vector<SyscallCallback> &get_syscall_callbacks() {
@@ -620,19 +1847,30 @@ protected:
     return syscall_callbacks;
   }
 
+  // 所有注册了回调的系统调用号（去重），用于生成 seccomp 过滤器
+  static inline std::vector<uint64_t> get_traced_syscalls() {
+    std::set<uint64_t> syscalls;
+    for (auto &c : get_syscall_callbacks()) {
+      syscalls.insert(c.syscall);
+    }
+    return {syscalls.begin(), syscalls.end()};
+  }
+
   struct SyscallRegister {
-    SyscallRegister(uint64_t syscall, Callback invoke, Callback result) {
-      get_syscall_callbacks().emplace_back(syscall, invoke, result);
+    SyscallRegister(uint64_t syscall, Operation op, Callback invoke,
+                    Callback result) {
+      get_syscall_callbacks().emplace_back(syscall, op, invoke, result);
     }
   };
 
   struct FunctionCallback {
     std::string name;
+    Operation op;
     Callback invoke;
     Callback result;
-    FunctionCallback(const std::string_view &name_, Callback invoke_,
-                     Callback result_)
-        : name(name_), invoke(invoke_), result(result_) {}
+    FunctionCallback(const std::string_view &name_, Operation op_,
+                     Callback invoke_, Callback result_)
+        : name(name_), op(op_), invoke(invoke_), result(result_) {}
   };
 
   static inline std::vector<FunctionCallback> &get_function_callbacks() {
@@ -641,16 +1879,25 @@ protected:
   }
 
   struct FunctionRegister {
-    FunctionRegister(const std::string_view &name, Callback invoke,
-                     Callback result) {
-      get_function_callbacks().emplace_back(name, invoke, result);
+    FunctionRegister(const std::string_view &name, Operation op,
+                     Callback invoke, Callback result) {
+      get_function_callbacks().emplace_back(name, op, invoke, result);
     }
   };
-  static inline auto on_mmap_register =
-      SyscallRegister(SYS_mmap, on_mmap_invoke, on_mmap_result);
+  static inline auto on_mmap_register = SyscallRegister(
+      SYS_mmap, op_type::UNKNOWN, on_mmap_invoke, on_mmap_result);
+
+  // 启动前按 --ops 移除未选择的操作的回调，之后不再为其设置断点或分发系统调用
+  static void select_operations(const OperationSet &ops) {
+    auto unselected = [&ops](auto &c) {
+      return c.op != op_type::UNKNOWN && !ops[c.op.index()];
+    };
+    std::erase_if(get_function_callbacks(), unselected);
+    std::erase_if(get_syscall_callbacks(), unselected);
+  }
 };
 
-#define DEBUG_SYSCALL_1(NAME, INVOKE)                                          \
+#define DEBUG_SYSCALL_1(NAME, OP, INVOKE)                                      \
   void INVOKE(pid_t, const user_regs_struct &, ThreadSafeArena &);             \
   static inline void debug_##NAME##_callback_##INVOKE(                         \
       SubClass *self, pid_t tid, const user_regs_struct &regs,                 \
@@ -658,9 +1905,10 @@ protected:
     self->INVOKE(tid, regs, arena);                                            \
   }                                                                            \
   static inline auto debug_##NAME##_register =                                 \
-      SyscallRegister(SYS_##NAME, debug_##NAME##_callback_##INVOKE, nullptr)
+      SyscallRegister(SYS_##NAME, op_type::OP,                                 \
+                      debug_##NAME##_callback_##INVOKE, nullptr)
 
-#define DEBUG_SYSCALL_2(NAME, INVOKE, RESULT)                                  \
+#define DEBUG_SYSCALL_2(NAME, OP, INVOKE, RESULT)                              \
   void INVOKE(pid_t, const user_regs_struct &, ThreadSafeArena &);             \
   static inline void debug_##NAME##_callback_##INVOKE(                         \
       SubClass *self, pid_t tid, const user_regs_struct &regs,                 \
@@ -674,15 +1922,16 @@ protected:
     self->RESULT(tid, regs, arena);                                            \
   }                                                                            \
   static inline auto debug_##NAME##_register =                                 \
-      SyscallRegister(SYS_##NAME, debug_##NAME##_callback_##INVOKE,            \
+      SyscallRegister(SYS_##NAME, op_type::OP,                                 \
+                      debug_##NAME##_callback_##INVOKE,                        \
                       debug_##NAME##_callback_##RESULT)
 
 #define DEBUG_SYSCALL_(_1, _2, NAME, ...) NAME
-#define DEBUG_SYSCALL(NAME, ...)                                               \
+#define DEBUG_SYSCALL(NAME, OP, ...)                                           \
   DEBUG_SYSCALL_(__VA_ARGS__, DEBUG_SYSCALL_2, DEBUG_SYSCALL_1)                \
-  (NAME, __VA_ARGS__)
+  (NAME, OP, __VA_ARGS__)
 
-#define DEBUG_FUNCTION_1(NAME, INVOKE)                                         \
+#define DEBUG_FUNCTION_1(NAME, OP, INVOKE)                                     \
   void INVOKE(pid_t, const user_regs_struct &, ThreadSafeArena &);             \
   static inline void debug_##NAME##_callback_##INVOKE(                         \
       SubClass *self, pid_t tid, const user_regs_struct &regs,                 \
@@ -690,9 +1939,10 @@ protected:
     self->INVOKE(tid, regs, arena);                                            \
   }                                                                            \
   static inline auto debug_##NAME##_register =                                 \
-      FunctionRegister(#NAME, debug_##NAME##_callback_##INVOKE, nullptr)
+      FunctionRegister(#NAME, op_type::OP,                                     \
+                       debug_##NAME##_callback_##INVOKE, nullptr)
 
-#define DEBUG_FUNCTION_2(NAME, INVOKE, RESULT)                                 \
+#define DEBUG_FUNCTION_2(NAME, OP, INVOKE, RESULT)                             \
   void INVOKE(pid_t, const user_regs_struct &, ThreadSafeArena &);             \
   static inline void debug_##NAME##_callback_##INVOKE(                         \
       SubClass *self, pid_t tid, const user_regs_struct &regs,                 \
@@ -706,12 +1956,13 @@ protected:
     self->RESULT(tid, regs, arena);                                            \
   }                                                                            \
   static inline auto debug_##NAME##_register =                                 \
-      FunctionRegister(#NAME, debug_##NAME##_callback_##INVOKE,                \
+      FunctionRegister(#NAME, op_type::OP,                                     \
+                       debug_##NAME##_callback_##INVOKE,                       \
                        debug_##NAME##_callback_##RESULT)
 
 #define DEBUG_FUNCTION_(_1, _2, NAME, ...) NAME
-#define DEBUG_FUNCTION(NAME, ...)                                              \
+#define DEBUG_FUNCTION(NAME, OP, ...)                                          \
   DEBUG_FUNCTION_(__VA_ARGS__, DEBUG_FUNCTION_2, DEBUG_FUNCTION_1)             \
-  (NAME, __VA_ARGS__)
+  (NAME, OP, __VA_ARGS__)
 
 } // namespace Memory::Profile
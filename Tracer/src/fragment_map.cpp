@@ -0,0 +1,239 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "fragment_map.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace Memory::Profile {
+
+void FragmentMap::add(uint64_t start, uint64_t end, uint8_t status) {
+  auto size = int64_t(end - start);
+  if (status == FREE) {
+    current.total_free += size;
+    current.free_count++;
+    free_sizes.insert(end - start);
+  } else if (status == ALLOC) {
+    current.total_used += size;
+    current.used_count++;
+  }
+  current.largest_free = free_sizes.empty() ? 0 : *free_sizes.rbegin();
+}
+
+void FragmentMap::remove(uint64_t start, uint64_t end, uint8_t status) {
+  auto size = int64_t(end - start);
+  if (status == FREE) {
+    current.total_free -= size;
+    current.free_count--;
+    auto item = free_sizes.find(end - start);
+    if (item != free_sizes.end()) {
+      free_sizes.erase(item);
+    }
+  } else if (status == ALLOC) {
+    current.total_used -= size;
+    current.used_count--;
+  }
+  current.largest_free = free_sizes.empty() ? 0 : *free_sizes.rbegin();
+}
+
+void FragmentMap::update(uint64_t addr, uint64_t size, Status status) {
+  if (size == 0) {
+    return;
+  }
+  auto addr_end = addr + size;
+
+  // 1. 与 [addr, addr_end) 重叠的片段为 [first, last)
+  auto first = fragments.lower_bound(addr);
+  if (first != fragments.begin()) {
+    auto prev = std::prev(first);
+    if (prev->second.end > addr) {
+      first = prev;
+    }
+  }
+  auto last = fragments.lower_bound(addr_end);
+  for (auto item = first; item != last; ++item) {
+    remove(item->first, item->second.end, item->second.status);
+  }
+
+  // 2. 被切断的左右两侧与代表当前操作的新片段
+  Fragment pieces[3];
+  size_t count = 0;
+  if (first != fragments.end() && first->first < addr) {
+    pieces[count++] = {first->first, addr, first->second.status};
+  }
+  if (status == ALLOC || status == FREE) {
+    pieces[count++] = {addr, addr_end, status};
+  }
+  if (last != fragments.begin()) {
+    auto prev = std::prev(last);
+    if (prev->second.end > addr_end) {
+      pieces[count++] = {addr_end, prev->second.end, prev->second.status};
+    }
+  }
+
+  // 3. 合并相邻的空闲片段
+  Fragment merged[3];
+  size_t merged_count = 0;
+  if (count > 0) {
+    // 与左侧的邻居合并
+    if (first != fragments.begin()) {
+      auto left = std::prev(first);
+      if (left->second.end == pieces[0].start &&
+          left->second.status == FREE && pieces[0].status == FREE) {
+        remove(left->first, left->second.end, left->second.status);
+        pieces[0].start = left->first;
+        first = left;
+      }
+    }
+    merged[merged_count++] = pieces[0];
+    for (size_t i = 1; i < count; i++) {
+      auto &back = merged[merged_count - 1];
+      if (pieces[i].start == back.end && back.status == FREE &&
+          pieces[i].status == FREE) {
+        back.end = pieces[i].end;
+      } else {
+        merged[merged_count++] = pieces[i];
+      }
+    }
+    // 与右侧的邻居合并
+    auto &back = merged[merged_count - 1];
+    if (last != fragments.end() && back.end == last->first &&
+        last->second.status == FREE && back.status == FREE) {
+      remove(last->first, last->second.end, last->second.status);
+      back.end = last->second.end;
+      ++last;
+    }
+  }
+
+  // 4. 替换受影响的片段
+  auto hint = fragments.erase(first, last);
+  for (size_t i = 0; i < merged_count; i++) {
+    auto &piece = merged[i];
+    fragments.emplace_hint(hint, piece.start, Piece{piece.end, piece.status});
+    add(piece.start, piece.end, piece.status);
+  }
+}
+
+void FragmentMap::assign(const std::vector<Fragment> &list) {
+  fragments.clear();
+  free_sizes.clear();
+  current = {};
+  for (auto &fragment : list) {
+    fragments.emplace_hint(fragments.end(), fragment.start,
+                           Piece{fragment.end, fragment.status});
+    add(fragment.start, fragment.end, fragment.status);
+  }
+}
+
+void FragmentMap::build(uint64_t base, uint64_t top,
+                        std::vector<std::pair<uint64_t, uint64_t>> allocs) {
+  std::sort(allocs.begin(), allocs.end());
+  std::vector<Fragment> list;
+  auto pos = base;
+  for (auto &[addr, size] : allocs) {
+    auto start = std::max(addr, pos);
+    auto end = addr + size;
+    if (start >= end) {
+      continue;
+    }
+    if (start > pos) {
+      list.push_back({pos, start, FREE});
+    }
+    list.push_back({start, end, ALLOC});
+    pos = end;
+  }
+  if (pos < top) {
+    list.push_back({pos, top, FREE});
+  }
+  assign(list);
+}
+
+void FragmentMap::collect(uint64_t begin, uint64_t end,
+                          std::vector<Fragment> &out) const {
+  out.clear();
+  for (auto item = fragments.lower_bound(begin);
+       item != fragments.end() && item->first < end; ++item) {
+    out.push_back({item->first, item->second.end, item->second.status});
+  }
+}
+
+} // namespace Memory::Profile
+
+using Memory::Profile::FragmentMap;
+
+struct mpr_fragments {
+  FragmentMap map;
+  std::vector<FragmentMap::Fragment> list;
+  std::vector<uint64_t> start;
+  std::vector<uint64_t> end;
+  std::vector<uint8_t> status;
+};
+
+static void export_stats(const FragmentMap &map, mpr_fragment_stats *stats) {
+  auto &current = map.stats();
+  stats->total_used = current.total_used;
+  stats->total_free = current.total_free;
+  stats->largest_free = current.largest_free;
+  stats->free_count = current.free_count;
+  stats->used_count = current.used_count;
+}
+
+mpr_fragments *mpr_fragments_new(void) { return new mpr_fragments; }
+
+void mpr_fragments_free(mpr_fragments *map) { delete map; }
+
+void mpr_fragments_update(mpr_fragments *map, uint64_t addr, uint64_t size,
+                          int status, mpr_fragment_stats *stats) {
+  map->map.update(addr, size, FragmentMap::Status(status));
+  if (stats != nullptr) {
+    export_stats(map->map, stats);
+  }
+}
+
+void mpr_fragments_stats(const mpr_fragments *map, mpr_fragment_stats *stats) {
+  export_stats(map->map, stats);
+}
+
+void mpr_fragments_assign(mpr_fragments *map, const uint64_t *start,
+                          const uint64_t *end, const uint8_t *status,
+                          size_t count) {
+  map->list.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    map->list[i] = {start[i], end[i], status[i]};
+  }
+  map->map.assign(map->list);
+}
+
+void mpr_fragments_build(mpr_fragments *map, uint64_t base, uint64_t top,
+                         const uint64_t *addr, const uint64_t *size,
+                         size_t count) {
+  std::vector<std::pair<uint64_t, uint64_t>> allocs(count);
+  for (size_t i = 0; i < count; i++) {
+    allocs[i] = {addr[i], size[i]};
+  }
+  map->map.build(base, top, std::move(allocs));
+}
+
+size_t mpr_fragments_collect(mpr_fragments *map, uint64_t begin, uint64_t end,
+                             mpr_fragment_list *list) {
+  map->map.collect(begin, end, map->list);
+  auto count = map->list.size();
+  map->start.resize(count);
+  map->end.resize(count);
+  map->status.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    map->start[i] = map->list[i].start;
+    map->end[i] = map->list[i].end;
+    map->status[i] = map->list[i].status;
+  }
+  list->count = count;
+  list->start = map->start.data();
+  list->end = map->end.data();
+  list->status = map->status.data();
+  return count;
+}
@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace Memory::Profile {
+
+// Analyzer 中 MemoryFragmentManager 的 C++ 实现：按起始地址有序的内存片段，
+// 另用有序的空闲片段大小集合维护最大空闲片段，每次更新为 O(k log n)
+// （k 为被覆盖的片段数），不需要重新扫描全部片段。
+// 更新、合并与统计的规则与 Python 版本一致：只合并相邻的空闲片段
+class FragmentMap {
+public:
+  enum Status : uint8_t {
+    FREE = 0,
+    ALLOC = 1,
+    REMOVE = 2, // 移除区域内的片段（brk 收缩），不插入新片段
+  };
+
+  struct Fragment {
+    uint64_t start;
+    uint64_t end;
+    uint8_t status;
+  };
+
+  struct Stats {
+    int64_t total_used = 0;
+    int64_t total_free = 0;
+    uint64_t largest_free = 0;
+    int64_t free_count = 0;
+    int64_t used_count = 0;
+  };
+
+  void update(uint64_t addr, uint64_t size, Status status);
+  // 以有序、不重叠的片段替换当前状态（从序列化的状态恢复）
+  void assign(const std::vector<Fragment> &list);
+  // 由 brk 范围 [base, top) 与其中的存活分配 (地址, 大小) 构建（用于检查点）
+  void build(uint64_t base, uint64_t top,
+             std::vector<std::pair<uint64_t, uint64_t>> allocs);
+
+  const Stats &stats() const { return current; }
+  size_t size() const { return fragments.size(); }
+  // 起始地址在 [begin, end) 内的片段
+  void collect(uint64_t begin, uint64_t end, std::vector<Fragment> &out) const;
+
+private:
+  struct Piece {
+    uint64_t end;
+    uint8_t status;
+  };
+
+  std::map<uint64_t, Piece> fragments; // 起始地址 -> 片段
+  std::multiset<uint64_t> free_sizes;
+  Stats current;
+
+  void add(uint64_t start, uint64_t end, uint8_t status);
+  void remove(uint64_t start, uint64_t end, uint8_t status);
+};
+
+} // namespace Memory::Profile
+
+// 供 Python（ctypes）使用的 C 接口，片段列表中的指针在下一次调用之前有效
+extern "C" {
+
+struct mpr_fragment_stats {
+  int64_t total_used;
+  int64_t total_free;
+  uint64_t largest_free;
+  int64_t free_count;
+  int64_t used_count;
+};
+
+struct mpr_fragment_list {
+  size_t count;
+  const uint64_t *start;
+  const uint64_t *end;
+  const uint8_t *status;
+};
+
+typedef struct mpr_fragments mpr_fragments;
+
+mpr_fragments *mpr_fragments_new(void);
+void mpr_fragments_free(mpr_fragments *map);
+// status 为 FragmentMap::Status，stats 不为空时写入更新后的统计
+void mpr_fragments_update(mpr_fragments *map, uint64_t addr, uint64_t size,
+                          int status, struct mpr_fragment_stats *stats);
+void mpr_fragments_stats(const mpr_fragments *map,
+                         struct mpr_fragment_stats *stats);
+void mpr_fragments_assign(mpr_fragments *map, const uint64_t *start,
+                          const uint64_t *end, const uint8_t *status,
+                          size_t count);
+void mpr_fragments_build(mpr_fragments *map, uint64_t base, uint64_t top,
+                         const uint64_t *addr, const uint64_t *size,
+                         size_t count);
+// 起始地址在 [begin, end) 内的片段，返回个数
+size_t mpr_fragments_collect(mpr_fragments *map, uint64_t begin, uint64_t end,
+                             struct mpr_fragment_list *list);
+}
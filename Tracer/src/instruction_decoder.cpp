@@ -0,0 +1,492 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "instruction_decoder.h"
+
+#include <cstring>
+#include <initializer_list>
+
+namespace Memory::Profile {
+
+namespace {
+// 操作码属性
+enum : uint16_t {
+  MODRM = 1 << 0,
+  IMM8 = 1 << 1,
+  IMM16 = 1 << 2,
+  IMMZ = 1 << 3,  // 16/32 位立即数，取决于 0x66 前缀
+  IMMV = 1 << 4,  // 16/32/64 位立即数，取决于 0x66 前缀与 REX.W
+  MOFFS = 1 << 5, // 32/64 位地址偏移，取决于 0x67 前缀
+  REL8 = 1 << 6,
+  REL32 = 1 << 7,
+  INVALID = 1 << 8,
+};
+
+// 单字节操作码表（64 位模式）
+uint16_t one_byte_flags(uint8_t op) {
+  if (op < 0x40) {
+    // 0x00-0x3F 为 ALU 指令，每 8 个一组
+    switch (op & 7) {
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+      return MODRM;
+    case 4:
+      return IMM8;
+    case 5:
+      return IMMZ;
+    default:
+      return INVALID;
+    }
+  }
+  if (op >= 0x50 && op <= 0x5F) {
+    return 0;
+  }
+  if (op >= 0x70 && op <= 0x7F) {
+    return REL8;
+  }
+  if (op >= 0x84 && op <= 0x8F) {
+    return MODRM;
+  }
+  if (op >= 0x90 && op <= 0x9F) {
+    return op == 0x9A ? INVALID : 0;
+  }
+  if (op >= 0xB0 && op <= 0xB7) {
+    return IMM8;
+  }
+  if (op >= 0xB8 && op <= 0xBF) {
+    return IMMV;
+  }
+  if (op >= 0xD8 && op <= 0xDF) {
+    return MODRM;
+  }
+  switch (op) {
+  case 0x63:
+    return MODRM;
+  case 0x68:
+    return IMMZ;
+  case 0x69:
+    return MODRM | IMMZ;
+  case 0x6A:
+    return IMM8;
+  case 0x6B:
+    return MODRM | IMM8;
+  case 0x6C:
+  case 0x6D:
+  case 0x6E:
+  case 0x6F:
+    return 0;
+  case 0x80:
+  case 0x83:
+    return MODRM | IMM8;
+  case 0x81:
+    return MODRM | IMMZ;
+  case 0xA0:
+  case 0xA1:
+  case 0xA2:
+  case 0xA3:
+    return MOFFS;
+  case 0xA8:
+    return IMM8;
+  case 0xA9:
+    return IMMZ;
+  case 0xA4:
+  case 0xA5:
+  case 0xA6:
+  case 0xA7:
+  case 0xAA:
+  case 0xAB:
+  case 0xAC:
+  case 0xAD:
+  case 0xAE:
+  case 0xAF:
+    return 0;
+  case 0xC0:
+  case 0xC1:
+  case 0xC6:
+    return MODRM | IMM8;
+  case 0xC7:
+    return MODRM | IMMZ;
+  case 0xC2:
+  case 0xCA:
+    return IMM16;
+  case 0xC8:
+    return IMM16 | IMM8;
+  case 0xCD:
+    return IMM8;
+  case 0xC3:
+  case 0xC9:
+  case 0xCB:
+  case 0xCC:
+  case 0xCF:
+    return 0;
+  case 0xD0:
+  case 0xD1:
+  case 0xD2:
+  case 0xD3:
+    return MODRM;
+  case 0xD7:
+    return 0;
+  case 0xE0:
+  case 0xE1:
+  case 0xE2:
+  case 0xE3:
+  case 0xEB:
+    return REL8;
+  case 0xE8:
+  case 0xE9:
+    return REL32;
+  case 0xE4:
+  case 0xE5:
+  case 0xE6:
+  case 0xE7:
+    return IMM8;
+  case 0xEC:
+  case 0xED:
+  case 0xEE:
+  case 0xEF:
+  case 0xF1:
+  case 0xF4:
+  case 0xF5:
+  case 0xF8:
+  case 0xF9:
+  case 0xFA:
+  case 0xFB:
+  case 0xFC:
+  case 0xFD:
+    return 0;
+  case 0xF6:
+  case 0xF7:
+  case 0xFE:
+  case 0xFF:
+    return MODRM;
+  default:
+    // 0x60-0x62, 0x82, 0xC4, 0xC5, 0xCE, 0xD4-0xD6, 0xEA 等
+    return INVALID;
+  }
+}
+
+// 双字节操作码表（0x0F 开头）
+uint16_t two_byte_flags(uint8_t op) {
+  if (op >= 0x80 && op <= 0x8F) {
+    return REL32;
+  }
+  if (op >= 0xC8 && op <= 0xCF) {
+    return 0; // bswap
+  }
+  if (op >= 0x30 && op <= 0x37) {
+    return 0; // wrmsr, rdtsc, rdmsr, rdpmc, sysenter, sysexit, getsec
+  }
+  switch (op) {
+  case 0x05:
+  case 0x06:
+  case 0x07:
+  case 0x08:
+  case 0x09:
+  case 0x0B:
+  case 0x0E:
+  case 0x77:
+  case 0xA0:
+  case 0xA1:
+  case 0xA2:
+  case 0xA8:
+  case 0xA9:
+  case 0xAA:
+    return 0;
+  case 0x0F:
+  case 0x70:
+  case 0x71:
+  case 0x72:
+  case 0x73:
+  case 0xA4:
+  case 0xAC:
+  case 0xBA:
+  case 0xC2:
+  case 0xC4:
+  case 0xC5:
+  case 0xC6:
+    return MODRM | IMM8;
+  case 0x04:
+  case 0x0A:
+  case 0x0C:
+  case 0x24:
+  case 0x25:
+  case 0x26:
+  case 0x27:
+  case 0x36:
+  case 0x39:
+  case 0x3B:
+  case 0x3C:
+  case 0x3D:
+  case 0x3E:
+  case 0x3F:
+  case 0x7A:
+  case 0x7B:
+  case 0xA6:
+  case 0xA7:
+    return INVALID;
+  default:
+    return MODRM;
+  }
+}
+
+bool is_legacy_prefix(uint8_t byte) {
+  switch (byte) {
+  case 0xF0:
+  case 0xF2:
+  case 0xF3:
+  case 0x2E:
+  case 0x36:
+  case 0x3E:
+  case 0x26:
+  case 0x64:
+  case 0x65:
+  case 0x66:
+  case 0x67:
+    return true;
+  default:
+    return false;
+  }
+}
+} // namespace
+
+bool decode_instruction(const uint8_t *code, size_t size, Instruction &insn) {
+  insn = Instruction{};
+  if (size > MAX_INSTRUCTION_LENGTH) {
+    size = MAX_INSTRUCTION_LENGTH;
+  }
+
+  size_t pos = 0;
+  bool operand_size = false, address_size = false;
+  uint8_t rex = 0;
+
+  // 前缀：REX 只有紧挨着操作码时才生效
+  while (pos < size) {
+    uint8_t byte = code[pos];
+    if (is_legacy_prefix(byte)) {
+      operand_size |= byte == 0x66;
+      address_size |= byte == 0x67;
+      rex = 0;
+      insn.rex_offset = -1;
+    } else if ((byte & 0xF0) == 0x40) {
+      rex = byte;
+      insn.rex_offset = static_cast<int8_t>(pos);
+    } else {
+      break;
+    }
+    pos++;
+  }
+  if (pos >= size) {
+    return false;
+  }
+
+  uint8_t op = code[pos++];
+  uint16_t flags = 0;
+  bool two_byte = false;
+  if (op == 0x0F) {
+    if (pos >= size) {
+      return false;
+    }
+    op = code[pos++];
+    two_byte = true;
+    if (op == 0x38 || op == 0x3A) {
+      // 三字节操作码，0F 3A 带 8 位立即数
+      if (pos >= size) {
+        return false;
+      }
+      pos++;
+      flags = MODRM | (op == 0x3A ? IMM8 : 0);
+      op = 0; // 三字节操作码不需要进一步区分
+      two_byte = false;
+    } else {
+      flags = two_byte_flags(op);
+    }
+  } else if (op == 0xC4 || op == 0xC5 || op == 0x62) {
+    // VEX/EVEX 编码暂不支持
+    return false;
+  } else if (op == 0x8F && pos < size && (code[pos] & 0x38) != 0) {
+    // XOP 编码暂不支持
+    return false;
+  } else {
+    flags = one_byte_flags(op);
+  }
+  if (flags & INVALID) {
+    return false;
+  }
+
+  uint8_t reg = 0;
+  if (flags & MODRM) {
+    if (pos >= size) {
+      return false;
+    }
+    insn.modrm_offset = static_cast<int8_t>(pos);
+    uint8_t modrm = code[pos++];
+    uint8_t mod = modrm >> 6, rm = modrm & 7;
+    reg = (modrm >> 3) & 7;
+    size_t disp = 0;
+    if (mod != 3) {
+      if (rm == 4) {
+        if (pos >= size) {
+          return false;
+        }
+        uint8_t sib = code[pos++];
+        if ((sib & 7) == 5 && mod == 0) {
+          disp = 4;
+        }
+      } else if (rm == 5 && mod == 0) {
+        insn.rip_relative = true;
+        disp = 4;
+      }
+      if (mod == 1) {
+        disp = 1;
+      } else if (mod == 2) {
+        disp = 4;
+      }
+    }
+    pos += disp;
+  }
+
+  // F6/F7 的立即数取决于 ModRM.reg
+  if (!two_byte && (op == 0xF6 || op == 0xF7) && reg <= 1) {
+    flags |= op == 0xF6 ? IMM8 : IMMZ;
+  }
+
+  if (flags & IMM8) {
+    pos += 1;
+  }
+  if (flags & IMM16) {
+    pos += 2;
+  }
+  if (flags & IMMZ) {
+    pos += operand_size ? 2 : 4;
+  }
+  if (flags & IMMV) {
+    pos += (rex & 0x08) ? 8 : (operand_size ? 2 : 4);
+  }
+  if (flags & MOFFS) {
+    pos += address_size ? 4 : 8;
+  }
+  if (flags & REL8) {
+    if (pos + 1 > size) {
+      return false;
+    }
+    insn.relative = static_cast<int8_t>(code[pos]);
+    pos += 1;
+  }
+  if (flags & REL32) {
+    if (pos + 4 > size) {
+      return false;
+    }
+    int32_t relative;
+    memcpy(&relative, code + pos, sizeof(relative));
+    insn.relative = relative;
+    pos += 4;
+  }
+  if (pos > size) {
+    return false;
+  }
+  insn.length = static_cast<uint8_t>(pos);
+
+  // 分类
+  insn.kind = Instruction::Kind::NORMAL;
+  if (two_byte) {
+    if (op >= 0x80 && op <= 0x8F) {
+      insn.kind = Instruction::Kind::JCC_REL;
+      insn.condition = op & 0x0F;
+    } else if (op == 0x05 || op == 0x07 || op == 0x34 || op == 0x35 ||
+               (op == 0xC7 && insn.rip_relative)) {
+      // syscall/sysret/sysenter/sysexit，以及隐式使用 rbx/rcx 的 cmpxchg16b
+      insn.kind = Instruction::Kind::UNSUPPORTED;
+    }
+  } else if (op >= 0x70 && op <= 0x7F) {
+    insn.kind = Instruction::Kind::JCC_REL;
+    insn.condition = op & 0x0F;
+  } else if (op == 0xE8) {
+    insn.kind = Instruction::Kind::CALL_REL;
+  } else if (op == 0xE9 || op == 0xEB) {
+    insn.kind = Instruction::Kind::JMP_REL;
+  } else if (op == 0xFF && reg == 2) {
+    insn.kind = Instruction::Kind::CALL_INDIRECT;
+  } else if ((op == 0xFF && (reg == 3 || reg == 5)) ||
+             (op >= 0xE0 && op <= 0xE3) || op == 0xCA || op == 0xCB ||
+             op == 0xCC || op == 0xCD || op == 0xCF || op == 0xF1 ||
+             op == 0xF4) {
+    // 远跳转、loop/jrcxz、中断与 hlt
+    insn.kind = Instruction::Kind::UNSUPPORTED;
+  }
+
+  // 相对跳转带 0x66 前缀、32 位寻址的 rip 相对寻址都不处理
+  if ((operand_size && (flags & (REL8 | REL32))) ||
+      (address_size && insn.rip_relative)) {
+    insn.kind = Instruction::Kind::UNSUPPORTED;
+  }
+  return true;
+}
+
+int relocate_rip_relative(const Instruction &insn, uint8_t *code) {
+  uint8_t modrm = code[insn.modrm_offset];
+  uint8_t reg = (modrm >> 3) & 7;
+  bool rex_r = insn.rex_offset >= 0 && (code[insn.rex_offset] & 0x04);
+
+  // 按 rbx、rsi、rdi 的顺序选择一个不与 ModRM.reg 冲突的寄存器
+  int base = 3;
+  for (int candidate : {3, 6, 7}) {
+    if (rex_r || candidate != reg) {
+      base = candidate;
+      break;
+    }
+  }
+
+  // mod=10, rm=base，即 [base + disp32]，位移保持不变
+  code[insn.modrm_offset] = 0x80 | (modrm & 0x38) | base;
+  if (insn.rex_offset >= 0) {
+    // 清除 REX.B，保证 base 为低 8 个寄存器
+    code[insn.rex_offset] &= ~0x01;
+  }
+  return base;
+}
+
+bool check_condition(uint8_t condition, uint64_t eflags) {
+  bool cf = eflags & (1 << 0);
+  bool pf = eflags & (1 << 2);
+  bool zf = eflags & (1 << 6);
+  bool sf = eflags & (1 << 7);
+  bool of = eflags & (1 << 11);
+
+  bool result = false;
+  switch (condition >> 1) {
+  case 0: // o
+    result = of;
+    break;
+  case 1: // b
+    result = cf;
+    break;
+  case 2: // e
+    result = zf;
+    break;
+  case 3: // be
+    result = cf || zf;
+    break;
+  case 4: // s
+    result = sf;
+    break;
+  case 5: // p
+    result = pf;
+    break;
+  case 6: // l
+    result = sf != of;
+    break;
+  case 7: // le
+    result = zf || sf != of;
+    break;
+  }
+  // 奇数条件码为取反
+  return (condition & 1) ? !result : result;
+}
+
+} // namespace Memory::Profile
@@ -0,0 +1,53 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Memory::Profile {
+
+// x86-64 指令的最大长度
+constexpr size_t MAX_INSTRUCTION_LENGTH = 15;
+
+// 指令解码结果，只保留离线单步（displaced step）需要的信息
+struct Instruction {
+  enum class Kind : uint8_t {
+    NORMAL,        // 可以直接在 scratch 页中单步执行
+    CALL_REL,      // call rel32，由调试器模拟执行
+    JMP_REL,       // jmp rel8/rel32，由调试器模拟执行
+    JCC_REL,       // jcc rel8/rel32，由调试器模拟执行
+    CALL_INDIRECT, // call r/m64，单步后需要修正压栈的返回地址
+    UNSUPPORTED,   // 无法离线执行，需要回退到暂停其它线程的方式
+  };
+
+  Kind kind = Kind::UNSUPPORTED;
+  uint8_t length = 0;
+  // ModRM 为 [rip + disp32] 形式
+  bool rip_relative = false;
+  // REX 前缀位置，不存在时为 -1
+  int8_t rex_offset = -1;
+  // ModRM 字节位置，不存在时为 -1
+  int8_t modrm_offset = -1;
+  // jcc 的条件码
+  uint8_t condition = 0;
+  // 相对跳转的位移
+  int32_t relative = 0;
+};
+
+// 解码 code 处的一条指令，失败或无法识别时返回 false
+bool decode_instruction(const uint8_t *code, size_t size, Instruction &insn);
+
+// 将 [rip + disp32] 改写为 [reg + disp32]，reg 为返回的寄存器编号(rbx/rsi/rdi)
+// 调用方需要在执行前把 reg 设置为原始指令的下一条指令地址
+int relocate_rip_relative(const Instruction &insn, uint8_t *code);
+
+// 根据 eflags 判断 jcc 条件是否成立
+bool check_condition(uint8_t condition, uint64_t eflags);
+
+} // namespace Memory::Profile
@@ -0,0 +1,391 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "live_heap.h"
+#include "allocation_sampler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+#include "boost/format.hpp"
+
+namespace Memory::Profile {
+
+// 记录到分配表中的分配操作（返回值为分配的地址）
+static bool IsTrackedAllocation(Operation op) {
+  switch (op.type()) {
+  case op_type::MALLOC:
+  case op_type::CALLOC:
+  case op_type::REALLOC:
+  case op_type::VALLOC:
+  case op_type::ALIGNED_ALLOC:
+  case op_type::NEW:
+  case op_type::NEW_ARRAY:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void LiveHeap::reset(size_t max_entries) {
+  this->max_entries = max_entries;
+  table.clear();
+  table_count = 0;
+  table_bits = 0;
+  sites.clear();
+  pending.clear();
+  brk_base = brk_top = 0;
+  next_sample = 0;
+  live_bytes = live_count = peak_bytes = 0;
+  peak_time = 0;
+  untracked_count = unmatched_free_count = 0;
+  if (max_entries > 0) {
+    table_bits = __builtin_ctzll(INITIAL_CAPACITY);
+    table.assign(INITIAL_CAPACITY, Entry{});
+  }
+}
+
+void LiveHeap::update(const TraceInfo &trace_info, uint32_t stack_id) {
+  if (!enabled()) {
+    return;
+  }
+  if (trace_info.timestamp >= next_sample) {
+    sample();
+    next_sample = trace_info.timestamp + SAMPLE_INTERVAL;
+  }
+
+  auto op = GetOperation(trace_info.tag);
+  auto key = (uint64_t(trace_info.tid) << 8) | op.index();
+  if (IsInvoke(trace_info.tag)) {
+    if (IsDeallocation(op)) {
+      if (trace_info.args[0] != 0) {
+        erase(trace_info.args[0]);
+      }
+    } else if (op.has_return()) {
+      // 与 Analyzer 相同，按 (tid, 操作) 匹配调用与返回
+      pending[key] = {trace_info.tag,
+                      {trace_info.args[0], trace_info.args[1]},
+                      trace_info.timestamp,
+                      stack_id,
+                      trace_info.weight};
+    }
+    return;
+  }
+
+  auto item = pending.find(key);
+  if (item == pending.end()) {
+    return;
+  }
+  auto args = item->second.args;
+  auto invoke_stack_id = item->second.stack_id;
+  pending.erase(item);
+  if (op == op_type::BRK) {
+    if (brk_base == 0) {
+      brk_base = trace_info.args[0];
+    }
+    brk_top = trace_info.args[0];
+    return;
+  }
+  if (!IsTrackedAllocation(op)) {
+    return;
+  }
+
+  auto addr = trace_info.args[0];
+  auto size = AllocationSize(op, args[0], args[1]);
+  // realloc 成功或以大小 0 调用时释放原来的分配
+  if (op == op_type::REALLOC && args[0] != 0 && (addr != 0 || size == 0)) {
+    erase(args[0]);
+  }
+  if (addr != 0) {
+    insert(addr, size, trace_info.timestamp, invoke_stack_id);
+  }
+}
+
+void LiveHeap::grow() {
+  std::vector<Entry> old(table.size() * 2, Entry{});
+  std::swap(old, table);
+  table_bits++;
+  auto mask = table.size() - 1;
+  for (auto &entry : old) {
+    if (entry.addr == 0) {
+      continue;
+    }
+    auto i = slot(entry.addr);
+    while (table[i].addr != 0) {
+      i = (i + 1) & mask;
+    }
+    table[i] = entry;
+  }
+}
+
+void LiveHeap::insert(uintptr_t addr, uint64_t size, timens_t timestamp,
+                      uint32_t stack_id) {
+  auto mask = table.size() - 1;
+  auto i = slot(addr);
+  while (table[i].addr != 0 && table[i].addr != addr) {
+    i = (i + 1) & mask;
+  }
+  if (table[i].addr == addr) {
+    // 同一地址再次分配，说明遗漏了释放，以新的分配为准
+    erase(addr);
+  } else if (table_count >= max_entries) {
+    untracked_count++;
+    return;
+  }
+  if ((table_count + 1) * 4 > table.size() * 3) {
+    grow();
+  }
+  mask = table.size() - 1;
+  i = slot(addr);
+  while (table[i].addr != 0) {
+    i = (i + 1) & mask;
+  }
+  table[i] = {addr, size, timestamp, stack_id};
+  table_count++;
+
+  if (stack_id >= sites.size()) {
+    sites.resize(stack_id + 1);
+  }
+  auto &site = sites[stack_id];
+  site.live_bytes += size;
+  site.live_count++;
+  site.alloc_bytes += size;
+  site.alloc_count++;
+  site.peak_bytes = std::max(site.peak_bytes, site.live_bytes);
+  live_bytes += size;
+  live_count++;
+  if (live_bytes > peak_bytes) {
+    peak_bytes = live_bytes;
+    peak_time = timestamp;
+  }
+}
+
+void LiveHeap::erase(uintptr_t addr) {
+  auto mask = table.size() - 1;
+  auto i = slot(addr);
+  while (table[i].addr != addr) {
+    if (table[i].addr == 0) {
+      unmatched_free_count++;
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+  auto &entry = table[i];
+  auto &site = sites[entry.stack_id];
+  site.live_bytes -= entry.size;
+  site.live_count--;
+  live_bytes -= entry.size;
+  live_count--;
+  table_count--;
+
+  // 向后移动后续条目，保持线性探测序列连续
+  for (auto j = (i + 1) & mask; table[j].addr != 0; j = (j + 1) & mask) {
+    auto k = slot(table[j].addr);
+    // k 不在 (i, j] 之间时可以移到 i
+    if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+      table[i] = table[j];
+      i = j;
+    }
+  }
+  table[i].addr = 0;
+}
+
+void LiveHeap::checkpoint(std::string &entry, timens_t timestamp,
+                          uint64_t event_count,
+                          const PendingFilter &skip_pending) const {
+  auto append = [&entry](const auto &value) {
+    entry.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  };
+  uint32_t pending_count = 0;
+  for (auto &[key, item] : pending) {
+    if (!skip_pending || !skip_pending(key)) {
+      pending_count++;
+    }
+  }
+  append(timestamp);
+  append(event_count);
+  append(uint64_t(brk_base));
+  append(uint64_t(brk_top));
+  append(uint32_t(table_count));
+  append(pending_count);
+  for (auto &item : table) {
+    if (item.addr == 0) {
+      continue;
+    }
+    append(uint64_t(item.addr));
+    append(item.size);
+    append(item.timestamp);
+    append(item.stack_id);
+  }
+  for (auto &[key, item] : pending) {
+    if (skip_pending && skip_pending(key)) {
+      continue;
+    }
+    append(item.tag);
+    append(pid_t(key >> 8));
+    append(uint64_t(item.args[0]));
+    append(uint64_t(item.args[1]));
+    append(item.timestamp);
+    append(item.stack_id);
+    append(item.weight);
+  }
+}
+
+LiveHeap::HeapUsage LiveHeap::heap_usage() const {
+  HeapUsage usage;
+  if (brk_top <= brk_base) {
+    return usage;
+  }
+  std::vector<std::pair<uintptr_t, uintptr_t>> blocks;
+  for (auto &entry : table) {
+    if (entry.addr >= brk_base && entry.addr < brk_top) {
+      blocks.emplace_back(entry.addr,
+                          std::min<uintptr_t>(entry.addr + entry.size, brk_top));
+    }
+  }
+  std::sort(blocks.begin(), blocks.end());
+  usage.heap_bytes = brk_top - brk_base;
+  auto pos = brk_base;
+  auto add_free = [&usage](uintptr_t begin, uintptr_t end) -> void {
+    if (end > begin) {
+      usage.free_bytes += end - begin;
+      usage.largest_free = std::max<uint64_t>(usage.largest_free, end - begin);
+    }
+  };
+  for (auto &[begin, end] : blocks) {
+    add_free(pos, begin);
+    pos = std::max(pos, end);
+  }
+  add_free(pos, brk_top);
+  return usage;
+}
+
+void LiveHeap::sample() {
+  for (auto &site : sites) {
+    site.trough_bytes = std::min(site.trough_bytes, site.live_bytes);
+  }
+}
+
+bool LiveHeap::save(const std::string &path, size_t top,
+                    const StackDescriber &describe) const {
+  std::ofstream file(path);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  auto printVar = [&file](const std::string &name, const auto &var) -> void {
+    file << boost::format("%-25s: ") % name << var << std::endl;
+  };
+  auto printStack = [&file, &describe](uint32_t stack_id) -> void {
+    if (stack_id == 0) {
+      file << "    <no stack>" << std::endl;
+      return;
+    }
+    for (auto &frame : describe(stack_id)) {
+      file << "    " << frame << std::endl;
+    }
+  };
+  // 各调用点的增长：当前存活字节数 - 采样到的最小存活字节数
+  auto growth = [](const Site &site) -> uint64_t {
+    return site.trough_bytes == UINT64_MAX
+               ? 0
+               : site.live_bytes - std::min(site.trough_bytes, site.live_bytes);
+  };
+
+  std::vector<uint32_t> ids;
+  for (uint32_t id = 0; id < sites.size(); id++) {
+    if (sites[id].alloc_count > 0) {
+      ids.push_back(id);
+    }
+  }
+
+  printVar("live_bytes", live_bytes);
+  printVar("live_count", live_count);
+  printVar("peak_live_bytes", peak_bytes);
+  printVar("peak_live_time", peak_time);
+  printVar("site_count", ids.size());
+  printVar("untracked_count", untracked_count);
+  printVar("unmatched_free_count", unmatched_free_count);
+
+  // 存活字节数最多的调用点
+  std::sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) {
+    return sites[a].live_bytes > sites[b].live_bytes;
+  });
+  file << std::endl << "-------- Top sites by live bytes" << std::endl;
+  for (size_t i = 0; i < ids.size() && i < top; i++) {
+    auto &site = sites[ids[i]];
+    if (site.live_bytes == 0) {
+      break;
+    }
+    file << boost::format("#%d stack=%u live_bytes=%u live_count=%u "
+                          "peak_bytes=%u alloc_bytes=%u alloc_count=%u") %
+                (i + 1) % ids[i] % site.live_bytes % site.live_count %
+                site.peak_bytes % site.alloc_bytes % site.alloc_count
+         << std::endl;
+    printStack(ids[i]);
+  }
+
+  // 增长最多的调用点
+  std::vector<uint32_t> growth_ids = ids;
+  std::sort(growth_ids.begin(), growth_ids.end(),
+            [this, &growth](uint32_t a, uint32_t b) {
+              return growth(sites[a]) > growth(sites[b]);
+            });
+  file << std::endl << "-------- Top sites by live bytes growth" << std::endl;
+  for (size_t i = 0; i < growth_ids.size() && i < top; i++) {
+    auto &site = sites[growth_ids[i]];
+    if (growth(site) == 0) {
+      break;
+    }
+    file << boost::format("#%d stack=%u growth=%u trough_bytes=%u "
+                          "live_bytes=%u") %
+                (i + 1) % growth_ids[i] % growth(site) % site.trough_bytes %
+                site.live_bytes
+         << std::endl;
+    printStack(growth_ids[i]);
+  }
+
+  // 结束时仍未释放的分配，按调用点汇总，只有前 top 个调用点输出调用栈
+  struct Leak {
+    timens_t oldest = INT64_MAX;
+    std::vector<uintptr_t> addrs;
+  };
+  std::map<uint32_t, Leak> leaks;
+  for (auto &entry : table) {
+    if (entry.addr == 0) {
+      continue;
+    }
+    auto &leak = leaks[entry.stack_id];
+    leak.oldest = std::min(leak.oldest, entry.timestamp);
+    if (leak.addrs.size() < LEAK_ADDRESS_MAX) {
+      leak.addrs.push_back(entry.addr);
+    }
+  }
+  file << std::endl << "-------- Leaks (live at exit)" << std::endl;
+  size_t rank = 0;
+  for (auto id : ids) {
+    auto item = leaks.find(id);
+    if (item == leaks.end()) {
+      continue;
+    }
+    auto &site = sites[id];
+    file << boost::format("stack=%u bytes=%u count=%u oldest_time=%d "
+                          "addrs=") %
+                id % site.live_bytes % site.live_count % item->second.oldest;
+    for (auto addr : item->second.addrs) {
+      file << boost::format("%#x ") % addr;
+    }
+    file << std::endl;
+    if (++rank <= top) {
+      printStack(id);
+    }
+  }
+  return true;
+}
+
+} // namespace Memory::Profile
@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "trace_writer.h"
+
+namespace Memory::Profile {
+
+// 在线维护的存活分配表：按地址记录大小、调用栈编号与时间戳，
+// 并按调用栈（调用点）统计存活字节数，结束时输出存活最多、增长最多的调用点
+// 以及未释放的分配（liveheap.txt）
+//
+// 由处理线程按时间顺序调用 update，不加锁；
+// 分配表为线性探测的开放寻址哈希表，所有条目位于一块连续内存中，
+// 条目数超过上限时不再记录新的分配，内存占用有界
+class LiveHeap {
+public:
+  // 记录各调用点存活字节数低谷的间隔（追踪时间）
+  static constexpr timens_t SAMPLE_INTERVAL = 100'000'000;
+  // 未释放分配列表中每个调用点列出的地址个数
+  static constexpr size_t LEAK_ADDRESS_MAX = 4;
+
+  LiveHeap() = default;
+  LiveHeap(const LiveHeap &) = delete;
+  LiveHeap &operator=(const LiveHeap &) = delete;
+
+  // 设置最多记录的分配个数并清空，0 表示不记录
+  void reset(size_t max_entries);
+  bool enabled() const { return max_entries > 0; }
+
+  // 处理一条追踪信息，stack_id 为其调用栈编号
+  void update(const TraceInfo &trace_info, uint32_t stack_id);
+
+  // 所有分配都已记录（未超过条目上限），此时才能生成检查点
+  bool complete() const { return untracked_count == 0; }
+  // 序列化检查点（TraceWriter::CHECKPOINT_ENTRY）：
+  // <q 时间戳><Q 事件数><Q brk 基址><Q brk 顶部><I 分配数><I 调用数>
+  // 分配：<Q 地址><Q 大小><q 时间戳><I 调用栈编号>
+  // 等待返回的调用：<B 标记><I tid><Q 参数1><Q 参数2><q 时间戳><I 调用栈编号><Q 权重>
+  // skip_pending 按 (tid << 8 | 操作) 排除尚未写入输出的调用
+  using PendingFilter = std::function<bool(uint64_t)>;
+  void checkpoint(std::string &entry, timens_t timestamp, uint64_t event_count,
+                  const PendingFilter &skip_pending = nullptr) const;
+
+  // brk 堆的使用情况：堆大小、未被存活分配占用的字节数及其中最大的连续空闲区，
+  // 不计分配器的块头与对齐，只是估计值
+  struct HeapUsage {
+    uint64_t heap_bytes = 0;
+    uint64_t free_bytes = 0;
+    uint64_t largest_free = 0;
+    // 碎片率：1 - 最大连续空闲区 / 空闲字节数
+    double fragmentation() const {
+      return free_bytes == 0 ? 0 : 1 - double(largest_free) / free_bytes;
+    }
+  };
+  HeapUsage heap_usage() const;
+
+  // 写入报告，top 为列出的调用点个数，describe 返回调用栈每帧的描述
+  using StackDescriber = std::function<std::vector<std::string>(uint32_t)>;
+  bool save(const std::string &path, size_t top,
+            const StackDescriber &describe) const;
+
+  uint64_t live_bytes = 0;         // 存活字节数
+  uint64_t live_count = 0;         // 存活分配个数
+  uint64_t peak_bytes = 0;         // 存活字节数峰值
+  timens_t peak_time = 0;          // 达到峰值的时间
+  uint64_t untracked_count = 0;    // 分配表已满而未记录的分配个数
+  uint64_t unmatched_free_count = 0; // 未找到对应分配的释放个数
+
+private:
+  // 分配表中的一项，addr 为 0 表示空位
+  struct Entry {
+    uintptr_t addr;
+    uint64_t size;
+    timens_t timestamp;
+    uint32_t stack_id;
+  };
+
+  // 按调用栈编号统计的调用点信息
+  struct Site {
+    uint64_t live_bytes = 0;
+    uint64_t live_count = 0;
+    uint64_t peak_bytes = 0;
+    uint64_t alloc_bytes = 0;
+    uint64_t alloc_count = 0;
+    // 采样时刻存活字节数的最小值，UINT64_MAX 表示尚未采样
+    uint64_t trough_bytes = UINT64_MAX;
+  };
+
+  // 等待返回的调用
+  struct Pending {
+    uint8_t tag;
+    uintptr_t args[2];
+    timens_t timestamp;
+    uint32_t stack_id;
+    uint64_t weight;
+  };
+
+  static constexpr size_t INITIAL_CAPACITY = 1 << 12;
+
+  size_t max_entries = 0;
+  std::vector<Entry> table; // 容量为 2 的幂，负载不超过 3/4
+  size_t table_count = 0;
+  int table_bits = 0;
+  std::vector<Site> sites; // 下标为调用栈编号，0 为没有调用栈的分配
+  std::unordered_map<uint64_t, Pending> pending; // (tid, 操作) 到调用参数
+  uintptr_t brk_base = 0; // 第一次 brk 返回的地址，0 表示尚未调用
+  uintptr_t brk_top = 0;  // 当前 brk 返回的地址
+  timens_t next_sample = 0;
+
+  size_t slot(uintptr_t addr) const {
+    return (addr * 0x9e3779b97f4a7c15ULL) >> (64 - table_bits);
+  }
+  void grow();
+  void insert(uintptr_t addr, uint64_t size, timens_t timestamp,
+              uint32_t stack_id);
+  void erase(uintptr_t addr);
+  // 记录各调用点当前的存活字节数
+  void sample();
+};
+
+} // namespace Memory::Profile
@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace Memory::Profile {
+
+// 按地址查找的只读有序表，写入方重建后以原子指针发布，读取方无锁二分查找
+// 只在加载库时重建，旧版本保留到析构，读取方不需要引用计数
+template <class V> class FlatTable {
+  struct Entry {
+    uintptr_t key;
+    V value;
+  };
+  using Version = std::vector<Entry>;
+
+  std::atomic<const Version *> current = nullptr;
+  std::vector<std::unique_ptr<const Version>> versions;
+
+public:
+  FlatTable() = default;
+  FlatTable(const FlatTable &) = delete;
+  FlatTable &operator=(const FlatTable &) = delete;
+
+  bool find(uintptr_t key, V &value) const {
+    auto table = current.load(std::memory_order_acquire);
+    if (table == nullptr) {
+      return false;
+    }
+    auto item = std::lower_bound(
+        table->begin(), table->end(), key,
+        [](const Entry &entry, uintptr_t key) { return entry.key < key; });
+    if (item == table->end() || item->key != key) {
+      return false;
+    }
+    value = item->value;
+    return true;
+  }
+
+  // 以 items 的内容发布新版本，调用方需保证写入方互斥
+  void publish(const std::map<uintptr_t, V> &items) {
+    auto table = std::make_unique<Version>();
+    table->reserve(items.size());
+    for (auto &[key, value] : items) {
+      table->push_back({key, value});
+    }
+    current.store(table.get(), std::memory_order_release);
+    versions.push_back(std::move(table));
+  }
+};
+
+// 只增不减的地址集合，线性探测的开放寻址哈希表，读取方无锁
+// 插入由调用方互斥，槽位以 release 写入，读取方看到地址时其它数据已经写入；
+// 扩容时复制到两倍大小的新表后发布，旧表保留到析构，总内存不超过最终表的两倍
+class AddressSet {
+  static constexpr size_t INITIAL_CAPACITY = 1 << 10;
+
+  struct Table {
+    explicit Table(size_t capacity)
+        : bits(__builtin_ctzll(capacity)), mask(capacity - 1),
+          slots(new std::atomic<uintptr_t>[capacity]) {
+      for (size_t i = 0; i < capacity; i++) {
+        slots[i].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    const int bits;
+    const size_t mask;
+    std::unique_ptr<std::atomic<uintptr_t>[]> slots; // 0 表示空位
+    size_t count = 0;
+
+    size_t slot(uintptr_t addr) const {
+      return (addr * 0x9e3779b97f4a7c15ULL) >> (64 - bits);
+    }
+  };
+
+  std::atomic<Table *> current;
+  std::vector<std::unique_ptr<Table>> tables;
+
+  // 写入方在已发布的表中插入，返回是否为新地址
+  static bool insert(Table &table, uintptr_t addr) {
+    auto i = table.slot(addr);
+    for (;; i = (i + 1) & table.mask) {
+      auto curr = table.slots[i].load(std::memory_order_relaxed);
+      if (curr == addr) {
+        return false;
+      }
+      if (curr == 0) {
+        break;
+      }
+    }
+    table.slots[i].store(addr, std::memory_order_release);
+    table.count++;
+    return true;
+  }
+
+public:
+  AddressSet() {
+    tables.push_back(std::make_unique<Table>(INITIAL_CAPACITY));
+    current = tables.back().get();
+  }
+  AddressSet(const AddressSet &) = delete;
+  AddressSet &operator=(const AddressSet &) = delete;
+
+  bool contains(uintptr_t addr) const {
+    auto table = current.load(std::memory_order_acquire);
+    for (auto i = table->slot(addr);; i = (i + 1) & table->mask) {
+      auto curr = table->slots[i].load(std::memory_order_acquire);
+      if (curr == addr) {
+        return true;
+      }
+      if (curr == 0) {
+        return false;
+      }
+    }
+  }
+
+  // addr 不能为 0，调用方需保证写入方互斥
+  void insert(uintptr_t addr) {
+    if (contains(addr)) {
+      return;
+    }
+    auto table = current.load(std::memory_order_relaxed);
+    // 负载不超过 1/2，保持探测序列较短
+    if ((table->count + 1) * 2 > table->mask + 1) {
+      auto next = std::make_unique<Table>((table->mask + 1) * 2);
+      for (size_t i = 0; i <= table->mask; i++) {
+        if (auto curr = table->slots[i].load(std::memory_order_relaxed)) {
+          insert(*next, curr);
+        }
+      }
+      table = next.get();
+      current.store(table, std::memory_order_release);
+      tables.push_back(std::move(next));
+    }
+    insert(*table, addr);
+  }
+};
+
+} // namespace Memory::Profile
@@ -0,0 +1,167 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "metrics_server.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "poll.h"
+#include "sys/socket.h"
+#include "sys/stat.h"
+#include "sys/un.h"
+#include "unistd.h"
+
+namespace Memory::Profile {
+
+static bool make_address(const std::string &path, sockaddr_un &addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    Log("[error] metrics socket path too long: %s", path.c_str());
+    return false;
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size());
+  return true;
+}
+
+bool MetricsServer::start(const std::string &path, Collector collector) {
+  sockaddr_un addr;
+  if (!make_address(path, addr)) {
+    return false;
+  }
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    perror("socket");
+    return false;
+  }
+  // 上次异常退出时遗留的套接字文件
+  unlink(path.c_str());
+  // 指标包含目标进程的信息，只允许当前用户连接：
+  // 套接字文件在 bind 时按 umask 创建，创建之后再 chmod 会留下可被连接的窗口
+  auto mask = umask(0177);
+  auto bound =
+      bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+  umask(mask);
+  if (!bound) {
+    perror("bind metrics socket");
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+  if (listen(listen_fd, 16) < 0) {
+    perror("listen metrics socket");
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(path.c_str());
+    return false;
+  }
+  socket_path = path;
+  this->collector = std::move(collector);
+  stopped = false;
+  thread = std::thread([this]() { serve(); });
+  Log("metrics: serving at %s", socket_path.c_str());
+  return true;
+}
+
+void MetricsServer::stop() {
+  stopped = true;
+  if (thread.joinable()) {
+    thread.join();
+  }
+  for (auto fd : clients) {
+    close(fd);
+  }
+  clients.clear();
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path.c_str());
+  }
+}
+
+void MetricsServer::serve() {
+  auto next = std::chrono::steady_clock::now() + INTERVAL;
+  while (!stopped) {
+    // 等待新连接直到下一次发送，最长等待 100ms 以便及时响应停止
+    auto now = std::chrono::steady_clock::now();
+    auto timeout = std::clamp<int64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(next - now)
+            .count(),
+        0, 100);
+    pollfd item = {listen_fd, POLLIN, 0};
+    if (poll(&item, 1, timeout) > 0) {
+      accept_clients();
+    }
+    if (std::chrono::steady_clock::now() < next) {
+      continue;
+    }
+    next += INTERVAL;
+    // 没有客户端时不收集指标
+    if (!clients.empty()) {
+      broadcast(collector() + "\n");
+    }
+  }
+}
+
+void MetricsServer::accept_clients() {
+  while (true) {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    clients.push_back(fd);
+  }
+}
+
+void MetricsServer::broadcast(const std::string &line) {
+  std::erase_if(clients, [&line](int fd) {
+    // 客户端读取过慢导致缓冲区满时同样断开，避免阻塞发送线程
+    auto n = send(fd, line.data(), line.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n == static_cast<ssize_t>(line.size())) {
+      return false;
+    }
+    close(fd);
+    return true;
+  });
+}
+
+int MetricsServer::Watch(const std::string &path) {
+  sockaddr_un addr;
+  if (!make_address(path, addr)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    fprintf(stderr, "connect %s: %s\n", path.c_str(), strerror(errno));
+    close(fd);
+    return -1;
+  }
+  char buffer[4096];
+  while (true) {
+    auto n = read(fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    fwrite(buffer, 1, n, stdout);
+    fflush(stdout);
+  }
+  close(fd);
+  return 0;
+}
+
+} // namespace Memory::Profile
@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sys/types.h"
+
+namespace Memory::Profile {
+
+// 追踪过程中的实时指标：在 Unix 域套接字上监听，
+// 每隔 INTERVAL 调用 collector 生成一行 JSON 发送给所有已连接的客户端。
+// 客户端只需连接并按行读取（如 mprofiler --watch），不会暂停目标进程
+class MetricsServer {
+public:
+  static constexpr auto INTERVAL = std::chrono::seconds(1);
+
+  using Collector = std::function<std::string()>;
+
+  MetricsServer() = default;
+  ~MetricsServer() { stop(); }
+  MetricsServer(const MetricsServer &) = delete;
+  MetricsServer &operator=(const MetricsServer &) = delete;
+
+  // 目标进程默认的套接字路径
+  static std::string DefaultPath(pid_t pid) {
+    return "/tmp/mprofiler-" + std::to_string(pid) + ".sock";
+  }
+
+  // 在 path 上监听并启动发送线程，collector 在发送线程中调用
+  bool start(const std::string &path, Collector collector);
+  // 停止发送线程，断开所有客户端并删除套接字文件
+  void stop();
+
+  // 客户端：连接 path 并把收到的数据输出到标准输出，直到服务端关闭
+  static int Watch(const std::string &path);
+
+private:
+  int listen_fd = -1;
+  std::vector<int> clients;
+  std::string socket_path;
+  Collector collector;
+  std::thread thread;
+  std::atomic<bool> stopped = false;
+
+  void serve();
+  // 接受所有等待中的连接
+  void accept_clients();
+  // 发送一行数据，发送失败的客户端被断开
+  void broadcast(const std::string &line);
+};
+
+} // namespace Memory::Profile
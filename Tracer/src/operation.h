@@ -0,0 +1,104 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Memory::Profile {
+
+// 操作枚举类型
+enum class op_type : uint8_t {
+  UNKNOWN = 0,
+  BRK,
+  SBRK,
+  MMAP,
+  MUNMAP,
+  CLONE,
+  CLONE3,
+  FORK,
+  VFORK,
+  EXECVE,
+  FREE,
+  MALLOC,
+  CALLOC,
+  REALLOC,
+  VALLOC,
+  POSIX_MEMALIGN,
+  ALIGNED_ALLOC,
+  NEW,
+  NEW_ARRAY,
+  DELETE_LEGACY,
+  DELETE,
+  DELETE_ARRAY,
+  _TYPE_COUNT,
+};
+
+// 封装的操作类型类
+class Operation {
+  op_type type_;
+
+public:
+  // 操作的元数据
+  struct OperationMeta {
+    std::string_view name; // 操作名称
+    uint8_t argc;          // 参数个数
+    bool has_return;       // 是否有返回值
+  };
+
+  // 操作类型数量
+  static constexpr size_t op_type_count =
+      static_cast<size_t>(op_type::_TYPE_COUNT);
+  // 操作元数据
+  static constexpr OperationMeta op_meta[op_type_count] = {
+      {"unknown", 2, true},       {"brk", 1, true},
+      {"sbrk", 1, true},          {"mmap", 2, true},
+      {"munmap", 2, true},        {"clone", 1, true},
+      {"clone3", 1, true},        {"fork", 0, true},
+      {"vfork", 0, true},         {"execve", 1, true},
+      {"free", 1, false},         {"malloc", 1, true},
+      {"calloc", 2, true},        {"realloc", 2, true},
+      {"valloc", 1, true},        {"posix_memalign", 2, true},
+      {"aligned_alloc", 2, true}, {"new", 1, true},
+      {"new_arr", 1, true},       {"delete_legacy", 1, false},
+      {"delete", 2, false},       {"delete_arr", 1, false},
+  };
+
+  // constexpr构造函数
+  constexpr Operation(op_type type) noexcept : type_(type) {}
+  // 转换到原始枚举
+  constexpr operator op_type() const noexcept { return type_; }
+  // 获取元数据
+  const OperationMeta &meta() const {
+    return op_meta[static_cast<size_t>(type_)];
+  }
+
+  // 读取方法
+  op_type type() const { return type_; }
+  uint8_t index() const { return static_cast<uint8_t>(type_); }
+  const std::string_view &name() const { return meta().name; }
+  uint8_t argc() const { return meta().argc; }
+  bool has_return() const { return meta().has_return; }
+
+  // Invoke操作，最低位为0
+  constexpr uint8_t invoke() const { return static_cast<uint8_t>(type_) << 1; }
+  // Result操作，最低位为1
+  constexpr uint8_t result() const {
+    return (static_cast<uint8_t>(type_) << 1) | 1;
+  }
+};
+
+// 判断操作是否为Invoke操作
+inline constexpr uint8_t IsInvoke(uint8_t tag) { return (tag & 1) == 0; }
+// 从标记中提取原始操作类型
+inline constexpr Operation GetOperation(uint8_t tag) {
+  return Operation(static_cast<op_type>(tag >> 1));
+}
+
+} // namespace Memory::Profile
@@ -0,0 +1,448 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "profile_reader.h"
+
+#include <array>
+#include <cstring>
+
+#include "zip_stream.h"
+
+namespace Memory::Profile {
+
+namespace {
+
+// 格式版本 1 的定长事件：<B 标记><I tid><Q 参数1><Q 参数2><q 时间戳><I 调用栈编号>
+constexpr size_t RECORD_V1_SIZE = 33;
+// 检查点条目：头部与每个分配、每个等待返回的调用的大小（见 LiveHeap::checkpoint）
+constexpr size_t CHECKPOINT_HEADER_SIZE = 40;
+constexpr size_t CHECKPOINT_ALLOC_SIZE = 28;
+constexpr size_t CHECKPOINT_PENDING_SIZE = 41;
+// arena 采样条目：头部与每个 arena 的大小（见 TraceWriter::write_arena）
+constexpr size_t ARENA_HEADER_SIZE = 10;
+constexpr size_t ARENA_SIZE = 77;
+// 丢弃的追踪信息条目：头部与每个标记的大小（见 TraceWriter::write_lost）
+constexpr size_t LOST_HEADER_SIZE = 30;
+constexpr size_t LOST_TAG_SIZE = 5;
+
+// 格式版本 2 中各标记的事件布局
+struct Layout {
+  uint8_t varints; // 变长整数个数
+  uint8_t argc;
+  bool is_call;    // 合并的调用
+  bool is_invoke;
+};
+
+constexpr Layout make_layout(uint8_t tag) {
+  bool is_call = tag & TraceWriter::CALL_ENTRY_FLAG;
+  tag &= ~TraceWriter::CALL_ENTRY_FLAG;
+  size_t op = tag >> 1;
+  uint8_t argc = op < Operation::op_type_count ? Operation::op_meta[op].argc : 2;
+  bool is_invoke = is_call || IsInvoke(tag);
+  // tid、时间差、调用耗时、参数、调用栈编号、返回值
+  uint8_t varints = 2 + is_call + (is_invoke ? argc + 1 : 0) +
+                    (is_call || !IsInvoke(tag) ? 1 : 0);
+  return {varints, argc, is_call, is_invoke};
+}
+
+constexpr auto LAYOUTS = [] {
+  std::array<Layout, 256> layouts{};
+  for (size_t tag = 0; tag < layouts.size(); tag++) {
+    layouts[tag] = make_layout(tag);
+  }
+  return layouts;
+}();
+
+// 名称、调用栈等特殊条目以外的标记
+inline bool is_event(uint8_t tag) {
+  return tag != TraceWriter::FILE_NAME_ENTRY &&
+         tag != TraceWriter::FUNC_NAME_ENTRY &&
+         tag < TraceWriter::LOST_ENTRY;
+}
+
+template <typename T> T load(const uint8_t *data) {
+  T value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+} // namespace
+
+void RecordBatch::clear() {
+  tag.clear();
+  is_call.clear();
+  tid.clear();
+  time.clear();
+  arg1.clear();
+  arg2.clear();
+  ret.clear();
+  stack_id.clear();
+  weight.clear();
+  offset.clear();
+  end.clear();
+}
+
+size_t DecodeRecords(const uint8_t *data, size_t size, size_t &offset,
+                     uint16_t version, size_t max_count, RecordBatch &batch) {
+  size_t count = 0;
+  size_t pos = offset;
+  uint64_t weight = 0;
+  uint64_t values[8];
+  while (count < max_count && pos < size) {
+    auto start = pos;
+    uint8_t tag = data[pos];
+    if (tag == TraceWriter::SAMPLE_WEIGHT_ENTRY) {
+      if (pos + 1 + sizeof(weight) > size) {
+        break;
+      }
+      weight = load<uint64_t>(data + pos + 1);
+      pos += 1 + sizeof(weight);
+      continue;
+    }
+    if (!is_event(tag)) {
+      break;
+    }
+
+    uint32_t tid = 0, stack_id = 0;
+    int64_t time = 0;
+    uint64_t arg1 = 0, arg2 = 0, ret = 0;
+    bool is_call = false;
+    if (version < TraceWriter::FORMAT_VERSION) {
+      if (pos + RECORD_V1_SIZE > size) {
+        break;
+      }
+      tid = load<uint32_t>(data + pos + 1);
+      arg1 = load<uint64_t>(data + pos + 5);
+      arg2 = load<uint64_t>(data + pos + 13);
+      time = load<int64_t>(data + pos + 21);
+      stack_id = load<uint32_t>(data + pos + 29);
+      pos += RECORD_V1_SIZE;
+    } else {
+      auto &layout = LAYOUTS[tag];
+      pos++;
+      // 依次读取 LEB128 变长整数
+      size_t n = 0;
+      uint64_t value = 0;
+      int shift = 0;
+      while (n < layout.varints && pos < size) {
+        uint8_t byte = data[pos++];
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+          values[n++] = value;
+          value = 0;
+          shift = 0;
+        } else {
+          shift += 7;
+        }
+      }
+      if (n < layout.varints) {
+        break;
+      }
+      tid = values[0];
+      time = int64_t(values[1] >> 1) ^ -int64_t(values[1] & 1);
+      // 合并的调用的调用耗时只用于记录
+      size_t next = layout.is_call ? 3 : 2;
+      if (layout.is_invoke) {
+        arg1 = layout.argc > 0 ? values[next] : 0;
+        arg2 = layout.argc > 1 ? values[next + 1] : 0;
+        next += layout.argc;
+      }
+      if (layout.is_call || !layout.is_invoke) {
+        ret = values[next];
+      }
+      if (layout.is_invoke) {
+        stack_id = values[layout.varints - 1];
+      }
+      is_call = layout.is_call;
+      tag &= ~TraceWriter::CALL_ENTRY_FLAG;
+    }
+
+    batch.tag.push_back(tag);
+    batch.is_call.push_back(is_call);
+    batch.tid.push_back(tid);
+    batch.time.push_back(time);
+    batch.arg1.push_back(arg1);
+    batch.arg2.push_back(arg2);
+    batch.ret.push_back(ret);
+    batch.stack_id.push_back(stack_id);
+    batch.weight.push_back(weight);
+    batch.offset.push_back(start);
+    batch.end.push_back(pos);
+    weight = 0;
+    offset = pos;
+    count++;
+  }
+  return count;
+}
+
+bool ProfileReader::open(const std::string &path) {
+  input = Zip::Stream::OpenFile(path);
+  if (input == nullptr || !*input) {
+    error_message = "failed to open " + path;
+    return false;
+  }
+  buffer.clear();
+  pos = 0;
+  input_end = false;
+  // 读取开头的格式条目，使 version() 在打开后即可用
+  bool complete;
+  if (fill() && uint8_t(buffer[0]) == TraceWriter::FORMAT_ENTRY) {
+    return read_entry(complete);
+  }
+  return true;
+}
+
+bool ProfileReader::fill() {
+  if (input_end) {
+    return false;
+  }
+  buffer.erase(0, pos);
+  base_offset += pos;
+  pos = 0;
+  auto size = buffer.size();
+  buffer.resize(size + READ_SIZE);
+  try {
+    input->read(buffer.data() + size, READ_SIZE);
+  } catch (const std::exception &e) {
+    error_message = e.what();
+    input->setstate(std::ios_base::badbit);
+  }
+  buffer.resize(size + input->gcount());
+  if (!*input) {
+    input_end = true;
+  }
+  return buffer.size() > size;
+}
+
+bool ProfileReader::read_entry(bool &complete) {
+  auto data = reinterpret_cast<const uint8_t *>(buffer.data()) + pos;
+  size_t size = buffer.size() - pos;
+  uint8_t tag = data[0];
+  complete = false;
+  if (tag == TraceWriter::FILE_NAME_ENTRY ||
+      tag == TraceWriter::FUNC_NAME_ENTRY) {
+    if (size < 3 || size < 3 + size_t(load<uint16_t>(data + 1))) {
+      return true;
+    }
+    auto length = load<uint16_t>(data + 1);
+    auto &names = tag == TraceWriter::FILE_NAME_ENTRY ? file_name_list
+                                                       : func_name_list;
+    names.emplace_back(reinterpret_cast<const char *>(data + 3), length);
+    pos += 3 + length;
+  } else if (tag == TraceWriter::FORMAT_ENTRY) {
+    if (size < 3) {
+      return true;
+    }
+    auto version = load<uint16_t>(data + 1);
+    if (version & TraceWriter::RAW_FORMAT_FLAG) {
+      error_message = "raw profile, convert it with mprofiler-symbolize first";
+      return false;
+    }
+    if (version < TraceWriter::FORMAT_VERSION_1 ||
+        version > TraceWriter::FORMAT_VERSION) {
+      error_message = "unsupported format version " + std::to_string(version);
+      return false;
+    }
+    format_version = version;
+    // 新的数据块，时间差重新开始计算
+    last_times.clear();
+    pos += 3;
+  } else if (tag == TraceWriter::STACK_ENTRY) {
+    if (size < 7) {
+      return true;
+    }
+    auto stack_id = load<uint32_t>(data + 1);
+    auto depth = load<uint16_t>(data + 5);
+    auto frame_size = sizeof(TraceWriter::FunctionInfo);
+    if (size < 7 + depth * frame_size) {
+      return true;
+    }
+    auto &frames = stacks[stack_id];
+    frames.resize(depth);
+    memcpy(frames.data(), data + 7, depth * frame_size);
+    pos += 7 + depth * frame_size;
+  } else if (tag == TraceWriter::CHECKPOINT_ENTRY) {
+    if (size < 1 + CHECKPOINT_HEADER_SIZE) {
+      return true;
+    }
+    auto allocs = load<uint32_t>(data + 1 + 32);
+    auto pending = load<uint32_t>(data + 1 + 36);
+    auto length = 1 + CHECKPOINT_HEADER_SIZE + allocs * CHECKPOINT_ALLOC_SIZE +
+                  pending * CHECKPOINT_PENDING_SIZE;
+    if (size < length) {
+      return true;
+    }
+    pos += length;
+  } else if (tag == TraceWriter::ARENA_ENTRY) {
+    if (size < 1 + ARENA_HEADER_SIZE) {
+      return true;
+    }
+    auto length =
+        1 + ARENA_HEADER_SIZE + load<uint16_t>(data + 9) * ARENA_SIZE;
+    if (size < length) {
+      return true;
+    }
+    pos += length;
+  } else if (tag == TraceWriter::LOST_ENTRY) {
+    if (size < 1 + LOST_HEADER_SIZE) {
+      return true;
+    }
+    auto length = 1 + LOST_HEADER_SIZE +
+                  load<uint16_t>(data + 1 + 28) * LOST_TAG_SIZE;
+    if (size < length) {
+      return true;
+    }
+    pos += length;
+  } else {
+    error_message = format_version == 0
+                        ? "missing format entry, format 0 is not supported"
+                        : "unexpected entry " + std::to_string(tag) +
+                              " at offset " + std::to_string(base_offset + pos);
+    return false;
+  }
+  complete = true;
+  return true;
+}
+
+bool ProfileReader::next(RecordBatch &batch, size_t max_count) {
+  batch.clear();
+  while (batch.size() < max_count && error_message.empty()) {
+    if (pos >= buffer.size() && !fill()) {
+      break;
+    }
+    uint8_t tag = buffer[pos];
+    if (format_version > 0 &&
+        (is_event(tag) || tag == TraceWriter::SAMPLE_WEIGHT_ENTRY)) {
+      auto begin = batch.size();
+      size_t offset = pos;
+      DecodeRecords(reinterpret_cast<const uint8_t *>(buffer.data()),
+                    buffer.size(), offset, format_version,
+                    max_count - begin, batch);
+      for (size_t i = begin; i < batch.size(); i++) {
+        if (format_version >= TraceWriter::FORMAT_VERSION) {
+          auto &last = last_times[batch.tid[i]];
+          last += batch.time[i];
+          batch.time[i] = last;
+        }
+        batch.offset[i] += base_offset;
+        batch.end[i] += base_offset;
+      }
+      if (offset != pos) {
+        pos = offset;
+      } else if (!fill()) {
+        // 记录跨越了已读取的数据且已到文件末尾
+        error_message = "truncated event at offset " +
+                        std::to_string(base_offset + pos);
+        break;
+      }
+      continue;
+    }
+    bool complete;
+    if (!read_entry(complete)) {
+      break;
+    }
+    if (!complete && !fill()) {
+      error_message = "truncated entry at offset " +
+                      std::to_string(base_offset + pos);
+      break;
+    }
+  }
+  return batch.size() > 0;
+}
+
+const std::vector<TraceWriter::FunctionInfo> *
+ProfileReader::stack(uint32_t stack_id) const {
+  auto item = stacks.find(stack_id);
+  return item != stacks.end() ? &item->second : nullptr;
+}
+
+} // namespace Memory::Profile
+
+using Memory::Profile::ProfileReader;
+using Memory::Profile::RecordBatch;
+
+struct mpr_decoder {
+  RecordBatch batch;
+};
+
+struct mpr_reader {
+  ProfileReader reader;
+  RecordBatch batch;
+};
+
+static void export_batch(const RecordBatch &batch, mpr_batch *out) {
+  out->count = batch.size();
+  out->tag = batch.tag.data();
+  out->is_call = batch.is_call.data();
+  out->tid = batch.tid.data();
+  out->time = batch.time.data();
+  out->arg1 = batch.arg1.data();
+  out->arg2 = batch.arg2.data();
+  out->ret = batch.ret.data();
+  out->stack_id = batch.stack_id.data();
+  out->weight = batch.weight.data();
+  out->offset = batch.offset.data();
+  out->end = batch.end.data();
+}
+
+mpr_decoder *mpr_decoder_new(void) { return new mpr_decoder; }
+
+void mpr_decoder_free(mpr_decoder *decoder) { delete decoder; }
+
+size_t mpr_decode(mpr_decoder *decoder, const uint8_t *data, size_t size,
+                  size_t offset, uint16_t version, size_t max_count,
+                  mpr_batch *batch) {
+  decoder->batch.clear();
+  Memory::Profile::DecodeRecords(data, size, offset, version, max_count,
+                                 decoder->batch);
+  export_batch(decoder->batch, batch);
+  return offset;
+}
+
+mpr_reader *mpr_open(const char *path) {
+  auto reader = new mpr_reader;
+  if (!reader->reader.open(path)) {
+    delete reader;
+    return nullptr;
+  }
+  return reader;
+}
+
+void mpr_close(mpr_reader *reader) { delete reader; }
+
+size_t mpr_next(mpr_reader *reader, size_t max_count, mpr_batch *batch) {
+  reader->reader.next(reader->batch, max_count);
+  export_batch(reader->batch, batch);
+  return batch->count;
+}
+
+uint16_t mpr_version(const mpr_reader *reader) {
+  return reader->reader.version();
+}
+
+const char *mpr_error(const mpr_reader *reader) {
+  return reader->reader.error().c_str();
+}
+
+size_t mpr_name_count(const mpr_reader *reader, int kind) {
+  return (kind == 0 ? reader->reader.file_names()
+                    : reader->reader.func_names())
+      .size();
+}
+
+const char *mpr_name(const mpr_reader *reader, int kind, size_t index) {
+  auto &names =
+      kind == 0 ? reader->reader.file_names() : reader->reader.func_names();
+  return index < names.size() ? names[index].c_str() : nullptr;
+}
+
+size_t mpr_stack(const mpr_reader *reader, uint32_t stack_id,
+                 const void **frames) {
+  auto stack = reader->reader.stack(stack_id);
+  *frames = stack != nullptr ? stack->data() : nullptr;
+  return stack != nullptr ? stack->size() : 0;
+}
@@ -0,0 +1,128 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "trace_writer.h"
+
+namespace Memory::Profile {
+
+// 列式的一批事件记录，各列长度相同
+struct RecordBatch {
+  std::vector<uint8_t> tag;      // 标记（不含 CALL_ENTRY_FLAG）
+  std::vector<uint8_t> is_call;  // 是否为合并的调用（格式版本 2）
+  std::vector<uint32_t> tid;
+  std::vector<int64_t> time;     // 时间戳，DecodeRecords 解码格式版本 2 时为时间差
+  std::vector<uint64_t> arg1;
+  std::vector<uint64_t> arg2;
+  std::vector<uint64_t> ret;     // 返回值（格式版本 2）
+  std::vector<uint32_t> stack_id;
+  std::vector<uint64_t> weight;  // 采样权重，0 表示未采样
+  std::vector<uint64_t> offset;  // 记录在解压后数据中的起始与结束位置
+  std::vector<uint64_t> end;
+
+  size_t size() const { return tag.size(); }
+  void clear();
+};
+
+// 解码解压后数据中从 offset 开始的连续事件记录（格式版本 1、2），最多 max_count 个，
+// 跳过其间的采样权重条目（权重写入下一个记录），遇到其它条目或数据不完整时停止。
+// 返回解码的记录个数，offset 更新到下一个未解码的位置
+size_t DecodeRecords(const uint8_t *data, size_t size, size_t &offset,
+                     uint16_t version, size_t max_count, RecordBatch &batch);
+
+// memory.profile 的流式读取：边解压边解码，名称条目与调用栈条目在读取时保存，
+// 事件按批返回，时间戳为绝对值。检查点与 arena 采样条目被跳过，不支持 raw 格式
+class ProfileReader {
+public:
+  bool open(const std::string &path);
+  // 读取最多 max_count 个事件，没有更多事件时返回 false
+  bool next(RecordBatch &batch, size_t max_count);
+
+  uint16_t version() const { return format_version; }
+  const std::vector<std::string> &file_names() const { return file_name_list; }
+  const std::vector<std::string> &func_names() const { return func_name_list; }
+  // 调用栈编号对应的各帧，未定义时返回 nullptr
+  const std::vector<TraceWriter::FunctionInfo> *stack(uint32_t stack_id) const;
+  const std::string &error() const { return error_message; }
+
+private:
+  // 每次从解压流中读取的数据大小
+  static constexpr size_t READ_SIZE = 1 << 20;
+
+  std::shared_ptr<std::istream> input;
+  std::string buffer; // 已解压、尚未解码的数据为 [pos, buffer.size())
+  size_t pos = 0;
+  uint64_t base_offset = 0; // buffer[0] 在解压后数据中的位置
+  bool input_end = false;
+  uint16_t format_version = 0;
+  std::unordered_map<uint32_t, int64_t> last_times; // 格式版本 2
+  std::vector<std::string> file_name_list;
+  std::vector<std::string> func_name_list;
+  std::unordered_map<uint32_t, std::vector<TraceWriter::FunctionInfo>> stacks;
+  std::string error_message;
+
+  // 再读取一块数据，已到文件末尾时返回 false
+  bool fill();
+  // 处理 pos 处的非事件条目，条目无法识别时返回 false，
+  // 数据不完整时 complete 为 false
+  bool read_entry(bool &complete);
+};
+
+} // namespace Memory::Profile
+
+// 供 Python（ctypes）使用的 C 接口，批次中的指针指向库内部的内存，
+// 在下一次解码或释放之前有效
+extern "C" {
+
+struct mpr_batch {
+  size_t count;
+  const uint8_t *tag;
+  const uint8_t *is_call;
+  const uint32_t *tid;
+  const int64_t *time;
+  const uint64_t *arg1;
+  const uint64_t *arg2;
+  const uint64_t *ret;
+  const uint32_t *stack_id;
+  const uint64_t *weight;
+  const uint64_t *offset;
+  const uint64_t *end;
+};
+
+typedef struct mpr_decoder mpr_decoder;
+typedef struct mpr_reader mpr_reader;
+
+mpr_decoder *mpr_decoder_new(void);
+void mpr_decoder_free(mpr_decoder *decoder);
+// DecodeRecords，返回下一个未解码的位置
+size_t mpr_decode(mpr_decoder *decoder, const uint8_t *data, size_t size,
+                  size_t offset, uint16_t version, size_t max_count,
+                  struct mpr_batch *batch);
+
+// 打开失败时返回 nullptr
+mpr_reader *mpr_open(const char *path);
+void mpr_close(mpr_reader *reader);
+// 读取下一批事件，返回事件个数，0 表示结束
+size_t mpr_next(mpr_reader *reader, size_t max_count, struct mpr_batch *batch);
+uint16_t mpr_version(const mpr_reader *reader);
+const char *mpr_error(const mpr_reader *reader);
+// kind 为 0（文件名）或 1（函数名）
+size_t mpr_name_count(const mpr_reader *reader, int kind);
+const char *mpr_name(const mpr_reader *reader, int kind, size_t index);
+// 调用栈的各帧（TraceWriter::FunctionInfo 数组），返回帧数
+size_t mpr_stack(const mpr_reader *reader, uint32_t stack_id,
+                 const void **frames);
+}
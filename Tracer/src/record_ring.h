@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "utils.h"
+
+namespace Memory::Profile {
+
+// 单生产者单消费者的变长记录环形缓冲区
+// 每条记录前有 8 字节的长度字段，记录按 8 字节对齐且不跨越缓冲区末尾，
+// 长度为 0 的记录表示填充到缓冲区末尾
+class RecordRing {
+  static constexpr size_t ALIGN = 8;
+
+  const size_t capacity;
+  std::unique_ptr<uint8_t[]> buffer;
+
+  alignas(64) std::atomic<uint64_t> head = 0; // 生产者位置
+  uint64_t reserved = 0;                      // 已申请但未发布的位置
+  uint64_t cached_tail = 0;                   // 生产者缓存的消费者位置
+  alignas(64) std::atomic<uint64_t> tail = 0; // 消费者位置
+
+  uint64_t &length(uint64_t pos) const {
+    return *reinterpret_cast<uint64_t *>(&buffer[pos & (capacity - 1)]);
+  }
+
+public:
+  // 消费者释放空间时通知生产者
+  Doorbell space;
+
+  // capacity 须为 2 的幂
+  explicit RecordRing(size_t capacity)
+      : capacity(capacity), buffer(new uint8_t[capacity]) {}
+
+  RecordRing(const RecordRing &) = delete;
+  RecordRing &operator=(const RecordRing &) = delete;
+
+  // 单条记录占用的字节数
+  static size_t record_size(size_t size) {
+    return ALIGN + ((size + ALIGN - 1) & ~(ALIGN - 1));
+  }
+
+  // 生产者申请 size 字节的连续空间，空间不足时返回 nullptr
+  void *reserve(size_t size) {
+    auto need = record_size(size);
+    if (need > capacity) {
+      return nullptr;
+    }
+    auto pos = head.load(std::memory_order_relaxed);
+    // 末尾剩余空间不足时先填充到末尾
+    auto offset = pos & (capacity - 1);
+    auto padding = offset + need > capacity ? capacity - offset : 0;
+    if (pos + padding + need - cached_tail > capacity) {
+      cached_tail = tail.load(std::memory_order_acquire);
+      if (pos + padding + need - cached_tail > capacity) {
+        return nullptr;
+      }
+    }
+    if (padding != 0) {
+      length(pos) = 0;
+      pos += padding;
+    }
+    length(pos) = size;
+    reserved = pos + need;
+    return &buffer[(pos & (capacity - 1)) + ALIGN];
+  }
+
+  // 生产者发布最近一次 reserve 的记录
+  void commit() { head.store(reserved, std::memory_order_release); }
+
+  // 消费者可读取的范围 [begin(), end())
+  uint64_t begin() const { return tail.load(std::memory_order_relaxed); }
+  uint64_t end() const { return head.load(std::memory_order_acquire); }
+  bool empty() const { return begin() == end(); }
+
+  // 消费者读取 pos 处的记录并前进到下一条，没有记录时返回 nullptr
+  // 返回的记录在 release 越过它之前保持有效
+  const void *read(uint64_t &pos, uint64_t end) const {
+    while (pos != end) {
+      auto size = length(pos);
+      if (size == 0) {
+        pos += capacity - (pos & (capacity - 1));
+        continue;
+      }
+      auto data = &buffer[(pos & (capacity - 1)) + ALIGN];
+      pos += record_size(size);
+      return data;
+    }
+    return nullptr;
+  }
+
+  // 消费者释放 pos 之前的记录
+  void release(uint64_t pos) {
+    tail.store(pos, std::memory_order_release);
+    space.ring();
+  }
+};
+
+} // namespace Memory::Profile
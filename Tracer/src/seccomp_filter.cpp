@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "seccomp_filter.h"
+#include "utils.h"
+
+#include "linux/audit.h"
+#include "linux/filter.h"
+#include "linux/seccomp.h"
+#include "sys/prctl.h"
+#include "sys/syscall.h"
+#include "unistd.h"
+
+namespace Memory::Profile {
+
+bool install_seccomp_filter(const std::vector<uint64_t> &syscalls) {
+  if (syscalls.size() > SECCOMP_FILTER_MAX) {
+    Log("seccomp filter: too many syscalls(%llu)", syscalls.size());
+    return false;
+  }
+
+  // 过滤器结构：
+  //   检查架构，非 x86-64 直接放行
+  //   依次比较系统调用号，命中则跳转到 TRACE
+  //   ALLOW
+  //   TRACE
+  std::vector<sock_filter> filter;
+  filter.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                            offsetof(struct seccomp_data, arch)));
+  filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 0,
+                            static_cast<uint8_t>(syscalls.size() + 1)));
+  filter.push_back(
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)));
+  for (size_t i = 0; i < syscalls.size(); i++) {
+    // 命中时跳过剩余的比较和 ALLOW
+    auto skip = static_cast<uint8_t>(syscalls.size() - i);
+    filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                              static_cast<uint32_t>(syscalls[i]), skip, 0));
+  }
+  filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+  filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+
+  sock_fprog prog = {
+      .len = static_cast<unsigned short>(filter.size()),
+      .filter = filter.data(),
+  };
+  // 非特权进程安装过滤器需要先设置 no_new_privs
+  if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+    perror("prctl(PR_SET_NO_NEW_PRIVS)");
+    return false;
+  }
+  if (syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, &prog) < 0) {
+    perror("seccomp(SECCOMP_SET_MODE_FILTER)");
+    return false;
+  }
+  return true;
+}
+
+} // namespace Memory::Profile
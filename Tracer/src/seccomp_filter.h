@@ -0,0 +1,23 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Memory::Profile {
+
+// seccomp-bpf 过滤器最多支持的系统调用个数（受 BPF 跳转偏移限制）
+constexpr size_t SECCOMP_FILTER_MAX = 255;
+
+// 在当前进程安装 seccomp-bpf 过滤器，syscalls 中的系统调用返回
+// SECCOMP_RET_TRACE，其余直接放行。需要在 execve 之前、被跟踪后调用
+bool install_seccomp_filter(const std::vector<uint64_t> &syscalls);
+
+} // namespace Memory::Profile
@@ -0,0 +1,167 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "self_stats.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "boost/format.hpp"
+#include "sys/syscall.h"
+#include "unistd.h"
+
+namespace Memory::Profile {
+
+namespace {
+thread_local SelfStats::ThreadStats *current_thread = nullptr;
+}
+
+void SelfStats::Histogram::merge(const Histogram &other) {
+  count += other.count;
+  total += other.total;
+  max = std::max(max, other.max);
+  for (size_t i = 0; i < BUCKETS; i++) {
+    buckets[i] += other.buckets[i];
+  }
+}
+
+uint64_t SelfStats::Histogram::percentile(double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = std::max<uint64_t>(1, q * count);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return std::min(max, (uint64_t(2) << i) - 1);
+    }
+  }
+  return max;
+}
+
+void SelfStats::ThreadStats::Recorder::add(uint64_t value) {
+  // 只有所属线程写入，不需要原子的读-改-写
+  auto relaxed = std::memory_order_relaxed;
+  size_t bucket = value > 0 ? std::bit_width(value) - 1 : 0;
+  bucket = std::min(bucket, Histogram::BUCKETS - 1);
+  count.store(count.load(relaxed) + 1, relaxed);
+  total.store(total.load(relaxed) + value, relaxed);
+  if (value > max.load(relaxed)) {
+    max.store(value, relaxed);
+  }
+  buckets[bucket].store(buckets[bucket].load(relaxed) + 1, relaxed);
+}
+
+SelfStats::Histogram SelfStats::ThreadStats::Recorder::load() const {
+  auto relaxed = std::memory_order_relaxed;
+  Histogram histogram;
+  histogram.count = count.load(relaxed);
+  histogram.total = total.load(relaxed);
+  histogram.max = max.load(relaxed);
+  for (size_t i = 0; i < Histogram::BUCKETS; i++) {
+    histogram.buckets[i] = buckets[i].load(relaxed);
+  }
+  return histogram;
+}
+
+uint64_t SelfStats::ThreadSummary::busy_ns() const {
+  // 追踪线程的其它阶段都在 trap 之内，uprobe 的处理线程没有 trap
+  auto tracing = phases[TRAP].count > 0 ? phases[TRAP].total : phases[ADD].total;
+  return tracing + phases[PROCESS].total + phases[COMPRESS].total;
+}
+
+SelfStats &SelfStats::Get() {
+  static SelfStats stats;
+  return stats;
+}
+
+SelfStats::ThreadStats &SelfStats::add_thread(const char *role) {
+  std::lock_guard<std::mutex> lock(threads_mutex);
+  auto &stats = threads.emplace_back();
+  stats.role = role;
+  stats.tid = static_cast<pid_t>(syscall(SYS_gettid));
+  return stats;
+}
+
+SelfStats::ThreadStats &SelfStats::Current() {
+  if (current_thread == nullptr) {
+    current_thread = &Get().add_thread("thread");
+  }
+  return *current_thread;
+}
+
+void SelfStats::SetThread(const char *role) {
+  if (current_thread != nullptr) {
+    current_thread->role = role;
+    return;
+  }
+  current_thread = &Get().add_thread(role);
+}
+
+SelfStats::Summary SelfStats::summarize() const {
+  auto relaxed = std::memory_order_relaxed;
+  Summary summary;
+  {
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    summary.threads.reserve(threads.size());
+    for (auto &stats : threads) {
+      auto &thread = summary.threads.emplace_back();
+      thread.role = stats.role;
+      thread.tid = stats.tid;
+      for (size_t i = 0; i < PHASE_COUNT; i++) {
+        thread.phases[i] = stats.phases[i].load();
+        summary.phases[i].merge(thread.phases[i]);
+      }
+      for (size_t i = 0; i < Operation::op_type_count; i++) {
+        summary.op_invoke_count[i] += stats.op_invoke_count[i].load(relaxed);
+        summary.op_result_count[i] += stats.op_result_count[i].load(relaxed);
+      }
+    }
+  }
+  summary.queue_bytes = queue_bytes.load();
+  std::stable_sort(summary.threads.begin(), summary.threads.end(),
+                   [](const ThreadSummary &lhs, const ThreadSummary &rhs) {
+                     return lhs.busy_ns() > rhs.busy_ns();
+                   });
+  return summary;
+}
+
+std::string SelfStats::Json(const Summary &summary, uint64_t bytes_in,
+                            uint64_t bytes_out) {
+  std::string phases;
+  for (size_t i = 0; i < PHASE_COUNT; i++) {
+    auto &phase = summary.phases[i];
+    if (phase.count == 0) {
+      continue;
+    }
+    phases += boost::str(
+        boost::format("%s\"%s\":{\"count\":%u,\"total_ms\":%.3f,"
+                      "\"avg_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f}") %
+        (phases.empty() ? "" : ",") % PHASE_NAMES[i] % phase.count %
+        (phase.total / 1e6) % (phase.average() / 1e3) %
+        (phase.percentile(0.99) / 1e3) % (phase.max / 1e3));
+  }
+  // 只列出最忙的几个线程
+  std::string threads;
+  for (size_t i = 0; i < summary.threads.size() && i < 8; i++) {
+    auto &thread = summary.threads[i];
+    threads += boost::str(boost::format("%s{\"role\":\"%s\",\"tid\":%d,"
+                                        "\"busy_ms\":%.3f}") %
+                          (threads.empty() ? "" : ",") % thread.role %
+                          thread.tid % (thread.busy_ns() / 1e6));
+  }
+  auto &queue = summary.queue_bytes;
+  return boost::str(
+      boost::format("{\"phases\":{%s},\"threads\":[%s],\"thread_count\":%u,"
+                    "\"queue_bytes_avg\":%.0f,\"queue_bytes_max\":%u,"
+                    "\"writer_bytes_in\":%u,\"writer_bytes_out\":%u}") %
+      phases % threads % summary.threads.size() % queue.average() % queue.max %
+      bytes_in % bytes_out);
+}
+
+} // namespace Memory::Profile
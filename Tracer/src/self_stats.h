@@ -0,0 +1,153 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sys/types.h"
+
+#include "operation.h"
+
+namespace Memory::Profile {
+
+// 追踪器自身的开销统计：各线程在各阶段的耗时分布与操作计数
+//
+// 每个线程只写入自己的统计块（relaxed 原子变量的读写，没有锁与原子加），
+// 结束时汇总与实时指标在其它线程中近似读取
+class SelfStats {
+public:
+  enum Phase : uint8_t {
+    TRAP,         // 处理一次 ptrace 停止（断点、系统调用或信号）
+    RESUME,       // resume_thread_breakpoint：越过断点继续执行
+    PAUSE_OTHERS, // 单步越过断点期间暂停其它线程
+    UNWIND,       // 采集调用栈
+    ADD,          // TraceData::add（包括采集调用栈与写入缓冲区）
+    RING_WAIT,    // 缓冲区满时等待处理线程释放空间
+    PROCESS,      // 处理线程写入一批追踪信息
+    SYMBOLIZE,    // 解析一批追踪信息中未缓存的地址
+    COMPRESS,     // 写入线程压缩并写入一个内存块
+    ARENA,        // 采样一次 glibc arena（--arena-interval）
+    PHASE_COUNT,
+  };
+  static constexpr const char *PHASE_NAMES[PHASE_COUNT] = {
+      "trap",    "resume_breakpoint", "pause_others",
+      "unwind",  "add",               "ring_wait",
+      "process", "symbolize",         "compress",
+      "arena_sample"};
+
+  // 对数分桶的直方图：第 i 个桶为 [2^i, 2^(i+1))，第 0 个桶包括 0
+  struct Histogram {
+    static constexpr size_t BUCKETS = 40;
+    uint64_t count = 0;
+    uint64_t total = 0;
+    uint64_t max = 0;
+    std::array<uint64_t, BUCKETS> buckets{};
+
+    void merge(const Histogram &other);
+    double average() const { return count > 0 ? double(total) / count : 0; }
+    // 分位数所在桶的上界（不超过最大值）
+    uint64_t percentile(double q) const;
+  };
+
+  // 单个线程的统计，只由所属线程写入
+  class ThreadStats {
+    struct Recorder {
+      std::atomic<uint64_t> count = 0;
+      std::atomic<uint64_t> total = 0;
+      std::atomic<uint64_t> max = 0;
+      std::atomic<uint64_t> buckets[Histogram::BUCKETS] = {};
+
+      void add(uint64_t value);
+      Histogram load() const;
+    };
+    Recorder phases[PHASE_COUNT];
+    std::atomic<uint64_t> op_invoke_count[Operation::op_type_count] = {};
+    std::atomic<uint64_t> op_result_count[Operation::op_type_count] = {};
+
+    friend class SelfStats;
+
+  public:
+    std::atomic<const char *> role; // 线程的角色，如 "tracer" "processor"
+    pid_t tid;
+
+    void record(Phase phase, uint64_t ns) { phases[phase].add(ns); }
+    void count_invoke(size_t op) { increase(op_invoke_count[op]); }
+    void count_result(size_t op) { increase(op_result_count[op]); }
+
+  private:
+    static void increase(std::atomic<uint64_t> &value) {
+      value.store(value.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+    }
+  };
+
+  // 在作用域结束时记录一个阶段的耗时
+  class Scope {
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+
+  public:
+    explicit Scope(Phase phase)
+        : phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~Scope() {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+      Current().record(phase, ns);
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
+
+  // 汇总结果
+  struct ThreadSummary {
+    const char *role;
+    pid_t tid;
+    Histogram phases[PHASE_COUNT];
+    uint64_t busy_ns() const; // 各外层阶段的耗时之和
+  };
+  struct Summary {
+    Histogram phases[PHASE_COUNT];
+    std::vector<ThreadSummary> threads; // 按耗时从大到小排列
+    Histogram queue_bytes; // 处理线程每次取数据时缓冲区中的字节数
+    uint64_t op_invoke_count[Operation::op_type_count] = {0};
+    uint64_t op_result_count[Operation::op_type_count] = {0};
+  };
+
+  // 进程内唯一的统计
+  static SelfStats &Get();
+  // 当前线程的统计块，首次使用时注册
+  static ThreadStats &Current();
+  // 设置当前线程的角色（字符串常量），线程开始时调用
+  static void SetThread(const char *role);
+
+  // 记录处理线程取数据时缓冲区中的字节数，只由处理线程调用
+  void record_queue(uint64_t bytes) { queue_bytes.add(bytes); }
+  // 汇总所有线程（包括已退出的线程）的统计
+  Summary summarize() const;
+  // 实时指标中的 JSON 对象，bytes_in/bytes_out 为写入的数据大小（未压缩/压缩后）
+  static std::string Json(const Summary &summary, uint64_t bytes_in,
+                          uint64_t bytes_out);
+
+private:
+  mutable std::mutex threads_mutex;
+  std::deque<ThreadStats> threads; // 地址不变，线程退出后保留
+  ThreadStats::Recorder queue_bytes;
+
+  ThreadStats &add_thread(const char *role);
+};
+
+} // namespace Memory::Profile
@@ -0,0 +1,785 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "stack_unwinder.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#include "elf.h"
+#include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/ptrace.h"
+#include "sys/stat.h"
+#include "sys/uio.h"
+#include "sys/user.h"
+#include "unistd.h"
+
+namespace Memory::Profile {
+
+namespace {
+// DWARF 寄存器编号（x86-64）
+constexpr uint8_t DW_RSP = 7;
+constexpr uint8_t DW_RBP = 6;
+constexpr uint8_t DW_RA = 16;
+
+// 指针编码（DW_EH_PE_*）
+constexpr uint8_t PE_OMIT = 0xff;
+constexpr uint8_t PE_ABSPTR = 0x00;
+constexpr uint8_t PE_ULEB128 = 0x01;
+constexpr uint8_t PE_UDATA2 = 0x02;
+constexpr uint8_t PE_UDATA4 = 0x03;
+constexpr uint8_t PE_UDATA8 = 0x04;
+constexpr uint8_t PE_SLEB128 = 0x09;
+constexpr uint8_t PE_SDATA2 = 0x0a;
+constexpr uint8_t PE_SDATA4 = 0x0b;
+constexpr uint8_t PE_SDATA8 = 0x0c;
+constexpr uint8_t PE_PCREL = 0x10;
+constexpr uint8_t PE_DATAREL = 0x30;
+// .eh_frame_hdr 查找表唯一常见的编码
+constexpr uint8_t PE_TABLE = PE_DATAREL | PE_SDATA4;
+
+// 带链接地址的只读数据游标
+struct Reader {
+  const uint8_t *begin;
+  const uint8_t *ptr;
+  const uint8_t *end;
+  uintptr_t addr; // begin 对应的链接地址
+
+  bool valid() const { return ptr != nullptr && ptr <= end; }
+  uintptr_t current() const { return addr + (ptr - begin); }
+
+  template <typename U> U read() {
+    U value{};
+    if (ptr + sizeof(U) > end) {
+      ptr = nullptr;
+      return value;
+    }
+    memcpy(&value, ptr, sizeof(U));
+    ptr += sizeof(U);
+    return value;
+  }
+
+  uint64_t uleb() {
+    uint64_t value = 0;
+    for (int shift = 0; ptr != nullptr && ptr < end; shift += 7) {
+      auto byte = *ptr++;
+      if (shift < 64) {
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      }
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    ptr = nullptr;
+    return value;
+  }
+
+  int64_t sleb() {
+    int64_t value = 0;
+    int shift = 0;
+    while (ptr != nullptr && ptr < end) {
+      auto byte = *ptr++;
+      if (shift < 64) {
+        value |= static_cast<int64_t>(byte & 0x7f) << shift;
+      }
+      shift += 7;
+      if ((byte & 0x80) == 0) {
+        if (shift < 64 && (byte & 0x40)) {
+          value |= -(static_cast<int64_t>(1) << shift);
+        }
+        return value;
+      }
+    }
+    ptr = nullptr;
+    return value;
+  }
+
+  void skip(size_t size) {
+    ptr = (ptr != nullptr && ptr + size <= end) ? ptr + size : nullptr;
+  }
+
+  // 读取按 encoding 编码的指针，data_base 为 datarel 的基址
+  uintptr_t encoded(uint8_t encoding, uintptr_t data_base = 0) {
+    if (encoding == PE_OMIT) {
+      return 0;
+    }
+    auto pc = current();
+    uintptr_t value = 0;
+    switch (encoding & 0x0f) {
+    case PE_ABSPTR:
+      value = read<uint64_t>();
+      break;
+    case PE_ULEB128:
+      value = uleb();
+      break;
+    case PE_UDATA2:
+      value = read<uint16_t>();
+      break;
+    case PE_UDATA4:
+      value = read<uint32_t>();
+      break;
+    case PE_UDATA8:
+      value = read<uint64_t>();
+      break;
+    case PE_SLEB128:
+      value = sleb();
+      break;
+    case PE_SDATA2:
+      value = read<int16_t>();
+      break;
+    case PE_SDATA4:
+      value = read<int32_t>();
+      break;
+    case PE_SDATA8:
+      value = read<int64_t>();
+      break;
+    default:
+      ptr = nullptr;
+      return 0;
+    }
+    switch (encoding & 0x70) {
+    case PE_PCREL:
+      value += pc;
+      break;
+    case PE_DATAREL:
+      value += data_base;
+      break;
+    default:
+      break;
+    }
+    return value;
+  }
+};
+
+// 执行 CFA 指令时的状态
+struct CfaState {
+  uint8_t cfa_register = DW_RSP;
+  int64_t cfa_offset = 8;
+  bool cfa_expression = false;
+};
+
+// user_regs_struct 到 DWARF 寄存器编号的映射
+constexpr decltype(&user_regs_struct::rax) REGISTER_MAP[] = {
+    &user_regs_struct::rax, &user_regs_struct::rdx, &user_regs_struct::rcx,
+    &user_regs_struct::rbx, &user_regs_struct::rsi, &user_regs_struct::rdi,
+    &user_regs_struct::rbp, &user_regs_struct::rsp, &user_regs_struct::r8,
+    &user_regs_struct::r9,  &user_regs_struct::r10, &user_regs_struct::r11,
+    &user_regs_struct::r12, &user_regs_struct::r13, &user_regs_struct::r14,
+    &user_regs_struct::r15, &user_regs_struct::rip,
+};
+} // namespace
+
+StackUnwinder::Module::~Module() {
+  if (data != nullptr) {
+    munmap(const_cast<uint8_t *>(data), length);
+  }
+}
+
+StackUnwinder::~StackUnwinder() = default;
+
+void StackUnwinder::reset(pid_t pid) {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  target_pid = pid;
+  modules.clear();
+  ranges.clear();
+  frames.clear();
+  stale = true;
+}
+
+bool StackUnwinder::StackMemory::read(uintptr_t addr, uint64_t &value) const {
+  if (addr >= base && addr + sizeof(value) <= base + size) {
+    memcpy(&value, data + (addr - base), sizeof(value));
+    return true;
+  }
+  // 超出栈副本的范围，单独读取
+  iovec local = {&value, sizeof(value)};
+  iovec remote = {reinterpret_cast<void *>(addr), sizeof(value)};
+  return process_vm_readv(tid, &local, 1, &remote, 1, 0) == sizeof(value);
+}
+
+std::shared_ptr<StackUnwinder::Module>
+StackUnwinder::load_module(const std::string &path) {
+  if (auto item = modules.find(path); item != modules.end()) {
+    return item->second;
+  }
+  // 无论成功与否都缓存，避免重复打开
+  auto module = std::make_shared<Module>();
+  module->path = path;
+  modules[path] = module;
+
+  auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return module;
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) < 0 || sb.st_size <= 0) {
+    close(fd);
+    return module;
+  }
+  auto length = static_cast<size_t>(sb.st_size);
+  auto data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return module;
+  }
+  module->data = static_cast<const uint8_t *>(data);
+  module->length = length;
+
+  // 解析 ELF 头、程序头和段表
+  auto bytes = module->data;
+  if (length <= sizeof(Elf64_Ehdr) || memcmp(bytes, ELFMAG, SELFMAG) != 0) {
+    return module;
+  }
+  auto ehdr = reinterpret_cast<const Elf64_Ehdr *>(bytes);
+  if (ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr) > length ||
+      ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > length ||
+      ehdr->e_shstrndx >= ehdr->e_shnum) {
+    return module;
+  }
+  auto phdrs = reinterpret_cast<const Elf64_Phdr *>(bytes + ehdr->e_phoff);
+  for (int i = 0; i < ehdr->e_phnum; i++) {
+    if (phdrs[i].p_type == PT_LOAD) {
+      module->loads.emplace_back(phdrs[i].p_offset, phdrs[i].p_vaddr);
+    }
+  }
+  auto shdrs = reinterpret_cast<const Elf64_Shdr *>(bytes + ehdr->e_shoff);
+  auto &shstrtab = shdrs[ehdr->e_shstrndx];
+  for (int i = 0; i < ehdr->e_shnum; i++) {
+    auto &shdr = shdrs[i];
+    if (shdr.sh_name >= shstrtab.sh_size || shdr.sh_type == SHT_NOBITS ||
+        shdr.sh_offset + shdr.sh_size > length) {
+      continue;
+    }
+    auto name =
+        reinterpret_cast<const char *>(bytes + shstrtab.sh_offset + shdr.sh_name);
+    if (strcmp(name, ".eh_frame_hdr") == 0) {
+      module->eh_frame_hdr = bytes + shdr.sh_offset;
+      module->eh_frame_hdr_addr = shdr.sh_addr;
+      // 头部：version, eh_frame_ptr_enc, fde_count_enc, table_enc
+      Reader reader = {module->eh_frame_hdr, module->eh_frame_hdr,
+                       module->eh_frame_hdr + shdr.sh_size, shdr.sh_addr};
+      auto version = reader.read<uint8_t>();
+      auto ptr_enc = reader.read<uint8_t>();
+      auto count_enc = reader.read<uint8_t>();
+      auto table_enc = reader.read<uint8_t>();
+      reader.encoded(ptr_enc, shdr.sh_addr);
+      auto count = reader.encoded(count_enc, shdr.sh_addr);
+      if (reader.valid() && version == 1 && table_enc == PE_TABLE &&
+          reader.ptr + count * 2 * sizeof(int32_t) <= reader.end) {
+        module->table = reinterpret_cast<const int32_t *>(reader.ptr);
+        module->table_count = count;
+      }
+    } else if (strcmp(name, ".eh_frame") == 0) {
+      module->eh_frame = bytes + shdr.sh_offset;
+      module->eh_frame_addr = shdr.sh_addr;
+      module->eh_frame_size = shdr.sh_size;
+    }
+  }
+  return module;
+}
+
+void StackUnwinder::refresh() {
+  stale = false;
+  ranges.clear();
+  frames.clear();
+
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/maps", target_pid);
+  auto file = fopen(path, "rb");
+  if (file == nullptr) {
+    perror("open maps file for unwinder");
+    return;
+  }
+  char line[4096], name[4096], perms[8];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    uintptr_t begin, end;
+    uint64_t offset;
+    name[0] = '\0';
+    if (sscanf(line, "%lx-%lx %7s %lx %*s %*s %4095[^\n]", &begin, &end, perms,
+               &offset, name) < 5 ||
+        perms[2] != 'x') {
+      continue;
+    }
+    if (strcmp(name, "[uprobes]") == 0) {
+      trampoline_begin = begin;
+      trampoline_end = end;
+    }
+    if (name[0] != '/') {
+      continue;
+    }
+    auto module = load_module(name);
+    // 找到包含该文件偏移的 PT_LOAD（按偏移升序），计算加载偏移
+    const std::pair<uint64_t, uint64_t> *load = nullptr;
+    for (auto &item : module->loads) {
+      if ((item.first & ~0xfffULL) <= offset) {
+        load = &item;
+      }
+    }
+    if (load != nullptr) {
+      auto [p_offset, p_vaddr] = *load;
+      auto bias = static_cast<intptr_t>(begin - (p_vaddr + offset - p_offset));
+      ranges[begin] = {end, bias, module};
+    }
+  }
+  fclose(file);
+}
+
+bool StackUnwinder::parse_frame(uintptr_t pc, Frame &frame) const {
+  frame = {};
+  auto item = ranges.upper_bound(pc);
+  if (item == ranges.begin()) {
+    return false;
+  }
+  --item;
+  auto &[end, bias, module] = item->second;
+  if (pc >= end || module->table == nullptr || module->eh_frame == nullptr) {
+    return false;
+  }
+
+  // 在 .eh_frame_hdr 中二分查找 pc 所在的 FDE
+  auto target = static_cast<intptr_t>(pc - bias - module->eh_frame_hdr_addr);
+  size_t low = 0, high = module->table_count;
+  while (low < high) {
+    auto mid = (low + high) / 2;
+    if (module->table[mid * 2] <= target) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  if (low == 0) {
+    return false;
+  }
+  auto fde_addr = module->eh_frame_hdr_addr + module->table[(low - 1) * 2 + 1];
+  if (fde_addr < module->eh_frame_addr ||
+      fde_addr >= module->eh_frame_addr + module->eh_frame_size) {
+    return false;
+  }
+
+  Reader section = {module->eh_frame, module->eh_frame,
+                    module->eh_frame + module->eh_frame_size,
+                    module->eh_frame_addr};
+  // 读取一个 CIE/FDE 条目的长度，返回条目结束位置
+  auto entry = [&section](uintptr_t addr, Reader &reader) -> bool {
+    reader = section;
+    reader.ptr = section.begin + (addr - section.addr);
+    uint64_t length = reader.read<uint32_t>();
+    if (length == 0xffffffff) {
+      length = reader.read<uint64_t>();
+    }
+    if (!reader.valid() || length == 0 || reader.ptr + length > section.end) {
+      return false;
+    }
+    reader.end = reader.ptr + length;
+    return true;
+  };
+
+  // FDE
+  Reader fde;
+  if (!entry(fde_addr, fde)) {
+    return false;
+  }
+  auto cie_pointer_addr = fde.current();
+  auto cie_pointer = fde.read<uint32_t>();
+  if (!fde.valid() || cie_pointer == 0) {
+    return false;
+  }
+
+  // CIE
+  Reader cie;
+  if (!entry(cie_pointer_addr - cie_pointer, cie) || cie.read<uint32_t>() != 0) {
+    return false;
+  }
+  auto version = cie.read<uint8_t>();
+  auto augmentation = reinterpret_cast<const char *>(cie.ptr);
+  auto augmentation_length = strnlen(augmentation, cie.end - cie.ptr);
+  cie.skip(augmentation_length + 1);
+  auto code_align = cie.uleb();
+  auto data_align = cie.sleb();
+  uint64_t ra_register = version == 1 ? cie.read<uint8_t>() : cie.uleb();
+  uint8_t fde_encoding = PE_ABSPTR;
+  bool has_augmentation_data = augmentation[0] == 'z';
+  if (has_augmentation_data) {
+    auto length = cie.uleb();
+    Reader data = cie;
+    for (size_t i = 1; i < augmentation_length && data.valid(); i++) {
+      switch (augmentation[i]) {
+      case 'R':
+        fde_encoding = data.read<uint8_t>();
+        break;
+      case 'L':
+        data.read<uint8_t>();
+        break;
+      case 'P':
+        data.encoded(data.read<uint8_t>() & 0x7f);
+        break;
+      default:
+        break;
+      }
+    }
+    cie.skip(length);
+  } else if (augmentation_length != 0) {
+    // 不认识的扩展无法继续解析
+    return false;
+  }
+  if (!cie.valid() || ra_register != DW_RA) {
+    return false;
+  }
+
+  auto pc_begin = fde.encoded(fde_encoding);
+  auto pc_range = fde.encoded(fde_encoding & 0x0f);
+  if (has_augmentation_data) {
+    fde.skip(fde.uleb());
+  }
+  auto link_pc = pc - bias;
+  if (!fde.valid() || link_pc < pc_begin || link_pc >= pc_begin + pc_range) {
+    return false;
+  }
+
+  // 执行 CIE 的初始指令和 FDE 的指令，直到超过 pc
+  Frame initial;
+  CfaState state;
+  std::vector<std::pair<CfaState, Frame>> remembered;
+  auto execute = [&](Reader reader, Frame &current, bool limit) -> bool {
+    uintptr_t loc = pc_begin;
+    auto rule = [&](uint64_t reg, Rule::Type type, int64_t value) {
+      if (reg < REGISTER_COUNT) {
+        current.rules[reg] = {type, value};
+      }
+    };
+    auto restore = [&](uint64_t reg) {
+      if (reg < REGISTER_COUNT) {
+        current.rules[reg] = initial.rules[reg];
+      }
+    };
+    auto advance = [&](uint64_t delta) -> bool {
+      loc += delta * code_align;
+      return !limit || loc <= link_pc;
+    };
+    while (reader.valid() && reader.ptr < reader.end) {
+      auto op = reader.read<uint8_t>();
+      switch (op & 0xc0) {
+      case 0x40: // DW_CFA_advance_loc
+        if (!advance(op & 0x3f)) {
+          return true;
+        }
+        continue;
+      case 0x80: // DW_CFA_offset
+        rule(op & 0x3f, Rule::OFFSET,
+             static_cast<int64_t>(reader.uleb()) * data_align);
+        continue;
+      case 0xc0: // DW_CFA_restore
+        restore(op & 0x3f);
+        continue;
+      default:
+        break;
+      }
+      switch (op) {
+      case 0x00: // DW_CFA_nop
+        break;
+      case 0x01: // DW_CFA_set_loc
+        loc = reader.encoded(fde_encoding);
+        if (limit && loc > link_pc) {
+          return true;
+        }
+        break;
+      case 0x02: // DW_CFA_advance_loc1
+        if (!advance(reader.read<uint8_t>())) {
+          return true;
+        }
+        break;
+      case 0x03: // DW_CFA_advance_loc2
+        if (!advance(reader.read<uint16_t>())) {
+          return true;
+        }
+        break;
+      case 0x04: // DW_CFA_advance_loc4
+        if (!advance(reader.read<uint32_t>())) {
+          return true;
+        }
+        break;
+      case 0x05: { // DW_CFA_offset_extended
+        auto reg = reader.uleb();
+        rule(reg, Rule::OFFSET, static_cast<int64_t>(reader.uleb()) * data_align);
+        break;
+      }
+      case 0x06: // DW_CFA_restore_extended
+        restore(reader.uleb());
+        break;
+      case 0x07: // DW_CFA_undefined
+        rule(reader.uleb(), Rule::UNDEFINED, 0);
+        break;
+      case 0x08: // DW_CFA_same_value
+        rule(reader.uleb(), Rule::SAME, 0);
+        break;
+      case 0x09: { // DW_CFA_register
+        auto reg = reader.uleb();
+        rule(reg, Rule::REGISTER, static_cast<int64_t>(reader.uleb()));
+        break;
+      }
+      case 0x0a: // DW_CFA_remember_state
+        remembered.emplace_back(state, current);
+        break;
+      case 0x0b: // DW_CFA_restore_state
+        if (remembered.empty()) {
+          return false;
+        }
+        state = remembered.back().first;
+        current = remembered.back().second;
+        remembered.pop_back();
+        break;
+      case 0x0c: // DW_CFA_def_cfa
+        state.cfa_register = static_cast<uint8_t>(reader.uleb());
+        state.cfa_offset = static_cast<int64_t>(reader.uleb());
+        state.cfa_expression = false;
+        break;
+      case 0x0d: // DW_CFA_def_cfa_register
+        state.cfa_register = static_cast<uint8_t>(reader.uleb());
+        state.cfa_expression = false;
+        break;
+      case 0x0e: // DW_CFA_def_cfa_offset
+        state.cfa_offset = static_cast<int64_t>(reader.uleb());
+        break;
+      case 0x0f: // DW_CFA_def_cfa_expression，不支持
+        reader.skip(reader.uleb());
+        state.cfa_expression = true;
+        break;
+      case 0x10: { // DW_CFA_expression，不支持，视为无法恢复
+        auto reg = reader.uleb();
+        reader.skip(reader.uleb());
+        rule(reg, Rule::UNDEFINED, 0);
+        break;
+      }
+      case 0x11: { // DW_CFA_offset_extended_sf
+        auto reg = reader.uleb();
+        rule(reg, Rule::OFFSET, reader.sleb() * data_align);
+        break;
+      }
+      case 0x12: // DW_CFA_def_cfa_sf
+        state.cfa_register = static_cast<uint8_t>(reader.uleb());
+        state.cfa_offset = reader.sleb() * data_align;
+        state.cfa_expression = false;
+        break;
+      case 0x13: // DW_CFA_def_cfa_offset_sf
+        state.cfa_offset = reader.sleb() * data_align;
+        break;
+      case 0x14: { // DW_CFA_val_offset
+        auto reg = reader.uleb();
+        rule(reg, Rule::VAL_OFFSET,
+             static_cast<int64_t>(reader.uleb()) * data_align);
+        break;
+      }
+      case 0x15: { // DW_CFA_val_offset_sf
+        auto reg = reader.uleb();
+        rule(reg, Rule::VAL_OFFSET, reader.sleb() * data_align);
+        break;
+      }
+      case 0x16: { // DW_CFA_val_expression，不支持
+        auto reg = reader.uleb();
+        reader.skip(reader.uleb());
+        rule(reg, Rule::UNDEFINED, 0);
+        break;
+      }
+      case 0x2e: // DW_CFA_GNU_args_size
+        reader.uleb();
+        break;
+      case 0x2f: { // DW_CFA_GNU_negative_offset_extended
+        auto reg = reader.uleb();
+        rule(reg, Rule::OFFSET, -static_cast<int64_t>(reader.uleb()) * data_align);
+        break;
+      }
+      default:
+        return false;
+      }
+    }
+    return reader.valid();
+  };
+
+  if (!execute(cie, initial, false)) {
+    return false;
+  }
+  remembered.clear();
+  frame = initial;
+  if (!execute(fde, frame, true) || state.cfa_expression ||
+      state.cfa_register >= REGISTER_COUNT) {
+    frame.valid = false;
+    return false;
+  }
+  frame.cfa_register = state.cfa_register;
+  frame.cfa_offset = state.cfa_offset;
+  frame.valid = true;
+  return true;
+}
+
+bool StackUnwinder::find_frame(uintptr_t pc, Frame &frame) {
+  if (!stale) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    if (auto item = frames.find(pc); item != frames.end()) {
+      frame = item->second;
+      return frame.valid;
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  if (stale) {
+    refresh();
+  }
+  if (auto item = frames.find(pc); item != frames.end()) {
+    frame = item->second;
+    return frame.valid;
+  }
+  parse_frame(pc, frame);
+  if (frames.size() >= FRAME_CACHE_MAX) {
+    frames.clear();
+  }
+  frames.emplace(pc, frame);
+  return frame.valid;
+}
+
+bool StackUnwinder::step(const StackMemory &memory,
+                         uint64_t (&regs)[REGISTER_COUNT],
+                         bool (&valid)[REGISTER_COUNT]) {
+  // 返回地址指向调用指令的下一条，减一后查找调用指令所在的范围
+  Frame frame;
+  if (!find_frame(regs[DW_RA] - 1, frame) || !valid[frame.cfa_register]) {
+    return false;
+  }
+  auto cfa = regs[frame.cfa_register] + frame.cfa_offset;
+
+  uint64_t next[REGISTER_COUNT];
+  bool next_valid[REGISTER_COUNT];
+  for (size_t i = 0; i < REGISTER_COUNT; i++) {
+    auto &rule = frame.rules[i];
+    next[i] = regs[i];
+    next_valid[i] = valid[i];
+    switch (rule.type) {
+    case Rule::SAME:
+      break;
+    case Rule::UNDEFINED:
+      next_valid[i] = false;
+      break;
+    case Rule::OFFSET:
+      next_valid[i] = memory.read(cfa + rule.value, next[i]);
+      break;
+    case Rule::VAL_OFFSET:
+      next[i] = cfa + rule.value;
+      next_valid[i] = true;
+      break;
+    case Rule::REGISTER:
+      if (rule.value < 0 || rule.value >= static_cast<int64_t>(REGISTER_COUNT)) {
+        return false;
+      }
+      next[i] = regs[rule.value];
+      next_valid[i] = valid[rule.value];
+      break;
+    }
+  }
+  // 返回地址无法恢复即到达栈底
+  if (!next_valid[DW_RA] || next[DW_RA] == 0) {
+    return false;
+  }
+  next[DW_RSP] = cfa;
+  next_valid[DW_RSP] = true;
+  memcpy(regs, next, sizeof(regs));
+  memcpy(valid, next_valid, sizeof(valid));
+  return true;
+}
+
+int StackUnwinder::unwind(pid_t tid, UnwindMode mode, uintptr_t *stack,
+                          int max_depth, std::vector<uint8_t> &buffer) {
+  user_regs_struct user_regs;
+  if (ptrace(PTRACE_GETREGS, tid, 0, &user_regs) < 0) {
+    Log("[%d][error] failed to get registers for unwinding", tid);
+    return -1;
+  }
+
+  // 按页拆分远程地址，栈顶不足时只复制已映射的部分
+  if (buffer.size() < STACK_COPY_SIZE) {
+    buffer.resize(STACK_COPY_SIZE);
+  }
+  constexpr size_t PAGE = 4096;
+  iovec remote[STACK_COPY_SIZE / PAGE + 1];
+  size_t count = 0;
+  for (uintptr_t addr = user_regs.rsp, end = user_regs.rsp + STACK_COPY_SIZE;
+       addr < end; count++) {
+    auto next = std::min<uintptr_t>((addr + PAGE) & ~(PAGE - 1), end);
+    remote[count] = {reinterpret_cast<void *>(addr), next - addr};
+    addr = next;
+  }
+  iovec local = {buffer.data(), STACK_COPY_SIZE};
+  auto copied = process_vm_readv(tid, &local, 1, remote, count, 0);
+  return unwind(tid, user_regs, buffer.data(),
+                copied > 0 ? static_cast<size_t>(copied) : 0, mode, stack,
+                max_depth, nullptr, 0);
+}
+
+int StackUnwinder::unwind(pid_t tid, const user_regs_struct &user_regs,
+                          const uint8_t *data, size_t size, UnwindMode mode,
+                          uintptr_t *stack, int max_depth,
+                          const uintptr_t *returns, size_t return_count) {
+  StackMemory memory = {tid, user_regs.rsp, data, size};
+  // uretprobe 把返回地址改写为 [uprobes] 跳板页中的地址，由内向外依次用 returns 恢复，
+  // 无法恢复时停止展开
+  size_t restored = 0;
+  auto restore = [&, begin = trampoline_begin.load(),
+                  end = trampoline_end.load()](uint64_t &ra) -> bool {
+    if (ra < begin || ra >= end) {
+      return true;
+    }
+    if (restored >= return_count) {
+      return false;
+    }
+    ra = returns[return_count - ++restored];
+    return true;
+  };
+
+  uint64_t regs[REGISTER_COUNT];
+  bool valid[REGISTER_COUNT];
+  for (size_t i = 0; i < REGISTER_COUNT; i++) {
+    regs[i] = user_regs.*REGISTER_MAP[i];
+    valid[i] = true;
+  }
+
+  int depth = 0;
+  stack[depth++] = regs[DW_RA];
+  // 第 0 帧可能位于函数入口，帧指针尚未建立，总是先按 .eh_frame 展开一帧
+  if (depth < max_depth && step(memory, regs, valid) && restore(regs[DW_RA])) {
+    stack[depth++] = regs[DW_RA];
+  } else {
+    return depth;
+  }
+
+  if (mode == UnwindMode::FP) {
+    // 帧结构：[rbp] 为上一帧的 rbp，[rbp + 8] 为返回地址
+    auto fp = valid[DW_RBP] ? regs[DW_RBP] : 0;
+    while (depth < max_depth && fp != 0 && (fp & 7) == 0 &&
+           fp >= regs[DW_RSP]) {
+      uint64_t next_fp, ra;
+      if (!memory.read(fp, next_fp) || !memory.read(fp + 8, ra) || ra == 0 ||
+          !restore(ra)) {
+        break;
+      }
+      stack[depth++] = ra;
+      if (next_fp <= fp) {
+        break;
+      }
+      fp = next_fp;
+    }
+    return depth;
+  }
+
+  while (depth < max_depth && step(memory, regs, valid) &&
+         restore(regs[DW_RA])) {
+    stack[depth++] = regs[DW_RA];
+  }
+  return depth;
+}
+
+} // namespace Memory::Profile
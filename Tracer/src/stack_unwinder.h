@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sys/types.h"
+#include "sys/user.h"
+
+#include "config.h"
+
+namespace Memory::Profile {
+
+// 本地展开远程线程的调用栈：每次只用一次 process_vm_readv 复制栈顶内存，
+// 然后基于按模块缓存的 .eh_frame 信息或帧指针链在本地展开
+class StackUnwinder {
+public:
+  // 每次复制的栈内存大小
+  static constexpr size_t STACK_COPY_SIZE = 32 * 1024;
+  // DWARF 寄存器个数（rax ~ r15 以及返回地址）
+  static constexpr size_t REGISTER_COUNT = 17;
+
+  StackUnwinder() = default;
+  ~StackUnwinder();
+  StackUnwinder(const StackUnwinder &) = delete;
+  StackUnwinder &operator=(const StackUnwinder &) = delete;
+
+  // 设置目标进程并清空缓存
+  void reset(pid_t pid);
+  // 目标进程的内存映射发生变化（如加载动态库）
+  void invalidate() { stale = true; }
+
+  // 展开 tid 的调用栈，第 0 帧为当前 rip，返回帧数，失败时返回 -1
+  // buffer 为调用方提供的栈内存副本缓冲区，避免每次分配
+  int unwind(pid_t tid, UnwindMode mode, uintptr_t *stack, int max_depth,
+             std::vector<uint8_t> &buffer);
+  // 以已采集的寄存器和栈顶内存副本（如 uprobe 采样）展开，data 从 rsp 开始；
+  // returns 为被 uretprobe 改写前的返回地址（外层在前）
+  int unwind(pid_t tid, const user_regs_struct &user_regs, const uint8_t *data,
+             size_t size, UnwindMode mode, uintptr_t *stack, int max_depth,
+             const uintptr_t *returns, size_t return_count);
+
+private:
+  // 寄存器恢复规则
+  struct Rule {
+    enum Type : uint8_t {
+      SAME,       // 与当前帧相同
+      UNDEFINED,  // 无法恢复
+      OFFSET,     // 保存在 CFA + value 处
+      VAL_OFFSET, // 值为 CFA + value
+      REGISTER,   // 保存在寄存器 value 中
+    } type = SAME;
+    int64_t value = 0;
+  };
+
+  // 某个地址处的 CFA 及各寄存器的恢复规则
+  struct Frame {
+    bool valid = false;
+    uint8_t cfa_register = 0;
+    int64_t cfa_offset = 0;
+    Rule rules[REGISTER_COUNT];
+  };
+
+  // 映射到内存的 ELF 文件及其 .eh_frame 信息
+  struct Module {
+    std::string path;
+    const uint8_t *data = nullptr;
+    size_t length = 0;
+    // 链接地址与文件内容
+    uintptr_t eh_frame_hdr_addr = 0;
+    const uint8_t *eh_frame_hdr = nullptr;
+    uintptr_t eh_frame_addr = 0;
+    const uint8_t *eh_frame = nullptr;
+    size_t eh_frame_size = 0;
+    // .eh_frame_hdr 中的二分查找表
+    const int32_t *table = nullptr;
+    size_t table_count = 0;
+    // 程序头，用于计算加载偏移
+    std::vector<std::pair<uint64_t, uint64_t>> loads; // {p_offset, p_vaddr}
+
+    ~Module();
+  };
+
+  // 可执行段的地址范围
+  struct Range {
+    uintptr_t end;
+    intptr_t bias; // 运行地址 - 链接地址
+    std::shared_ptr<Module> module;
+  };
+
+  // 目标内存：优先从栈副本中读取，超出范围时单独读取
+  struct StackMemory {
+    pid_t tid;
+    uintptr_t base;
+    const uint8_t *data;
+    size_t size;
+    bool read(uintptr_t addr, uint64_t &value) const;
+  };
+
+  static constexpr size_t FRAME_CACHE_MAX = 1 << 16;
+
+  pid_t target_pid = 0;
+  std::atomic<bool> stale = true;
+  mutable std::shared_mutex mutex;
+  std::map<std::string, std::shared_ptr<Module>> modules;
+  std::map<uintptr_t, Range> ranges;
+  std::unordered_map<uintptr_t, Frame> frames;
+  // uretprobe 跳板页的地址范围
+  std::atomic<uintptr_t> trampoline_begin = 0;
+  std::atomic<uintptr_t> trampoline_end = 0;
+
+  // 重新读取 /proc/pid/maps，调用方需持有写锁
+  void refresh();
+  std::shared_ptr<Module> load_module(const std::string &path);
+  // 查找 pc 处的展开规则（带缓存）
+  bool find_frame(uintptr_t pc, Frame &frame);
+  // 解析 pc 所在的 FDE 并执行 CFA 指令
+  bool parse_frame(uintptr_t pc, Frame &frame) const;
+  // 展开一帧，更新寄存器
+  bool step(const StackMemory &memory, uint64_t (&regs)[REGISTER_COUNT],
+            bool (&valid)[REGISTER_COUNT]);
+};
+
+} // namespace Memory::Profile
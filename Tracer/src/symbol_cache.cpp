@@ -0,0 +1,198 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "symbol_cache.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "unistd.h"
+
+namespace Memory::Profile {
+
+bool SymbolCache::open(const std::string &dir) {
+  close();
+  std::error_code error;
+  std::filesystem::create_directories(dir, error);
+  if (error) {
+    Log("[error] failed to create symcache dir %s: %s", dir.c_str(),
+        error.message().c_str());
+    return false;
+  }
+  this->dir = dir;
+  hit_count = miss_count = 0;
+  return true;
+}
+
+void SymbolCache::close() {
+  if (!enabled()) {
+    return;
+  }
+  size_t saved = 0;
+  for (auto &[build_id, file] : files) {
+    if (!file.added.empty() && save(build_id, file)) {
+      saved++;
+    }
+    unmap(file);
+  }
+  Log("symcache: hits: [%llu], misses: [%llu], modules: [%zu], updated: [%zu]",
+      hit_count, miss_count, files.size(), saved);
+  files.clear();
+  dir.clear();
+}
+
+std::string SymbolCache::path(const std::string &build_id) const {
+  return dir + "/" + build_id + ".symcache";
+}
+
+void SymbolCache::unmap(File &file) {
+  if (file.data != nullptr) {
+    munmap(file.data, file.length);
+  }
+  file.data = nullptr;
+  file.entries = nullptr;
+  file.count = 0;
+}
+
+SymbolCache::File &SymbolCache::get(const std::string &build_id) {
+  auto [item, inserted] = files.try_emplace(build_id);
+  auto &file = item->second;
+  if (!inserted) {
+    return file;
+  }
+
+  auto fd = ::open(path(build_id).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return file;
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) < 0 || static_cast<size_t>(sb.st_size) < sizeof(Header)) {
+    ::close(fd);
+    return file;
+  }
+  file.length = sb.st_size;
+  file.data = mmap(nullptr, file.length, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (file.data == MAP_FAILED) {
+    file.data = nullptr;
+    return file;
+  }
+
+  auto header = static_cast<const Header *>(file.data);
+  auto strings = sizeof(Header) + header->count * sizeof(Entry);
+  if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header->count > file.length / sizeof(Entry) || strings > file.length) {
+    Log("[warning] invalid symcache file: %s", path(build_id).c_str());
+    unmap(file);
+    return file;
+  }
+  file.entries = reinterpret_cast<const Entry *>(header + 1);
+  file.count = header->count;
+  file.strings = static_cast<const char *>(file.data) + strings;
+  file.strings_size = file.length - strings;
+  // 最后一个字符串须以 '\0' 结尾
+  if (file.strings_size > 0 && file.strings[file.strings_size - 1] != '\0') {
+    file.strings_size = 0;
+  }
+  return file;
+}
+
+bool SymbolCache::find(const std::string &build_id, uint64_t offset,
+                       Record &record) {
+  auto &file = get(build_id);
+  auto entry = std::lower_bound(
+      file.entries, file.entries + file.count, offset,
+      [](const Entry &entry, uint64_t offset) { return entry.offset < offset; });
+  if (entry == file.entries + file.count || entry->offset != offset) {
+    miss_count++;
+    return false;
+  }
+  record.func_name = file.string(entry->func_name);
+  record.file_name = file.string(entry->file_name);
+  record.line_no = entry->line_no;
+  record.col_no = entry->col_no;
+  hit_count++;
+  return true;
+}
+
+void SymbolCache::add(const std::string &build_id, uint64_t offset,
+                      Record record) {
+  get(build_id).added.insert_or_assign(offset, std::move(record));
+}
+
+bool SymbolCache::save(const std::string &build_id, const File &file) const {
+  std::vector<Entry> entries;
+  std::string strings;
+  std::unordered_map<std::string, uint32_t> positions;
+  auto intern = [&strings, &positions](const std::string &value) -> uint32_t {
+    auto [item, inserted] = positions.try_emplace(value, strings.size());
+    if (inserted) {
+      strings.append(value);
+      strings.push_back('\0');
+    }
+    return item->second;
+  };
+  auto append = [&](uint64_t offset, const Record &record) -> void {
+    entries.push_back({offset, intern(record.func_name),
+                       intern(record.file_name), record.line_no,
+                       record.col_no});
+  };
+
+  // 合并已有条目与新条目，两者都按偏移排序，偏移相同时使用新的结果
+  entries.reserve(file.count + file.added.size());
+  auto added = file.added.begin();
+  for (uint64_t i = 0; i < file.count; i++) {
+    auto &entry = file.entries[i];
+    for (; added != file.added.end() && added->first < entry.offset; ++added) {
+      append(added->first, added->second);
+    }
+    if (added != file.added.end() && added->first == entry.offset) {
+      continue;
+    }
+    append(entry.offset, {file.string(entry.func_name),
+                          file.string(entry.file_name), entry.line_no,
+                          entry.col_no});
+  }
+  for (; added != file.added.end(); ++added) {
+    append(added->first, added->second);
+  }
+
+  // 写入临时文件后替换，并发运行的进程只会读到完整的文件
+  auto target = path(build_id);
+  auto temp = target + "." + std::to_string(getpid()) + ".tmp";
+  {
+    std::ofstream output(temp, std::ios::binary | std::ios::trunc);
+    Header header{};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.count = entries.size();
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char *>(entries.data()),
+                 entries.size() * sizeof(Entry));
+    output.write(strings.data(), strings.size());
+    if (!output) {
+      Log("[error] failed to write symcache file: %s", temp.c_str());
+      output.close();
+      unlink(temp.c_str());
+      return false;
+    }
+  }
+  if (rename(temp.c_str(), target.c_str()) < 0) {
+    perror("rename symcache file");
+    unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+} // namespace Memory::Profile
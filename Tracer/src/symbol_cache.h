@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+namespace Memory::Profile {
+
+// 持久化的符号解析缓存（--symcache）：每个模块一个文件 <dir>/<build-id>.symcache，
+// 记录模块内偏移到 (函数, 文件, 行, 列) 的解析结果，按偏移排序，mmap 后二分查找；
+// 新的解析结果在 save 时与已有内容合并，写入临时文件后替换
+//
+// 文件格式：<8s 魔数><Q 条目数>
+// 条目：<Q 偏移><I 函数名位置><I 文件名位置><i 行号><i 列号>
+// 之后为以 '\0' 结尾的字符串，位置相对于第一个字符串
+//
+// 只由符号解析的调用线程使用，不加锁
+class SymbolCache {
+public:
+  struct Record {
+    std::string func_name;
+    std::string file_name;
+    int line_no = -1;
+    int col_no = -1;
+  };
+
+  SymbolCache() = default;
+  ~SymbolCache() { close(); }
+  SymbolCache(const SymbolCache &) = delete;
+  SymbolCache &operator=(const SymbolCache &) = delete;
+
+  // 使用目录 dir，不存在时创建
+  bool open(const std::string &dir);
+  // 写入新的解析结果并关闭所有文件
+  void close();
+  bool enabled() const { return !dir.empty(); }
+
+  // 查找 build_id 模块中偏移为 offset 的解析结果
+  bool find(const std::string &build_id, uint64_t offset, Record &record);
+  // 记录新的解析结果，close 时写入
+  void add(const std::string &build_id, uint64_t offset, Record record);
+
+  uint64_t hit_count = 0;
+  uint64_t miss_count = 0;
+
+private:
+  static constexpr char MAGIC[8] = "MPSYMC1";
+
+  struct Header {
+    char magic[8];
+    uint64_t count;
+  };
+  struct Entry {
+    uint64_t offset;
+    uint32_t func_name;
+    uint32_t file_name;
+    int32_t line_no;
+    int32_t col_no;
+  };
+
+  // 一个模块的缓存文件，文件不存在或无效时 entries 为空
+  struct File {
+    void *data = nullptr;
+    size_t length = 0;
+    const Entry *entries = nullptr;
+    uint64_t count = 0;
+    const char *strings = nullptr;
+    size_t strings_size = 0;
+    std::map<uint64_t, Record> added; // 本次新解析的结果
+
+    const char *string(uint32_t pos) const {
+      return pos < strings_size ? strings + pos : "<nil>";
+    }
+  };
+
+  std::string dir;
+  std::unordered_map<std::string, File> files;
+
+  File &get(const std::string &build_id);
+  std::string path(const std::string &build_id) const;
+  bool save(const std::string &build_id, const File &file) const;
+  static void unmap(File &file);
+};
+
+} // namespace Memory::Profile
@@ -0,0 +1,405 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+// mprofiler-symbolize：将 --raw-stacks 保存的 memory.raw 离线转换为 memory.profile
+
+#include <filesystem>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "trace_writer.h"
+#include "utils.h"
+#include "zip_stream.h"
+
+using namespace Memory::Profile;
+
+static constexpr std::string_view HELP_TEXT =
+    R"(Usage: mprofiler-symbolize [OPTION...] INPUT [OUTPUT]
+  
+  Convert raw stack addresses saved by "mprofiler --raw-stacks" to memory.profile.
+  OUTPUT defaults to memory.profile in the same directory as INPUT.
+  
+  Options:
+    -h, --help             Show help options
+    --threads              Specified number of symbolization threads(default 4)
+    --symcache             Specified directory of the persistent symbolization cache
+    --format               Specified memory.profile format version(default: same as INPUT)
+    --no-print-save        Don't print saved entries(default)
+    --print-save           Print saved entries
+  )";
+
+// 离线处理的批次更大，便于各线程分担更多地址
+static constexpr size_t BATCH_MAX_SIZE = 1 << 16;
+
+namespace {
+
+template <typename T> bool read(std::istream &input, T &value) {
+  return (bool)input.read(reinterpret_cast<char *>(&value), sizeof(value));
+}
+
+// LEB128 变长整数（格式版本 2）
+bool read_varint(std::istream &input, uint64_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    auto byte = input.get();
+    if (byte == std::istream::traits_type::eof()) {
+      return false;
+    }
+    value |= uint64_t(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// zigzag 编码的有符号变长整数
+bool read_signed(std::istream &input, int64_t &value) {
+  uint64_t encoded;
+  if (!read_varint(input, encoded)) {
+    return false;
+  }
+  value = int64_t(encoded >> 1) ^ -int64_t(encoded & 1);
+  return true;
+}
+
+bool read_string(std::istream &input, std::string &value, size_t length) {
+  value.resize(length);
+  return (bool)input.read(value.data(), length);
+}
+
+class Converter {
+  TraceWriter writer;
+  // raw 调用栈编号到地址的映射，每次映射快照后重新编号
+  std::unordered_map<uint32_t, std::vector<uintptr_t>> raw_stacks;
+  std::vector<TraceInfo> infos;
+  std::vector<const TraceInfo *> batch;
+  size_t event_count = 0;
+  size_t snapshot_count = 0;
+  size_t arena_count = 0;
+  size_t lost_count = 0; // 丢弃的追踪信息个数（--overflow drop）
+  uint64_t pending_weight = 0; // 采样权重条目，作用于下一个追踪信息
+  uint16_t format_version = 0;
+  // 各线程上一条记录的时间戳（格式版本 2）
+  std::unordered_map<pid_t, timens_t> last_times;
+
+  void flush() {
+    batch.clear();
+    for (auto &info : infos) {
+      batch.push_back(&info);
+    }
+    writer.write_batch(batch);
+    infos.clear();
+  }
+
+  bool read_maps(std::istream &input) {
+    timens_t timestamp;
+    uint32_t maps_length;
+    uint16_t module_count;
+    std::string maps;
+    if (!read(input, timestamp) || !read(input, maps_length) ||
+        !read_string(input, maps, maps_length) || !read(input, module_count)) {
+      return false;
+    }
+    for (uint16_t i = 0; i < module_count; i++) {
+      uint16_t length;
+      std::string path, build_id;
+      if (!read(input, length) || !read_string(input, path, length) ||
+          !read(input, length) || !read_string(input, build_id, length)) {
+        return false;
+      }
+      // 本机上的文件与采集时不一致时，解析结果可能是错误的
+      auto local_id = read_build_id(path);
+      if (!build_id.empty() && local_id != build_id) {
+        Log("[warning] build-id mismatch: %s (recorded %s, local %s)",
+            path.c_str(), build_id.c_str(),
+            local_id.empty() ? "<missing>" : local_id.c_str());
+      }
+    }
+    // 之前的追踪信息按旧的映射解析
+    flush();
+    writer.update_modules(timestamp, maps);
+    raw_stacks.clear();
+    snapshot_count++;
+    return true;
+  }
+
+  bool read_arena(std::istream &input) {
+    timens_t timestamp;
+    uint16_t count;
+    if (!read(input, timestamp) || !read(input, count)) {
+      return false;
+    }
+    std::vector<ArenaStats> arenas(count);
+    for (auto &arena : arenas) {
+      if (!read(input, arena.address) || !read(input, arena.system_mem) ||
+          !read(input, arena.top_size) || !read(input, arena.largest_free) ||
+          !read(input, arena.tcache_bytes) ||
+          !read(input, arena.fastbin_bytes) ||
+          !read(input, arena.unsorted_bytes) ||
+          !read(input, arena.smallbin_bytes) ||
+          !read(input, arena.largebin_bytes) ||
+          !read(input, arena.free_chunks) || !read(input, arena.flags)) {
+        return false;
+      }
+    }
+    // 保持与追踪信息的先后顺序
+    flush();
+    writer.write_arena(timestamp, arenas);
+    arena_count++;
+    return true;
+  }
+
+  bool read_lost(std::istream &input) {
+    LostEvents lost;
+    uint32_t tid;
+    uint16_t tags;
+    if (!read(input, tid) || !read(input, lost.start) ||
+        !read(input, lost.end) || !read(input, lost.alloc_bytes) ||
+        !read(input, tags)) {
+      return false;
+    }
+    lost.tid = tid;
+    for (uint16_t i = 0; i < tags; i++) {
+      uint8_t tag;
+      uint32_t count;
+      if (!read(input, tag) || !read(input, count)) {
+        return false;
+      }
+      if (tag < std::size(lost.count)) {
+        lost.count[tag] = count;
+      }
+    }
+    // 保持与追踪信息的先后顺序
+    flush();
+    writer.write_lost(lost);
+    lost_count += lost.total();
+    return true;
+  }
+
+  bool read_stack(std::istream &input) {
+    uint32_t stack_id;
+    uint16_t stack_size;
+    if (!read(input, stack_id) || !read(input, stack_size) ||
+        stack_size > STACK_MAX) {
+      return false;
+    }
+    auto &stack = raw_stacks[stack_id];
+    stack.resize(stack_size);
+    return (bool)input.read(reinterpret_cast<char *>(stack.data()),
+                            stack_size * sizeof(uintptr_t));
+  }
+
+  void set_stack(TraceInfo &info, uint32_t stack_id) {
+    info.stack_size = 0;
+    if (stack_id != 0) {
+      auto item = raw_stacks.find(stack_id);
+      if (item == raw_stacks.end()) {
+        Log("[warning] undefined stack id %u", stack_id);
+      } else {
+        info.stack_size = item->second.size();
+        std::copy(item->second.begin(), item->second.end(), info.stack);
+      }
+    }
+  }
+
+  void add_trace_info() {
+    event_count++;
+    if (infos.size() >= BATCH_MAX_SIZE) {
+      flush();
+    }
+  }
+
+  bool read_trace_info(std::istream &input, uint8_t tag) {
+    if (format_version >= TraceWriter::FORMAT_VERSION) {
+      return read_compact(input, tag);
+    }
+    auto &info = infos.emplace_back();
+    uint32_t stack_id;
+    info.tag = tag;
+    if (!read(input, info.tid) || !read(input, info.args[0]) ||
+        !read(input, info.args[1]) || !read(input, info.timestamp) ||
+        !read(input, stack_id)) {
+      infos.pop_back();
+      return false;
+    }
+    info.weight = pending_weight;
+    pending_weight = 0;
+    set_stack(info, stack_id);
+    add_trace_info();
+    return true;
+  }
+
+  // 格式版本 2 的记录，合并的调用拆分为调用与返回
+  bool read_compact(std::istream &input, uint8_t tag) {
+    bool is_call = (tag & TraceWriter::CALL_ENTRY_FLAG) != 0;
+    tag &= ~TraceWriter::CALL_ENTRY_FLAG;
+    uint64_t tid, value, stack_id = 0;
+    int64_t delta, duration = 0;
+    uintptr_t args[2] = {0, 0};
+    uintptr_t ret = 0;
+    if (!read_varint(input, tid) || !read_signed(input, delta) ||
+        (is_call && !read_signed(input, duration))) {
+      return false;
+    }
+    if (is_call || IsInvoke(tag)) {
+      auto argc = GetOperation(tag).argc();
+      for (uint8_t i = 0; i < argc && i < 2; i++) {
+        if (!read_varint(input, value)) {
+          return false;
+        }
+        args[i] = value;
+      }
+    }
+    if (is_call || !IsInvoke(tag)) {
+      if (!read_varint(input, value)) {
+        return false;
+      }
+      ret = value;
+    }
+    if ((is_call || IsInvoke(tag)) && !read_varint(input, stack_id)) {
+      return false;
+    }
+    auto &last_time = last_times[tid];
+    last_time += delta;
+
+    if (is_call || IsInvoke(tag)) {
+      auto &info = infos.emplace_back();
+      info = {tag, pid_t(tid), {args[0], args[1]}, last_time - duration,
+              pending_weight, 0, {}};
+      pending_weight = 0;
+      set_stack(info, stack_id);
+      add_trace_info();
+    }
+    if (is_call || !IsInvoke(tag)) {
+      auto &info = infos.emplace_back();
+      info = {uint8_t(tag | 1), pid_t(tid), {ret, 0}, last_time, 0, 0, {}};
+      add_trace_info();
+    }
+    return true;
+  }
+
+public:
+  // output_version 为 0 时输出与输入的格式版本相同
+  bool run(const std::string &input_path, const std::string &output_path,
+           int threads, const std::string &symcache_dir, bool print_save,
+           uint16_t output_version) {
+    auto input = Zip::Stream::OpenFile(input_path);
+    uint8_t tag;
+    uint16_t version;
+    if (!read(*input, tag) || !read(*input, version) ||
+        tag != TraceWriter::FORMAT_ENTRY ||
+        (version & TraceWriter::RAW_FORMAT_FLAG) == 0) {
+      Log("[error] %s is not a raw trace file", input_path.c_str());
+      return false;
+    }
+    format_version = version & ~TraceWriter::RAW_FORMAT_FLAG;
+    if (format_version < TraceWriter::FORMAT_VERSION_1 ||
+        format_version > TraceWriter::FORMAT_VERSION) {
+      Log("[error] unsupported raw format version: %u", format_version);
+      return false;
+    }
+
+    writer.isPrintSaveEntry = print_save;
+    if (!writer.open(output_path, false, Zip::Stream::CompressionLevel::DEFAULT,
+                     0, output_version != 0 ? output_version : format_version) ||
+        !writer.start_symbolizer(0, threads, symcache_dir)) {
+      return false;
+    }
+    infos.reserve(BATCH_MAX_SIZE);
+
+    while (read(*input, tag)) {
+      bool ok;
+      if (tag == TraceWriter::MAPS_ENTRY) {
+        ok = read_maps(*input);
+      } else if (tag == TraceWriter::ARENA_ENTRY) {
+        ok = read_arena(*input);
+      } else if (tag == TraceWriter::LOST_ENTRY) {
+        ok = read_lost(*input);
+      } else if (tag == TraceWriter::STACK_ENTRY) {
+        ok = read_stack(*input);
+      } else if (tag == TraceWriter::SAMPLE_WEIGHT_ENTRY) {
+        ok = read(*input, pending_weight);
+      } else if (tag == TraceWriter::FORMAT_ENTRY) {
+        // 新的数据块，时间差重新开始计算
+        ok = read(*input, version);
+        last_times.clear();
+      } else {
+        ok = read_trace_info(*input, tag);
+      }
+      if (!ok) {
+        Log("[warning] truncated input after %zu events", event_count);
+        break;
+      }
+    }
+    flush();
+    writer.close();
+
+    Log("events: [%zu], maps snapshots: [%zu], arena samples: [%zu], "
+        "lost events: [%zu], stacks: [%d]",
+        event_count, snapshot_count, arena_count, lost_count,
+        writer.stack_count);
+    Log("saved to: %s", output_path.c_str());
+    return true;
+  }
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int threads = 4;
+  std::string symcache_dir;
+  bool print_save = false;
+  int format_version = 0;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    // 显示帮助信息
+    if (arg == "-h" || arg == "--help") {
+      Log(HELP_TEXT.data());
+      return 0;
+    }
+    // 设置符号解析线程数
+    else if (arg == "--threads" && i + 1 < argc) {
+      threads = std::stoi(argv[++i]);
+    }
+    // 设置持久化符号解析缓存目录
+    else if (arg == "--symcache" && i + 1 < argc) {
+      symcache_dir = argv[++i];
+    }
+    // 设置输出格式版本
+    else if (arg == "--format" && i + 1 < argc) {
+      format_version = std::stoi(argv[++i]);
+    }
+    // 是否打印写入的条目
+    else if (arg == "--print-save") {
+      print_save = true;
+    } else if (arg == "--no-print-save") {
+      print_save = false;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty() || paths.size() > 2 || threads < 1 || format_version < 0 ||
+      format_version > TraceWriter::FORMAT_VERSION) {
+    Log(HELP_TEXT.data());
+    return 1;
+  }
+  if (paths.size() == 1) {
+    paths.push_back(std::filesystem::path(paths[0]).parent_path() /
+                    "memory.profile");
+  }
+
+  Converter converter;
+  return converter.run(paths[0], paths[1], threads, symcache_dir, print_save,
+                       format_version)
+             ? 0
+             : 1;
+}
@@ -0,0 +1,319 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "symbolizer.h"
+#include "trace_writer.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <set>
+#include <sstream>
+
+namespace Memory::Profile {
+
+static Dwfl *create_dwfl(pid_t pid) {
+  static const Dwfl_Callbacks callbacks = {.find_elf = dwfl_linux_proc_find_elf,
+                                           .find_debuginfo =
+                                               dwfl_standard_find_debuginfo};
+  Dwfl *dwfl = dwfl_begin(&callbacks);
+  if (dwfl == nullptr) {
+    Log("[%d][error] failed to create DWFL object", pid);
+  }
+  return dwfl;
+}
+
+static bool report_dwfl(Dwfl *dwfl, pid_t pid, const std::string &maps) {
+  dwfl_report_begin(dwfl);
+  int result = -1;
+  if (pid != 0) {
+    result = dwfl_linux_proc_report(dwfl, pid);
+  } else if (FILE *file = fmemopen(const_cast<char *>(maps.data()),
+                                   maps.size(), "r")) {
+    // 离线解析时按保存的映射快照报告模块
+    result = dwfl_linux_proc_maps_report(dwfl, file);
+    fclose(file);
+  }
+  if (result < 0) {
+    Log("[%d][error] failed to report process mappings for PID %d", pid, pid);
+    dwfl_report_end(dwfl, nullptr, nullptr);
+    return false;
+  }
+  if (dwfl_report_end(dwfl, nullptr, nullptr) < 0) {
+    Log("[%d][error] failed to finalize report update", pid);
+    return false;
+  }
+  return true;
+}
+
+bool Symbolizer::start(pid_t pid, int workers, const std::string &cache_dir) {
+  stop();
+  target_pid = pid;
+  stopped = false;
+  if (!cache_dir.empty() && !cache.open(cache_dir)) {
+    return false;
+  }
+  for (int i = 0; i < std::max(workers, 1); i++) {
+    Dwfl *dwfl = create_dwfl(pid);
+    if (dwfl == nullptr) {
+      stop();
+      return false;
+    }
+    dwfls.push_back(dwfl);
+  }
+  // dwfls[0] 由调用线程使用，其余各自对应一个工作线程
+  for (size_t i = 1; i < dwfls.size(); i++) {
+    threads.emplace_back(&Symbolizer::worker, this, i);
+  }
+  return true;
+}
+
+void Symbolizer::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  task_ready.notify_all();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  threads.clear();
+  for (auto dwfl : dwfls) {
+    dwfl_end(dwfl);
+  }
+  dwfls.clear();
+  cache.close();
+  mappings.clear();
+  for (auto &shard : shards) {
+    shard.symbols.clear();
+  }
+}
+
+bool Symbolizer::update(
+    const std::string &maps,
+    std::vector<std::pair<uintptr_t, uintptr_t>> &removed) {
+  // 调用时工作线程处于空闲状态，无需加锁
+  // 调用方先读取映射再更新 dwfl，保证映射中的模块都能被 dwfl 找到
+  std::istringstream lines(maps);
+  std::map<uintptr_t, Mapping> current;
+  std::string line, path;
+  const Mapping *last = nullptr;
+  while (std::getline(lines, line)) {
+    uintptr_t start, end, offset;
+    char perms[8];
+    int pos = 0;
+    if (sscanf(line.c_str(), "%lx-%lx %7s %lx %*s %*u %n", &start, &end, perms,
+               &offset, &pos) < 4 ||
+        pos == 0 || line[pos] == '\0') {
+      last = nullptr;
+      continue;
+    }
+    path = line.substr(pos);
+    // 同一文件连续的映射属于同一模块，基址为第一个映射的起始地址
+    uintptr_t base = start;
+    std::string build_id;
+    if (last != nullptr && offset != 0 && last->path == path) {
+      base = last->base;
+      build_id = last->build_id;
+    } else if (cache.enabled() && path[0] == '/') {
+      // 模块未变化时沿用之前读取的 build-id
+      auto item = mappings.find(start);
+      build_id = item != mappings.end() && item->second.path == path
+                     ? item->second.build_id
+                     : read_build_id(path);
+    }
+    last = &(current[start] = {end, base, path, build_id});
+  }
+  for (auto dwfl : dwfls) {
+    if (!report_dwfl(dwfl, target_pid, maps)) {
+      return false;
+    }
+  }
+
+  // 找出被移除或替换的模块
+  std::set<uintptr_t> bases;
+  for (auto &[start, mapping] : mappings) {
+    auto item = current.find(mapping.base);
+    if (item == current.end() || item->second.path != mapping.path ||
+        item->second.base != mapping.base) {
+      removed.emplace_back(start, mapping.end);
+      bases.insert(mapping.base);
+    }
+  }
+  mappings = std::move(current);
+  if (bases.empty()) {
+    return true;
+  }
+  for (auto &shard : shards) {
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    std::erase_if(shard.symbols,
+                  [&](const auto &item) { return bases.count(item.first.base); });
+  }
+  return true;
+}
+
+const Symbolizer::Mapping *Symbolizer::locate(uintptr_t addr,
+                                              Key &key) const {
+  auto item = mappings.upper_bound(addr);
+  if (item == mappings.begin()) {
+    return nullptr;
+  }
+  --item;
+  if (addr >= item->second.end) {
+    return nullptr;
+  }
+  key = {item->second.base, addr - item->second.base};
+  return &item->second;
+}
+
+void Symbolizer::load_cached(std::vector<uintptr_t> &addresses) {
+  SymbolCache::Record record;
+  std::erase_if(addresses, [this, &record](uintptr_t addr) {
+    Key key;
+    auto mapping = locate(addr, key);
+    if (mapping == nullptr || mapping->build_id.empty() ||
+        !cache.find(mapping->build_id, key.offset, record)) {
+      return false;
+    }
+    auto &shard = shards[shard_index(key)];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.symbols.try_emplace(key, Symbol{true, std::move(record.func_name),
+                                          std::move(record.file_name),
+                                          record.line_no, record.col_no});
+    return true;
+  });
+}
+
+void Symbolizer::save_cached(const std::vector<uintptr_t> &addresses) {
+  for (auto addr : addresses) {
+    Key key;
+    auto mapping = locate(addr, key);
+    if (mapping == nullptr || mapping->build_id.empty()) {
+      continue;
+    }
+    auto symbol = find(addr);
+    if (symbol != nullptr && symbol->valid) {
+      cache.add(mapping->build_id, key.offset,
+                {symbol->func_name, symbol->file_name, symbol->line_no,
+                 symbol->col_no});
+    }
+  }
+}
+
+const Symbolizer::Symbol *Symbolizer::find(uintptr_t addr) const {
+  Key key;
+  if (!locate(addr, key)) {
+    return nullptr;
+  }
+  auto &shard = shards[shard_index(key)];
+  std::shared_lock<std::shared_mutex> lock(shard.mutex);
+  auto item = shard.symbols.find(key);
+  return item != shard.symbols.end() ? &item->second : nullptr;
+}
+
+void Symbolizer::resolve(std::vector<uintptr_t> &addresses) {
+  if (dwfls.empty() || addresses.empty()) {
+    return;
+  }
+  // 排序后相邻地址多位于同一模块，便于各线程复用 dwfl 内部的查找结果
+  std::sort(addresses.begin(), addresses.end());
+  addresses.erase(std::unique(addresses.begin(), addresses.end()),
+                  addresses.end());
+  std::erase_if(addresses, [this](uintptr_t addr) {
+    Key key;
+    return !locate(addr, key) || find(addr) != nullptr;
+  });
+  if (cache.enabled()) {
+    load_cached(addresses);
+  }
+
+  pending_count.store(addresses.size(), std::memory_order_relaxed);
+  if (threads.empty() || addresses.size() < PARALLEL_MIN_SIZE) {
+    resolve_range(dwfls[0], addresses.data(),
+                  addresses.data() + addresses.size());
+    pending_count.store(0, std::memory_order_relaxed);
+    if (cache.enabled()) {
+      save_cached(addresses);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks = &addresses;
+    remaining = threads.size();
+    round++;
+  }
+  task_ready.notify_all();
+  // 调用线程负责第 0 段
+  resolve_range(dwfls[0], addresses.data(),
+                addresses.data() + addresses.size() / dwfls.size());
+  std::unique_lock<std::mutex> lock(mutex);
+  task_done.wait(lock, [this]() { return remaining == 0; });
+  tasks = nullptr;
+  pending_count.store(0, std::memory_order_relaxed);
+  lock.unlock();
+  if (cache.enabled()) {
+    save_cached(addresses);
+  }
+}
+
+void Symbolizer::resolve_range(Dwfl *dwfl, const uintptr_t *begin,
+                               const uintptr_t *end) {
+  for (auto ptr = begin; ptr != end; ptr++) {
+    Key key;
+    if (!locate(*ptr, key)) {
+      continue;
+    }
+    Symbol symbol;
+    Dwarf_Addr addr = *ptr;
+    // 根据地址获取对应的 DWARF 模块
+    Dwfl_Module *mod = dwfl_addrmodule(dwfl, addr);
+    if (mod != nullptr) {
+      symbol.valid = true;
+      // 获取当前地址的函数名
+      const char *func_name = dwfl_module_addrname(mod, addr);
+      symbol.func_name = func_name != nullptr ? func_name : "<nil>";
+      // 获取文件名、行号和列号
+      Dwfl_Line *line = dwfl_module_getsrc(mod, addr);
+      const char *file_name = dwfl_lineinfo(line, nullptr, &symbol.line_no,
+                                            &symbol.col_no, nullptr, nullptr);
+      symbol.file_name = file_name != nullptr ? file_name : "<nil>";
+    }
+
+    auto &shard = shards[shard_index(key)];
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.symbols.try_emplace(key, std::move(symbol));
+  }
+}
+
+void Symbolizer::worker(size_t index) {
+  uint64_t seen = 0;
+  while (true) {
+    const std::vector<uintptr_t> *current;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      task_ready.wait(lock, [&]() { return stopped || round != seen; });
+      if (stopped) {
+        return;
+      }
+      seen = round;
+      current = tasks;
+    }
+
+    auto size = current->size(), count = dwfls.size();
+    resolve_range(dwfls[index], current->data() + size * index / count,
+                  current->data() + size * (index + 1) / count);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--remaining == 0) {
+      task_done.notify_one();
+    }
+  }
+}
+
+} // namespace Memory::Profile
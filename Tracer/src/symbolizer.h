@@ -0,0 +1,126 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "elfutils/libdwfl.h"
+#include "sys/types.h"
+
+#include "symbol_cache.h"
+
+namespace Memory::Profile {
+
+// 多线程符号解析：每个工作线程持有独立的 Dwfl 句柄，
+// 解析结果保存在按 (模块基址, 偏移) 分片的缓存中，只在模块变化时失效
+class Symbolizer {
+public:
+  // 单个地址的解析结果
+  struct Symbol {
+    bool valid = false; // 地址是否属于某个模块
+    std::string func_name;
+    std::string file_name;
+    int line_no = -1;
+    int col_no = -1;
+  };
+
+  Symbolizer() = default;
+  ~Symbolizer() { stop(); }
+  Symbolizer(const Symbolizer &) = delete;
+  Symbolizer &operator=(const Symbolizer &) = delete;
+
+  // 为目标进程创建 workers 个解析线程，pid 为 0 时表示离线解析
+  // cache_dir 不为空时使用持久化的符号解析缓存
+  bool start(pid_t pid, int workers, const std::string &cache_dir = "");
+  void stop();
+
+  // 按 maps（/proc/pid/maps 格式）更新模块列表，
+  // 返回被移除或替换的模块地址范围 [start, end)
+  bool update(const std::string &maps,
+              std::vector<std::pair<uintptr_t, uintptr_t>> &removed);
+
+  // 并行解析 addresses 中尚未缓存的地址，结果写入缓存
+  void resolve(std::vector<uintptr_t> &addresses);
+  // 查找已缓存的解析结果，未缓存时返回 nullptr
+  const Symbol *find(uintptr_t addr) const;
+  // 正在解析的地址个数（可在其它线程读取）
+  size_t pending() const { return pending_count.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr size_t SHARD_COUNT = 16;
+  // 少于该数量时直接在调用线程中解析
+  static constexpr size_t PARALLEL_MIN_SIZE = 64;
+
+  struct Key {
+    uintptr_t base;
+    uintptr_t offset;
+    bool operator==(const Key &other) const = default;
+  };
+  struct KeyHash {
+    size_t operator()(const Key &key) const {
+      return std::hash<uintptr_t>()(key.base * 0x9e3779b97f4a7c15ULL ^
+                                    key.offset);
+    }
+  };
+  struct Shard {
+    mutable std::shared_mutex mutex;
+    std::unordered_map<Key, Symbol, KeyHash> symbols;
+  };
+
+  // 模块映射：起始地址 -> {结束地址, 模块基址, 路径, build-id}
+  struct Mapping {
+    uintptr_t end;
+    uintptr_t base;
+    std::string path;
+    std::string build_id; // 只在使用持久化缓存时读取
+  };
+
+  pid_t target_pid = 0;
+  std::map<uintptr_t, Mapping> mappings;
+  Shard shards[SHARD_COUNT];
+
+  // 每个线程一个 Dwfl 句柄（dwfl 不是线程安全的），dwfls[0] 供调用线程使用
+  std::vector<Dwfl *> dwfls;
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable task_ready;
+  std::condition_variable task_done;
+  // 本轮任务：待解析的地址，按线程编号均分
+  const std::vector<uintptr_t> *tasks = nullptr;
+  uint64_t round = 0;
+  size_t remaining = 0;
+  bool stopped = false;
+  std::atomic<size_t> pending_count = 0;
+  SymbolCache cache;
+
+  // 地址所属模块的映射，不属于任何模块时返回 nullptr
+  const Mapping *locate(uintptr_t addr, Key &key) const;
+  // 从持久化缓存中取出 addresses 中已解析的地址，其余保留
+  void load_cached(std::vector<uintptr_t> &addresses);
+  // 将 dwfl 解析的 addresses 写入持久化缓存
+  void save_cached(const std::vector<uintptr_t> &addresses);
+  static size_t shard_index(const Key &key) {
+    return KeyHash()(key) % SHARD_COUNT;
+  }
+  // 使用 dwfl 解析 [begin, end) 中的地址
+  void resolve_range(Dwfl *dwfl, const uintptr_t *begin, const uintptr_t *end);
+  void worker(size_t index);
+};
+
+} // namespace Memory::Profile
@@ -7,7 +7,10 @@ LICENSE file in the root directory of this source tree.
 
 #include "target_loader.h"
 
+#include <algorithm>
 #include <cstring>
+#include <mutex>
+#include <unordered_map>
 
 #include "elf.h"
 #include "elfutils/libdwfl.h"
@@ -18,6 +21,7 @@ LICENSE file in the root directory of this source tree.
 #include "sys/stat.h"
 #include "unistd.h"
 
+#include "trace_writer.h"
 #include "utils.h"
 
 namespace Memory::Profile {
@@ -107,15 +111,17 @@ bool get_maps_addr(pid_t pid, const std::set<std::string> &ignore,
   char addr[NUMBER_SIZE] = {0};
   char maps[NUMBER_SIZE] = {0};
   char name[BUFFER_SIZE] = {0};
-  while (!feof(file)) {
+  char line[BUFFER_SIZE + (NUMBER_SIZE << 2)] = {0};
+  // 按行读取，匿名映射没有name，不能让解析跨到下一行
+  while (fgets(line, sizeof(line), file) != nullptr) {
     // 解析一行：
     // 例如：7f6764831000-7f6764833000 r--p 00000000 08:10 6230
     // /usr/lib/x86_64-linux-gnu/ld-linux-x86-64.so.2
     // 以空格分隔，第一项的"-"左边数字为待提取的基地址，存入addr，第三项是maps，第六项为name
-    if (fscanf(file, "%[^-]-%*[^ ] %*[^ ] %[^ ] %*[^ ] %*[^ ] %[^\n]\n", addr,
-               maps, name) < 0) {
-      perror("read line of maps file");
-      break;
+    name[0] = '\0';
+    if (sscanf(line, "%[^-]-%*[^ ] %*[^ ] %[^ ] %*[^ ] %*[^ ] %[^\n]", addr,
+               maps, name) < 3) {
+      continue;
     }
 
     // 检查匹配条件:
@@ -237,21 +243,26 @@ inline bool get_function_offset(const char *path, OffsetCallback callback,
   struct stat sb;
   if (fstat(fd, &sb) < 0) {
     perror("get file stat");
+    close(fd);
     return false;
   } else if (sb.st_size <= 0) {
     Log("bad size(%d) of target file: %s", sb.st_size, path);
+    close(fd);
     return false;
   }
 
   auto length = static_cast<size_t>(sb.st_size);
   auto data = static_cast<const char *>(
       mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0));
+  close(fd);
   if (data == MAP_FAILED) {
     perror("mmap target file");
     return false;
   }
 
-  if (!parse_elf_file(data, length, callback, from_relocation)) {
+  auto result = parse_elf_file(data, length, callback, from_relocation);
+  munmap(const_cast<char *>(data), length);
+  if (!result) {
     Log("bad elf format of target file: %s", path);
     return false;
   }
@@ -259,6 +270,81 @@ inline bool get_function_offset(const char *path, OffsetCallback callback,
   return true;
 }
 
+std::shared_ptr<const SymbolIndex> get_symbol_index(const char *path) {
+  static std::mutex cache_mutex;
+  static std::unordered_map<std::string, std::shared_ptr<const SymbolIndex>>
+      cache;
+
+  auto fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror("open target file");
+    return nullptr;
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) < 0) {
+    perror("get file stat");
+    close(fd);
+    return nullptr;
+  } else if (sb.st_size <= 0) {
+    Log("bad size(%d) of target file: %s", sb.st_size, path);
+    close(fd);
+    return nullptr;
+  }
+  auto length = static_cast<size_t>(sb.st_size);
+  auto data = static_cast<const char *>(
+      mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0));
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("mmap target file");
+    return nullptr;
+  }
+
+  auto index = std::make_shared<SymbolIndex>();
+  index->build_id = read_build_id(path);
+  if (!index->build_id.empty()) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (auto item = cache.find(index->build_id); item != cache.end()) {
+      munmap(const_cast<char *>(data), length);
+      return item->second;
+    }
+  }
+
+  // 未定义的导入符号偏移为 0，不记录
+  auto ok = parse_elf_file(
+      data, length,
+      [&index](const char *name, uintptr_t offset) -> bool {
+        if (offset != 0) {
+          index->functions.emplace_back(name, offset);
+        }
+        return false;
+      },
+      false);
+  if (ok) {
+    auto ehdr = reinterpret_cast<const Elf64_Ehdr *>(data);
+    if (ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr) <= length) {
+      auto phdrs = reinterpret_cast<const Elf64_Phdr *>(data + ehdr->e_phoff);
+      for (size_t i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD) {
+          index->segments.push_back(
+              {phdrs[i].p_vaddr, phdrs[i].p_offset, phdrs[i].p_filesz});
+        }
+      }
+    }
+  }
+  munmap(const_cast<char *>(data), length);
+  if (!ok) {
+    Log("bad elf format of target file: %s", path);
+    return nullptr;
+  }
+  std::sort(index->functions.begin(), index->functions.end());
+
+  if (!index->build_id.empty()) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache.try_emplace(index->build_id, index);
+  }
+  return index;
+}
+
 bool get_function_offset(const char *path, OffsetCallback callback) {
   return get_function_offset(path, callback, false);
 }
@@ -7,10 +7,15 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <set>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "sys/types.h"
 
@@ -27,6 +32,45 @@ bool get_maps_addr(pid_t pid, const std::set<std::string> &ignore,
                    OffsetCallback callback);
 
 bool get_function_offset(const char *path, OffsetCallback callback);
+
+// ELF 文件动态符号表中的函数，按名称排序，同名的版本化符号各占一项
+struct SymbolIndex {
+  std::string build_id; // 十六进制，没有 build-id 时为空
+  std::vector<std::pair<std::string, uintptr_t>> functions;
+  // PT_LOAD 段，用于把函数地址换算为文件偏移（uprobe 按文件偏移注册）
+  struct Segment {
+    uintptr_t vaddr;
+    uint64_t offset;
+    uint64_t size;
+  };
+  std::vector<Segment> segments;
+
+  // 对名称为 name 的每个函数偏移调用 callback
+  template <class F> void find(std::string_view name, F &&callback) const {
+    auto item = std::lower_bound(
+        functions.begin(), functions.end(), name,
+        [](const auto &entry, std::string_view name) {
+          return entry.first < name;
+        });
+    for (; item != functions.end() && item->first == name; ++item) {
+      callback(item->second);
+    }
+  }
+
+  // 函数地址 vaddr 在文件中的偏移，不在任何段内时返回 0
+  uint64_t file_offset(uintptr_t vaddr) const {
+    for (auto &segment : segments) {
+      if (vaddr >= segment.vaddr && vaddr < segment.vaddr + segment.size) {
+        return vaddr - segment.vaddr + segment.offset;
+      }
+    }
+    return 0;
+  }
+};
+
+// mmap 文件一次建立符号索引，按 build-id 缓存在内存中，
+// 同一文件以不同路径或重新加载时不再解析，失败时返回 nullptr
+std::shared_ptr<const SymbolIndex> get_symbol_index(const char *path);
 bool get_relocation_offset(const char *path, OffsetCallback callback);
 
 } // namespace Memory::Profile
@@ -10,6 +10,10 @@ LICENSE file in the root directory of this source tree.
 
 #include "boost/format.hpp"
 #include "libunwind-ptrace.h"
+#include "fcntl.h"
+#include "sys/ptrace.h"
+#include "sys/user.h"
+#include "unistd.h"
 
 namespace Memory::Profile {
 
@@ -35,6 +39,9 @@ bool TraceData::ThreadContext::init(pid_t tid) {
 }
 
 TraceData::ThreadContext::~ThreadContext() {
+  if (buffer != nullptr) {
+    buffer->retired.store(true, std::memory_order_release);
+  }
   if (context != nullptr) {
     _UPT_destroy(context);
     unw_destroy_addr_space(addr_space);
@@ -45,6 +52,7 @@ TraceData::ThreadContext::~ThreadContext() {
 
 bool TraceData::ThreadContext::get_stack_trace(TraceInfo &trace_info,
                                                int max_depth) {
+  SelfStats::Scope scope(SelfStats::UNWIND);
   if (context == nullptr && !init(trace_info.tid)) {
     return false;
   }
@@ -64,33 +72,158 @@ bool TraceData::ThreadContext::get_stack_trace(TraceInfo &trace_info,
   return true;
 }
 
+bool TraceData::ThreadContext::get_stack_trace(TraceInfo &trace_info,
+                                               StackUnwinder &unwinder,
+                                               UnwindMode mode, int max_depth) {
+  SelfStats::Scope scope(SelfStats::UNWIND);
+  max_depth = std::min<int>(max_depth, STACK_MAX);
+  int depth;
+  if (sample != nullptr) {
+    // 采样时线程已经继续运行，只能使用采样的寄存器和栈内存，libunwind 模式按 DWARF 展开；
+    // uprobe 的 rip 为函数入口，与断点陷入后一致地指向下一字节，第 0 帧按 rip - 1 查找
+    auto regs = sample->regs;
+    regs.rip++;
+    depth = unwinder.unwind(
+        trace_info.tid, regs, sample->stack, sample->stack_size,
+        mode == UnwindMode::LIBUNWIND ? UnwindMode::DWARF_CACHED : mode,
+        trace_info.stack, max_depth, sample->returns, sample->return_count);
+  } else {
+    depth = unwinder.unwind(trace_info.tid, mode, trace_info.stack, max_depth,
+                            stack_copy);
+  }
+  if (depth < 0) {
+    return false;
+  }
+  trace_info.stack_size = depth;
+  return true;
+}
+
 bool TraceData::start(pid_t pid) {
   start_time = std::chrono::steady_clock::now();
-  clear_dwfl();
   target_pid = pid;
-  output = Zip::Stream::CreateFile(config.save_binary_path);
+  unwinder.reset(pid);
+  writer.isPrintSaveEntry = config.isPrintSaveEntry;
+  // 按策略计算各操作的调用栈深度
+  for (size_t i = 0; i < Operation::op_type_count; i++) {
+    auto &policy = config.stackPolicy[i];
+    stack_depth[i] = policy.maxDepth < 0
+                         ? config.maxStackTraceDepth
+                         : std::min<int>(policy.maxDepth, STACK_MAX);
+    module_filter[i] = policy.hasModuleFilter();
+  }
+  modules_stale = true;
+  writer.open(config.save_binary_path, config.isRawStacks,
+              Zip::Stream::CompressionLevel(config.compressLevel),
+              config.compressThreads, config.formatVersion);
+  // raw 模式下调用栈编号会重新分配，不维护存活分配表
+  live_heap.reset(config.isRawStacks ? 0 : config.liveHeapEntries);
+  writer.live_heap = live_heap.enabled() ? &live_heap : nullptr;
+  writer.checkpoint_interval = config.checkpointInterval;
+  writer.checkpoint_events = config.checkpointEvents;
+  next_metrics = 0;
+  arena_sampler.reset(target_pid);
+  next_arena_sample = 0;
+  if (!config.agent_ring_name.empty()) {
+    // 调用栈深度与断点方式保持一致
+    uint16_t depth = 0;
+    uint16_t op_depth[Operation::op_type_count] = {0};
+    if (config.isGetStackTrace) {
+      depth = std::clamp<int>(config.maxStackTraceDepth, 1, STACK_MAX);
+      for (size_t i = 0; i < Operation::op_type_count; i++) {
+        op_depth[i] = std::clamp<int>(stack_depth[i], 0, STACK_MAX);
+      }
+    }
+    if (!agent_ring.create(config.agent_ring_name.c_str(),
+                           AGENT_RING_CAPACITY, depth, config.sampleBytes,
+                           op_depth, config.tracedOps.to_ullong())) {
+      perror("create agent ring");
+      return false;
+    }
+    Log("agent ring: [%s], capacity: [%zu], stack depth: [%d]",
+        config.agent_ring_name.c_str(), AGENT_RING_CAPACITY, depth);
+  }
   processor = std::thread([this]() -> void {
-    if (!init_dwfl()) {
+    SelfStats::SetThread("processor");
+    if (!config.isRawStacks &&
+        !writer.start_symbolizer(target_pid, config.symbolizeThreads,
+                                 config.symcache_dir)) {
+      // 通知追踪线程不再等待缓冲区空间
+      stopped = true;
       return;
     }
     need_update_dwfl = true;
 
+    // agent 无法通过 doorbell 唤醒，缩短空闲时的等待
+    auto interval = std::chrono::milliseconds(agent_ring.ready() ? 1 : 25);
+    std::vector<const TraceInfo *> batch;
+    batch.reserve(2 * BATCH_MAX_SIZE);
+    std::vector<TraceInfo> agent_batch;
+    agent_batch.reserve(BATCH_MAX_SIZE);
+    std::vector<TraceInfo> spilled_batch;
+    spilled_batch.reserve(BATCH_MAX_SIZE);
+    std::vector<std::pair<ThreadBuffer *, uint64_t>> drained;
+
     // 主处理循环
-    while (!stopped || !queue.empty() || need_update_dwfl) {
+    while (true) {
+      // 先读取停止标志，保证停止后还会再取一次数据
+      auto bell = doorbell.value();
+      bool done = stopped;
+
       // 如果需要更新 DWARF 信息，立即更新
       if (need_update_dwfl) {
         update_dwfl();
       }
-      // 等待队列中有数据
-      if (queue.empty()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(25));
+
+      batch.clear();
+      agent_batch.clear();
+      spilled_batch.clear();
+      // 停止后各线程不再添加，全部输出
+      auto watermark = done ? PENDING_IDLE : getTime() - ORDER_DELAY;
+      merge(batch, drained, spilled_batch, agent_batch, watermark);
+
+      // 等待缓冲区中有数据
+      if (batch.empty()) {
+        if (done) {
+          // 写入结束时仍在丢弃的各段的统计
+          std::lock_guard<std::mutex> lock(rings_mutex);
+          for (auto &buffer : rings) {
+            if (buffer->lost_open) {
+              writer.write_lost(buffer->lost);
+              buffer->lost_open = false;
+            }
+          }
+          break;
+        }
+        sample_arenas();
+        doorbell.wait(bell, interval);
         continue;
       }
 
-      TraceInfo trace_info;
-      if (queue.pop(trace_info)) {
-        // 处理数据
-        process(trace_info);
+      // 合并结果已按时间戳排序，agent 中的记录可能略微乱序
+      std::stable_sort(batch.begin(), batch.end(),
+                       [](const TraceInfo *lhs, const TraceInfo *rhs) {
+                         return lhs->timestamp < rhs->timestamp;
+                       });
+      metrics.processing_count.store(batch.size(), std::memory_order_relaxed);
+      {
+        SelfStats::Scope scope(SelfStats::PROCESS);
+        writer.write_batch(batch);
+      }
+      metrics.processing_count.store(0, std::memory_order_relaxed);
+      metrics.processed_count.fetch_add(batch.size(),
+                                        std::memory_order_relaxed);
+      if (config.isPublishMetrics && getTime() >= next_metrics) {
+        publish_metrics();
+      }
+      sample_arenas();
+      // 处理完成后才释放缓冲区空间
+      for (auto &[buffer, pos] : drained) {
+        buffered_bytes.fetch_sub(pos - buffer->ring.begin(),
+                                 std::memory_order_relaxed);
+        buffer->ring.release(pos);
+      }
+      if (!drained.empty()) {
+        released.ring();
       }
     }
   });
@@ -98,139 +231,254 @@ bool TraceData::start(pid_t pid) {
   return true;
 }
 
+void TraceData::stop_agent() {
+  if (agent_ring.ready()) {
+    agent_ring.stop();
+  }
+}
+
 bool TraceData::stop() {
+  // 之后 agent 不再等待缓冲区空间
+  stop_agent();
   stopped = true;
+  doorbell.ring();
   if (processor.joinable()) {
     processor.join();
   }
-  clear_dwfl();
-  return true;
-}
-
-bool TraceData::init_dwfl() {
-  std::lock_guard<std::mutex> lock(dwfl_mutex);
-  static const Dwfl_Callbacks callbacks = {.find_elf = dwfl_linux_proc_find_elf,
-                                           .find_debuginfo =
-                                               dwfl_standard_find_debuginfo};
-  dwfl = dwfl_begin(&callbacks);
-  if (dwfl == nullptr) {
-    Log("[%d][error] failed to create DWFL object", target_pid);
-    return false;
+  if (agent_ring.ready()) {
+    agent_stat.dropped_count = agent_ring.dropped();
+    agent_ring.close();
+    shm_unlink(config.agent_ring_name.c_str());
   }
-  if (dwfl_linux_proc_attach(dwfl, target_pid, false) < 0) {
-    Log("[%d][error] failed to attach to PID %d", target_pid, target_pid);
-    dwfl_end(dwfl);
-    dwfl = nullptr;
-    return false;
+  if (spill_fd >= 0) {
+    close(spill_fd);
+    spill_fd = -1;
+  }
+  writer.close();
+  if (live_heap.enabled() && !config.live_heap_path.empty()) {
+    bool ok = live_heap.save(
+        config.live_heap_path, config.liveHeapTop,
+        [this](uint32_t stack_id) { return writer.describe_stack(stack_id); });
+    if (!ok) {
+      Log("[error] failed to save live heap report: %s",
+          config.live_heap_path.c_str());
+    }
+    // 只保存一次
+    config.live_heap_path.clear();
   }
   return true;
 }
 
-void TraceData::clear_dwfl() {
-  std::lock_guard<std::mutex> lock(dwfl_mutex);
-  if (dwfl != nullptr) {
-    dwfl_end(dwfl);
-    dwfl = nullptr;
+void TraceData::publish_metrics() {
+  next_metrics = getTime() + METRICS_INTERVAL;
+  if (!live_heap.enabled()) {
+    return;
   }
+  auto usage = live_heap.heap_usage();
+  metrics.live_bytes.store(live_heap.live_bytes, std::memory_order_relaxed);
+  metrics.live_count.store(live_heap.live_count, std::memory_order_relaxed);
+  metrics.peak_live_bytes.store(live_heap.peak_bytes,
+                                std::memory_order_relaxed);
+  metrics.heap_bytes.store(usage.heap_bytes, std::memory_order_relaxed);
+  metrics.free_bytes.store(usage.free_bytes, std::memory_order_relaxed);
+  metrics.largest_free.store(usage.largest_free, std::memory_order_relaxed);
 }
 
-void TraceData::update_dwfl() {
-  std::lock_guard<std::mutex> lock(dwfl_mutex);
-  // Log("updating dwfl");
-  dwfl_report_begin(dwfl);
-  if (dwfl_linux_proc_report(dwfl, target_pid) < 0) {
-    Log("[%d][error] failed to report process mappings for PID %d", target_pid,
-        target_pid);
-    dwfl_report_end(dwfl, nullptr, nullptr);
+void TraceData::sample_arenas() {
+  if (config.arenaInterval <= 0 || getTime() < next_arena_sample) {
     return;
   }
-  if (dwfl_report_end(dwfl, nullptr, nullptr) < 0) {
-    Log("[%d][error] failed to finalize report update", target_pid);
-    return;
+  auto now = getTime();
+  next_arena_sample = now + config.arenaInterval;
+  {
+    SelfStats::Scope scope(SelfStats::ARENA);
+    if (!arena_sampler.sample(arena_stats)) {
+      return;
+    }
   }
-  function_cache.clear();
-  need_update_dwfl = false;
-  // Log("finished updating dwfl");
+  writer.write_arena(now, arena_stats);
 }
 
-static inline bool
-set_name_index(const char *&name, uint32_t &index,
-               std::unordered_map<std::string, uint32_t> &names) {
-  if (name == nullptr) {
-    name = "<nil>";
+bool TraceData::peek(MergeSource &source) {
+  if (source.buffer == nullptr) {
+    auto item = agent_ring.front();
+    if (item == nullptr) {
+      return false;
+    }
+    // agent 使用 CLOCK_MONOTONIC
+    source.timestamp = getTime(item->timestamp);
+    return true;
   }
-  auto item = names.find(name);
-  if (item != names.end()) {
-    index = item->second;
-    // Log("[exist] [%s] already exists in names map", name);
-    return false;
-  } else {
-    index = names[name] = names.size();
-    // Log("[found] added [%s] as #%d", name, index);
+  source.next = source.pos;
+  auto record = source.buffer->ring.read(source.next, source.end);
+  if (record != nullptr) {
+    source.record = static_cast<const TraceInfo *>(record);
+    source.timestamp = source.record->timestamp;
     return true;
   }
+  auto &buffer = *source.buffer;
+  if (!buffer.spilling.load(std::memory_order_acquire)) {
+    return false;
+  }
+  // 追踪线程在持有锁时才开始溢出，此时之前写入缓冲区的记录都已可见，
+  // 只有这些记录都已取出后才能读回，保持同一线程的顺序
+  std::lock_guard<std::mutex> lock(spill_mutex);
+  if (buffer.ring.end() != source.pos || buffer.spilled.empty()) {
+    return false;
+  }
+  source.record = nullptr;
+  source.timestamp = buffer.spilled.front().timestamp;
+  return true;
 }
 
-void TraceData::process(TraceInfo &trace_info) {
-  FunctionInfo stack[STACK_MAX] = {0};
-
-  // 遍历每个调用栈地址
-  for (uint16_t i = 0; i < trace_info.stack_size; i++) {
-    // 先在缓存中查找是否存在
-    auto cache_item = function_cache.find(trace_info.stack[i]);
-    if (cache_item != function_cache.end()) {
-      stack[i] = cache_item->second;
-      continue;
+const TraceInfo *TraceData::take(MergeSource &source,
+                                 std::vector<TraceInfo> &spilled,
+                                 std::vector<TraceInfo> &agent) {
+  if (source.buffer != nullptr && source.record != nullptr) {
+    source.pos = source.next;
+    return source.record;
+  }
+  if (source.buffer != nullptr) {
+    auto &buffer = *source.buffer;
+    std::lock_guard<std::mutex> lock(spill_mutex);
+    auto [offset, size, timestamp] = buffer.spilled.front();
+    buffer.spilled.pop_front();
+    spill_count--;
+    if (buffer.spilled.empty()) {
+      buffer.spilling.store(false, std::memory_order_release);
     }
-
-    // 将 unw_word_t 类型的 IP 地址转换为 Dwarf_Addr 类型
-    Dwarf_Addr addr = trace_info.stack[i];
-    // 根据 IP 地址获取对应的 DWARF 模块
-    Dwfl_Module *mod = dwfl_addrmodule(dwfl, addr);
-    if (mod == nullptr) {
-      if (false) {
-        Log("[%d][error] failed to get DWARF module for address 0x%lx, op=%s",
-            trace_info.tid, addr, GetOperation(trace_info.tag).name().data());
+    auto &trace_info = spilled.emplace_back();
+    bool ok = pread(spill_fd, &trace_info, size, offset) == ssize_t(size);
+    if (!ok) {
+      perror("read spill file");
+      spilled.pop_back();
+      overflow_stat.lost_count++;
+    }
+    // 全部读回后从头复用临时文件
+    if (spill_count == 0 && spill_size > 0) {
+      spill_size = 0;
+      if (ftruncate(spill_fd, 0) != 0) {
+        perror("truncate spill file");
       }
-      continue;
     }
+    return ok ? &trace_info : nullptr;
+  }
+  auto item = agent_ring.front();
+  auto &trace_info = agent.emplace_back();
+  trace_info.tag = item->tag;
+  trace_info.tid = item->tid;
+  trace_info.args[0] = item->args[0];
+  trace_info.args[1] = item->args[1];
+  trace_info.timestamp = source.timestamp;
+  trace_info.weight = item->weight;
+  trace_info.stack_size = std::min<uint16_t>(item->stack_size, STACK_MAX);
+  memcpy(trace_info.stack, item->stack(),
+         trace_info.stack_size * sizeof(uintptr_t));
+  agent_ring.pop();
 
-    auto &frame = stack[i];
-
-    // 获取当前地址的函数名
-    const char *func_name = dwfl_module_addrname(mod, addr);
-    if (set_name_index(func_name, frame.func_index, func_names)) {
-      write_name_entry(FUNC_NAME_ENTRY, func_name);
-      function_max_length =
-          std::max(function_max_length, (int)strlen(func_name));
+  auto op = GetOperation(trace_info.tag);
+  if (IsInvoke(trace_info.tag)) {
+    agent_stat.op_invoke_count[op.index()]++;
+    agent_stat.max_stack_size =
+        std::max<int>(trace_info.stack_size, agent_stat.max_stack_size);
+    if (trace_info.weight != 0) {
+      sampled_count++;
     }
+  } else {
+    agent_stat.op_result_count[op.index()]++;
+  }
+  if (config.isPrintInvokeResultLog) {
+    showTraceInfo(trace_info);
+  }
+  return &trace_info;
+}
 
-    // 获取源代码行信息
-    Dwfl_Line *line = dwfl_module_getsrc(mod, addr);
-
-    int line_no = -1, col_no = -1;
-
-    // 获取文件名、行号和列号
-    const char *file_name =
-        dwfl_lineinfo(line, nullptr, &line_no, &col_no, nullptr, nullptr);
-    if (set_name_index(file_name, frame.file_index, file_names)) {
-      write_name_entry(FILE_NAME_ENTRY, file_name);
-      filename_max_length =
-          std::max(filename_max_length, (int)strlen(file_name));
+void TraceData::merge(std::vector<const TraceInfo *> &batch,
+                      std::vector<std::pair<ThreadBuffer *, uint64_t>> &drained,
+                      std::vector<TraceInfo> &spilled,
+                      std::vector<TraceInfo> &agent, timens_t watermark) {
+  drained.clear();
+  sources.clear();
+  uint64_t queued = 0;
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  // 释放已退出线程中记录都已处理完成的缓冲区
+  std::erase_if(rings, [this](const std::shared_ptr<ThreadBuffer> &buffer) {
+    if (!buffer->retired.load(std::memory_order_acquire) ||
+        !buffer->ring.empty() ||
+        buffer->spilling.load(std::memory_order_acquire)) {
+      return false;
     }
+    if (buffer->lost_open) {
+      writer.write_lost(buffer->lost);
+    }
+    return true;
+  });
+  for (auto &buffer : rings) {
+    auto &ring = buffer->ring;
+    auto pos = ring.begin(), end = ring.end();
+    queued += end - pos;
+    // 先取当前时间再读取，之后才获取时间戳的追踪信息不会早于 watermark
+    watermark = std::min(watermark, buffer->pending.load());
+    sources.push_back({buffer.get(), pos, pos, end, nullptr, 0});
+  }
+  if (agent_ring.ready()) {
+    sources.push_back({nullptr, 0, 0, 0, nullptr, 0});
+  }
+  // 各数据源内按时间顺序，按下一条记录的时间戳 k 路归并
+  std::vector<size_t> heap;
+  auto later = [this](size_t lhs, size_t rhs) {
+    return sources[lhs].timestamp > sources[rhs].timestamp;
+  };
+  for (size_t i = 0; i < sources.size(); i++) {
+    if (peek(sources[i]) && sources[i].timestamp < watermark) {
+      heap.push_back(i);
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), later);
+  while (!heap.empty() && batch.size() < BATCH_MAX_SIZE) {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    auto &source = sources[heap.back()];
+    if (auto record = take(source, spilled, agent)) {
+      batch.push_back(record);
+    }
+    if (peek(source) && source.timestamp < watermark) {
+      std::push_heap(heap.begin(), heap.end(), later);
+    } else {
+      heap.pop_back();
+    }
+  }
+  for (auto &source : sources) {
+    if (source.buffer != nullptr && source.pos != source.buffer->ring.begin()) {
+      drained.emplace_back(source.buffer, source.pos);
+    }
+  }
+  // 只记录有数据时的队列深度，空闲时的轮询不计入
+  if (queued > 0) {
+    SelfStats::Get().record_queue(queued);
+  }
+}
 
-    frame.line_no = line_no;
-    frame.col_no = col_no;
-
-    // 将函数信息写入缓存
-    function_cache[trace_info.stack[i]] = frame;
+void TraceData::update_dwfl() {
+  need_update_dwfl = false;
+  std::ifstream file("/proc/" + std::to_string(target_pid) + "/maps");
+  if (!file.is_open()) {
+    Log("[%d][error] failed to open maps", target_pid);
+    return;
+  }
+  std::string maps;
+  try {
+    maps.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+  } catch (const std::ios_base::failure &) {
+    // 目标进程已退出
+    Log("[%d][error] failed to read maps", target_pid);
+    return;
   }
-  // 序列化到输出流
-  write_trace_info(trace_info, stack);
+  writer.update_modules(getTime(), maps);
 }
 
-void TraceData::showTraceInfo(TraceInfo &trace_info) const {
-  auto &[tag, tid, args, timestamp, stack_size, stack] = trace_info;
+void TraceData::showTraceInfo(const TraceInfo &trace_info) const {
+  auto &[tag, tid, args, timestamp, weight, stack_size, stack] = trace_info;
   auto op = GetOperation(tag);
 
   // 时间后三位不显示了，节约空间
@@ -268,51 +516,60 @@ void TraceData::showTraceInfo(TraceInfo &trace_info) const {
   }
 }
 
-void TraceData::write_name_entry(uint8_t entry_type, const char *name) {
-  uint16_t name_length = strlen(name);
-  write(entry_type);
-  write(name_length);
-  output->write(name, name_length);
-  if (config.isPrintSaveEntry) {
-    const char *type = entry_type == FILE_NAME_ENTRY ? "filename" : "function";
-    Log("[%s][%lld]: len=[%2d], name=[%s]", type, getTime() / 1000, name_length,
-        name);
-  }
-}
-
-void TraceData::write_trace_info(TraceInfo &trace_info,
-                                 FunctionInfo (&stack)[STACK_MAX]) {
-  write(trace_info.tag);        // 1B
-  write(trace_info.tid);        // 4B
-  write(trace_info.args[0]);    // 8B
-  write(trace_info.args[1]);    // 8B
-  write(trace_info.timestamp);  // 8B
-  write(trace_info.stack_size); // 2B
-
-  union {
-    const FunctionInfo (*ptr)[STACK_MAX]{};
-    const char *data;
-  };
-  ptr = &stack;
-  output->write(data, sizeof(FunctionInfo) * trace_info.stack_size);
-  if (config.isPrintSaveEntry) {
-    Log("[traceinfo][%lld]: tag=[%d(%s %s)] tid=[%d] args=[%#lx, %#lx], "
-        "stacksize=[%d]",
-        trace_info.timestamp / 1000, trace_info.tag,
-        IsInvoke(trace_info.tag) ? "invoke" : "result",
-        GetOperation(trace_info.tag).name().data(), trace_info.tid,
-        trace_info.args[0], trace_info.args[1], trace_info.stack_size);
-  }
-}
-
 bool TraceData::add(uint8_t tag, pid_t tid, uintptr_t arg1, uintptr_t arg2,
                     ThreadContext &context, int *stack_size = nullptr) {
-  TraceInfo trace_info = {tag, tid, {arg1, arg2}, getTime(), 0, {0}};
-  // 如果是调用操作(Invoke)，采集调用栈
-  if (IsInvoke(tag) && config.isGetStackTrace &&
-      !context.get_stack_trace(trace_info, config.maxStackTraceDepth)) {
+  SelfStats::Scope scope(SelfStats::ADD);
+  auto sample = context.sample;
+  // 首次添加时为当前线程创建缓冲区
+  if (context.buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    context.buffer = rings.emplace_back(std::make_shared<ThreadBuffer>());
+  }
+  auto &buffer = *context.buffer;
+  // 先标记正在获取时间戳再获取，处理线程因此不会越过尚未写入的追踪信息
+  PendingScope pending(buffer, PENDING_BUSY);
+  auto timestamp = sample != nullptr ? getTime(sample->time) : getTime();
+  buffer.pending.store(timestamp);
+  TraceInfo trace_info = {tag, tid, {arg1, arg2}, timestamp, 0, 0, {0}};
+  // 丢弃了调用时，其返回之前的追踪信息一并丢弃，保证调用与返回成对
+  if (buffer.lost_depth > 0) {
+    drop(buffer, trace_info);
     return false;
   }
+  auto op = GetOperation(tag);
+  auto depth = stack_depth[op.index()];
+  bool need_stack = IsInvoke(tag) && config.isGetStackTrace && depth > 0;
+  // 采样模式下只采集被采样的分配的调用栈，释放操作不采集调用栈
+  if (need_stack && config.sampleBytes > 0) {
+    auto size = AllocationSize(op, arg1, arg2);
+    if (size > 0) {
+      if (!context.sampler.ready()) {
+        context.sampler.seed(uint64_t(tid) * 0x9e3779b97f4a7c15ULL ^
+                             uint64_t(trace_info.timestamp));
+      }
+      trace_info.weight = context.sampler.sample(size, config.sampleBytes);
+      need_stack = trace_info.weight != 0;
+      if (need_stack) {
+        sampled_count++;
+      }
+    } else if (IsDeallocation(op)) {
+      need_stack = false;
+    }
+  }
+  // 调用者位于被排除的模块中时不采集调用栈
+  if (need_stack && module_filter[op.index()] && skip_by_module(op, tid, sample)) {
+    need_stack = false;
+  }
+  // 如果是调用操作(Invoke)，采集调用栈
+  if (need_stack) {
+    bool ok = config.unwindMode == UnwindMode::LIBUNWIND && sample == nullptr
+                  ? context.get_stack_trace(trace_info, depth)
+                  : context.get_stack_trace(trace_info, unwinder,
+                                            config.unwindMode, depth);
+    if (!ok) {
+      return false;
+    }
+  }
   // 打印当前信息到日志
   if (config.isPrintInvokeResultLog) {
     showTraceInfo(trace_info);
@@ -321,18 +578,263 @@ bool TraceData::add(uint8_t tag, pid_t tid, uintptr_t arg1, uintptr_t arg2,
   if (stack_size) {
     *stack_size = trace_info.stack_size;
   }
-  // 将追踪信息推入无锁队列
-  if (!queue.push(std::move(trace_info))) {
-    // 添加失败
-    Log("[%d][error] cannot add trace data: tag(%u) args = [%#lx, %#lx]", tid,
-        tag, arg1, arg2);
+  // 写入缓冲区，超出预算或缓冲区已满时按策略等待、写入临时文件或丢弃
+  auto policy = config.overflowPolicy;
+  if (!buffer.spilling.load(std::memory_order_acquire) &&
+      flush_lost(buffer, trace_info, false) &&
+      push(buffer, trace_info, policy == OverflowPolicy::BLOCK)) {
+    doorbell.ring();
+    return true;
+  }
+  if (policy == OverflowPolicy::SPILL && spill(buffer, trace_info)) {
+    doorbell.ring();
+    return true;
+  }
+  // 对应的调用已经写入，丢弃返回会使调用无法配对，等待溢出的记录读回和缓冲区空间
+  if (!IsInvoke(tag)) {
+    while (buffer.spilling.load(std::memory_order_acquire) && !stopped) {
+      auto bell = released.value();
+      doorbell.ring();
+      released.wait(bell, std::chrono::milliseconds(25));
+    }
+    if (!buffer.spilling.load(std::memory_order_acquire) &&
+        flush_lost(buffer, trace_info, true) &&
+        push(buffer, trace_info, true)) {
+      doorbell.ring();
+      return true;
+    }
+  }
+  drop(buffer, trace_info);
+  return false;
+}
+
+bool TraceData::push(ThreadBuffer &buffer, TraceInfo &trace_info,
+                     bool wait) {
+  auto &ring = buffer.ring;
+  auto size = record_size(trace_info);
+  auto need = RecordRing::record_size(size);
+  void *record;
+  std::optional<SelfStats::Scope> waiting;
+  while (true) {
+    auto ring_bell = ring.space.value();
+    auto budget_bell = released.value();
+    // 缓冲区为空时总是允许写入，避免预算小于单条记录时无法前进
+    auto used = buffered_bytes.load(std::memory_order_relaxed);
+    bool over_budget = config.eventBudget > 0 && used > 0 &&
+                       used + need > config.eventBudget;
+    if (!over_budget && (record = ring.reserve(size)) != nullptr) {
+      break;
+    }
+    if (!wait) {
+      return false;
+    }
+    if (!waiting) {
+      waiting.emplace(SelfStats::RING_WAIT);
+      overflow_stat.blocked_count++;
+      // 等待期间不阻止处理线程输出其他线程的记录，以免互相等待
+      buffer.pending.store(PENDING_IDLE);
+    }
+    if (stopped) {
+      // 添加失败
+      Log("[%d][error] cannot add trace data: tag(%u) args = [%#lx, %#lx]",
+          trace_info.tid, trace_info.tag, trace_info.args[0],
+          trace_info.args[1]);
+      return false;
+    }
+    doorbell.ring();
+    if (over_budget) {
+      released.wait(budget_bell, std::chrono::milliseconds(25));
+    } else {
+      ring.space.wait(ring_bell, std::chrono::milliseconds(25));
+    }
+  }
+  if (waiting) {
+    waiting.reset();
+    // 已越过原来的时间戳输出了其他线程的记录，重新获取时间戳
+    buffer.pending.store(PENDING_BUSY);
+    trace_info.timestamp = getTime();
+    buffer.pending.store(trace_info.timestamp);
+  }
+  // reserve 不移动写入位置，提交前后之差即占用的字节数（含末尾的填充）
+  auto head = ring.end();
+  memcpy(record, &trace_info, size);
+  ring.commit();
+  buffered_bytes.fetch_add(ring.end() - head, std::memory_order_relaxed);
+  return true;
+}
+
+bool TraceData::spill(ThreadBuffer &buffer, const TraceInfo &trace_info) {
+  auto size = record_size(trace_info);
+  std::lock_guard<std::mutex> lock(spill_mutex);
+  if (spill_failed) {
+    return false;
+  }
+  if (spill_fd < 0) {
+    spill_fd = open(config.spill_path.c_str(),
+                    O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (spill_fd < 0) {
+      perror("open spill file");
+      spill_failed = true;
+      return false;
+    }
+    // 只通过文件描述符访问，追踪器退出后不留下文件
+    unlink(config.spill_path.c_str());
+    Log("spill events to: [%s]", config.spill_path.c_str());
+  }
+  auto offset = spill_size.load(std::memory_order_relaxed);
+  if (pwrite(spill_fd, &trace_info, size, offset) != ssize_t(size)) {
+    perror("write spill file");
+    spill_failed = true;
     return false;
   }
+  buffer.spilled.push_back(
+      {offset, static_cast<uint32_t>(size), trace_info.timestamp});
+  buffer.spilling.store(true, std::memory_order_release);
+  spill_size = offset + size;
+  spill_count++;
+  overflow_stat.spilled_count++;
+  overflow_stat.spilled_bytes += size;
+  if (offset + size > overflow_stat.peak_spill_bytes) {
+    overflow_stat.peak_spill_bytes = offset + size;
+  }
+  return true;
+}
+
+void TraceData::drop(ThreadBuffer &buffer, const TraceInfo &trace_info) {
+  auto &lost = buffer.lost;
+  if (!buffer.lost_open) {
+    lost = {};
+    lost.tid = trace_info.tid;
+    lost.start = trace_info.timestamp;
+    buffer.lost_open = true;
+  }
+  lost.end = trace_info.timestamp;
+  lost.count[trace_info.tag]++;
+  overflow_stat.lost_count++;
+  auto op = GetOperation(trace_info.tag);
+  if (IsInvoke(trace_info.tag)) {
+    auto size = AllocationSize(op, trace_info.args[0], trace_info.args[1]);
+    lost.alloc_bytes += size;
+    overflow_stat.lost_alloc_bytes += size;
+    if (op.has_return()) {
+      buffer.lost_depth++;
+    }
+  } else if (buffer.lost_depth > 0) {
+    buffer.lost_depth--;
+  }
+}
+
+bool TraceData::flush_lost(ThreadBuffer &buffer, TraceInfo &next, bool wait) {
+  if (!buffer.lost_open) {
+    return true;
+  }
+  // 这一段的起止时间写在统计中，记录的时间戳不能早于当前线程之前公布的时间戳
+  TraceInfo trace_info = {TraceWriter::LOST_ENTRY, buffer.lost.tid, {0, 0},
+                          next.timestamp, 0, 0, {0}};
+  trace_info.stack_size =
+      (sizeof(LostEvents) + sizeof(trace_info.stack[0]) - 1) /
+      sizeof(trace_info.stack[0]);
+  memcpy(trace_info.stack, &buffer.lost, sizeof(LostEvents));
+  if (!push(buffer, trace_info, wait)) {
+    return false;
+  }
+  // 等待过时重新获取了时间戳，之后的记录不能早于它
+  next.timestamp = trace_info.timestamp;
+  buffer.lost_open = false;
   return true;
 }
 
 void TraceData::on_library_loaded(pid_t tid) {
   need_update_dwfl = true;
+  unwinder.invalidate();
+  modules_stale = true;
+  doorbell.ring();
+}
+
+void TraceData::on_thread_exit(ThreadContext &context) {
+  if (context.buffer != nullptr) {
+    context.buffer->retired.store(true, std::memory_order_release);
+    context.buffer.reset();
+  }
+}
+
+void TraceData::refresh_modules() {
+  // 判断路径为 path 的模块中发起的调用是否跳过
+  auto skip = [this](const std::string &path) -> OperationSet {
+    auto contains = [&path](const std::vector<std::string> &modules) -> bool {
+      return std::any_of(modules.begin(), modules.end(),
+                         [&path](const std::string &module) {
+                           return !path.empty() &&
+                                  path.find(module) != std::string::npos;
+                         });
+    };
+    OperationSet result;
+    for (size_t i = 0; i < Operation::op_type_count; i++) {
+      auto &policy = config.stackPolicy[i];
+      result[i] = module_filter[i] &&
+                  (contains(policy.denyModules) ||
+                   (!policy.allowModules.empty() &&
+                    !contains(policy.allowModules)));
+    }
+    return result;
+  };
+
+  module_ranges.clear();
+  skip_unknown = skip("");
+  std::ifstream maps("/proc/" + std::to_string(target_pid) + "/maps");
+  std::string line;
+  while (std::getline(maps, line)) {
+    // 格式：start-end perms offset dev inode path
+    uintptr_t start, end;
+    char perms[5];
+    int path_pos = 0;
+    if (sscanf(line.c_str(), "%lx-%lx %4s %*s %*s %*s %n", &start, &end, perms,
+               &path_pos) < 3 ||
+        perms[2] != 'x') {
+      continue;
+    }
+    auto path = path_pos > 0 ? line.substr(path_pos) : std::string();
+    module_ranges.push_back({start, end, skip(path)});
+  }
+  std::sort(module_ranges.begin(), module_ranges.end(),
+            [](const ModuleRange &a, const ModuleRange &b) {
+              return a.start < b.start;
+            });
+}
+
+bool TraceData::skip_by_module(Operation op, pid_t tid,
+                               const UprobeTracer::Sample *sample) {
+  // 断点位于函数入口，栈顶即为返回地址
+  long caller = 0;
+  if (sample != nullptr) {
+    if (sample->stack_size < sizeof(caller)) {
+      return false;
+    }
+    memcpy(&caller, sample->stack, sizeof(caller));
+  } else {
+    errno = 0;
+    auto sp = ptrace(PTRACE_PEEKUSER, tid, offsetof(user_regs_struct, rsp), 0);
+    caller = ptrace(PTRACE_PEEKDATA, tid, sp, 0);
+    if (errno != 0) {
+      return false;
+    }
+  }
+  if (modules_stale) {
+    std::unique_lock<std::shared_mutex> lock(modules_mutex);
+    if (modules_stale.exchange(false)) {
+      refresh_modules();
+    }
+  }
+  std::shared_lock<std::shared_mutex> lock(modules_mutex);
+  auto it = std::upper_bound(module_ranges.begin(), module_ranges.end(),
+                             uintptr_t(caller),
+                             [](uintptr_t addr, const ModuleRange &range) {
+                               return addr < range.start;
+                             });
+  if (it != module_ranges.begin() && uintptr_t(caller) < (--it)->end) {
+    return it->skip[op.index()];
+  }
+  return skip_unknown[op.index()];
 }
 
 bool StatInfo::save(const std::string &filename) const {
@@ -446,6 +948,48 @@ void StatInfo::output(std::ostream &os, bool console) const {
     }
   };
 
+  // 打印追踪器自身的开销：各阶段的耗时分布，以及最忙的几个线程上各阶段的耗时
+  auto printSelfStats = [&]() -> void {
+    for (size_t i = 0; i < SelfStats::PHASE_COUNT; i++) {
+      auto &phase = self_stats.phases[i];
+      if (phase.count == 0) {
+        continue;
+      }
+      printHead(std::string("self_") + SelfStats::PHASE_NAMES[i]);
+      os << boost::format("count=%u total_ms=%.3f avg_us=%.3f p50_us=%.3f "
+                          "p99_us=%.3f max_us=%.3f") %
+                phase.count % (phase.total / 1e6) % (phase.average() / 1e3) %
+                (phase.percentile(0.5) / 1e3) %
+                (phase.percentile(0.99) / 1e3) % (phase.max / 1e3)
+         << '\n';
+    }
+    auto &queue = self_stats.queue_bytes;
+    if (queue.count > 0) {
+      printHead("self_queue_bytes");
+      os << boost::format("avg=%.0f p99=%u max=%u") % queue.average() %
+                queue.percentile(0.99) % queue.max
+         << '\n';
+    }
+    printVar("writer_bytes_in", writer_bytes_in);
+    printVar("writer_bytes_out", writer_bytes_out);
+    printVar("tracer_max_rss_kb", tracer_max_rss_kb);
+    printVar("self_thread_count", self_stats.threads.size());
+    size_t top = console ? 4 : 16;
+    for (size_t i = 0; i < self_stats.threads.size() && i < top; i++) {
+      auto &thread = self_stats.threads[i];
+      printHead(boost::str(boost::format("self_thread[%s/%d]") % thread.role %
+                           thread.tid));
+      os << boost::format("busy_ms=%.3f") % (thread.busy_ns() / 1e6);
+      for (size_t j = 0; j < SelfStats::PHASE_COUNT; j++) {
+        if (thread.phases[j].count > 0) {
+          os << boost::format(" %s=%u/%.3fms") % SelfStats::PHASE_NAMES[j] %
+                    thread.phases[j].count % (thread.phases[j].total / 1e6);
+        }
+      }
+      os << '\n';
+    }
+  };
+
   // 打印分隔线
   printSection("================ Statistic Information ================");
 
@@ -460,7 +1004,9 @@ void StatInfo::output(std::ostream &os, bool console) const {
   printVar("argc", argc);
   printStrArr("argv[]", argv, 0, argc - 1);
   printStrArr("mprofiler_args", argv, 1, argc - 1 - commands.size() + 1);
-  printStrArr("executed_commands", commands, 0, commands.size() - 1);
+  if (!commands.empty()) {
+    printStrArr("executed_commands", commands, 0, commands.size() - 1);
+  }
   printVar("target", target);
   printVar("target_full_path", target_full_path);
   printVar("working_directory", working_dir);
@@ -470,7 +1016,48 @@ void StatInfo::output(std::ostream &os, bool console) const {
   printVar("total_traceinfo_count", total_count);
   printVar("max_stack_size", max_stack_size);
   printVar("filename_max_length", filename_max_length);
+  printVar("stack_count", stack_count);
   printVar("function_max_length", function_max_length);
+  if (!traced_ops.empty()) {
+    printVar("traced_ops", traced_ops);
+  }
+  if (agent_dropped_count > 0) {
+    printVar("agent_dropped_count", agent_dropped_count);
+  }
+  if (uprobe_lost_count > 0) {
+    printVar("uprobe_lost_count", uprobe_lost_count);
+  }
+  if (uprobe_open_failed_count > 0) {
+    printVar("uprobe_open_failed_count", uprobe_open_failed_count);
+  }
+  if (event_budget > 0 || overflow_policy != "block") {
+    printVar("event_budget", event_budget);
+    printVar("overflow_policy", overflow_policy);
+  }
+  if (overflow_blocked_count > 0) {
+    printVar("overflow_blocked_count", overflow_blocked_count);
+  }
+  if (overflow_spilled_count > 0) {
+    printVar("overflow_spilled_count", overflow_spilled_count);
+    printVar("overflow_spilled_bytes", overflow_spilled_bytes);
+    printVar("overflow_peak_spill_bytes", overflow_peak_spill_bytes);
+  }
+  if (overflow_lost_count > 0) {
+    printVar("overflow_lost_count", overflow_lost_count);
+    printVar("overflow_lost_alloc_bytes", overflow_lost_alloc_bytes);
+  }
+  if (sample_bytes > 0) {
+    printVar("sample_bytes", sample_bytes);
+    printVar("sampled_count", sampled_count);
+  }
+  if (detached) {
+    printVar("detached_time", detached_time);
+  }
+  if (live_heap) {
+    printVar("live_bytes_at_exit", live_bytes);
+    printVar("live_count_at_exit", live_count);
+    printVar("peak_live_bytes", peak_live_bytes);
+  }
 
   printSection("-------- Process Information");
   printVar("main_pid", main_pid);
@@ -490,6 +1077,9 @@ void StatInfo::output(std::ostream &os, bool console) const {
   printSection("-------- Operation Called");
   printOpCalledCount();
 
+  printSection("-------- Tracer Overhead");
+  printSelfStats();
+
   printSection("================ ===================== ================");
 }
 } // namespace Memory::Profile
\ No newline at end of file
@@ -7,194 +7,187 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
-#include "boost/lockfree/queue.hpp"
-#include "elfutils/libdwfl.h"
 #include "libunwind.h"
 #include "zstd.h"
 
-#include "zip_stream.h"
+#include "agent_ring.h"
+#include "allocation_sampler.h"
+#include "arena_sampler.h"
+#include "live_heap.h"
+#include "operation.h"
+#include "record_ring.h"
+#include "self_stats.h"
+#include "stack_unwinder.h"
+#include "trace_writer.h"
+#include "uprobe_tracer.h"
 
 namespace Memory::Profile {
 
-// 操作枚举类型
-enum class op_type : uint8_t {
-  UNKNOWN = 0,
-  BRK,
-  SBRK,
-  MMAP,
-  MUNMAP,
-  CLONE,
-  CLONE3,
-  FORK,
-  VFORK,
-  EXECVE,
-  FREE,
-  MALLOC,
-  CALLOC,
-  REALLOC,
-  VALLOC,
-  POSIX_MEMALIGN,
-  ALIGNED_ALLOC,
-  NEW,
-  NEW_ARRAY,
-  DELETE_LEGACY,
-  DELETE,
-  DELETE_ARRAY,
-  _TYPE_COUNT,
-};
-
-// 封装的操作类型类
-class Operation {
-  op_type type_;
-
-public:
-  // 操作的元数据
-  struct OperationMeta {
-    std::string_view name; // 操作名称
-    uint8_t argc;          // 参数个数
-    bool has_return;       // 是否有返回值
-  };
-
-  // 操作类型数量
-  static constexpr size_t op_type_count =
-      static_cast<size_t>(op_type::_TYPE_COUNT);
-  // 操作元数据
-  static constexpr OperationMeta op_meta[op_type_count] = {
-      {"unknown", 2, true},       {"brk", 1, true},
-      {"sbrk", 1, true},          {"mmap", 2, true},
-      {"munmap", 2, true},        {"clone", 1, true},
-      {"clone3", 1, true},        {"fork", 0, true},
-      {"vfork", 0, true},         {"execve", 1, true},
-      {"free", 1, false},         {"malloc", 1, true},
-      {"calloc", 2, true},        {"realloc", 2, true},
-      {"valloc", 1, true},        {"posix_memalign", 2, true},
-      {"aligned_alloc", 2, true}, {"new", 1, true},
-      {"new_arr", 1, true},       {"delete_legacy", 1, false},
-      {"delete", 2, false},       {"delete_arr", 1, false},
-  };
-
-  // constexpr构造函数
-  constexpr Operation(op_type type) noexcept : type_(type) {}
-  // 转换到原始枚举
-  constexpr operator op_type() const noexcept { return type_; }
-  // 获取元数据
-  const OperationMeta &meta() const {
-    return op_meta[static_cast<size_t>(type_)];
-  }
-
-  // 读取方法
-  op_type type() const { return type_; }
-  uint8_t index() const { return static_cast<uint8_t>(type_); }
-  const std::string_view &name() const { return meta().name; }
-  uint8_t argc() const { return meta().argc; }
-  bool has_return() const { return meta().has_return; }
-
-  // Invoke操作，最低位为0
-  constexpr uint8_t invoke() const { return static_cast<uint8_t>(type_) << 1; }
-  // Result操作，最低位为1
-  constexpr uint8_t result() const {
-    return (static_cast<uint8_t>(type_) << 1) | 1;
-  }
-};
-
-// 判断操作是否为Invoke操作
-inline constexpr uint8_t IsInvoke(uint8_t tag) { return (tag & 1) == 0; }
-// 从标记中提取原始操作类型
-inline constexpr Operation GetOperation(uint8_t tag) {
-  return Operation(static_cast<op_type>(tag >> 1));
-}
-
 using TimePoint = std::chrono::steady_clock::time_point; // 时间点
-using timens_t = int64_t; // 时间戳类型（单位纳秒）
+
 
 // 追踪数据核心类，负责内存操作信息的收集和处理
 class TraceData {
-  // 最大调用栈深度
-  static inline constexpr uint16_t STACK_MAX = 100;
-
-  // 单次内存操作的追踪信息（对应原TraceDataEntry）
-  struct TraceInfo {
-    uint8_t tag;                // 操作类型 + 调用/返回
-    pid_t tid;                  // thread id
-    uintptr_t args[2];          // 参数或返回值
-    timens_t timestamp;         // 操作对应的时间戳
-    uint16_t stack_size;        // 调用栈元素个数
-    uintptr_t stack[STACK_MAX]; // 调用栈
-  };
-
-  static inline constexpr size_t QUEUE_INIT_SIZE = 10000; // 无锁队列初始容量
-  boost::lockfree::queue<TraceInfo> queue{QUEUE_INIT_SIZE}; // 无锁队列容器
+  // 缓冲区中的记录只包含 stack_size 个调用栈元素
+  static size_t record_size(const TraceInfo &trace_info) {
+    return offsetof(TraceInfo, stack) +
+           trace_info.stack_size * sizeof(trace_info.stack[0]);
+  }
 
-  bool stopped = false;  // 停止标志位
+  static inline constexpr size_t THREAD_RING_CAPACITY = 1 << 18; // 每个线程的缓冲区容量
+  static inline constexpr timens_t PENDING_IDLE = std::numeric_limits<timens_t>::max(); // 没有正在添加的追踪信息
+  static inline constexpr timens_t PENDING_BUSY = std::numeric_limits<timens_t>::min(); // 正在获取时间戳
+  // 单个追踪线程的缓冲区，以及超出预算时写入临时文件、丢弃的状态
+  struct ThreadBuffer {
+    RecordRing ring{THREAD_RING_CAPACITY};
+    // 写入临时文件后尚未读回的记录（文件偏移、大小、时间戳），由 spill_mutex 保护
+    struct Spilled {
+      uint64_t offset;
+      uint32_t size;
+      timens_t timestamp;
+    };
+    std::deque<Spilled> spilled;
+    // 有尚未读回的记录时，之后的记录也写入临时文件，保持同一线程的顺序
+    std::atomic<bool> spilling = false;
+    // 正在丢弃的一段追踪信息，以及其中等待返回的调用个数，只由追踪线程访问
+    LostEvents lost;
+    bool lost_open = false;
+    int lost_depth = 0;
+    // 正在添加、尚未写入缓冲区的追踪信息的时间戳，处理线程不会越过它输出其他线程的记录
+    std::atomic<timens_t> pending = PENDING_IDLE;
+    // 线程已退出，处理完成后由处理线程释放
+    std::atomic<bool> retired = false;
+  };
+  // 添加追踪信息期间公布其时间戳，返回时清除
+  struct PendingScope {
+    ThreadBuffer &buffer;
+    PendingScope(ThreadBuffer &buffer, timens_t timestamp) : buffer(buffer) {
+      buffer.pending.store(timestamp);
+    }
+    ~PendingScope() { buffer.pending.store(PENDING_IDLE); }
+  };
+  // 每个追踪线程一个缓冲区，与 ThreadContext 共有（ThreadContext 可能在 TraceData 之后析构）
+  std::vector<std::shared_ptr<ThreadBuffer>> rings;
+  std::mutex rings_mutex; // 互斥锁保护 rings
+  Doorbell doorbell;      // 有新数据时唤醒处理线程
+  // 各线程缓冲区中占用的字节数（含正在处理的记录），与 config.eventBudget 比较
+  std::atomic<uint64_t> buffered_bytes = 0;
+  Doorbell released; // 处理线程释放缓冲区空间时唤醒等待预算的追踪线程
+
+  // 溢出的记录写入的临时文件（打开后即删除），由 spill_mutex 保护
+  std::mutex spill_mutex;
+  int spill_fd = -1;
+  bool spill_failed = false;               // 无法写入临时文件，不再尝试
+  std::atomic<uint64_t> spill_size = 0;    // 临时文件中已写入的大小
+  uint64_t spill_count = 0;                // 尚未读回的记录个数
+
+  static inline constexpr size_t AGENT_RING_CAPACITY = 1 << 14; // agent 缓冲区容量
+  static inline constexpr size_t BATCH_MAX_SIZE = 4096; // 单次处理的最大条数
+  // agent 与 uprobe 采样的时间戳早于记录可见的时间，合并时只输出早于当前时间减去该值的记录
+  static inline constexpr timens_t ORDER_DELAY = 20'000'000;
+  Agent::Ring agent_ring; // agent 写入的共享内存环形缓冲区
+
+  StackUnwinder unwinder; // 本地展开调用栈（非 libunwind 方式）
+
+  std::atomic<bool> stopped = false; // 停止标志位
   pid_t target_pid = 0;  // 目标进程PID
   std::thread processor; // 后台处理线程
   TimePoint start_time;  // 开始时间点
 
-  // 特殊标记：文件名条目（使用 UNKNOWN 的 Invoke 标记）
-  static inline constexpr uint8_t FILE_NAME_ENTRY =
-      Operation(op_type::UNKNOWN).invoke();
-  // 特殊标记：函数名条目（使用 UNKNOWN 的 Result 标记）
-  static inline constexpr uint8_t FUNC_NAME_ENTRY =
-      Operation(op_type::UNKNOWN).result();
-
-  // 函数信息结构，调用栈的一帧（对应原 StackFrame ）
-  struct FunctionInfo {
-    uint32_t file_index; // 文件名索引
-    uint32_t func_index; // 函数名索引
-    int32_t line_no;     // 源代码行号
-    int32_t col_no;      // 源代码列号
+  std::atomic<bool> need_update_dwfl = false; // DWARF信息是否需要更新
+
+  // 各操作采集调用栈的最大深度，0 表示不采集
+  std::array<int, Operation::op_type_count> stack_depth{};
+  // 设置了模块过滤的操作
+  OperationSet module_filter;
+  // 可执行段的地址范围，以及调用者位于其中时不采集调用栈的操作
+  struct ModuleRange {
+    uintptr_t start;
+    uintptr_t end;
+    OperationSet skip;
   };
-
-  // 索引到文件名/函数名的映射（对应原 TraceMap ）
-  std::unordered_map<std::string, uint32_t> file_names; // 文件名到索引的映射
-  std::unordered_map<std::string, uint32_t> func_names; // 函数名到索引的映射
-  std::map<uintptr_t, FunctionInfo> function_cache; // 地址到函数信息的缓存
-
-  std::shared_ptr<std::ostream> output; // 输出流（压缩文件）
-
-  bool need_update_dwfl = false; // DWARF信息是否需要更新
-  Dwfl *dwfl = nullptr;          // DWARF调试信息句柄
-  std::mutex dwfl_mutex;         // 互斥锁保护 dwfl
-
-  // dwfl相关操作
-  bool init_dwfl();
-  void clear_dwfl();
+  std::vector<ModuleRange> module_ranges; // 按起始地址排序
+  OperationSet skip_unknown; // 调用者不在任何模块中时不采集调用栈的操作
+  std::shared_mutex modules_mutex;      // 读写锁保护 module_ranges
+  std::atomic<bool> modules_stale = true; // 模块映射是否需要重新读取
+
+  // 重新读取 /proc/pid/maps，按策略标记各模块，调用方需持有写锁
+  void refresh_modules();
+  // 按调用者所在模块判断是否跳过 tid 当前调用的调用栈，
+  // sample 不为空时从采样的栈内存中读取返回地址
+  bool skip_by_module(Operation op, pid_t tid,
+                      const UprobeTracer::Sample *sample);
+
+  // 读取目标进程的模块映射并通知 writer
   void update_dwfl();
-
-  // 处理单个追踪信息
-  void process(TraceInfo &trace_info);
+  // 发布存活分配表的实时指标，由处理线程调用
+  void publish_metrics();
+  static inline constexpr timens_t METRICS_INTERVAL = 1'000'000'000; // 实时指标的更新间隔
+  timens_t next_metrics = 0;
+  // 到达采样间隔时采样 glibc arena 并写入 writer，由处理线程调用
+  void sample_arenas();
+  ArenaSampler arena_sampler;
+  std::vector<ArenaStats> arena_stats;
+  timens_t next_arena_sample = 0;
+
+  // 将追踪信息写入线程缓冲区，超出预算或缓冲区已满时，wait 为 true 则等待，否则返回 false，
+  // 等待过时重新获取时间戳
+  bool push(ThreadBuffer &buffer, TraceInfo &trace_info, bool wait);
+  // 将追踪信息写入临时文件，失败时返回 false
+  bool spill(ThreadBuffer &buffer, const TraceInfo &trace_info);
+  // 丢弃追踪信息，计入当前线程正在丢弃的一段
+  void drop(ThreadBuffer &buffer, const TraceInfo &trace_info);
+  // 在 next 之前将正在丢弃的一段的统计写入线程缓冲区，时间戳与 next 相同，
+  // 缓冲区仍然已满时返回 false
+  bool flush_lost(ThreadBuffer &buffer, TraceInfo &next, bool wait);
+  // 合并时的一个数据源：线程缓冲区，buffer 为空时为 agent 缓冲区
+  struct MergeSource {
+    ThreadBuffer *buffer;
+    uint64_t pos;             // 已取出的位置
+    uint64_t next;            // 取出下一条记录后的位置
+    uint64_t end;             // 可读取的范围
+    const TraceInfo *record;  // 下一条记录，位于临时文件中时为空
+    timens_t timestamp;       // 下一条记录的时间戳
+  };
+  std::vector<MergeSource> sources; // 只由处理线程使用
+  // 读取数据源的下一条记录，没有时返回 false
+  bool peek(MergeSource &source);
+  // 取出 peek 读到的记录，临时文件中的记录复制到 spilled，agent 的记录复制到 agent，
+  // 读取失败时返回 nullptr
+  const TraceInfo *take(MergeSource &source, std::vector<TraceInfo> &spilled,
+                        std::vector<TraceInfo> &agent);
+  // 按时间戳合并各线程缓冲区、临时文件和 agent 中早于 watermark 的追踪信息，
+  // 最多 BATCH_MAX_SIZE 条，记录每个缓冲区读到的位置，之后的记录时间戳都不早于 watermark
+  void merge(std::vector<const TraceInfo *> &batch,
+             std::vector<std::pair<ThreadBuffer *, uint64_t>> &drained,
+             std::vector<TraceInfo> &spilled, std::vector<TraceInfo> &agent,
+             timens_t watermark);
   // 打印追踪信息
-  void showTraceInfo(TraceInfo &trace_info) const;
-
-  // 向输出流写入任意类型数据
-  template <typename T> void write(const T &value) {
-    union {
-      const T *ptr{};
-      const char *data;
-    };
-    ptr = &value;
-    output->write(data, sizeof(value));
-  }
-
-  // 写入文件名/函数名条目
-  void write_name_entry(uint8_t entry_type, const char *name);
-  // 写入完整的追踪信息
-  void write_trace_info(TraceInfo &trace_info,
-                        FunctionInfo (&stack)[STACK_MAX]);
+  void showTraceInfo(const TraceInfo &trace_info) const;
 
 public:
   TraceData() = default;
@@ -209,11 +202,46 @@ public:
     bool isGetTraceData;
     bool isSaveTraceData;
     int maxStackTraceDepth;
+    UnwindMode unwindMode = UnwindMode::LIBUNWIND;
+    int symbolizeThreads = 4;
+    // 持久化符号解析缓存的目录，为空时不使用
+    std::string symcache_dir;
+    // 是否保存原始地址，由 mprofiler-symbolize 离线符号化
+    bool isRawStacks = false;
+    // 输出格式版本
+    uint16_t formatVersion = TraceWriter::DEFAULT_FORMAT_VERSION;
+    int compressLevel = 0;
+    int compressThreads = 2;
+    // 存活分配表最多记录的分配个数，0 表示不维护
+    uint64_t liveHeapEntries = 0;
+    int liveHeapTop = 20;
+    // 检查点间隔（纳秒/追踪信息个数），需要存活分配表
+    timens_t checkpointInterval = 0;
+    uint64_t checkpointEvents = 0;
+    // glibc arena 的采样间隔（纳秒），0 表示不采样
+    timens_t arenaInterval = 0;
+    // 缓冲的追踪信息的内存预算（字节），0 表示只受各线程缓冲区容量限制
+    uint64_t eventBudget = 0;
+    // 超出预算或缓冲区已满时的处理方式
+    OverflowPolicy overflowPolicy = OverflowPolicy::BLOCK;
+    // 按字节数采样调用栈的平均间隔，0 表示采集所有调用栈
+    uint64_t sampleBytes = 0;
+    // 各操作的调用栈采集策略
+    StackPolicyTable stackPolicy;
+    // 追踪的操作（--ops），传递给 agent
+    OperationSet tracedOps = OperationSet().set();
+    // 是否每秒发布实时指标（--metrics）
+    bool isPublishMetrics = false;
     bool isPrintInvokeResultLog;
     bool isPrintStack;
     bool isPrintSaveEntry;
 
     std::string save_binary_path;
+    std::string live_heap_path;
+    // 溢出的记录写入的临时文件（--overflow spill）
+    std::string spill_path;
+    // agent 共享内存名称，为空时不使用 agent
+    std::string agent_ring_name;
 
     // 调试时是否打印跟踪数据
     bool isPrintTraceData = true;
@@ -222,8 +250,57 @@ public:
 
   } config;
 
-  int filename_max_length = -1;
-  int function_max_length = -1;
+  TraceWriter writer; // 输出文件写入
+  LiveHeap live_heap; // 存活分配表，由处理线程更新
+
+  // agent 采集的操作统计，结束时合并到 StatInfo
+  struct AgentStat {
+    uint64_t op_invoke_count[Operation::op_type_count] = {0};
+    uint64_t op_result_count[Operation::op_type_count] = {0};
+    int max_stack_size = -1;
+    uint64_t dropped_count = 0;
+  } agent_stat;
+
+  // 采样到的分配个数（--sample-bytes）
+  std::atomic<uint64_t> sampled_count = 0;
+
+  // 超出预算或缓冲区已满时的统计（--event-budget/--overflow），结束时合并到 StatInfo
+  struct OverflowStat {
+    std::atomic<uint64_t> blocked_count = 0;  // 等待过缓冲区空间的追踪信息个数
+    std::atomic<uint64_t> spilled_count = 0;  // 写入临时文件的追踪信息个数
+    std::atomic<uint64_t> spilled_bytes = 0;  // 写入临时文件的字节数
+    std::atomic<uint64_t> peak_spill_bytes = 0; // 临时文件的最大大小
+    std::atomic<uint64_t> lost_count = 0;     // 丢弃的追踪信息个数
+    std::atomic<uint64_t> lost_alloc_bytes = 0; // 丢弃的分配请求的字节数
+  } overflow_stat;
+
+  // 实时指标，可在其它线程读取
+  struct Metrics {
+    std::atomic<uint64_t> processed_count = 0;  // 已写入的追踪信息个数
+    std::atomic<uint64_t> processing_count = 0; // 正在符号解析/写入的个数
+    // 以下由处理线程每秒更新（需要存活分配表）
+    std::atomic<uint64_t> live_bytes = 0;
+    std::atomic<uint64_t> live_count = 0;
+    std::atomic<uint64_t> peak_live_bytes = 0;
+    std::atomic<uint64_t> heap_bytes = 0;
+    std::atomic<uint64_t> free_bytes = 0;
+    std::atomic<uint64_t> largest_free = 0;
+  } metrics;
+  // 各线程缓冲区中等待处理的字节数
+  uint64_t queued_bytes() const {
+    return buffered_bytes.load(std::memory_order_relaxed);
+  }
+  // 临时文件中的字节数（含已读回、尚未复用的部分）
+  uint64_t spilled_bytes() const {
+    return spill_size.load(std::memory_order_relaxed);
+  }
+  // agent 缓冲区中等待处理的记录数，未使用 agent 时为 0
+  uint64_t agent_queued() const {
+    return agent_ring.ready() ? agent_ring.pending() : 0;
+  }
+  uint64_t agent_dropped() const {
+    return agent_ring.ready() ? agent_ring.dropped() : 0;
+  }
 
   // 获取当前时间戳
   timens_t getTime() const {
@@ -231,27 +308,51 @@ public:
                std::chrono::steady_clock::now() - start_time)
         .count();
   }
+  // CLOCK_MONOTONIC 时间（agent、uprobe 采样）换算为时间戳，与 steady_clock 同源
+  timens_t getTime(uint64_t monotonic) const {
+    return monotonic - std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           start_time.time_since_epoch())
+                           .count();
+  }
 
   // 线程上下文管理类（用于获取调用栈）
   class ThreadContext {
     void *context = nullptr;         // libunwind 上下文
     unw_addr_space_t addr_space = 0; // 地址空间对象
+    std::vector<uint8_t> stack_copy; // 本地展开时的栈内存副本
+    std::shared_ptr<ThreadBuffer> buffer; // 本线程的追踪数据缓冲区
+    AllocationSampler sampler;       // 本线程的分配采样
+    // 正在处理的 uprobe 采样，不为空时使用其中的时间、寄存器和栈内存
+    const UprobeTracer::Sample *sample = nullptr;
 
     bool init(pid_t tid); // 初始化上下文
 
+    friend class TraceData;
+
   public:
     ThreadContext() = default;
     ~ThreadContext();
 
     // 获取当前线程的调用栈
     bool get_stack_trace(TraceInfo &trace_info, int max_depth = STACK_MAX);
+    // 复制栈内存后在本地展开当前线程的调用栈
+    bool get_stack_trace(TraceInfo &trace_info, StackUnwinder &unwinder,
+                         UnwindMode mode, int max_depth = STACK_MAX);
+    // 设置之后 add 的内核采样，处理完成后设置为 nullptr
+    void set_sample(const UprobeTracer::Sample *sample) {
+      this->sample = sample;
+    }
   };
 
-  // 添加追踪数据到队列
+  // 添加追踪数据到当前线程的缓冲区
   bool add(uint8_t tag, pid_t tid, uintptr_t arg1, uintptr_t arg2,
            ThreadContext &context, int *stack_size);
   // 动态库加载时的回调
   void on_library_loaded(pid_t tid);
+  // 通知 agent 停止写入（分离时），已写入的记录仍会处理
+  void stop_agent();
+  // 线程退出时的回调，其缓冲区处理完成后由处理线程释放
+  void on_thread_exit(ThreadContext &context);
 };
 
 // 统计信息
@@ -266,10 +367,34 @@ struct StatInfo {
   std::string working_dir;
   std::string save_path;
 
-  int total_count;
+  uint64_t total_count = 0;
   int max_stack_size = -1;
   int filename_max_length = -1;
   int function_max_length = -1;
+  uint64_t stack_count = 0;
+  uint64_t agent_dropped_count = 0;
+  uint64_t uprobe_lost_count = 0;
+  uint64_t uprobe_open_failed_count = 0;
+  // 只追踪部分操作时（--ops）追踪的操作列表，追踪全部操作时为空
+  std::string traced_ops;
+  // 超出缓冲预算时的处理（--event-budget/--overflow）
+  uint64_t event_budget = 0;
+  std::string overflow_policy;
+  uint64_t overflow_blocked_count = 0;
+  uint64_t overflow_spilled_count = 0;
+  uint64_t overflow_spilled_bytes = 0;
+  uint64_t overflow_peak_spill_bytes = 0;
+  uint64_t overflow_lost_count = 0;
+  uint64_t overflow_lost_alloc_bytes = 0;
+  uint64_t sample_bytes = 0;
+  uint64_t sampled_count = 0;
+  bool live_heap = false;
+  uint64_t live_bytes = 0;
+  uint64_t live_count = 0;
+  uint64_t peak_live_bytes = 0;
+  // 追踪窗口结束后分离了目标进程（--pid/--duration）
+  bool detached = false;
+  timens_t detached_time = 0;
 
   pid_t main_pid;
   std::vector<pid_t> child_tid_list;
@@ -279,10 +404,16 @@ struct StatInfo {
   std::string timestamp_end;
   timens_t time_end;
 
-  int op_invoke_count[Operation::op_type_count];
-  int op_result_count[Operation::op_type_count];
-  int invoke_count;
-  int result_count;
+  uint64_t op_invoke_count[Operation::op_type_count] = {0};
+  uint64_t op_result_count[Operation::op_type_count] = {0};
+  uint64_t invoke_count = 0;
+  uint64_t result_count = 0;
+
+  // 追踪器自身的开销（各阶段耗时、各线程耗时与队列深度）
+  SelfStats::Summary self_stats;
+  uint64_t writer_bytes_in = 0;
+  uint64_t writer_bytes_out = 0;
+  uint64_t tracer_max_rss_kb = 0;
 
   bool save(const std::string &filename) const;
   void print() const;
@@ -0,0 +1,725 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "trace_writer.h"
+#include "live_heap.h"
+#include "self_stats.h"
+#include "utils.h"
+#include "zip_stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <set>
+
+#include "elf.h"
+#include "fcntl.h"
+#include "unistd.h"
+
+namespace Memory::Profile {
+
+std::string read_build_id(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return "";
+  }
+  std::string build_id;
+  Elf64_Ehdr ehdr;
+  if (pread(fd, &ehdr, sizeof(ehdr), 0) == sizeof(ehdr) &&
+      memcmp(ehdr.e_ident, ELFMAG, SELFMAG) == 0 &&
+      ehdr.e_ident[EI_CLASS] == ELFCLASS64 &&
+      ehdr.e_phentsize == sizeof(Elf64_Phdr)) {
+    std::vector<Elf64_Phdr> phdrs(ehdr.e_phnum);
+    auto size = sizeof(Elf64_Phdr) * phdrs.size();
+    if (pread(fd, phdrs.data(), size, ehdr.e_phoff) == (ssize_t)size) {
+      for (auto &phdr : phdrs) {
+        if (phdr.p_type != PT_NOTE || !build_id.empty()) {
+          continue;
+        }
+        std::vector<uint8_t> notes(phdr.p_filesz);
+        if (pread(fd, notes.data(), notes.size(), phdr.p_offset) !=
+            (ssize_t)notes.size()) {
+          continue;
+        }
+        // 遍历段中的 note，查找 NT_GNU_BUILD_ID
+        size_t pos = 0;
+        while (pos + sizeof(Elf64_Nhdr) <= notes.size()) {
+          auto nhdr = reinterpret_cast<const Elf64_Nhdr *>(&notes[pos]);
+          auto name = pos + sizeof(Elf64_Nhdr);
+          auto desc = name + ((nhdr->n_namesz + 3) & ~3u);
+          auto next = desc + ((nhdr->n_descsz + 3) & ~3u);
+          if (next > notes.size()) {
+            break;
+          }
+          if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+              memcmp(&notes[name], "GNU", 4) == 0) {
+            static const char digits[] = "0123456789abcdef";
+            for (size_t i = 0; i < nhdr->n_descsz; i++) {
+              build_id += digits[notes[desc + i] >> 4];
+              build_id += digits[notes[desc + i] & 0xf];
+            }
+            break;
+          }
+          pos = next;
+        }
+      }
+    }
+  }
+  close(fd);
+  return build_id;
+}
+
+// 以小端序追加任意类型数据
+template <typename T> static void append(std::string &buffer, const T &value) {
+  buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// LEB128 变长整数写入 data，返回写入的字节数
+static inline size_t put_varint(uint8_t *data, uint64_t value) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    data[size++] = uint8_t(value) | 0x80;
+    value >>= 7;
+  }
+  data[size++] = uint8_t(value);
+  return size;
+}
+
+// 有符号整数的 zigzag 编码，绝对值小的负数也只占少量字节
+static inline uint64_t zigzag(int64_t value) {
+  return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+bool TraceWriter::open(const std::string &path, bool raw,
+                       Zip::Stream::CompressionLevel level, int workers,
+                       uint16_t version) {
+  close();
+  output = Zip::Stream::CreateFile(path, level, workers);
+  is_raw = raw;
+  format_version = version;
+  held_calls.clear();
+  last_times.clear();
+  need_format_entry = false;
+  file_names.clear();
+  func_names.clear();
+  file_name_list.clear();
+  func_name_list.clear();
+  function_cache.clear();
+  stack_ids.clear();
+  stack_keys.clear();
+  last_maps.clear();
+  filename_max_length = -1;
+  function_max_length = -1;
+  stack_count = 0;
+  data_size = 0;
+  chunk = ChunkInfo{};
+  chunks.clear();
+  tables.clear();
+  event_count = 0;
+  checkpoint_time = 0;
+  checkpoint_events_at = 0;
+  checkpoint_offset = 0;
+  checkpoint_size = 0;
+  buffer.clear();
+  buffer.reserve(BLOCK_SIZE * 2);
+  pending.clear();
+  pending.reserve(BLOCK_SIZE * 2);
+  has_pending = false;
+  output_stop = false;
+  output_failed = false;
+  frame_ends.clear();
+  input_bytes = 0;
+  output_bytes = 0;
+  output_thread = std::thread(&TraceWriter::output_loop, this);
+  write(FORMAT_ENTRY);
+  write(uint16_t(format_version | (raw ? RAW_FORMAT_FLAG : 0)));
+  return true;
+}
+
+void TraceWriter::close() {
+  symbolizer.stop();
+  if (output == nullptr) {
+    return;
+  }
+  flush_calls();
+  if (!is_raw) {
+    end_chunk();
+  }
+  if (!buffer.empty()) {
+    submit(false);
+  }
+  {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    output_stop = true;
+  }
+  output_cv.notify_all();
+  output_thread.join();
+  if (!is_raw && !output_failed) {
+    write_index();
+  }
+  // 结束最后的压缩帧（raw 模式），得到文件的最终大小
+  output_bytes = Zip::Stream::EndFrame(*output);
+  output.reset();
+}
+
+void TraceWriter::submit(bool end_frame) {
+  std::unique_lock<std::mutex> lock(output_mutex);
+  // 等待上一个内存块写完
+  output_cv.wait(lock, [this] { return !has_pending; });
+  std::swap(buffer, pending);
+  has_pending = true;
+  pending_end_frame = end_frame;
+  lock.unlock();
+  output_cv.notify_all();
+}
+
+void TraceWriter::output_loop() {
+  SelfStats::SetThread("writer");
+  std::unique_lock<std::mutex> lock(output_mutex);
+  while (true) {
+    output_cv.wait(lock, [this] { return has_pending || output_stop; });
+    if (!has_pending) {
+      break;
+    }
+    lock.unlock();
+    if (!output_failed) {
+      SelfStats::Scope scope(SelfStats::COMPRESS);
+      try {
+        output->write(pending.data(), pending.size());
+        if (pending_end_frame) {
+          frame_ends.push_back(Zip::Stream::EndFrame(*output));
+        }
+        input_bytes.fetch_add(pending.size(), std::memory_order_relaxed);
+        output_bytes.store(Zip::Stream::BytesWritten(*output),
+                           std::memory_order_relaxed);
+      } catch (const std::exception &e) {
+        Log("write trace data failed: %s", e.what());
+        output_failed = true;
+      }
+    }
+    pending.clear();
+    lock.lock();
+    has_pending = false;
+    output_cv.notify_all();
+  }
+}
+
+void TraceWriter::end_chunk() {
+  if (data_size == chunk.data_offset) {
+    return;
+  }
+  chunk.data_size = data_size - chunk.data_offset;
+  chunks.push_back(chunk);
+  submit(true);
+
+  chunk = ChunkInfo{};
+  chunk.data_offset = data_size;
+  // 新数据块中的时间差重新开始计算
+  last_times.clear();
+  need_format_entry = format_version >= FORMAT_VERSION;
+  chunk.file_names = file_names.size();
+  chunk.func_names = func_names.size();
+  chunk.stacks = stack_count;
+}
+
+bool TraceWriter::checkpoint_due(timens_t timestamp) const {
+  if (live_heap == nullptr || !live_heap->complete()) {
+    return false;
+  }
+  bool due =
+      (checkpoint_interval > 0 &&
+       timestamp - checkpoint_time >= checkpoint_interval) ||
+      (checkpoint_events > 0 &&
+       event_count - checkpoint_events_at >= checkpoint_events);
+  // 检查点之间的数据不少于检查点本身，限制检查点占用的空间
+  return due && data_size - checkpoint_offset >= checkpoint_size;
+}
+
+void TraceWriter::write_checkpoint(timens_t timestamp) {
+  end_chunk();
+  std::string entry;
+  append(entry, CHECKPOINT_ENTRY);
+  // 暂不写入的调用会与返回合并写入，不需要从检查点恢复，也不计入已写入的个数
+  live_heap->checkpoint(entry, timestamp, event_count - held_calls.size(),
+                        [this](uint64_t key) { return held_calls.contains(key); });
+  write_data(entry.data(), entry.size());
+  chunk.checkpoint_size = entry.size();
+  checkpoint_time = timestamp;
+  checkpoint_events_at = event_count;
+  checkpoint_offset = data_size;
+  checkpoint_size = entry.size();
+  if (isPrintSaveEntry) {
+    Log("[checkpoint][%lld]: size=[%zu], events=[%lu]", timestamp / 1000,
+        entry.size(), event_count);
+  }
+}
+
+void TraceWriter::write_index() {
+  // 写入线程已退出，根据各帧的结束位置计算块的偏移
+  uint64_t offset = 0;
+  for (size_t i = 0; i < chunks.size() && i < frame_ends.size(); i++) {
+    chunks[i].offset = offset;
+    chunks[i].size = frame_ends[i] - offset;
+    offset = frame_ends[i];
+  }
+  // 跳过 skippable 帧头（魔数 + 大小）
+  uint64_t tables_offset = Zip::Stream::EndFrame(*output) + 8;
+  auto compressed = Zip::Stream::Compress(tables);
+  Zip::Stream::WriteSkippableFrame(*output, compressed);
+
+  std::string index;
+  for (auto &item : chunks) {
+    append(index, item.offset);
+    append(index, item.size);
+    append(index, item.data_offset);
+    append(index, item.data_size);
+    append(index, item.first_time);
+    append(index, item.last_time);
+    append(index, item.event_count);
+    append(index, item.file_names);
+    append(index, item.func_names);
+    append(index, item.stacks);
+    append(index, item.checkpoint_size);
+  }
+  append(index, tables_offset);
+  append(index, uint32_t(compressed.size()));
+  append(index, uint32_t(chunks.size()));
+  append(index, INDEX_VERSION);
+  append(index, INDEX_MAGIC);
+  Zip::Stream::WriteSkippableFrame(*output, index);
+  if (isPrintSaveEntry) {
+    Log("[index]: chunks=[%zu], tables=[%zu]", chunks.size(),
+        compressed.size());
+  }
+}
+
+bool TraceWriter::start_symbolizer(pid_t pid, int workers,
+                                   const std::string &cache_dir) {
+  return symbolizer.start(pid, workers, cache_dir);
+}
+
+void TraceWriter::update_modules(timens_t timestamp, const std::string &maps) {
+  // 映射没有变化（如只是匿名映射）时跳过
+  if (maps == last_maps) {
+    return;
+  }
+  last_maps = maps;
+
+  if (is_raw) {
+    // 暂不写入的调用的调用栈编号按旧的映射分配
+    flush_calls();
+    // 写入映射快照以及其中各模块的 build-id
+    std::set<std::string> paths;
+    size_t pos = 0;
+    while (pos < maps.size()) {
+      auto end = maps.find('\n', pos);
+      if (end == std::string::npos) {
+        end = maps.size();
+      }
+      auto path = maps.find('/', pos);
+      if (path < end) {
+        paths.insert(maps.substr(path, end - path));
+      }
+      pos = end + 1;
+    }
+
+    write(MAPS_ENTRY);             // 1B
+    write(timestamp);              // 8B
+    write(uint32_t(maps.size()));  // 4B
+    write_data(maps.data(), maps.size());
+    write(uint16_t(paths.size())); // 2B
+    for (auto &path : paths) {
+      auto build_id = read_build_id(path);
+      write(uint16_t(path.size()));
+      write_data(path.data(), path.size());
+      write(uint16_t(build_id.size()));
+      write_data(build_id.data(), build_id.size());
+    }
+    if (isPrintSaveEntry) {
+      Log("[maps][%lld]: len=[%zu], modules=[%zu]", timestamp / 1000,
+          maps.size(), paths.size());
+    }
+    // 之后的调用栈地址按新的映射解析
+    stack_ids.clear();
+    return;
+  }
+
+  std::vector<std::pair<uintptr_t, uintptr_t>> removed;
+  if (!symbolizer.update(maps, removed)) {
+    return;
+  }
+  for (auto [start, end] : removed) {
+    function_cache.erase(function_cache.lower_bound(start),
+                         function_cache.lower_bound(end));
+  }
+}
+
+void TraceWriter::write_batch(const std::vector<const TraceInfo *> &batch) {
+  // 丢弃的统计的内容位于 stack 中，不是调用栈
+  auto write_lost_info = [this](const TraceInfo &trace_info) {
+    LostEvents lost;
+    memcpy(&lost, trace_info.stack, sizeof(lost));
+    write_lost(lost);
+  };
+  if (is_raw) {
+    for (auto item : batch) {
+      current_time = item->timestamp;
+      if (item->tag == LOST_ENTRY) {
+        write_lost_info(*item);
+        continue;
+      }
+      write_trace_info(*item, intern_stack(item->stack, sizeof(uintptr_t),
+                                           item->stack_size));
+    }
+    return;
+  }
+  // 先并行解析地址，再按顺序处理数据，保证名称索引的分配顺序不变
+  {
+    SelfStats::Scope scope(SelfStats::SYMBOLIZE);
+    resolve(batch);
+  }
+  for (auto item : batch) {
+    if (item->tag == LOST_ENTRY) {
+      write_lost_info(*item);
+      continue;
+    }
+    process(*item);
+  }
+}
+
+void TraceWriter::write_arena(timens_t timestamp,
+                              const std::vector<ArenaStats> &arenas) {
+  write(ARENA_ENTRY);               // 1B
+  write(timestamp);                 // 8B
+  write(uint16_t(arenas.size()));   // 2B
+  for (auto &arena : arenas) {
+    write(arena.address);
+    write(arena.system_mem);
+    write(arena.top_size);
+    write(arena.largest_free);
+    write(arena.tcache_bytes);
+    write(arena.fastbin_bytes);
+    write(arena.unsorted_bytes);
+    write(arena.smallbin_bytes);
+    write(arena.largebin_bytes);
+    write(arena.free_chunks);
+    write(arena.flags);
+  }
+  if (isPrintSaveEntry) {
+    Log("[arena][%lld]: arenas=[%zu]", timestamp / 1000, arenas.size());
+  }
+}
+
+void TraceWriter::write_lost(const LostEvents &lost) {
+  uint16_t tags = 0;
+  for (auto value : lost.count) {
+    tags += value != 0;
+  }
+  write(LOST_ENTRY);        // 1B
+  write(uint32_t(lost.tid)); // 4B
+  write(lost.start);        // 8B
+  write(lost.end);          // 8B
+  write(lost.alloc_bytes);  // 8B
+  write(tags);              // 2B
+  for (size_t tag = 0; tag < std::size(lost.count); tag++) {
+    if (lost.count[tag] != 0) {
+      write(uint8_t(tag));
+      write(lost.count[tag]);
+    }
+  }
+  if (isPrintSaveEntry) {
+    Log("[lost][%lld]: tid=[%d], events=[%lu], bytes=[%lu]", lost.start / 1000,
+        lost.tid, lost.total(), lost.alloc_bytes);
+  }
+}
+
+void TraceWriter::resolve(const std::vector<const TraceInfo *> &batch) {
+  unresolved.clear();
+  for (auto item : batch) {
+    if (item->tag == LOST_ENTRY) {
+      continue;
+    }
+    for (uint16_t i = 0; i < item->stack_size; i++) {
+      if (!function_cache.contains(item->stack[i])) {
+        unresolved.push_back(item->stack[i]);
+      }
+    }
+  }
+  symbolizer.resolve(unresolved);
+}
+
+static inline bool
+set_name_index(const char *&name, uint32_t &index,
+               std::unordered_map<std::string, uint32_t> &names) {
+  if (name == nullptr) {
+    name = "<nil>";
+  }
+  auto item = names.find(name);
+  if (item != names.end()) {
+    index = item->second;
+    // Log("[exist] [%s] already exists in names map", name);
+    return false;
+  } else {
+    index = names[name] = names.size();
+    // Log("[found] added [%s] as #%d", name, index);
+    return true;
+  }
+}
+
+void TraceWriter::process(const TraceInfo &trace_info) {
+  FunctionInfo stack[STACK_MAX] = {0};
+  current_time = trace_info.timestamp;
+
+  // 遍历每个调用栈地址
+  for (uint16_t i = 0; i < trace_info.stack_size; i++) {
+    // 先在缓存中查找是否存在
+    auto cache_item = function_cache.find(trace_info.stack[i]);
+    if (cache_item != function_cache.end()) {
+      stack[i] = cache_item->second;
+      continue;
+    }
+
+    // 获取 resolve 中解析好的符号
+    auto symbol = symbolizer.find(trace_info.stack[i]);
+    if (symbol == nullptr || !symbol->valid) {
+      continue;
+    }
+
+    auto &frame = stack[i];
+
+    // 函数名
+    const char *func_name = symbol->func_name.c_str();
+    if (set_name_index(func_name, frame.func_index, func_names)) {
+      write_name_entry(FUNC_NAME_ENTRY, func_name);
+      func_name_list.emplace_back(func_name);
+      function_max_length =
+          std::max(function_max_length, (int)strlen(func_name));
+    }
+
+    // 文件名
+    const char *file_name = symbol->file_name.c_str();
+    if (set_name_index(file_name, frame.file_index, file_names)) {
+      write_name_entry(FILE_NAME_ENTRY, file_name);
+      file_name_list.emplace_back(file_name);
+      filename_max_length =
+          std::max(filename_max_length, (int)strlen(file_name));
+    }
+
+    frame.line_no = symbol->line_no;
+    frame.col_no = symbol->col_no;
+
+    // 将函数信息写入缓存
+    function_cache[trace_info.stack[i]] = frame;
+  }
+  // 序列化到输出流
+  write_trace_info(trace_info, intern_stack(stack, sizeof(FunctionInfo),
+                                            trace_info.stack_size));
+}
+
+void TraceWriter::write_name_entry(uint8_t entry_type, const char *name) {
+  uint16_t name_length = strlen(name);
+  std::string entry;
+  append(entry, entry_type);
+  append(entry, name_length);
+  entry.append(name, name_length);
+  write_data(entry.data(), entry.size());
+  if (!is_raw) {
+    tables += entry;
+  }
+  if (isPrintSaveEntry) {
+    const char *type = entry_type == FILE_NAME_ENTRY ? "filename" : "function";
+    Log("[%s][%lld]: len=[%2d], name=[%s]", type, current_time / 1000,
+        name_length, name);
+  }
+}
+
+uint32_t TraceWriter::intern_stack(const void *stack, size_t frame_size,
+                                   uint16_t stack_size) {
+  if (stack_size == 0) {
+    return 0;
+  }
+  std::string key(static_cast<const char *>(stack), frame_size * stack_size);
+  auto [item, inserted] = stack_ids.try_emplace(std::move(key), 0);
+  if (!inserted) {
+    return item->second;
+  }
+  uint32_t stack_id = item->second = ++stack_count;
+  if (!is_raw) {
+    stack_keys.push_back(&item->first);
+  }
+
+  std::string entry;
+  append(entry, STACK_ENTRY); // 1B
+  append(entry, stack_id);    // 4B
+  append(entry, stack_size);  // 2B
+  entry += item->first;
+  write_data(entry.data(), entry.size());
+  if (!is_raw) {
+    tables += entry;
+  }
+  if (isPrintSaveEntry) {
+    Log("[stack][%lld]: id=[%u], stacksize=[%d]", current_time / 1000,
+        stack_id, stack_size);
+  }
+  return stack_id;
+}
+
+std::vector<std::string> TraceWriter::describe_stack(uint32_t stack_id) const {
+  std::vector<std::string> frames;
+  if (is_raw || stack_id == 0 || stack_id > stack_keys.size()) {
+    return frames;
+  }
+  auto &key = *stack_keys[stack_id - 1];
+  auto stack = reinterpret_cast<const FunctionInfo *>(key.data());
+  for (size_t i = 0; i < key.size() / sizeof(FunctionInfo); i++) {
+    auto &frame = stack[i];
+    std::string func = frame.func_index < func_name_list.size()
+                    ? func_name_list[frame.func_index]
+                    : "<unknown>";
+    auto file = frame.file_index < file_name_list.size()
+                    ? file_name_list[frame.file_index]
+                    : "<unknown>";
+    if (frame.line_no > 0) {
+      func += " (" + file + ":" + std::to_string(frame.line_no) + ")";
+    }
+    frames.push_back(std::move(func));
+  }
+  return frames;
+}
+
+void TraceWriter::write_trace_info(const TraceInfo &trace_info,
+                                   uint32_t stack_id) {
+  if (format_version < FORMAT_VERSION) {
+    if (trace_info.weight != 0) {
+      write(SAMPLE_WEIGHT_ENTRY); // 1B
+      write(trace_info.weight);   // 8B
+    }
+    write(trace_info.tag);       // 1B
+    write(trace_info.tid);       // 4B
+    write(trace_info.args[0]);   // 8B
+    write(trace_info.args[1]);   // 8B
+    write(trace_info.timestamp); // 8B
+    write(stack_id);             // 4B
+  } else {
+    auto op = GetOperation(trace_info.tag);
+    auto key = (uint64_t(trace_info.tid) << 8) | op.index();
+    if (IsInvoke(trace_info.tag)) {
+      Call call = {trace_info.tag,
+                   trace_info.tid,
+                   {trace_info.args[0], trace_info.args[1]},
+                   trace_info.timestamp,
+                   trace_info.weight,
+                   stack_id};
+      if (op.has_return()) {
+        // 与 Analyzer 相同，按 (tid, 操作) 匹配调用与返回，
+        // 之前的同一调用没有返回时单独写入
+        auto [item, inserted] = held_calls.try_emplace(key, call);
+        if (!inserted) {
+          write_compact(&item->second, nullptr);
+          item->second = call;
+        }
+      } else {
+        write_compact(&call, nullptr);
+      }
+    } else {
+      auto item = held_calls.find(key);
+      if (item != held_calls.end()) {
+        write_compact(&item->second, &trace_info);
+        held_calls.erase(item);
+      } else {
+        write_compact(nullptr, &trace_info);
+      }
+    }
+  }
+
+  if (live_heap != nullptr) {
+    live_heap->update(trace_info, stack_id);
+  }
+  if (!is_raw) {
+    if (chunk.event_count++ == 0) {
+      chunk.first_time = trace_info.timestamp;
+    }
+    chunk.last_time = trace_info.timestamp;
+  }
+
+  if (isPrintSaveEntry) {
+    Log("[traceinfo][%lld]: tag=[%d(%s %s)] tid=[%d] args=[%#lx, %#lx], "
+        "stacksize=[%d], stackid=[%u], weight=[%lu]",
+        trace_info.timestamp / 1000, trace_info.tag,
+        IsInvoke(trace_info.tag) ? "invoke" : "result",
+        GetOperation(trace_info.tag).name().data(), trace_info.tid,
+        trace_info.args[0], trace_info.args[1], trace_info.stack_size,
+        stack_id, trace_info.weight);
+  }
+
+  // 在追踪信息之间切分数据块
+  event_count++;
+  if (!is_raw && checkpoint_due(trace_info.timestamp)) {
+    write_checkpoint(trace_info.timestamp);
+  } else if (!is_raw && data_size - chunk.data_offset >= CHUNK_SIZE) {
+    end_chunk();
+  }
+}
+
+void TraceWriter::write_compact(const Call *call, const TraceInfo *result) {
+  if (need_format_entry) {
+    write(FORMAT_ENTRY);
+    write(format_version);
+    need_format_entry = false;
+  }
+  if (call != nullptr && call->weight != 0) {
+    write(SAMPLE_WEIGHT_ENTRY);
+    write(call->weight);
+  }
+  auto tid = call != nullptr ? call->tid : result->tid;
+  auto timestamp = result != nullptr ? result->timestamp : call->timestamp;
+  uint8_t data[64];
+  size_t size = 0;
+  if (call == nullptr) {
+    data[size++] = result->tag;
+  } else {
+    data[size++] = result != nullptr ? call->tag | CALL_ENTRY_FLAG : call->tag;
+  }
+  size += put_varint(data + size, uint32_t(tid));
+  auto &last_time = last_times[tid];
+  size += put_varint(data + size, zigzag(timestamp - last_time));
+  last_time = timestamp;
+  if (call != nullptr) {
+    if (result != nullptr) {
+      size += put_varint(data + size, zigzag(timestamp - call->timestamp));
+    }
+    // 只写入操作实际使用的参数
+    auto argc = GetOperation(call->tag).argc();
+    for (uint8_t i = 0; i < argc && i < 2; i++) {
+      size += put_varint(data + size, call->args[i]);
+    }
+  }
+  if (result != nullptr) {
+    size += put_varint(data + size, result->args[0]);
+  }
+  if (call != nullptr) {
+    size += put_varint(data + size, call->stack_id);
+  }
+  write_data(data, size);
+}
+
+void TraceWriter::flush_calls() {
+  // 按时间顺序写入
+  std::vector<const Call *> calls;
+  for (auto &[key, call] : held_calls) {
+    calls.push_back(&call);
+  }
+  std::sort(calls.begin(), calls.end(), [](const Call *a, const Call *b) {
+    return a->timestamp < b->timestamp;
+  });
+  for (auto call : calls) {
+    write_compact(call, nullptr);
+  }
+  held_calls.clear();
+}
+
+} // namespace Memory::Profile
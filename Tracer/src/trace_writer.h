@@ -0,0 +1,320 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "sys/types.h"
+
+#include "operation.h"
+#include "arena_sampler.h"
+#include "symbolizer.h"
+#include "zip_stream.h"
+
+namespace Memory::Profile {
+
+class LiveHeap;
+
+using timens_t = int64_t; // 时间戳类型（单位纳秒）
+
+// 最大调用栈深度
+inline constexpr uint16_t STACK_MAX = 100;
+
+// 单次内存操作的追踪信息（对应原TraceDataEntry）
+struct TraceInfo {
+  uint8_t tag;                // 操作类型 + 调用/返回
+  pid_t tid;                  // thread id
+  uintptr_t args[2];          // 参数或返回值
+  timens_t timestamp;         // 操作对应的时间戳
+  uint64_t weight;            // 采样权重（估计的字节数），0 表示未采样
+  uint16_t stack_size;        // 调用栈元素个数
+  uintptr_t stack[STACK_MAX]; // 调用栈
+};
+
+// 按溢出策略（--overflow drop）丢弃的一段连续追踪信息的统计，按线程记录
+// 在线程缓冲区中以 tag 为 TraceWriter::LOST_ENTRY 的 TraceInfo 传递，内容位于 stack 中
+struct LostEvents {
+  pid_t tid = 0;
+  timens_t start = 0;       // 第一个被丢弃的追踪信息的时间戳
+  timens_t end = 0;         // 最后一个被丢弃的追踪信息的时间戳
+  uint64_t alloc_bytes = 0; // 被丢弃的分配请求的字节数
+  uint32_t count[Operation::op_type_count * 2] = {0}; // 各标记被丢弃的个数
+
+  uint64_t total() const {
+    uint64_t sum = 0;
+    for (auto value : count) {
+      sum += value;
+    }
+    return sum;
+  }
+};
+static_assert(sizeof(LostEvents) <= sizeof(TraceInfo::stack));
+
+// 读取 ELF 文件的 GNU build-id（十六进制），失败时返回空串
+std::string read_build_id(const std::string &path);
+
+// 输出文件的写入：名称条目、调用栈表与追踪信息
+// 普通模式下写入符号化后的 memory.profile，raw 模式下写入原始地址和模块映射快照，
+// 由 mprofiler-symbolize 离线转换为 memory.profile
+//
+// memory.profile 按约 CHUNK_SIZE 字节（未压缩）分块，每块为独立的 zstd 帧，
+// 关闭时在文件末尾追加两个 skippable 帧：
+//   1. 名称表与调用栈表（压缩后的名称条目与调用栈条目）
+//   2. 块索引：ChunkInfo 数组 + 尾部 <Q 表偏移><I 表大小><I 块数><H 版本><I 魔数>
+// 按顺序解压整个文件得到的内容与不分块时相同
+//
+// 格式版本 2 中追踪信息为变长编码（V 为 LEB128 变长整数，Z 为 zigzag 编码的
+// 有符号变长整数，时间差相对于同一线程在当前数据块中的上一条记录，块中第一条为绝对值）：
+//   调用：<B 标记><V tid><Z 时间差><V 参数 × argc><V 调用栈编号>
+//   返回：<B 标记><V tid><Z 时间差><V 返回值>
+//   合并的调用：<B 标记 | CALL_ENTRY_FLAG><V tid><Z 返回时间差><Z 调用耗时>
+//               <V 参数 × argc><V 返回值><V 调用栈编号>
+// 有返回值的调用暂不写入，返回时与返回合并为一条记录；每个数据块的第一条记录前
+// 写入格式版本条目，解析时据此重置时间差，数据块仍可单独解析。
+// 格式版本 1（默认）中追踪信息为定长：<B 标记><I tid><Q 参数1><Q 参数2><q 时间戳><I 调用栈编号>
+//
+// 设置了存活分配表时，每隔 checkpoint_interval 或 checkpoint_events 个追踪信息
+// 结束当前数据块，并在新块开头写入检查点，Analyzer 可以从最近的检查点开始重放
+//
+// 设置了 --arena-interval 时定期写入 glibc arena 的采样（ARENA_ENTRY，两种格式版本相同）：
+//   <B 标记><q 时间戳><H arena 个数>，每个 arena 为
+//   <Q 地址><Q system_mem><Q top 大小><Q 最大空闲块><Q tcache><Q fastbin><Q unsorted>
+//   <Q small bin><Q large bin><I 空闲块个数><B 标志>
+//
+// 溢出策略丢弃追踪信息后（--overflow drop）写入丢弃的统计（LOST_ENTRY，两种格式版本相同）：
+//   <B 标记><I tid><q 开始时间戳><q 结束时间戳><Q 分配字节数><H 个数>，
+//   之后为每个被丢弃的标记 <B 追踪信息标记><I 个数>
+//
+// 数据先序列化到内存块中，写满 BLOCK_SIZE 后交给写入线程压缩（双缓冲），
+// 处理线程只在上一个块尚未写完时等待
+class TraceWriter {
+public:
+  // 特殊标记：文件名条目（使用 UNKNOWN 的 Invoke 标记）
+  static inline constexpr uint8_t FILE_NAME_ENTRY =
+      Operation(op_type::UNKNOWN).invoke();
+  // 特殊标记：函数名条目（使用 UNKNOWN 的 Result 标记）
+  static inline constexpr uint8_t FUNC_NAME_ENTRY =
+      Operation(op_type::UNKNOWN).result();
+  // 特殊标记：丢弃的追踪信息条目（--overflow drop），为最小的特殊标记
+  static inline constexpr uint8_t LOST_ENTRY = 0xf9;
+  // 特殊标记：glibc arena 采样条目（--arena-interval）
+  static inline constexpr uint8_t ARENA_ENTRY = 0xfa;
+  // 特殊标记：检查点条目（存活分配、brk 范围与等待返回的调用），位于数据块开头
+  static inline constexpr uint8_t CHECKPOINT_ENTRY = 0xfb;
+  // 特殊标记：采样权重条目（--sample-bytes），作用于紧随其后的追踪信息
+  static inline constexpr uint8_t SAMPLE_WEIGHT_ENTRY = 0xfc;
+  // 特殊标记：模块映射快照条目（仅 raw 模式）
+  static inline constexpr uint8_t MAPS_ENTRY = 0xfd;
+  // 特殊标记：调用栈条目（首次出现的调用栈及其编号）
+  static inline constexpr uint8_t STACK_ENTRY = 0xfe;
+  // 特殊标记：格式版本条目（位于文件开头）
+  static inline constexpr uint8_t FORMAT_ENTRY = 0xff;
+  // 合并的调用条目标记：调用的标记 | CALL_ENTRY_FLAG（仅格式版本 2）
+  static inline constexpr uint8_t CALL_ENTRY_FLAG = 0x80;
+  // 输出格式版本 1：定长的追踪信息，以调用栈编号代替完整调用栈
+  static inline constexpr uint16_t FORMAT_VERSION_1 = 1;
+  // 输出格式版本 2：变长编码的追踪信息，合并调用与返回
+  static inline constexpr uint16_t FORMAT_VERSION = 2;
+  // 默认输出格式版本：版本 2 的数据更小，但 Analyzer 解析版本 1 仍然更快
+  static inline constexpr uint16_t DEFAULT_FORMAT_VERSION = FORMAT_VERSION_1;
+  // raw 格式标记：调用栈为原始地址
+  static inline constexpr uint16_t RAW_FORMAT_FLAG = 0x8000;
+  // 每个数据块的大小（未压缩）
+  static inline constexpr uint64_t CHUNK_SIZE = 4 << 20;
+  // 交给写入线程的内存块大小
+  static inline constexpr size_t BLOCK_SIZE = 1 << 20;
+  // 块索引的魔数与版本
+  static inline constexpr uint32_t INDEX_MAGIC = 0x5849504d; // "MPIX"
+  static inline constexpr uint16_t INDEX_VERSION = 2;
+
+  // 函数信息结构，调用栈的一帧（对应原 StackFrame ）
+  struct FunctionInfo {
+    uint32_t file_index; // 文件名索引
+    uint32_t func_index; // 函数名索引
+    int32_t line_no;     // 源代码行号
+    int32_t col_no;      // 源代码列号
+  };
+
+  // 块索引中的一项
+  struct ChunkInfo {
+    uint64_t offset;      // 压缩帧在文件中的偏移（关闭时由写入线程的结果填充）
+    uint32_t size;        // 压缩帧大小
+    uint64_t data_offset; // 解压后数据中的偏移
+    uint32_t data_size;   // 解压后大小
+    timens_t first_time;  // 第一个追踪信息的时间戳
+    timens_t last_time;   // 最后一个追踪信息的时间戳
+    uint32_t event_count; // 追踪信息个数
+    // 块开始时已写入的文件名、函数名与调用栈个数
+    uint32_t file_names;
+    uint32_t func_names;
+    uint32_t stacks;
+    uint32_t checkpoint_size; // 块开头的检查点条目大小，0 表示没有检查点
+  };
+
+  TraceWriter() = default;
+  ~TraceWriter() { close(); }
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+
+  // level 与 workers 为 zstd 压缩等级与压缩线程数，version 为输出格式版本
+  bool open(const std::string &path, bool raw,
+            Zip::Stream::CompressionLevel level =
+                Zip::Stream::CompressionLevel::DEFAULT,
+            int workers = 0, uint16_t version = DEFAULT_FORMAT_VERSION);
+  void close();
+  bool raw() const { return is_raw; }
+
+  // 启动符号解析（非 raw 模式），pid 为 0 时表示离线解析
+  // cache_dir 为持久化符号解析缓存的目录，为空时不使用
+  bool start_symbolizer(pid_t pid, int workers,
+                        const std::string &cache_dir = "");
+  // 模块映射发生变化，maps 为 /proc/pid/maps 的内容
+  // raw 模式下写入映射快照，否则只清除发生变化的模块的缓存
+  void update_modules(timens_t timestamp, const std::string &maps);
+  // 写入一批按时间排序的追踪信息
+  void write_batch(const std::vector<const TraceInfo *> &batch);
+  // 写入一次 glibc arena 采样
+  void write_arena(timens_t timestamp, const std::vector<ArenaStats> &arenas);
+  // 写入一段被丢弃的追踪信息的统计
+  void write_lost(const LostEvents &lost);
+
+  // 调用栈编号对应的每帧描述（函数名与源文件位置），仅非 raw 模式
+  std::vector<std::string> describe_stack(uint32_t stack_id) const;
+  // 正在符号解析的地址个数（可在其它线程读取）
+  size_t symbolize_pending() const { return symbolizer.pending(); }
+  // 写入线程已处理的数据大小（未压缩）与写入文件的大小（可在其它线程读取）
+  uint64_t bytes_in() const { return input_bytes.load(std::memory_order_relaxed); }
+  uint64_t bytes_out() const { return output_bytes.load(std::memory_order_relaxed); }
+
+  bool isPrintSaveEntry = false;
+  // 写入追踪信息时同步更新的存活分配表，为空时不更新
+  LiveHeap *live_heap = nullptr;
+  // 写入检查点的时间间隔（纳秒）与追踪信息个数间隔，0 表示不按该条件写入
+  timens_t checkpoint_interval = 0;
+  uint64_t checkpoint_events = 0;
+
+  int filename_max_length = -1;
+  int function_max_length = -1;
+  int stack_count = 0; // 不同调用栈的个数
+
+private:
+  // 等待返回的调用（格式版本 2）
+  struct Call {
+    uint8_t tag;
+    pid_t tid;
+    uintptr_t args[2];
+    timens_t timestamp;
+    uint64_t weight;
+    uint32_t stack_id;
+  };
+
+  bool is_raw = false;
+  uint16_t format_version = DEFAULT_FORMAT_VERSION;
+  timens_t current_time = 0; // 正在写入的追踪信息的时间戳，用于日志
+  std::string last_maps;     // 上一次的模块映射
+
+  // 索引到文件名/函数名的映射（对应原 TraceMap ）
+  std::unordered_map<std::string, uint32_t> file_names; // 文件名到索引的映射
+  std::unordered_map<std::string, uint32_t> func_names; // 函数名到索引的映射
+  std::vector<std::string> file_name_list; // 索引到文件名
+  std::vector<std::string> func_name_list; // 索引到函数名
+  std::map<uintptr_t, FunctionInfo> function_cache; // 地址到函数信息的缓存
+  std::vector<uintptr_t> unresolved; // 当前批次中未缓存的地址
+  // 调用栈（原始字节）到编号的映射，编号从 1 开始，0 表示空栈
+  // raw 模式下每次写入映射快照后重新编号
+  std::unordered_map<std::string, uint32_t> stack_ids;
+  std::vector<const std::string *> stack_keys; // 编号 - 1 到调用栈（原始字节）
+
+  uint64_t data_size = 0;         // 已写入的数据大小（未压缩）
+  ChunkInfo chunk{};              // 正在写入的数据块
+  std::vector<ChunkInfo> chunks;  // 已完成的数据块
+  std::string tables;             // 已写入的名称条目与调用栈条目
+  uint64_t event_count = 0;       // 已写入的追踪信息个数
+  // 上一个检查点的时间、位置与大小
+  timens_t checkpoint_time = 0;
+  uint64_t checkpoint_events_at = 0;
+  uint64_t checkpoint_offset = 0;
+  uint64_t checkpoint_size = 0;
+  // 格式版本 2 的编码状态：(tid, 操作) 到暂不写入的调用、各线程上一条记录的时间戳，
+  // 以及是否需要在下一条记录前写入格式版本条目（新的数据块）
+  std::unordered_map<uint64_t, Call> held_calls;
+  std::unordered_map<pid_t, timens_t> last_times;
+  bool need_format_entry = false;
+
+  std::shared_ptr<std::ostream> output; // 输出流（压缩文件），由写入线程使用
+  std::string buffer;                   // 正在序列化的内存块
+  // 交给写入线程的内存块
+  std::string pending;
+  bool has_pending = false;
+  bool pending_end_frame = false; // 写入后结束当前压缩帧
+  bool output_stop = false;
+  bool output_failed = false;
+  std::vector<uint64_t> frame_ends; // 各压缩帧结束时的文件偏移
+  std::atomic<uint64_t> input_bytes = 0;
+  std::atomic<uint64_t> output_bytes = 0;
+  std::mutex output_mutex;
+  std::condition_variable output_cv;
+  std::thread output_thread;
+  Symbolizer symbolizer;                // 多线程符号解析
+
+  // 并行解析一批追踪信息中未缓存的地址
+  void resolve(const std::vector<const TraceInfo *> &batch);
+  // 符号化并写入单个追踪信息
+  void process(const TraceInfo &trace_info);
+
+  // 向输出流写入任意类型数据
+  template <typename T> void write(const T &value) {
+    write_data(&value, sizeof(value));
+  }
+  void write_data(const void *data, size_t size) {
+    buffer.append(static_cast<const char *>(data), size);
+    data_size += size;
+    if (buffer.size() >= BLOCK_SIZE) {
+      submit(false);
+    }
+  }
+
+  // 将当前内存块交给写入线程，end_frame 表示写入后结束压缩帧
+  void submit(bool end_frame);
+  // 写入线程：压缩并写入内存块
+  void output_loop();
+  // 结束当前数据块，开始新的压缩帧
+  void end_chunk();
+  // 是否需要在 timestamp 处写入检查点
+  bool checkpoint_due(timens_t timestamp) const;
+  // 结束当前数据块，在新块开头写入检查点
+  void write_checkpoint(timens_t timestamp);
+  // 写入名称表、调用栈表与块索引
+  void write_index();
+
+  // 写入文件名/函数名条目
+  void write_name_entry(uint8_t entry_type, const char *name);
+  // 查找调用栈编号，首次出现时写入调用栈条目
+  uint32_t intern_stack(const void *stack, size_t frame_size,
+                        uint16_t stack_size);
+  // 写入完整的追踪信息
+  void write_trace_info(const TraceInfo &trace_info, uint32_t stack_id);
+  // 以格式版本 2 写入一条记录：只有 call 时为调用，只有 result 时为返回，
+  // 两者都有时为合并的调用
+  void write_compact(const Call *call, const TraceInfo *result);
+  // 写入所有暂不写入的调用（没有返回的调用）
+  void flush_calls();
+};
+
+} // namespace Memory::Profile
@@ -7,9 +7,16 @@ LICENSE file in the root directory of this source tree.
 
 #include "tracer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <csignal>
 #include <limits>
 #include <unistd.h>
 
+#include "boost/format.hpp"
+#include "sys/resource.h"
+
+#include "seccomp_filter.h"
 #include "utils.h"
 
 namespace Memory::Profile {
@@ -20,14 +27,63 @@ bool init_traceconfig(TraceData &data, const Config &config) {
   data.config.isGetStackTrace = config.isGetStackTrace;
   data.config.isSaveTraceData = config.isSaveTraceData;
   data.config.maxStackTraceDepth = config.maxStackTraceDepth;
+  data.config.sampleBytes = config.sampleBytes;
+  data.config.stackPolicy = config.stackPolicy;
+  data.config.tracedOps = config.tracedOps;
+  data.config.unwindMode = config.unwindMode;
+  data.config.symbolizeThreads = config.symbolizeThreads;
+  data.config.symcache_dir = config.symcache_dir;
+  data.config.isRawStacks = config.isRawStacks;
+  data.config.formatVersion = config.formatVersion;
+  data.config.compressLevel = config.compressLevel;
+  data.config.compressThreads = config.compressThreads;
+  data.config.liveHeapEntries = config.liveHeapEntries;
+  data.config.liveHeapTop = config.liveHeapTop;
+  data.config.checkpointInterval = config.checkpointInterval * 1e9;
+  data.config.checkpointEvents = config.checkpointEvents;
+  data.config.arenaInterval = config.arenaInterval * 1e9;
+  data.config.eventBudget = config.eventBudget;
+  data.config.overflowPolicy = config.overflowPolicy;
+  data.config.isPublishMetrics = config.isMetrics;
   data.config.isPrintStack = config.isPrintStack;
   data.config.isPrintInvokeResultLog = config.isPrintInvokeResultLog;
   data.config.isPrintSaveEntry = config.isPrintSaveEntry;
 
   data.config.save_binary_path = config.save_binary_path;
+  data.config.live_heap_path = config.live_heap_path;
+  data.config.spill_path = config.spill_path;
+  data.config.agent_ring_name = config.agent_ring_name;
+  return true;
+}
+
+bool init_debugconfig(Tracer::DebugConfig &debug_config,
+                      const Config &config) {
+  debug_config.stepMode = config.stepMode;
+  debug_config.returnCapture = config.returnCapture;
+  debug_config.isSeccomp = config.isSeccomp;
+  debug_config.isAttach = config.pid() > 0;
+  debug_config.engine = config.engine;
+  debug_config.backend = config.backend;
+  debug_config.uprobeStackSize =
+      config.isGetStackTrace ? UprobeTracer::STACK_SIZE : 0;
+  for (size_t i = 0; i < Operation::op_type_count; i++) {
+    auto depth = config.stackPolicy[i].maxDepth;
+    debug_config.uprobeStackOps[i] =
+        (depth < 0 ? config.maxStackTraceDepth : depth) > 0;
+  }
   return true;
 }
 
+// 结束追踪窗口的信号，需要在创建其它线程前屏蔽，由 Tracer::watchWindow 接收
+sigset_t window_signals() {
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGTERM);
+  sigaddset(&set, SIGUSR1);
+  return set;
+}
+
 bool init_statinfo(StatInfo &stat, const Config &config) {
   stat.argc = config.argc();
   stat.argv = config.argv();
@@ -38,7 +94,7 @@ bool init_statinfo(StatInfo &stat, const Config &config) {
 
 void Tracer::invoke(Operation op, pid_t tid, uintptr_t arg1, uintptr_t arg2,
                     TraceData::ThreadContext &context) {
-  stat.op_invoke_count[op.index()]++;
+  SelfStats::Current().count_invoke(op.index());
   int stacksize = 0;
   data.add(op.invoke(), tid, arg1, arg2, context, &stacksize);
   stat.max_stack_size = std::max(stacksize, stat.max_stack_size);
@@ -46,11 +102,10 @@ void Tracer::invoke(Operation op, pid_t tid, uintptr_t arg1, uintptr_t arg2,
 
 void Tracer::result(Operation op, pid_t tid, uintptr_t ret,
                     TraceData::ThreadContext &context) {
-  stat.op_result_count[op.index()]++;
+  SelfStats::Current().count_result(op.index());
   data.add(op.result(), tid, ret, 0, context, nullptr);
 }
 
-#ifdef TRACE_BRK
 void Tracer::on_brk_invoke(pid_t tid, const user_regs_struct &regs,
                            TraceData::ThreadContext &context) {
   invoke(op_type::BRK, tid, regs.rdi, 0, context);
@@ -59,8 +114,7 @@ void Tracer::on_brk_result(pid_t tid, const user_regs_struct &regs,
                            TraceData::ThreadContext &context) {
   result(op_type::BRK, tid, regs.rax, context);
 }
-#endif
-#ifdef TRACE_SBRK
+
 void Tracer::on_sbrk_invoke(pid_t tid, const user_regs_struct &regs,
                             TraceData::ThreadContext &context) {
   invoke(op_type::SBRK, tid, regs.rdi, 0, context);
@@ -69,8 +123,7 @@ void Tracer::on_sbrk_result(pid_t tid, const user_regs_struct &regs,
                             TraceData::ThreadContext &context) {
   result(op_type::SBRK, tid, regs.rax, context);
 }
-#endif
-#ifdef TRACE_MMAP
+
 void Tracer::on_mmap_invoke(pid_t tid, const user_regs_struct &regs,
                             TraceData::ThreadContext &context) {
   invoke(op_type::MMAP, tid, regs.rdi, regs.rsi, context);
@@ -79,8 +132,7 @@ void Tracer::on_mmap_result(pid_t tid, const user_regs_struct &regs,
                             TraceData::ThreadContext &context) {
   result(op_type::MMAP, tid, regs.rax, context);
 }
-#endif
-#ifdef TRACE_MUNMAP
+
 void Tracer::on_munmap_invoke(pid_t tid, const user_regs_struct &regs,
                               TraceData::ThreadContext &context) {
   invoke(op_type::MUNMAP, tid, regs.rdi, regs.rsi, context);
@@ -89,9 +141,7 @@ void Tracer::on_munmap_result(pid_t tid, const user_regs_struct &regs,
                               TraceData::ThreadContext &context) {
   result(op_type::MUNMAP, tid, regs.rax, context);
 }
-#endif
 
-#ifdef TRACE_FORK
 void Tracer::on_clone_invoke(pid_t tid, const user_regs_struct &regs,
                              TraceData::ThreadContext &context) {
   // RDI: flags
@@ -132,13 +182,11 @@ void Tracer::on_vfork_result(pid_t tid, const user_regs_struct &regs,
                              TraceData::ThreadContext &context) {
   result(op_type::VFORK, tid, regs.rax, context);
 }
-#endif
 
-#ifdef TRACE_EXECVE
 void Tracer::on_execve_invoke(pid_t tid, const user_regs_struct &regs,
                               TraceData::ThreadContext &context) {
-  // RDI: flags
-  invoke(op_type::EXECVE, tid, regs.rdi, regs.rsi, context);
+  // RDI: filename，只记录一个参数，与 op_meta 的参数个数一致
+  invoke(op_type::EXECVE, tid, regs.rdi, 0, context);
 }
 
 void Tracer::on_execve_result(pid_t tid, const user_regs_struct &regs,
@@ -146,15 +194,12 @@ void Tracer::on_execve_result(pid_t tid, const user_regs_struct &regs,
   // RAX: child pid
   result(op_type::EXECVE, tid, regs.rax, context);
 }
-#endif
 
-#ifdef TRACE_FREE
 void Tracer::on_free_invoke(pid_t tid, const user_regs_struct &regs,
                             TraceData::ThreadContext &context) {
   invoke(op_type::FREE, tid, regs.rdi, 0, context);
 }
-#endif
-#ifdef TRACE_MALLOC
+
 void Tracer::on_malloc_invoke(pid_t tid, const user_regs_struct &regs,
                               TraceData::ThreadContext &context) {
   invoke(op_type::MALLOC, tid, regs.rdi, 0, context);
@@ -163,8 +208,7 @@ void Tracer::on_malloc_result(pid_t tid, const user_regs_struct &regs,
                               TraceData::ThreadContext &context) {
   result(op_type::MALLOC, tid, regs.rax, context);
 }
-#endif
-#ifdef TRACE_CALLOC
+
 void Tracer::on_calloc_invoke(pid_t tid, const user_regs_struct &regs,
                               TraceData::ThreadContext &context) {
   invoke(op_type::CALLOC, tid, regs.rdi, regs.rsi, context);
@@ -173,8 +217,7 @@ void Tracer::on_calloc_result(pid_t tid, const user_regs_struct &regs,
                               TraceData::ThreadContext &context) {
   result(op_type::CALLOC, tid, regs.rax, context);
 }
-#endif
-#ifdef TRACE_REALLOC
+
 void Tracer::on_realloc_invoke(pid_t tid, const user_regs_struct &regs,
                                TraceData::ThreadContext &context) {
   invoke(op_type::REALLOC, tid, regs.rdi, regs.rsi, context);
@@ -183,8 +226,7 @@ void Tracer::on_realloc_result(pid_t tid, const user_regs_struct &regs,
                                TraceData::ThreadContext &context) {
   result(op_type::REALLOC, tid, regs.rax, context);
 }
-#endif
-#ifdef TRACE_VALLOC
+
 void Tracer::on_valloc_invoke(pid_t tid, const user_regs_struct &regs,
                               TraceData::ThreadContext &context) {
   invoke(op_type::VALLOC, tid, regs.rdi, 0, context);
@@ -193,8 +235,6 @@ void Tracer::on_valloc_result(pid_t tid, const user_regs_struct &regs,
                               TraceData::ThreadContext &context) {
   result(op_type::VALLOC, tid, regs.rax, context);
 }
-#endif
-#ifdef TRACE_MALLOCCALLED
 void Tracer::on_aligned_alloc_invoke(pid_t tid, const user_regs_struct &regs,
                                      TraceData::ThreadContext &context) {
   invoke(op_type::ALIGNED_ALLOC, tid, regs.rdi, regs.rsi, context);
@@ -215,9 +255,7 @@ void Tracer::on_posix_memalign_result(pid_t tid, const user_regs_struct &regs,
                                       TraceData::ThreadContext &context) {
   result(op_type::POSIX_MEMALIGN, tid, regs.rdi, context);
 }
-#endif
 
-#ifdef TRACE_CPP
 void Tracer::on_new_invoke(pid_t tid, const user_regs_struct &regs,
                            TraceData::ThreadContext &context) {
   invoke(op_type::NEW, tid, regs.rdi, 0, context);
@@ -229,7 +267,7 @@ void Tracer::on_new_result(pid_t tid, const user_regs_struct &regs,
 
 void Tracer::on_new_array_invoke(pid_t tid, const user_regs_struct &regs,
                                  TraceData::ThreadContext &context) {
-  invoke(op_type::NEW_ARRAY, tid, regs.rdi, regs.rsi, context);
+  invoke(op_type::NEW_ARRAY, tid, regs.rdi, 0, context);
 }
 void Tracer::on_new_array_result(pid_t tid, const user_regs_struct &regs,
                                  TraceData::ThreadContext &context) {
@@ -248,11 +286,44 @@ void Tracer::on_delete_array_invoke(pid_t tid, const user_regs_struct &regs,
                                     TraceData::ThreadContext &context) {
   invoke(op_type::DELETE_ARRAY, tid, regs.rdi, 0, context);
 }
-#endif
 
 void Tracer::gatherStat() {
 
+  // 合并各追踪线程与 agent 采集的数据
+  stat.self_stats = SelfStats::Get().summarize();
+  for (int i = 0; i < Operation::op_type_count; i++) {
+    stat.op_invoke_count[i] = stat.self_stats.op_invoke_count[i] +
+                              data.agent_stat.op_invoke_count[i];
+    stat.op_result_count[i] = stat.self_stats.op_result_count[i] +
+                              data.agent_stat.op_result_count[i];
+  }
+  stat.max_stack_size =
+      std::max(stat.max_stack_size, data.agent_stat.max_stack_size);
+  stat.agent_dropped_count = data.agent_stat.dropped_count;
+  stat.uprobe_lost_count = uprobe_lost_count();
+  stat.uprobe_open_failed_count = uprobe_open_failed_count();
+  stat.event_budget = data.config.eventBudget;
+  stat.overflow_policy = config.overflowPolicy == OverflowPolicy::SPILL  ? "spill"
+                         : config.overflowPolicy == OverflowPolicy::DROP ? "drop"
+                                                                         : "block";
+  if (!config.tracedOps.all()) {
+    for (size_t i = 1; i < Operation::op_type_count; i++) {
+      if (config.tracedOps[i]) {
+        stat.traced_ops += stat.traced_ops.empty() ? "" : ",";
+        stat.traced_ops += Operation::op_meta[i].name;
+      }
+    }
+  }
+  auto &overflow = data.overflow_stat;
+  stat.overflow_blocked_count = overflow.blocked_count;
+  stat.overflow_spilled_count = overflow.spilled_count;
+  stat.overflow_spilled_bytes = overflow.spilled_bytes;
+  stat.overflow_peak_spill_bytes = overflow.peak_spill_bytes;
+  stat.overflow_lost_count = overflow.lost_count;
+  stat.overflow_lost_alloc_bytes = overflow.lost_alloc_bytes;
+
   // 统计调用次数
+  stat.invoke_count = stat.result_count = 0;
   for (int i = 0; i < Operation::op_type_count; i++) {
     stat.invoke_count += stat.op_invoke_count[i];
     stat.result_count += stat.op_result_count[i];
@@ -264,19 +335,45 @@ void Tracer::gatherStat() {
   stat.time_end = data.getTime();
   stat.target_full_path = target_path;
   stat.main_pid = target_pid;
-  stat.target = config.command()[0];
+  stat.target =
+      config.command().empty() ? target_path : config.command()[0];
   stat.working_dir = std::filesystem::current_path().string();
   stat.save_path = config.parentDir();
   stat.commands = config.command();
   stat.timestamp_end = config.getTimestamp();
-  stat.filename_max_length = data.filename_max_length;
-  stat.function_max_length = data.function_max_length;
+  stat.filename_max_length = data.writer.filename_max_length;
+  stat.function_max_length = data.writer.function_max_length;
+  stat.stack_count = data.writer.stack_count;
+  stat.writer_bytes_in = data.writer.bytes_in();
+  stat.writer_bytes_out = data.writer.bytes_out();
+  // 追踪器自身的峰值内存（不包括目标进程）
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    stat.tracer_max_rss_kb = usage.ru_maxrss;
+  }
+  stat.sample_bytes = data.config.sampleBytes;
+  stat.sampled_count = data.sampled_count;
+  stat.live_heap = data.live_heap.enabled();
+  stat.live_bytes = data.live_heap.live_bytes;
+  stat.live_count = data.live_heap.live_count;
+  stat.peak_live_bytes = data.live_heap.peak_bytes;
 
   // 额外的信息（键值对）
   stat.extrakeys = config.extrakeys;
 }
 
 void Tracer::on_library_loaded(pid_t tid) { data.on_library_loaded(tid); }
+void Tracer::on_thread_exit(pid_t tid, TraceData::ThreadContext &context) {
+  data.on_thread_exit(context);
+}
+void Tracer::on_uprobe_sample(TraceData::ThreadContext &context,
+                              const UprobeTracer::Sample *sample) {
+  context.set_sample(sample);
+}
+bool Tracer::should_trace_function(const std::string &name) const {
+  // agent 已拦截的函数不再设置断点，sbrk 仍由断点采集
+  return !config.isAgent || name == "sbrk";
+}
 void Tracer::add_new_tid(pid_t parent, pid_t child) {
   stat.child_tid_list.push_back(child);
   stat.tid_relations.push_back(std::pair(parent, child));
@@ -294,6 +391,19 @@ bool Tracer::run_target() {
   }
 
   Log("run target: %s", config.command()[0]);
+  // 目标程序不继承 mprofiler 屏蔽的信号
+  auto signals = window_signals();
+  sigprocmask(SIG_UNBLOCK, &signals, nullptr);
+
+  // 注入 agent，并通过环境变量传递共享内存名称
+  if (config.isAgent) {
+    std::string preload = config.agent_library_path;
+    if (auto old = getenv("LD_PRELOAD"); old != nullptr && *old != '\0') {
+      preload = preload + ":" + old;
+    }
+    setenv("LD_PRELOAD", preload.c_str(), 1);
+    setenv(Agent::RING_ENV, config.agent_ring_name.c_str(), 1);
+  }
 
   /* 允许跟踪该进程 */
   if (ptrace(PTRACE_TRACEME, 0, 0, 0) < 0) {
@@ -304,6 +414,14 @@ bool Tracer::run_target() {
   // notify parent that tracing can start
   // kill(getpid(), SIGSTOP);
 
+  // seccomp 模式下先暂停，等待父进程设置 PTRACE_O_TRACESECCOMP 后再安装过滤器
+  if (config.isSeccomp) {
+    kill(getpid(), SIGSTOP);
+    if (!install_seccomp_filter(get_traced_syscalls())) {
+      return false;
+    }
+  }
+
   /* 用给定的程序替换该进程的映像 */
   // execv(config.command()[0], config.command().data() + 1);
   execv(config.command()[0], config.command().data());
@@ -319,8 +437,19 @@ bool Tracer::attach_target() {
   }
   target_pid = static_cast<pid_t>(config.pid());
 
+  if (config.isSignalWindow) {
+    Log("waiting for SIGUSR1 to attach target with pid(%d)", target_pid);
+    auto signals = window_signals();
+    int signal = 0;
+    if (sigwait(&signals, &signal) != 0 || signal != SIGUSR1) {
+      // 附加前收到 SIGINT/SIGTERM，直接退出
+      target_pid = 0;
+      return true;
+    }
+  }
+
+  // 主线程在这里附加，其它线程在 Debugger::run 中附加
   Log("attach target with pid(%d)", target_pid);
-  // TODO: attach target with pid
   if (ptrace(PTRACE_ATTACH, target_pid, nullptr, nullptr) == -1) {
     perror("Failed to attach to target process");
     Log("Failed to attach to target process with pid(%d)", target_pid);
@@ -329,6 +458,84 @@ bool Tracer::attach_target() {
   return true;
 }
 
+void Tracer::watchWindow() {
+  auto signals = window_signals();
+  auto deadline = data.getTime() + timens_t(config.traceDuration * 1e9);
+  while (!window_done) {
+    timespec timeout = {0, 100'000'000};
+    int signal = sigtimedwait(&signals, nullptr, &timeout);
+    if (signal > 0) {
+      Log("received signal %d, stop tracing", signal);
+      break;
+    }
+    if (config.traceDuration > 0 && data.getTime() >= deadline) {
+      Log("trace duration(%gs) reached, stop tracing", config.traceDuration);
+      break;
+    }
+  }
+  // 目标进程已结束
+  if (window_done) {
+    return;
+  }
+  stat.detached = true;
+  stat.detached_time = data.getTime();
+  // agent 不随分离停止，通知其不再写入
+  data.stop_agent();
+  detach();
+}
+
+std::string Tracer::collectMetrics() {
+  auto now = data.getTime();
+  double elapsed = (now - metrics_time) / 1e9;
+  metrics_time = now;
+
+  // 追踪线程与处理线程仍在更新计数，这里只做近似读取
+  auto load = [](uint64_t &count) -> uint64_t {
+    return std::atomic_ref<uint64_t>(count).load(std::memory_order_relaxed);
+  };
+  auto summary = SelfStats::Get().summarize();
+  std::string ops;
+  uint64_t invoke_count = 0;
+  double invoke_rate = 0;
+  for (size_t i = 0; i < Operation::op_type_count; i++) {
+    auto count = summary.op_invoke_count[i] +
+                 load(data.agent_stat.op_invoke_count[i]);
+    auto rate = elapsed > 0 ? (count - metrics_invoke_count[i]) / elapsed : 0;
+    metrics_invoke_count[i] = count;
+    invoke_count += count;
+    invoke_rate += rate;
+    if (count == 0) {
+      continue;
+    }
+    ops += boost::str(boost::format("%s\"%s\":{\"count\":%u,\"rate\":%.1f}") %
+                      (ops.empty() ? "" : ",") % Operation(static_cast<op_type>(i)).name() % count %
+                      rate);
+  }
+
+  auto &m = data.metrics;
+  LiveHeap::HeapUsage usage = {m.heap_bytes.load(), m.free_bytes.load(),
+                               m.largest_free.load()};
+  return boost::str(
+      boost::format(
+          "{\"time\":%.3f,\"invoke_count\":%u,\"invoke_rate\":%.1f,"
+          "\"ops\":{%s},\"queue_bytes\":%u,\"agent_queue\":%u,"
+          "\"agent_dropped\":%u,\"lost\":%u,\"spill_bytes\":%u,"
+          "\"processed\":%u,\"processing\":%u,"
+          "\"symbolize_pending\":%u,\"live_bytes\":%u,\"live_count\":%u,"
+          "\"peak_live_bytes\":%u,\"heap_bytes\":%u,\"free_bytes\":%u,"
+          "\"largest_free\":%u,\"fragmentation\":%.4f,\"self\":%s}") %
+      (now / 1e9) % invoke_count % invoke_rate % ops % data.queued_bytes() %
+      data.agent_queued() % data.agent_dropped() %
+      data.overflow_stat.lost_count.load() % data.spilled_bytes() %
+      m.processed_count.load() %
+      m.processing_count.load() % data.writer.symbolize_pending() %
+      m.live_bytes.load() % m.live_count.load() % m.peak_live_bytes.load() %
+      usage.heap_bytes % usage.free_bytes % usage.largest_free %
+      usage.fragmentation() %
+      SelfStats::Json(summary, data.writer.bytes_in(),
+                      data.writer.bytes_out()));
+}
+
 int Tracer::run(int argc, char *argv[]) {
 #define CHECK(S)                                                               \
   do {                                                                         \
@@ -340,6 +547,15 @@ int Tracer::run(int argc, char *argv[]) {
   } while (0)
 
   CHECK(config.parseArgs(argc, argv));
+  if (!config.watch_target.empty()) {
+    return MetricsServer::Watch(config.watch_target);
+  }
+  if (config.hasTraceWindow()) {
+    auto signals = window_signals();
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  }
+  // 子进程中生成 seccomp 过滤器之前移除未选择的操作的回调
+  select_operations(config.tracedOps);
   CHECK(config.pid() > 0 ? attach_target() : run_target());
 
   if (target_pid == 0) {
@@ -349,8 +565,29 @@ int Tracer::run(int argc, char *argv[]) {
   CHECK(config.init());
   CHECK(init_statinfo(stat, config));
   CHECK(init_traceconfig(data, config));
+  CHECK(init_debugconfig(debug_config, config));
   CHECK(data.start(target_pid));
-  CHECK(this->Debugger::run());
+  if (config.isMetrics) {
+    if (config.metrics_socket_path.empty()) {
+      config.metrics_socket_path = MetricsServer::DefaultPath(target_pid);
+    }
+    // 套接字创建失败不影响追踪
+    metrics.start(config.metrics_socket_path,
+                  [this]() { return collectMetrics(); });
+  }
+  if (config.hasTraceWindow()) {
+    window_thread = std::thread([this]() { watchWindow(); });
+  }
+  bool ok = this->Debugger::run();
+  window_done = true;
+  if (window_thread.joinable()) {
+    window_thread.join();
+  }
+  CHECK(ok);
+
+  // 先停止发布，之后 agent 缓冲区会被关闭
+  metrics.stop();
+  CHECK(data.stop());
 
 #undef CHECK
   gatherStat();
@@ -9,6 +9,7 @@ LICENSE file in the root directory of this source tree.
 
 #include "config.h"
 #include "debugger.h"
+#include "metrics_server.h"
 #include "trace_data.h"
 
 namespace Memory::Profile {
@@ -19,61 +20,47 @@ class Tracer : public Debugger<Tracer, TraceData::ThreadContext> {
   TraceData data;
   // 统计数据
   StatInfo stat;
+  // 实时指标
+  MetricsServer metrics;
+  // 上一次发布实时指标时各操作的调用次数与时间，用于计算速率
+  uint64_t metrics_invoke_count[Operation::op_type_count] = {0};
+  timens_t metrics_time = 0;
+  // 等待追踪窗口结束（超时或信号）后分离目标进程
+  std::thread window_thread;
+  std::atomic<bool> window_done = false;
 
-#ifdef TRACE_BRK
-  DEBUG_SYSCALL(brk, on_brk_invoke, on_brk_result);
-#endif
-#ifdef TRACE_SBRK
-  DEBUG_FUNCTION(sbrk, on_sbrk_invoke, on_sbrk_result);
-#endif
-#ifdef TRACE_MMAP
-  DEBUG_SYSCALL(mmap, on_mmap_invoke, on_mmap_result);
-#endif
-#ifdef TRACE_MUNMAP
-  DEBUG_SYSCALL(munmap, on_munmap_invoke, on_munmap_result);
-#endif
-#ifdef TRACE_FORK
-  DEBUG_SYSCALL(clone, on_clone_invoke, on_clone_result);
-  DEBUG_SYSCALL(clone3, on_clone3_invoke, on_clone3_result);
-  DEBUG_SYSCALL(fork, on_fork_invoke, on_fork_result);
-  DEBUG_SYSCALL(vfork, on_vfork_invoke, on_vfork_result);
-#endif
-#ifdef TRACE_EXECVE
-  DEBUG_SYSCALL(execve, on_execve_invoke, on_execve_result);
-#endif
-#ifdef TRACE_FREE
-  DEBUG_FUNCTION(free, on_free_invoke);
-#endif
-#ifdef TRACE_MALLOC
-  DEBUG_FUNCTION(malloc, on_malloc_invoke, on_malloc_result);
-#endif
-#ifdef TRACE_CALLOC
-  DEBUG_FUNCTION(calloc, on_calloc_invoke, on_calloc_result);
-#endif
-#ifdef TRACE_REALLOC
-  DEBUG_FUNCTION(realloc, on_realloc_invoke, on_realloc_result);
-#endif
-#ifdef TRACE_VALLOC
-  DEBUG_FUNCTION(valloc, on_valloc_invoke, on_valloc_result);
-#endif
-#ifdef TRACE_MALLOCCALLED
-  DEBUG_FUNCTION(posix_memalign, on_posix_memalign_invoke,
+  DEBUG_SYSCALL(brk, BRK, on_brk_invoke, on_brk_result);
+  DEBUG_FUNCTION(sbrk, SBRK, on_sbrk_invoke, on_sbrk_result);
+  DEBUG_SYSCALL(mmap, MMAP, on_mmap_invoke, on_mmap_result);
+  DEBUG_SYSCALL(munmap, MUNMAP, on_munmap_invoke, on_munmap_result);
+  DEBUG_SYSCALL(clone, CLONE, on_clone_invoke, on_clone_result);
+  DEBUG_SYSCALL(clone3, CLONE3, on_clone3_invoke, on_clone3_result);
+  DEBUG_SYSCALL(fork, FORK, on_fork_invoke, on_fork_result);
+  DEBUG_SYSCALL(vfork, VFORK, on_vfork_invoke, on_vfork_result);
+  DEBUG_SYSCALL(execve, EXECVE, on_execve_invoke, on_execve_result);
+  DEBUG_FUNCTION(free, FREE, on_free_invoke);
+  DEBUG_FUNCTION(malloc, MALLOC, on_malloc_invoke, on_malloc_result);
+  DEBUG_FUNCTION(calloc, CALLOC, on_calloc_invoke, on_calloc_result);
+  DEBUG_FUNCTION(realloc, REALLOC, on_realloc_invoke, on_realloc_result);
+  DEBUG_FUNCTION(valloc, VALLOC, on_valloc_invoke, on_valloc_result);
+  DEBUG_FUNCTION(posix_memalign, POSIX_MEMALIGN, on_posix_memalign_invoke,
                  on_posix_memalign_result);
-  DEBUG_FUNCTION(aligned_alloc, on_aligned_alloc_invoke,
+  DEBUG_FUNCTION(aligned_alloc, ALIGNED_ALLOC, on_aligned_alloc_invoke,
                  on_aligned_alloc_result);
-#endif
-#ifdef TRACE_CPP
-  DEBUG_FUNCTION(_Znwm, on_new_invoke, on_new_result);
-  DEBUG_FUNCTION(_Znam, on_new_array_invoke, on_new_array_result);
-  DEBUG_FUNCTION(_ZdlPv, on_delete_legacy_invoke);
-  DEBUG_FUNCTION(_ZdlPvm, on_delete_invoke);
-  DEBUG_FUNCTION(_ZdaPv, on_delete_array_invoke);
-#endif
+  DEBUG_FUNCTION(_Znwm, NEW, on_new_invoke, on_new_result);
+  DEBUG_FUNCTION(_Znam, NEW_ARRAY, on_new_array_invoke, on_new_array_result);
+  DEBUG_FUNCTION(_ZdlPv, DELETE_LEGACY, on_delete_legacy_invoke);
+  DEBUG_FUNCTION(_ZdlPvm, DELETE, on_delete_invoke);
+  DEBUG_FUNCTION(_ZdaPv, DELETE_ARRAY, on_delete_array_invoke);
 
   bool run_target();
   bool attach_target();
 
   void gatherStat();
+  // 等待 --duration 超时或 SIGINT/SIGTERM/SIGUSR1，之后分离目标进程
+  void watchWindow();
+  // 生成一行 JSON 格式的实时指标
+  std::string collectMetrics();
 
   void invoke(Operation op, pid_t tid, uintptr_t arg1, uintptr_t arg2,
               TraceData::ThreadContext &context);
@@ -83,6 +70,10 @@ class Tracer : public Debugger<Tracer, TraceData::ThreadContext> {
 public:
   int run(int argc, char *argv[]);
   void on_library_loaded(pid_t tid);
+  void on_thread_exit(pid_t tid, TraceData::ThreadContext &context);
+  void on_uprobe_sample(TraceData::ThreadContext &context,
+                        const UprobeTracer::Sample *sample);
+  bool should_trace_function(const std::string &name) const;
   void add_new_tid(pid_t parent, pid_t child);
 };
 } // namespace Memory::Profile
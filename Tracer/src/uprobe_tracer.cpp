@@ -0,0 +1,467 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#include "uprobe_tracer.h"
+#include "self_stats.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+
+#include "asm/perf_regs.h"
+#include "linux/perf_event.h"
+#include "poll.h"
+#include "sys/ioctl.h"
+#include "sys/mman.h"
+#include "sys/resource.h"
+#include "sys/syscall.h"
+#include "unistd.h"
+
+namespace Memory::Profile {
+
+namespace {
+constexpr const char *UPROBE_PMU = "/sys/bus/event_source/devices/uprobe";
+
+// 采样的用户态寄存器，记录中按位序排列
+constexpr std::pair<int, decltype(&user_regs_struct::rax)> SAMPLE_REGISTERS[] = {
+    {PERF_REG_X86_AX, &user_regs_struct::rax},
+    {PERF_REG_X86_BX, &user_regs_struct::rbx},
+    {PERF_REG_X86_CX, &user_regs_struct::rcx},
+    {PERF_REG_X86_DX, &user_regs_struct::rdx},
+    {PERF_REG_X86_SI, &user_regs_struct::rsi},
+    {PERF_REG_X86_DI, &user_regs_struct::rdi},
+    {PERF_REG_X86_BP, &user_regs_struct::rbp},
+    {PERF_REG_X86_SP, &user_regs_struct::rsp},
+    {PERF_REG_X86_IP, &user_regs_struct::rip},
+    {PERF_REG_X86_R8, &user_regs_struct::r8},
+    {PERF_REG_X86_R9, &user_regs_struct::r9},
+    {PERF_REG_X86_R10, &user_regs_struct::r10},
+    {PERF_REG_X86_R11, &user_regs_struct::r11},
+    {PERF_REG_X86_R12, &user_regs_struct::r12},
+    {PERF_REG_X86_R13, &user_regs_struct::r13},
+    {PERF_REG_X86_R14, &user_regs_struct::r14},
+    {PERF_REG_X86_R15, &user_regs_struct::r15},
+};
+
+uint64_t sample_regs_mask() {
+  uint64_t mask = 0;
+  for (auto &[bit, reg] : SAMPLE_REGISTERS) {
+    mask |= 1ULL << bit;
+  }
+  return mask;
+}
+
+uint64_t monotonic_time() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+std::string read_line(const std::string &path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+// 事件只跟随线程（cpu 为 -1），同一线程的事件可以共用一个环形缓冲区
+int perf_event_open(perf_event_attr &attr, pid_t tid) {
+  return syscall(SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+} // namespace
+
+bool UprobeTracer::Supported() {
+  return !read_line(std::string(UPROBE_PMU) + "/type").empty();
+}
+
+bool UprobeTracer::start(size_t stack_size, Handler handler) {
+  auto type = read_line(std::string(UPROBE_PMU) + "/type");
+  if (type.empty()) {
+    Log("[error] uprobe PMU is not supported by the kernel");
+    return false;
+  }
+  uprobe_type = std::stoi(type);
+  // 格式为 "config:0"
+  auto format = read_line(std::string(UPROBE_PMU) + "/format/retprobe");
+  if (auto pos = format.find(':'); pos != std::string::npos) {
+    retprobe_bit = atoi(format.c_str() + pos + 1);
+  }
+  this->stack_size = stack_size;
+  this->handler = std::move(handler);
+
+  // 事件个数为 线程数 *（探针数 + 1），尽量提高文件描述符上限
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  started = true;
+  stopped = false;
+  collected = false;
+  reader = std::thread([this]() { read_loop(); });
+  dispatcher = std::thread([this]() { dispatch_loop(); });
+  Log("uprobe: ring pages: %zu per thread, stack size: %zu", RING_PAGES,
+      stack_size);
+  return true;
+}
+
+bool UprobeTracer::open_ring(pid_t tid, Ring &ring) const {
+  auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  perf_event_attr attr = {};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_SOFTWARE;
+  attr.config = PERF_COUNT_SW_DUMMY;
+  attr.use_clockid = 1;
+  attr.clockid = CLOCK_MONOTONIC;
+  // 缓冲区使用超过 1/16 时唤醒读取线程
+  attr.watermark = 1;
+  attr.wakeup_watermark = RING_PAGES * page_size / 16;
+  auto fd = perf_event_open(attr, tid);
+  if (fd < 0) {
+    return false;
+  }
+  auto length = (RING_PAGES + 1) * page_size;
+  auto base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    auto error = errno;
+    close(fd);
+    errno = error;
+    return false;
+  }
+  ring = {fd, base, length};
+  return true;
+}
+
+int UprobeTracer::open_event(pid_t tid, const std::string &path,
+                             uint64_t offset, bool is_return,
+                             size_t stack_size) const {
+  perf_event_attr attr = {};
+  attr.size = sizeof(attr);
+  attr.type = uprobe_type;
+  attr.config = is_return ? 1ULL << retprobe_bit : 0;
+  attr.uprobe_path = reinterpret_cast<uint64_t>(path.c_str());
+  attr.probe_offset = offset;
+  attr.sample_period = 1;
+  attr.sample_type = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_TID |
+                     PERF_SAMPLE_TIME | PERF_SAMPLE_REGS_USER;
+  attr.sample_regs_user = sample_regs_mask();
+  if (stack_size > 0) {
+    attr.sample_type |= PERF_SAMPLE_STACK_USER;
+    attr.sample_stack_user = stack_size;
+  }
+  attr.use_clockid = 1;
+  attr.clockid = CLOCK_MONOTONIC;
+  return perf_event_open(attr, tid);
+}
+
+bool UprobeTracer::open_probe(pid_t tid, int ring_fd, const Probe &probe,
+                              std::vector<int> &fds) {
+  for (int is_return = 0; is_return <= int(probe.with_return); is_return++) {
+    auto stack = is_return ? 0 : probe.stack_size;
+    auto fd = open_event(tid, probe.path, probe.offset, is_return, stack);
+    if (fd < 0) {
+      // 线程已退出
+      if (errno == ESRCH) {
+        return true;
+      }
+      open_failed_count++;
+      Log("[%d][error] failed to open uprobe %s+%#lx: %s", tid,
+          probe.path.c_str(), probe.offset, strerror(errno));
+      return false;
+    }
+    fds.push_back(fd);
+    uint64_t id = 0;
+    if (ioctl(fd, PERF_EVENT_IOC_ID, &id) < 0 ||
+        ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, ring_fd) < 0) {
+      open_failed_count++;
+      perror("ioctl uprobe event");
+      return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(probes_mutex);
+    probes[id] = {probe.probe, bool(is_return), stack > 0};
+  }
+  return true;
+}
+
+bool UprobeTracer::add(const std::string &path, uint64_t offset,
+                       uint64_t probe, bool with_return, size_t stack_size) {
+  if (!enabled()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(events_mutex);
+  auto &item = registered.emplace_back(Probe{
+      path, offset, probe, with_return, std::min(stack_size, this->stack_size)});
+  bool ok = true;
+  for (auto &[tid, thread] : events) {
+    ok = open_probe(tid, thread.ring_fd, item, thread.fds) && ok;
+  }
+  return ok;
+}
+
+bool UprobeTracer::add_thread(pid_t tid) {
+  if (!enabled()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(events_mutex);
+  if (events.contains(tid)) {
+    return true;
+  }
+  Ring ring;
+  if (!open_ring(tid, ring)) {
+    // 线程已退出
+    if (errno == ESRCH) {
+      return true;
+    }
+    open_failed_count++;
+    Log("[%d][error] failed to open uprobe ring: %s", tid, strerror(errno));
+    return false;
+  }
+  {
+    std::unique_lock<std::shared_mutex> lock(rings_mutex);
+    rings[tid] = ring;
+  }
+  auto &thread = events[tid];
+  thread.ring_fd = ring.fd;
+  bool ok = true;
+  for (auto &probe : registered) {
+    ok = open_probe(tid, ring.fd, probe, thread.fds) && ok;
+  }
+  return ok;
+}
+
+void UprobeTracer::remove_thread(pid_t tid) {
+  {
+    std::lock_guard<std::mutex> lock(events_mutex);
+    if (auto item = events.find(tid); item != events.end()) {
+      for (auto fd : item->second.fds) {
+        close(fd);
+      }
+      events.erase(item);
+    }
+  }
+  // 取出缓冲区中剩余的记录后再释放
+  std::vector<Pending> items;
+  {
+    std::unique_lock<std::shared_mutex> lock(rings_mutex);
+    auto item = rings.find(tid);
+    if (item == rings.end()) {
+      return;
+    }
+    collect_ring(item->second, items);
+    munmap(item->second.base, item->second.length);
+    close(item->second.fd);
+    rings.erase(item);
+  }
+  if (!items.empty()) {
+    std::lock_guard<std::mutex> lock(incoming_mutex);
+    std::move(items.begin(), items.end(), std::back_inserter(incoming));
+  }
+}
+
+void UprobeTracer::stop() {
+  std::lock_guard<std::mutex> stop_lock(stop_mutex);
+  {
+    std::lock_guard<std::mutex> lock(events_mutex);
+    for (auto &[tid, thread] : events) {
+      for (auto fd : thread.fds) {
+        close(fd);
+      }
+    }
+    events.clear();
+    registered.clear();
+  }
+  // 事件关闭后不再有新记录，两个线程依次处理完剩余记录后退出
+  stopped = true;
+  if (reader.joinable()) {
+    reader.join();
+  }
+  collected = true;
+  if (dispatcher.joinable()) {
+    dispatcher.join();
+  }
+  {
+    std::unique_lock<std::shared_mutex> lock(rings_mutex);
+    for (auto &[tid, ring] : rings) {
+      munmap(ring.base, ring.length);
+      close(ring.fd);
+    }
+    rings.clear();
+  }
+  if (started) {
+    Log("uprobe: samples: [%llu], lost: [%llu], open failed: [%llu]",
+        sample_count.load(), lost_count.load(), open_failed_count.load());
+  }
+  started = false;
+}
+
+void UprobeTracer::read_loop() {
+  std::vector<pollfd> fds;
+  while (!stopped) {
+    // 线程随时加入与退出，每次重新收集缓冲区
+    fds.clear();
+    {
+      std::shared_lock<std::shared_mutex> lock(rings_mutex);
+      for (auto &[tid, ring] : rings) {
+        fds.push_back({ring.fd, POLLIN, 0});
+      }
+    }
+    poll(fds.data(), fds.size(), 10);
+    collect();
+  }
+  collect();
+}
+
+void UprobeTracer::dispatch_loop() {
+  SelfStats::SetThread("uprobe");
+  while (!collected) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    dispatch(monotonic_time() - REORDER_WINDOW);
+  }
+  dispatch(UINT64_MAX);
+}
+
+void UprobeTracer::collect() {
+  std::vector<Pending> items;
+  {
+    std::shared_lock<std::shared_mutex> lock(rings_mutex);
+    for (auto &[tid, ring] : rings) {
+      collect_ring(ring, items);
+    }
+  }
+  if (!items.empty()) {
+    std::lock_guard<std::mutex> lock(incoming_mutex);
+    std::move(items.begin(), items.end(), std::back_inserter(incoming));
+  }
+}
+
+void UprobeTracer::collect_ring(Ring &ring, std::vector<Pending> &items) {
+  auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  std::vector<uint8_t> record;
+  auto meta = static_cast<perf_event_mmap_page *>(ring.base);
+  auto data = static_cast<const uint8_t *>(ring.base) + page_size;
+  auto size = ring.length - page_size;
+  auto head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+  auto tail = meta->data_tail;
+  // 记录可能跨越缓冲区末尾，复制后再解析
+  auto copy = [data, size](uint64_t pos, void *dest, size_t length) -> void {
+    auto offset = pos % size;
+    auto first = std::min(length, size - offset);
+    memcpy(dest, data + offset, first);
+    memcpy(static_cast<uint8_t *>(dest) + first, data, length - first);
+  };
+  while (tail < head) {
+    perf_event_header header;
+    copy(tail, &header, sizeof(header));
+    if (header.size < sizeof(header)) {
+      tail = head;
+      break;
+    }
+    record.resize(header.size);
+    copy(tail, record.data(), header.size);
+    if (!parse(record.data(), header.size, items.emplace_back())) {
+      items.pop_back();
+    }
+    tail += header.size;
+  }
+  __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+bool UprobeTracer::parse(const uint8_t *record, size_t size, Pending &item) {
+  auto header = reinterpret_cast<const perf_event_header *>(record);
+  auto pos = record + sizeof(*header);
+  auto end = record + size;
+  auto read = [&pos, end](void *value, size_t length) -> bool {
+    if (pos + length > end) {
+      return false;
+    }
+    memcpy(value, pos, length);
+    pos += length;
+    return true;
+  };
+
+  if (header->type == PERF_RECORD_LOST) {
+    uint64_t id, lost;
+    if (read(&id, sizeof(id)) && read(&lost, sizeof(lost))) {
+      lost_count += lost;
+    }
+    return false;
+  }
+  if (header->type != PERF_RECORD_SAMPLE) {
+    return false;
+  }
+
+  // 按 sample_type 的顺序：id, pid/tid, time, regs, stack
+  auto &sample = item.sample;
+  uint64_t id, abi;
+  uint32_t pid_tid[2];
+  if (!read(&id, sizeof(id)) || !read(pid_tid, sizeof(pid_tid)) ||
+      !read(&sample.time, sizeof(sample.time)) || !read(&abi, sizeof(abi)) ||
+      abi == PERF_SAMPLE_REGS_ABI_NONE) {
+    return false;
+  }
+  for (auto &[bit, reg] : SAMPLE_REGISTERS) {
+    if (!read(&(sample.regs.*reg), sizeof(uint64_t))) {
+      return false;
+    }
+  }
+  Event event;
+  {
+    std::shared_lock<std::shared_mutex> lock(probes_mutex);
+    auto probe = probes.find(id);
+    if (probe == probes.end()) {
+      return false;
+    }
+    event = probe->second;
+  }
+  // 只有采样栈内存的事件才有栈内存部分
+  if (event.with_stack) {
+    uint64_t length = 0, dynamic = 0;
+    if (!read(&length, sizeof(length)) || pos + length > end) {
+      return false;
+    }
+    auto data = pos;
+    pos += length;
+    if (length > 0 && read(&dynamic, sizeof(dynamic))) {
+      item.stack.assign(data, data + std::min(length, dynamic));
+    }
+  }
+  sample.probe = event.probe;
+  sample.is_return = event.is_return;
+  sample.tid = pid_tid[1];
+  sample_count++;
+  return true;
+}
+
+void UprobeTracer::dispatch(uint64_t until) {
+  {
+    std::lock_guard<std::mutex> lock(incoming_mutex);
+    std::move(incoming.begin(), incoming.end(), std::back_inserter(pending));
+    incoming.clear();
+  }
+  std::stable_sort(pending.begin(), pending.end(),
+                   [](const Pending &a, const Pending &b) {
+                     return a.sample.time < b.sample.time;
+                   });
+  size_t count = 0;
+  for (; count < pending.size() && pending[count].sample.time <= until;
+       count++) {
+    auto &item = pending[count];
+    item.sample.stack = item.stack.data();
+    item.sample.stack_size = item.stack.size();
+    handler(item.sample);
+  }
+  pending.erase(pending.begin(), pending.begin() + count);
+}
+
+} // namespace Memory::Profile
@@ -0,0 +1,161 @@
+/*
+Copyright (c) 2026, Chen Jie, Joungtao, Xuzheng Jiang
+All rights reserved.
+This source code is licensed under the BSD-2-Clause license found in the
+LICENSE file in the root directory of this source tree.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "sys/types.h"
+#include "sys/user.h"
+
+namespace Memory::Profile {
+
+// 基于 perf_event_open 的 uprobe/uretprobe 追踪（--backend uprobe）：
+// 由内核在函数入口和返回处采样寄存器与栈顶内存，目标线程不会因 ptrace 停止
+//
+// 每个线程有一个环形缓冲区（cpu 为 -1 的 dummy 事件），每个探针在每个线程上打开
+// 一个 cpu 为 -1 的事件并输出到该线程的缓冲区，事件数为 线程数 *（探针数 + 1），
+// 与 CPU 数无关。不使用 inherit：内核继承 uprobe 事件时会从新线程的地址空间读取
+// uprobe_path，导致 clone 失败，新线程由调用方在其开始运行前通过 add_thread 加入。
+// 读取线程只负责尽快取出记录，避免内核缓冲区溢出；处理线程合并各线程的记录，
+// 按时间排序后调用 handler
+class UprobeTracer {
+public:
+  // 采样的栈顶内存大小（PERF_SAMPLE_STACK_USER），用于本地展开调用栈
+  static constexpr size_t STACK_SIZE = 8192;
+  // 每个线程环形缓冲区的页数（2 的幂），映射的内存随线程数增加
+  static constexpr size_t RING_PAGES = 1024;
+
+  struct Sample {
+    uint64_t probe;        // add 时指定的探针编号
+    bool is_return;        // 是否为返回探针
+    pid_t tid;
+    uint64_t time;         // CLOCK_MONOTONIC，纳秒
+    user_regs_struct regs; // 只有通用寄存器、rsp 和 rip 有效
+    const uint8_t *stack;  // 从 rsp 开始的栈内存副本
+    size_t stack_size;
+    // 由 handler 设置：尚未返回的、带返回探针的调用的原始返回地址（外层在前），
+    // 栈中对应的返回地址已被内核改写为跳板地址
+    const uintptr_t *returns;
+    size_t return_count;
+  };
+  using Handler = std::function<void(const Sample &)>;
+
+  UprobeTracer() = default;
+  ~UprobeTracer() { stop(); }
+  UprobeTracer(const UprobeTracer &) = delete;
+  UprobeTracer &operator=(const UprobeTracer &) = delete;
+
+  // 内核是否支持 uprobe PMU（/sys/bus/event_source/devices/uprobe）
+  static bool Supported();
+
+  // 启动读取线程，stack_size 为 0 时不采样栈内存
+  bool start(size_t stack_size, Handler handler);
+  // 在 path 文件偏移 offset 处注册入口探针，with_return 时同时注册返回探针，
+  // 对已加入的所有线程生效；入口探针采样 stack_size 字节的栈内存（不超过 start
+  // 时指定的大小），返回探针不采样栈内存
+  bool add(const std::string &path, uint64_t offset, uint64_t probe,
+           bool with_return, size_t stack_size);
+  // 加入线程，创建其环形缓冲区并打开已注册的所有探针，线程退出后调用
+  // remove_thread 关闭
+  bool add_thread(pid_t tid);
+  void remove_thread(pid_t tid);
+  // 关闭所有事件，处理剩余的记录后停止读取线程
+  void stop();
+  bool enabled() const { return started; }
+
+  std::atomic<uint64_t> sample_count = 0;
+  std::atomic<uint64_t> lost_count = 0;
+  // 打开失败（线程已退出除外）的事件数，包括环形缓冲区
+  std::atomic<uint64_t> open_failed_count = 0;
+
+private:
+  // 一个线程的环形缓冲区，由该线程上的 dummy 事件持有
+  struct Ring {
+    int fd;
+    void *base;
+    size_t length;
+  };
+  // 等待排序的记录
+  struct Pending {
+    Sample sample;
+    std::vector<uint8_t> stack;
+  };
+  // 内核写入后还未提交的记录可能晚于之后读到的记录，只处理早于该时间的记录
+  static constexpr uint64_t REORDER_WINDOW = 2'000'000;
+
+  std::atomic<bool> started = false;
+  size_t stack_size = 0;
+  int uprobe_type = -1;
+  int retprobe_bit = 0;
+  Handler handler;
+  // 读取线程持有共享锁读取，加入与移除线程时持有独占锁
+  std::shared_mutex rings_mutex;
+  std::map<pid_t, Ring> rings;
+  std::mutex incoming_mutex;
+  std::vector<Pending> incoming; // 读取线程取出、等待处理的记录
+  std::vector<Pending> pending;  // 处理线程中等待排序的记录
+
+  struct Probe {
+    std::string path;
+    uint64_t offset;
+    uint64_t probe;
+    bool with_return;
+    size_t stack_size; // 入口探针采样的栈内存大小
+  };
+  std::mutex events_mutex;
+  std::vector<Probe> registered;
+  // 一个线程的事件：环形缓冲区与各探针的事件
+  struct ThreadEvents {
+    int ring_fd = -1;
+    std::vector<int> fds;
+  };
+  std::map<pid_t, ThreadEvents> events;
+  // 事件 id 到探针的信息，读取线程查找
+  struct Event {
+    uint64_t probe;   // 探针编号
+    bool is_return;   // 是否为返回探针
+    bool with_stack;  // 是否采样栈内存
+  };
+  mutable std::shared_mutex probes_mutex;
+  std::unordered_map<uint64_t, Event> probes;
+
+  std::mutex stop_mutex;
+  std::thread reader;
+  std::thread dispatcher;
+  std::atomic<bool> stopped = false;   // 事件已关闭，读取线程取出剩余记录后退出
+  std::atomic<bool> collected = false; // 读取线程已退出，处理线程处理剩余记录后退出
+
+  int open_event(pid_t tid, const std::string &path, uint64_t offset,
+                 bool is_return, size_t stack_size) const;
+  // 在 tid 上创建环形缓冲区，线程已退出时返回 false 且 errno 为 ESRCH
+  bool open_ring(pid_t tid, Ring &ring) const;
+  // 在 tid 上打开 probe 的所有事件并输出到 ring_fd，调用方需持有 events_mutex
+  bool open_probe(pid_t tid, int ring_fd, const Probe &probe,
+                  std::vector<int> &fds);
+  void read_loop();
+  void dispatch_loop();
+  // 读出所有环形缓冲区中的记录
+  void collect();
+  // 读出一个环形缓冲区中的记录，调用方需持有 rings_mutex
+  void collect_ring(Ring &ring, std::vector<Pending> &items);
+  bool parse(const uint8_t *record, size_t size, Pending &item);
+  // 按时间顺序处理早于 until 的记录
+  void dispatch(uint64_t until);
+};
+
+} // namespace Memory::Profile
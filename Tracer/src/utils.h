@@ -7,10 +7,17 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <climits>
 #include <cstdarg>
+#include <cstdint>
 #include <cstdio>
 #include <ranges>
 
+#include "linux/futex.h"
+#include "sys/syscall.h"
+#include "unistd.h"
 
 namespace Memory::Profile {
 
@@ -28,4 +35,34 @@ auto enumerate(auto &data) {
          });
 }
 
+// 基于 futex 的唤醒通知：等待方在序号未变化时休眠，通知方递增序号后唤醒
+class Doorbell {
+  std::atomic<uint32_t> sequence = 0;
+  std::atomic<uint32_t> waiters = 0;
+
+public:
+  uint32_t value() const { return sequence.load(); }
+
+  // 序号仍为 expected 时休眠，直到被唤醒或超时
+  void wait(uint32_t expected, std::chrono::nanoseconds timeout) {
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    timespec ts = {seconds.count(), (timeout - seconds).count()};
+    waiters.fetch_add(1);
+    if (sequence.load() == expected) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t *>(&sequence),
+              FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0);
+    }
+    waiters.fetch_sub(1);
+  }
+
+  // 通知所有等待方，没有等待方时不进入内核
+  void ring() {
+    sequence.fetch_add(1);
+    if (waiters.load() != 0) {
+      syscall(SYS_futex, reinterpret_cast<uint32_t *>(&sequence),
+              FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+  }
+};
+
 } // namespace Memory::Profile
@@ -43,32 +43,42 @@ inline size_t check(size_t code) {
  * Provides stream compression functionality
  */
 struct cstream {
-  cstream() {
-    cstrm_ = ZSTD_createCStream();
+  cstream(CompressionLevel level = CompressionLevel::DEFAULT, int workers = 0) {
+    cctx_ = ZSTD_createCCtx();
+    check(ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, static_cast<int>(level)));
+    // Fails if libzstd is built without multithreading support, in which
+    // case data is compressed in the calling thread
+    if (workers > 0 &&
+        !ZSTD_isError(ZSTD_CCtx_setParameter(cctx_, ZSTD_c_nbWorkers, workers))) {
+      // Small jobs so that a single frame is still split across workers
+      ZSTD_CCtx_setParameter(cctx_, ZSTD_c_jobSize, 1 << 20);
+    }
   }
 
   ~cstream() {
-    check(ZSTD_freeCStream(cstrm_));
+    check(ZSTD_freeCCtx(cctx_));
   }
 
-  size_t init(CompressionLevel level = CompressionLevel::DEFAULT) {
-    return check(ZSTD_initCStream(cstrm_, static_cast<int>(level)));
+  size_t init() {
+    return check(ZSTD_CCtx_reset(cctx_, ZSTD_reset_session_only));
   }
 
   size_t compress(ZSTD_outBuffer* output, ZSTD_inBuffer* input) {
-    return check(ZSTD_compressStream(cstrm_, output, input));
+    return check(ZSTD_compressStream2(cctx_, output, input, ZSTD_e_continue));
   }
 
   size_t flush(ZSTD_outBuffer* output) {
-    return check(ZSTD_flushStream(cstrm_, output));
+    ZSTD_inBuffer input = {nullptr, 0, 0};
+    return check(ZSTD_compressStream2(cctx_, output, &input, ZSTD_e_flush));
   }
 
   size_t end(ZSTD_outBuffer* output) {
-    return check(ZSTD_endStream(cstrm_, output));
+    ZSTD_inBuffer input = {nullptr, 0, 0};
+    return check(ZSTD_compressStream2(cctx_, output, &input, ZSTD_e_end));
   }
 
 private:
-  ZSTD_CStream* cstrm_;
+  ZSTD_CCtx* cctx_;
 };
 
 /**
@@ -93,11 +103,12 @@ private:
 };
 
 /**
- * stream buffer for compression. Data is written in a single big frame.
+ * stream buffer for compression. Data is written in a single big frame unless
+ * end_frame() is called, which starts a new independent frame.
  */
 class ostreambuf : public std::streambuf {
 public:
-  explicit ostreambuf(std::streambuf* sbuf, CompressionLevel level = CompressionLevel::DEFAULT) : sbuf_(sbuf), clevel_(level), strInit_(false) {
+  explicit ostreambuf(std::streambuf* sbuf, CompressionLevel level = CompressionLevel::DEFAULT, int workers = 0) : sbuf_(sbuf), strm_(level, workers), strInit_(false) {
     inbuf_.resize(ZSTD_CStreamInSize());
     outbuf_.resize(ZSTD_CStreamOutSize());
     inhint_ = inbuf_.size();
@@ -135,11 +146,9 @@ public:
       ret = strm_.end(&output);
       strInit_ = ret > 0;
 
-      if (output.pos > 0) {
-        if (sbuf_->sputn(reinterpret_cast<char*>(output.dst), output.pos) !=
-            ssize_t(output.pos)) {
-          return -1;
-        }
+      if (output.pos > 0 &&
+          !put(reinterpret_cast<char*>(output.dst), output.pos)) {
+        return -1;
       }
     }
 
@@ -148,22 +157,53 @@ public:
     return 0;
   }
 
+  // Finish the current frame, returns the number of bytes written so far
+  uint64_t end_frame() {
+    sync();
+    return written_;
+  }
+
+  // Number of bytes written to the file so far, without flushing
+  uint64_t written() const { return written_; }
+
+  // Write a skippable frame after the current frame
+  bool write_skippable(const std::string& payload) {
+    end_frame();
+    uint32_t header[2] = {ZSTD_MAGIC_SKIPPABLE_START, uint32_t(payload.size())};
+    if (!put(reinterpret_cast<const char*>(header), sizeof(header)) ||
+        !put(payload.data(), payload.size())) {
+      return false;
+    }
+    sbuf_->pubsync();
+    return true;
+  }
+
 private:
+  bool put(const char* data, size_t size) {
+    if (sbuf_->sputn(data, size) != ssize_t(size)) {
+      return false;
+    }
+    written_ += size;
+    return true;
+  }
+
   ssize_t compress(size_t pos) {
+    // Don't start an empty frame (e.g. when syncing after end_frame())
+    if (pos == 0) {
+      return 0;
+    }
     if (!strInit_) {
-      strm_.init(clevel_);
+      strm_.init();
       strInit_ = true;
     }
 
     ZSTD_inBuffer input = {inbuf_.data(), pos, 0};
     while (input.pos != input.size) {
       ZSTD_outBuffer output = {outbuf_.data(), outbuf_.size(), 0};
-      auto ret = strm_.compress(&output, &input);
-      inhint_ = std::min(ret, inbuf_.size());
+      strm_.compress(&output, &input);
 
       if (output.pos > 0 &&
-          sbuf_->sputn(reinterpret_cast<char*>(output.dst), output.pos) !=
-              ssize_t(output.pos)) {
+          !put(reinterpret_cast<char*>(output.dst), output.pos)) {
         return -1;
       }
     }
@@ -172,12 +212,12 @@ private:
   }
 
   std::streambuf* sbuf_;
-  CompressionLevel clevel_;
   cstream strm_;
   std::vector<char> inbuf_;
   std::vector<char> outbuf_;
   size_t inhint_;
   bool strInit_;
+  uint64_t written_ = 0;
 };
 
 /**
@@ -220,10 +260,13 @@ public:
         ZSTD_inBuffer input = {inbuf_.data(), inavail_, inpos_};
         ZSTD_outBuffer output = {outbuf_.data(), outbuf_.size(), 0};
         auto ret = strm_.decompress(&output, &input);
-        inhint_ = std::min(ret, inbuf_.size());
+        // ret == 0 means a frame was completed; the next frame (if any)
+        // starts with a fresh input hint
+        inhint_ = ret == 0 ? inbuf_.size() : std::min(ret, inbuf_.size());
         inpos_ = input.pos;
-        if (output.pos == 0 && inhint_ > 0 && inpos_ >= inavail_) {
-          // Zstd did not decompress anything but requested more data
+        if (output.pos == 0) {
+          // Nothing decompressed yet (frame header, skippable frame or end of
+          // frame), keep feeding input until there is data or end of file
           continue;
         }
         setg(outbuf_.data(), outbuf_.data(), outbuf_.data() + output.pos);
@@ -296,7 +339,7 @@ protected:
  * Output file stream that writes compressed data
  */
 struct ofstream : private fsholder<std::ofstream>, public std::ostream {
-  explicit ofstream(const std::string& path, CompressionLevel level = CompressionLevel::DEFAULT, std::ios_base::openmode mode = std::ios_base::out) : fsholder<std::ofstream>(path, mode | std::ios_base::binary), std::ostream(new ostreambuf(fs_.rdbuf(), level)) {
+  explicit ofstream(const std::string& path, CompressionLevel level = CompressionLevel::DEFAULT, int workers = 0, std::ios_base::openmode mode = std::ios_base::out) : fsholder<std::ofstream>(path, mode | std::ios_base::binary), std::ostream(new ostreambuf(fs_.rdbuf(), level, workers)) {
     exceptions(std::ios_base::badbit);
   }
 
@@ -334,12 +377,37 @@ struct ifstream : private fsholder<std::ifstream>, public std::istream {
   void close() { fs_.close(); }
 };
 
-std::shared_ptr<std::ostream> CreateFile(const std::string &file, CompressionLevel level) {
-  return std::make_shared<ofstream>(file, level);
+std::shared_ptr<std::ostream> CreateFile(const std::string &file, CompressionLevel level, int workers) {
+  return std::make_shared<ofstream>(file, level, workers);
 }
 
 std::shared_ptr<std::istream> OpenFile(const std::string &file) {
   return std::make_shared<ifstream>(file);
 }
 
+uint64_t EndFrame(std::ostream &stream) {
+  auto buf = dynamic_cast<ostreambuf*>(stream.rdbuf());
+  return buf != nullptr ? buf->end_frame() : 0;
+}
+
+uint64_t BytesWritten(std::ostream &stream) {
+  auto buf = dynamic_cast<ostreambuf*>(stream.rdbuf());
+  return buf != nullptr ? buf->written() : 0;
+}
+
+void WriteSkippableFrame(std::ostream &stream, const std::string &payload) {
+  auto buf = dynamic_cast<ostreambuf*>(stream.rdbuf());
+  if (buf == nullptr || !buf->write_skippable(payload)) {
+    stream.setstate(std::ios_base::badbit);
+  }
+}
+
+std::string Compress(const std::string &data, CompressionLevel level) {
+  std::string result(ZSTD_compressBound(data.size()), '\0');
+  auto size = check(ZSTD_compress(result.data(), result.size(), data.data(),
+                                  data.size(), static_cast<int>(level)));
+  result.resize(size);
+  return result;
+}
+
 } // namespace Zip::Stream
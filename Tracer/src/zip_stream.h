@@ -7,15 +7,28 @@ LICENSE file in the root directory of this source tree.
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <string>
 
 namespace Zip::Stream {
 
+// 其余取值直接对应 zstd 的压缩等级
 enum class CompressionLevel : int {
     DEFAULT = 0,
 };
 
-std::shared_ptr<std::ostream> CreateFile(const std::string &file, CompressionLevel level = CompressionLevel::DEFAULT);
+// workers 为 zstd 压缩线程数，0 表示在写入线程中压缩
+std::shared_ptr<std::ostream> CreateFile(const std::string &file, CompressionLevel level = CompressionLevel::DEFAULT, int workers = 0);
 std::shared_ptr<std::istream> OpenFile(const std::string &file);
 
+// 结束当前压缩帧，返回已写入文件的字节数，之后写入的数据位于新的帧中
+uint64_t EndFrame(std::ostream &stream);
+// 已写入文件的字节数（压缩后），不结束当前压缩帧
+uint64_t BytesWritten(std::ostream &stream);
+// 写入 zstd skippable 帧，普通解压时会跳过其中的内容
+void WriteSkippableFrame(std::ostream &stream, const std::string &payload);
+// 将数据压缩为单个 zstd 帧
+std::string Compress(const std::string &data, CompressionLevel level = CompressionLevel::DEFAULT);
+
 } // namespace Zip::Stream
@@ -0,0 +1,384 @@
+// 离线单步（--step-mode displaced）的测试用例（x86-64）
+// 被跟踪函数的入口指令、以及调用点之后的指令（返回断点处）分别为 rip 相对寻址、
+// 相对跳转、条件跳转、相对调用、间接调用以及解码器不支持的指令，
+// 离线执行或模拟出错时结果校验失败或崩溃；同时另一个线程不断向主线程发送
+// SIGUSR1，单步被信号打断时信号不能丢失。
+// 用法：mprofiler --step-mode displaced test_displaced，输出 OK 且退出码为 0
+// （程序以 -rdynamic 链接，替换的 operator new/delete 位于 .dynsym 中）
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+extern "C" {
+// asm 中使用的计数与数据
+long test_new_count = 0;
+long test_array_count = 0;
+long test_delete_count = 0;
+long test_rip_count = 0;
+long test_rip_value = 0;
+long test_rip_copy = 0;
+long test_helper_count = 0;
+long test_cmp_a = 0;
+long test_cmp_b = 0;
+void *test_last_ptr = nullptr;
+alignas(16) unsigned char test_buf[32];
+
+__attribute__((used)) void *test_new_impl(size_t size) {
+  test_new_count++;
+  return malloc(size);
+}
+
+__attribute__((used)) void test_delete_impl(void *ptr) {
+  test_delete_count++;
+  free(ptr);
+}
+
+__attribute__((used)) void test_return_helper() { test_helper_count++; }
+
+void test_delete_thunk(void *ptr);
+void (*test_delete_ptr)(void *) = test_delete_thunk;
+void (*test_helper_ptr)() = test_return_helper;
+
+// 返回处为各种指令的调用点，返回 operator new 的结果
+void *test_site_rip_add(size_t size);
+void *test_site_rip_imm(size_t size);
+void *test_site_rip_rdi(size_t size);
+void *test_site_rip_lea(size_t size);
+void *test_site_call(size_t size);
+void *test_site_call_reg(size_t size);
+void *test_site_call_rip(size_t size);
+void *test_site_jmp(size_t size);
+void *test_site_syscall(size_t size);
+void *test_site_vex(size_t size);
+void *test_site_cmpxchg16b(size_t size);
+}
+
+// 替换全局的 operator new/delete，入口指令各不相同：
+//   new: 相对跳转  new[]: rip 相对寻址  delete: rip 相对的间接调用
+//   sized delete: 相对调用  delete[]: 条件跳转
+// new 返回前按 test_cmp_a 与 test_cmp_b 设置标志位，供返回处的条件跳转使用
+asm(R"(
+  .text
+  .globl _Znwm
+  .type _Znwm, @function
+_Znwm:
+  jmp test_new_body
+test_new_body:
+  sub $8, %rsp
+  call test_new_impl
+  add $8, %rsp
+  mov %rax, test_last_ptr(%rip)
+  mov test_cmp_a(%rip), %rcx
+  cmp test_cmp_b(%rip), %rcx
+  ret
+  .size _Znwm, .-_Znwm
+
+  .globl _Znam
+  .type _Znam, @function
+_Znam:
+  incq test_array_count(%rip)
+  jmp test_new_body
+  .size _Znam, .-_Znam
+
+  .globl _ZdlPv
+  .type _ZdlPv, @function
+_ZdlPv:
+  call *test_delete_ptr(%rip)
+  ret
+  .size _ZdlPv, .-_ZdlPv
+
+  .globl _ZdlPvm
+  .type _ZdlPvm, @function
+_ZdlPvm:
+  call test_delete_thunk
+  ret
+  .size _ZdlPvm, .-_ZdlPvm
+
+  .globl _ZdaPv
+  .type _ZdaPv, @function
+_ZdaPv:
+  jne 1f
+1:
+  jmp test_delete_impl
+  .size _ZdaPv, .-_ZdaPv
+
+  .globl test_delete_thunk
+  .type test_delete_thunk, @function
+test_delete_thunk:
+  call test_delete_impl
+  ret
+  .size test_delete_thunk, .-test_delete_thunk
+
+  .macro SITE name
+  .globl \name
+  .type \name, @function
+\name:
+  push %rbx
+  call _Znwm
+  .endm
+
+  .macro SITE_END name
+  mov test_last_ptr(%rip), %rax
+  pop %rbx
+  ret
+  .size \name, .-\name
+  .endm
+
+  SITE test_site_rip_add
+  addq $1, test_rip_count(%rip)
+  SITE_END test_site_rip_add
+
+  SITE test_site_rip_imm
+  movq $7, test_rip_value(%rip)
+  SITE_END test_site_rip_imm
+
+  SITE test_site_rip_rdi
+  mov test_rip_value(%rip), %rdi
+  mov %rdi, test_rip_copy(%rip)
+  SITE_END test_site_rip_rdi
+
+  SITE test_site_rip_lea
+  lea test_rip_count(%rip), %rbx
+  addq $1, (%rbx)
+  SITE_END test_site_rip_lea
+
+  SITE test_site_call
+  call test_return_helper
+  SITE_END test_site_call
+
+  .globl test_site_call_reg
+  .type test_site_call_reg, @function
+test_site_call_reg:
+  push %rbx
+  lea test_return_helper(%rip), %rbx
+  call _Znwm
+  call *%rbx
+  SITE_END test_site_call_reg
+
+  SITE test_site_call_rip
+  call *test_helper_ptr(%rip)
+  SITE_END test_site_call_rip
+
+  SITE test_site_jmp
+  jmp 1f
+  ud2
+1:
+  SITE_END test_site_jmp
+
+  SITE test_site_syscall
+  syscall
+  SITE_END test_site_syscall
+
+  SITE test_site_vex
+  vmovdqu test_buf(%rip), %xmm0
+  SITE_END test_site_vex
+
+  SITE test_site_cmpxchg16b
+  cmpxchg16b test_buf(%rip)
+  SITE_END test_site_cmpxchg16b
+
+  .macro JCC_SITE cc
+  .globl test_jcc_\cc
+  .type test_jcc_\cc, @function
+test_jcc_\cc:
+  sub $8, %rsp
+  call _Znwm
+  j\cc 1f
+  xor %eax, %eax
+  add $8, %rsp
+  ret
+1:
+  mov $1, %eax
+  add $8, %rsp
+  ret
+  .size test_jcc_\cc, .-test_jcc_\cc
+
+  .globl test_jcc_near_\cc
+  .type test_jcc_near_\cc, @function
+test_jcc_near_\cc:
+  sub $8, %rsp
+  call _Znwm
+  j\cc 2f
+  xor %eax, %eax
+  add $8, %rsp
+  ret
+  .fill 160, 1, 0xcc
+2:
+  mov $1, %eax
+  add $8, %rsp
+  ret
+  .size test_jcc_near_\cc, .-test_jcc_near_\cc
+
+  .globl test_expect_\cc
+  .type test_expect_\cc, @function
+test_expect_\cc:
+  mov test_cmp_a(%rip), %rcx
+  cmp test_cmp_b(%rip), %rcx
+  set\cc %al
+  movzbl %al, %eax
+  ret
+  .size test_expect_\cc, .-test_expect_\cc
+  .endm
+
+  .irp cc, o, no, b, ae, e, ne, be, a, s, ns, p, np, l, ge, le, g
+  JCC_SITE \cc
+  .endr
+)");
+
+#define CONDITIONS(X)                                                          \
+  X(o) X(no) X(b) X(ae) X(e) X(ne) X(be) X(a) X(s) X(ns) X(p) X(np) X(l)       \
+      X(ge) X(le) X(g)
+#define DECLARE_CONDITION(cc)                                                  \
+  long test_jcc_##cc(size_t);                                                  \
+  long test_jcc_near_##cc(size_t);                                             \
+  long test_expect_##cc();
+extern "C" {
+CONDITIONS(DECLARE_CONDITION)
+}
+
+struct Condition {
+  const char *name;
+  long (*jcc)(size_t);
+  long (*jcc_near)(size_t);
+  long (*expect)();
+};
+#define CONDITION_ENTRY(cc)                                                    \
+  {#cc, test_jcc_##cc, test_jcc_near_##cc, test_expect_##cc},
+static const Condition conditions[] = {CONDITIONS(CONDITION_ENTRY)};
+
+static const long values[] = {0, 1, -1, 2, 0x7f, 0x80, LONG_MAX, LONG_MIN};
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+  if (!ok) {
+    printf("FAILED: %s\n", what);
+    failures++;
+  }
+}
+
+// 依次使用不同入口指令的 delete
+static void release(void *ptr) {
+  static int next = 0;
+  switch (next++ % 3) {
+  case 0:
+    operator delete(ptr);
+    break;
+  case 1:
+    operator delete(ptr, 16);
+    break;
+  default:
+    operator delete[](ptr);
+    break;
+  }
+}
+
+static void test_conditions() {
+  for (auto &c : conditions) {
+    for (auto a : values) {
+      for (auto b : values) {
+        test_cmp_a = a;
+        test_cmp_b = b;
+        auto expect = c.expect();
+        char what[64];
+        snprintf(what, sizeof(what), "j%s %ld, %ld", c.name, a, b);
+        check(c.jcc(16) == expect, what);
+        release(test_last_ptr);
+        snprintf(what, sizeof(what), "j%s near %ld, %ld", c.name, a, b);
+        check(c.jcc_near(16) == expect, what);
+        release(test_last_ptr);
+      }
+    }
+  }
+}
+
+static void test_sites(bool avx) {
+  auto rip_count = test_rip_count;
+  release(test_site_rip_add(16));
+  release(test_site_rip_lea(16));
+  check(test_rip_count == rip_count + 2, "rip relative add");
+
+  test_rip_value = 0;
+  release(test_site_rip_imm(16));
+  check(test_rip_value == 7, "rip relative immediate");
+  test_rip_value = 42;
+  release(test_site_rip_rdi(16));
+  check(test_rip_copy == 42, "rip relative load into rdi");
+
+  auto helper_count = test_helper_count;
+  release(test_site_call(16));
+  release(test_site_call_reg(16));
+  release(test_site_call_rip(16));
+  check(test_helper_count == helper_count + 3, "call at return site");
+
+  release(test_site_jmp(16));
+  release(test_site_syscall(16));
+  if (avx) {
+    release(test_site_vex(16));
+  }
+  release(test_site_cmpxchg16b(16));
+
+  auto array_count = test_array_count;
+  auto p = static_cast<char *>(operator new[](32));
+  p[0] = p[31] = 1;
+  release(p);
+  check(test_array_count == array_count + 1, "rip relative entry");
+}
+
+// 信号测试：等待主线程处理完上一个 SIGUSR1 后再发送下一个
+static constexpr int SIGNALS = 200;
+static std::atomic<int> signal_count = 0;
+static std::atomic<bool> sending = true;
+static int lost_signals = 0;
+
+static void on_signal(int) { signal_count++; }
+
+static void *send_signals(void *arg) {
+  auto target = *static_cast<pthread_t *>(arg);
+  for (int i = 0; i < SIGNALS; i++) {
+    pthread_kill(target, SIGUSR1);
+    int wait = 0;
+    while (signal_count <= i && wait++ < 2000) {
+      usleep(1000);
+    }
+    if (signal_count <= i) {
+      lost_signals++;
+      signal_count = i + 1;
+    }
+  }
+  sending = false;
+  return nullptr;
+}
+
+int main() {
+  struct sigaction action = {};
+  action.sa_handler = on_signal;
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR1, &action, nullptr);
+
+  bool avx = __builtin_cpu_supports("avx");
+  auto self = pthread_self();
+  pthread_t sender;
+  pthread_create(&sender, nullptr, send_signals, &self);
+
+  int rounds = 0;
+  do {
+    test_conditions();
+    test_sites(avx);
+    rounds++;
+  } while (sending && failures == 0);
+  pthread_join(sender, nullptr);
+
+  long allocs = test_new_count;
+  check(test_delete_count == allocs, "every new is deleted");
+  check(lost_signals == 0, "signals delivered");
+  printf("rounds: %d, new: %ld, delete: %ld, signals: %d, lost: %d\n", rounds,
+         allocs, test_delete_count, signal_count.load(), lost_signals);
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}